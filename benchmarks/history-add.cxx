@@ -0,0 +1,84 @@
+/*
+ * Compares speed of adding lines to a full history one by one
+ * and as a single batch, for growing numbers of lines,
+ * and of adding lines one by one with history snapshots published after each line.
+ *
+ * History size limit is half the number of added lines
+ * and every fourth line repeats an earlier one,
+ * so both trimming and deduplication are exercised.
+ *
+ * Usage: replxx-benchmark-history-add [max-lines] [rounds]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "replxx.hxx"
+
+using namespace replxx;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+std::vector<std::string> generate( int lines_ ) {
+	std::vector<std::string> lines;
+	lines.reserve( static_cast<size_t>( lines_ ) );
+	for ( int i( 0 ); i < lines_; ++ i ) {
+		int n( ( i % 4 ) == 3 ? i / 2 : i );
+		lines.push_back( "some_command --option=" + std::to_string( n ) + " --path=/usr/local/share/replxx/" + std::to_string( n * 31 % 1009 ) );
+	}
+	return ( lines );
+}
+
+template<typename adder_t>
+double measure( std::vector<std::string> const& lines_, bool unique_, int rounds_, adder_t adder_ ) {
+	double best( 0 );
+	for ( int r( 0 ); r < rounds_; ++ r ) {
+		Replxx rx;
+		rx.set_unique_history( unique_ );
+		rx.set_max_history_size( static_cast<int>( lines_.size() / 2 ) );
+		clock_type::time_point start( clock_type::now() );
+		adder_( rx, lines_ );
+		double elapsed( std::chrono::duration<double, std::milli>( clock_type::now() - start ).count() );
+		if ( ( r == 0 ) || ( elapsed < best ) ) {
+			best = elapsed;
+		}
+	}
+	return ( best );
+}
+
+}
+
+int main( int argc_, char** argv_ ) {
+	int maxLines( argc_ > 1 ? atoi( argv_[1] ) : 400000 );
+	int rounds( argc_ > 2 ? atoi( argv_[2] ) : 3 );
+	std::cout << std::setw( 10 ) << "lines" << std::setw( 8 ) << "unique" << std::setw( 14 ) << "one-by-one" << std::setw( 14 ) << "batch" << std::setw( 14 ) << "snapshots" << std::endl;
+	for ( int lines( 25000 ); lines <= maxLines; lines *= 2 ) {
+		std::vector<std::string> input( generate( lines ) );
+		for ( bool unique : { false, true } ) {
+			double single( measure( input, unique, rounds, []( Replxx& rx_, std::vector<std::string> const& lines_ ) {
+				for ( std::string const& line : lines_ ) {
+					rx_.history_add( line );
+				}
+			} ) );
+			double batch( measure( input, unique, rounds, []( Replxx& rx_, std::vector<std::string> const& lines_ ) {
+				rx_.history_add_batch( lines_ );
+			} ) );
+			double snapshots( measure( input, unique, rounds, []( Replxx& rx_, std::vector<std::string> const& lines_ ) {
+				rx_.set_history_snapshots( true );
+				for ( std::string const& line : lines_ ) {
+					rx_.history_add( line );
+				}
+			} ) );
+			std::cout << std::setw( 10 ) << lines << std::setw( 8 ) << ( unique ? "yes" : "no" )
+				<< std::fixed << std::setprecision( 2 ) << std::setw( 11 ) << single << " ms" << std::setw( 11 ) << batch << " ms"
+				<< std::setw( 11 ) << snapshots << " ms" << std::endl;
+		}
+	}
+	return ( 0 );
+}
@@ -0,0 +1,66 @@
+/*
+ * Compares history loading speed of file name based loader
+ * (memory mapped file) and std::istream based loader.
+ *
+ * Usage: replxx-benchmark-history-load [entries] [rounds]
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "replxx.hxx"
+
+using namespace replxx;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+std::string const HISTORY_PATH( "replxx-benchmark-history.txt" );
+
+void generate( int entries_ ) {
+	std::ofstream out( HISTORY_PATH );
+	char timestamp[32];
+	for ( int i( 0 ); i < entries_; ++ i ) {
+		snprintf( timestamp, sizeof ( timestamp ), "2021-%02d-%02d %02d:%02d:%02d.%03d", 1 + i / 2678400 % 12, 1 + i / 86400 % 28, i / 3600 % 24, i / 60 % 60, i % 60, i % 1000 );
+		out << "### " << timestamp << "\n"
+			<< "some_command --option=" << i << " --path=/usr/local/share/replxx/" << ( i * 7919 % 100003 ) << " | grep żółw\n";
+	}
+}
+
+template<typename loader_t>
+double measure( char const* name_, int rounds_, loader_t loader_ ) {
+	double best( 0 );
+	int size( 0 );
+	for ( int r( 0 ); r < rounds_; ++ r ) {
+		Replxx rx;
+		rx.set_max_history_size( 1 << 30 );
+		clock_type::time_point start( clock_type::now() );
+		loader_( rx );
+		double elapsed( std::chrono::duration<double, std::milli>( clock_type::now() - start ).count() );
+		if ( ( r == 0 ) || ( elapsed < best ) ) {
+			best = elapsed;
+		}
+		size = rx.history_size();
+	}
+	std::cout << std::setw( 10 ) << name_ << ": " << std::fixed << std::setprecision( 2 ) << best << " ms (" << size << " entries)" << std::endl;
+	return ( best );
+}
+
+}
+
+int main( int argc_, char** argv_ ) {
+	int entries( argc_ > 1 ? atoi( argv_[1] ) : 200000 );
+	int rounds( argc_ > 2 ? atoi( argv_[2] ) : 5 );
+	generate( entries );
+	double stream( measure( "istream", rounds, []( Replxx& rx_ ) { std::ifstream in( HISTORY_PATH ); rx_.history_load( in ); } ) );
+	double mapped( measure( "mmap", rounds, []( Replxx& rx_ ) { rx_.history_load( HISTORY_PATH ); } ) );
+	std::cout << "speedup: " << std::setprecision( 2 ) << ( stream / mapped ) << "x" << std::endl;
+	std::remove( HISTORY_PATH.c_str() );
+	return ( 0 );
+}
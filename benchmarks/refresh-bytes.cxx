@@ -0,0 +1,170 @@
+/*
+ * Compares number of bytes sent to the terminal per key press
+ * by full redraw of the input and by differential rendering
+ * (see Replxx::set_differential_rendering()).
+ *
+ * REPL runs in a child process attached to a pseudo terminal,
+ * the benchmark types keys into it one at a time, waits until
+ * output settles after each key and counts bytes of the output.
+ * Edited input has given number of lines, each wrapped over two screen rows,
+ * and the highlighter colors every other word.
+ *
+ * Usage: replxx-benchmark-refresh-bytes [lines] [columns]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include "replxx.hxx"
+
+using namespace replxx;
+
+namespace {
+
+int const KEY_COUNT( 40 );
+int const SETTLE_MS( 20 );
+
+int repl( bool differential_ ) {
+	Replxx rx;
+	rx.set_differential_rendering( differential_ );
+	rx.set_highlighter_callback( []( std::string const& input_, Replxx::colors_t& colors_ ) {
+		int word( 0 );
+		bool inWord( false );
+		for ( size_t i( 0 ); i < input_.length(); ++ i ) {
+			bool letter( isalnum( static_cast<unsigned char>( input_[i] ) ) != 0 );
+			if ( letter && ! inWord ) {
+				++ word;
+			}
+			inWord = letter;
+			if ( letter && ( ( word % 2 ) == 0 ) ) {
+				colors_[i] = Replxx::Color::BRIGHTBLUE;
+			}
+		}
+	} );
+	rx.input( "> " );
+	return ( 0 );
+}
+
+class Session {
+	int _master;
+	pid_t _child;
+public:
+	Session( char const* self_, bool differential_, int columns_ )
+		: _master( posix_openpt( O_RDWR | O_NOCTTY ) )
+		, _child( -1 ) {
+		if ( ( _master < 0 ) || ( grantpt( _master ) != 0 ) || ( unlockpt( _master ) != 0 ) ) {
+			throw std::runtime_error( "cannot open pseudo terminal" );
+		}
+		struct winsize ws;
+		memset( &ws, 0, sizeof ( ws ) );
+		ws.ws_col = static_cast<unsigned short>( columns_ );
+		ws.ws_row = 200;
+		ioctl( _master, TIOCSWINSZ, &ws );
+		std::string slave( ptsname( _master ) );
+		_child = fork();
+		if ( _child == 0 ) {
+			setsid();
+			int fd( open( slave.c_str(), O_RDWR ) );
+			dup2( fd, 0 );
+			dup2( fd, 1 );
+			close( fd );
+			close( _master );
+			setenv( "TERM", "xterm", 1 );
+			execl( self_, self_, "--repl", differential_ ? "1" : "0", static_cast<char*>( nullptr ) );
+			_exit( 1 );
+		}
+		settle( 200 );
+	}
+	~Session( void ) {
+		kill( _child, SIGKILL );
+		waitpid( _child, nullptr, 0 );
+		close( _master );
+	}
+	/* returns number of bytes written by REPL in response */
+	int type( std::string const& keys_, int settleMs_ = SETTLE_MS ) {
+		if ( write( _master, keys_.data(), keys_.length() ) != static_cast<ssize_t>( keys_.length() ) ) {
+			throw std::runtime_error( "write failed" );
+		}
+		return ( settle( settleMs_ ) );
+	}
+private:
+	int settle( int ms_ ) {
+		int bytes( 0 );
+		char buf[4096];
+		pollfd pfd{ _master, POLLIN, 0 };
+		while ( poll( &pfd, 1, ms_ ) > 0 ) {
+			ssize_t n( read( _master, buf, sizeof ( buf ) ) );
+			if ( n <= 0 ) {
+				break;
+			}
+			bytes += static_cast<int>( n );
+		}
+		return ( bytes );
+	}
+};
+
+struct Scenario {
+	char const* name;
+	std::string setup;
+	std::string key;
+};
+
+double measure( char const* self_, bool differential_, int lines_, int columns_, Scenario const& scenario_ ) {
+	Session session( self_, differential_, columns_ );
+	std::string line;
+	while ( static_cast<int>( line.length() ) < columns_ * 3 / 2 ) {
+		line.append( "word" ).append( std::to_string( line.length() ) ).append( " " );
+	}
+	std::string input;
+	for ( int i( 0 ); i < lines_; ++ i ) {
+		input.append( i > 0 ? "\n" : "" ).append( line );
+	}
+	session.type( input, 200 );
+	session.type( scenario_.setup, 200 );
+	long bytes( 0 );
+	for ( int i( 0 ); i < KEY_COUNT; ++ i ) {
+		bytes += session.type( scenario_.key );
+	}
+	return ( static_cast<double>( bytes ) / KEY_COUNT );
+}
+
+}
+
+int main( int argc_, char** argv_ ) {
+	if ( ( argc_ > 2 ) && ( strcmp( argv_[1], "--repl" ) == 0 ) ) {
+		return ( repl( argv_[2][0] == '1' ) );
+	}
+	int lines( argc_ > 1 ? atoi( argv_[1] ) : 20 );
+	int columns( argc_ > 2 ? atoi( argv_[2] ) : 80 );
+	std::string up;
+	for ( int i( 0 ); i < lines / 2; ++ i ) {
+		up.append( "\033[A" );
+	}
+	std::vector<Scenario> scenarios( {
+		{ "append", "", "x" },
+		{ "insert", up, "x" },
+		{ "backspace", up, "\x7f" },
+		{ "move", up, "\033[D" }
+	} );
+	std::cout << lines << " lines, " << columns << " columns, bytes per key press" << std::endl;
+	std::cout << std::setw( 12 ) << "scenario" << std::setw( 14 ) << "full" << std::setw( 14 ) << "differential" << std::endl;
+	for ( Scenario const& scenario : scenarios ) {
+		double full( measure( argv_[0], false, lines, columns, scenario ) );
+		double differential( measure( argv_[0], true, lines, columns, scenario ) );
+		std::cout << std::setw( 12 ) << scenario.name
+			<< std::fixed << std::setprecision( 1 ) << std::setw( 14 ) << full << std::setw( 14 ) << differential << std::endl;
+	}
+	return ( 0 );
+}
@@ -0,0 +1,161 @@
+/*
+ * Compares speed of character width lookup in the two level table
+ * (mk_wcwidth()) with binary search over sorted intervals
+ * of zero width and wide characters, the way widths used to be looked up.
+ *
+ * Intervals are derived from the table, so both methods give the same widths,
+ * which is verified for every code point before measuring.
+ * Each text is measured in a number of rounds and the best one is reported.
+ *
+ * Usage: replxx-benchmark-wcwidth [characters] [rounds]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace replxx {
+
+int mk_wcwidth( char32_t );
+
+}
+
+using namespace replxx;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+char32_t const MAX_CODE_POINT( 0x110000 );
+
+struct Interval {
+	char32_t first;
+	char32_t last;
+};
+
+typedef std::vector<Interval> intervals_t;
+
+intervals_t collect( int width_ ) {
+	intervals_t intervals;
+	for ( char32_t c( 1 ); c < MAX_CODE_POINT; ++ c ) {
+		if ( mk_wcwidth( c ) != width_ ) {
+			continue;
+		}
+		if ( ! intervals.empty() && ( intervals.back().last == c - 1 ) ) {
+			intervals.back().last = c;
+		} else {
+			intervals.push_back( Interval{ c, c } );
+		}
+	}
+	return ( intervals );
+}
+
+bool bisearch( char32_t ucs_, intervals_t const& table_ ) {
+	int min( 0 );
+	int max( static_cast<int>( table_.size() ) - 1 );
+	if ( ( ucs_ < table_[0].first ) || ( ucs_ > table_[static_cast<size_t>( max )].last ) ) {
+		return ( false );
+	}
+	while ( max >= min ) {
+		int mid( ( min + max ) / 2 );
+		if ( ucs_ > table_[static_cast<size_t>( mid )].last ) {
+			min = mid + 1;
+		} else if ( ucs_ < table_[static_cast<size_t>( mid )].first ) {
+			max = mid - 1;
+		} else {
+			return ( true );
+		}
+	}
+	return ( false );
+}
+
+class IntervalWidth {
+	intervals_t _combining;
+	intervals_t _wide;
+public:
+	IntervalWidth( void )
+		: _combining( collect( 0 ) )
+		, _wide( collect( 2 ) ) {
+	}
+	int operator()( char32_t ucs_ ) const {
+		if ( ucs_ == 0 ) {
+			return ( 0 );
+		}
+		if ( ( ucs_ < 32 ) || ( ( ucs_ >= 0x7f ) && ( ucs_ < 0xa0 ) ) ) {
+			return ( -1 );
+		}
+		if ( bisearch( ucs_, _combining ) ) {
+			return ( 0 );
+		}
+		return ( bisearch( ucs_, _wide ) ? 2 : 1 );
+	}
+};
+
+std::u32string generate( std::u32string const& alphabet_, int size_ ) {
+	std::u32string text;
+	text.reserve( static_cast<size_t>( size_ ) );
+	for ( int i( 0 ); i < size_; ++ i ) {
+		text.push_back( alphabet_[static_cast<size_t>( i * 7919 ) % alphabet_.length()] );
+	}
+	return ( text );
+}
+
+template<typename width_t>
+double measure( std::u32string const& text_, int rounds_, width_t const& width_, long& columns_ ) {
+	double best( 0 );
+	for ( int r( 0 ); r < rounds_; ++ r ) {
+		columns_ = 0;
+		clock_type::time_point start( clock_type::now() );
+		for ( char32_t c : text_ ) {
+			columns_ += width_( c );
+		}
+		double elapsed( std::chrono::duration<double, std::nano>( clock_type::now() - start ).count() / static_cast<double>( text_.length() ) );
+		if ( ( r == 0 ) || ( elapsed < best ) ) {
+			best = elapsed;
+		}
+	}
+	return ( best );
+}
+
+}
+
+int main( int argc_, char** argv_ ) {
+	int size( argc_ > 1 ? atoi( argv_[1] ) : 1000000 );
+	int rounds( argc_ > 2 ? atoi( argv_[2] ) : 5 );
+	IntervalWidth intervalWidth;
+	for ( char32_t c( 0 ); c < MAX_CODE_POINT; ++ c ) {
+		if ( intervalWidth( c ) != mk_wcwidth( c ) ) {
+			std::cerr << "width mismatch for U+" << std::hex << static_cast<int unsigned>( c ) << std::endl;
+			return ( 1 );
+		}
+	}
+	struct Text {
+		char const* name;
+		std::u32string alphabet;
+	} const texts[] = {
+		{ "ascii", U"The quick brown fox jumps over the lazy dog 0123456789 (){}[];" },
+		{ "latin", U"Zażółć gęślą jaźń, Größe, café, naïve, Ελληνικά, русский" },
+		{ "cjk", U"中文字符测试日本語のテキスト한국어텍스트漢字かなカナ、。「」" },
+		{ "emoji", U"😀😃😄😁😆😅🤣😂🙂🙃😉😊😇🥰😍🤩😘👍👎👋🎉🔥🚀🌍🍕⚽🐱🐶" },
+		{ "mixed", U"ls -la 📁 文件 ✅ done, naïve → 结果 🎉 ok" }
+	};
+	std::cout << "ns per character, best of " << rounds << " rounds over " << size << " characters" << std::endl;
+	std::cout << std::setw( 8 ) << "text" << std::setw( 12 ) << "bisearch" << std::setw( 12 ) << "table" << std::endl;
+	for ( Text const& text : texts ) {
+		std::u32string input( generate( text.alphabet, size ) );
+		long intervalColumns( 0 );
+		long tableColumns( 0 );
+		double interval( measure( input, rounds, intervalWidth, intervalColumns ) );
+		double table( measure( input, rounds, mk_wcwidth, tableColumns ) );
+		if ( intervalColumns != tableColumns ) {
+			std::cerr << "column count mismatch for " << text.name << std::endl;
+			return ( 1 );
+		}
+		std::cout << std::setw( 8 ) << text.name
+			<< std::fixed << std::setprecision( 2 ) << std::setw( 12 ) << interval << std::setw( 12 ) << table << std::endl;
+	}
+	return ( 0 );
+}
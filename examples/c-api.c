@@ -144,6 +144,7 @@ int main( int argc, char** argv ) {
 	int installHighlighterCallback = 1;
 	int installHintsCallback = 1;
 	int indentMultiline = 0;
+	int sharedHistory = 0;
 	while ( argc > 1 ) {
 		-- argc;
 		++ argv;
@@ -160,14 +161,20 @@ int main( int argc, char** argv ) {
 			case 'd': replxx_set_double_tab_completion( replxx, (*argv)[1] - '0' );        break;
 			case 'h': replxx_set_max_hint_rows( replxx, atoi( (*argv) + 1 ) );             break;
 			case 'H': replxx_set_hint_delay( replxx, atoi( (*argv) + 1 ) );                break;
+			case 'r': replxx_set_history_hints( replxx, (*argv)[1] - '0' );                break;
 			case 's': replxx_set_max_history_size( replxx, atoi( (*argv) + 1 ) );          break;
 			case 'P': replxx_set_preload_buffer( replxx, recode( (*argv) + 1 ) );          break;
 			case 'I': replxx_set_immediate_completion( replxx, (*argv)[1] - '0' );         break;
 			case 'u': replxx_set_unique_history( replxx, (*argv)[1] - '0' );               break;
+			case 'j': replxx_set_history_journal( replxx, atoi( (*argv) + 1 ) );           break;
+			case 'f': replxx_set_history_binary_format( replxx, (*argv)[1] - '0' );        break;
+			case 'a': replxx_set_history_async( replxx, (*argv)[1] - '0' );                break;
+			case 'l': sharedHistory = (*argv)[1] - '0';                                    break;
 			case 'w': replxx_set_word_break_characters( replxx, (*argv) + 1 );             break;
 			case 'm': replxx_set_no_color( replxx, (*argv)[1] - '0' );                     break;
 			case 'i': replxx_set_ignore_case( replxx, (*argv)[1] - '0' );                  break;
 			case 'n': indentMultiline = (*argv)[1] - '0';                                  break;
+			case 'D': replxx_set_differential_rendering( replxx, (*argv)[1] - '0' );       break;
 			case 'B': replxx_enable_bracketed_paste( replxx );                             break;
 			case 'p': prompt = recode( (*argv) + 1 );                                      break;
 			case 'q': quiet = atoi( (*argv) + 1 );                                         break;
@@ -184,6 +191,7 @@ int main( int argc, char** argv ) {
 	const char* file = "./replxx_history.txt";
 
 	replxx_history_load( replxx, file );
+	replxx_set_history_shared( replxx, sharedHistory );
 	if ( installModifyCallback ) {
 		replxx_set_modify_callback( replxx, modify_callback, 0 );
 	}
@@ -220,6 +228,59 @@ int main( int argc, char** argv ) {
 				replxx_print( replxx, "%4d: %s\n", index, he.text );
 			}
 			replxx_history_scan_stop( replxx, hs );
+		} else if (!strncmp(result, "/lengths", 9)) {
+			/* Display byte lengths of timestamp and text of each history entry. */
+			ReplxxHistoryScan* hs = replxx_history_scan_start( replxx );
+			ReplxxHistoryEntry he;
+			ReplxxHistoryEntryView hv;
+			while ( replxx_history_scan_next( replxx, hs, &he ) == 0 ) {
+				replxx_history_scan_view( replxx, hs, &hv );
+				replxx_print( replxx, "%d %d: %.*s\n", hv.timestampLength, hv.textLength, hv.textLength, hv.text );
+			}
+			replxx_history_scan_stop( replxx, hs );
+		} else if (!strncmp(result, "/failed", 8)) {
+			/* Display failed commands along with their exit status. */
+			ReplxxHistoryFilter hf = { REPLXX_HISTORY_FILTER_FAILED, 0, 0, NULL, 0 };
+			ReplxxHistoryScan* hs = replxx_history_filter_start( replxx, &hf );
+			ReplxxHistoryEntry he;
+			ReplxxHistoryMetadata hm;
+			while ( replxx_history_scan_next( replxx, hs, &he ) == 0 ) {
+				replxx_history_scan_metadata( replxx, hs, &hm );
+				replxx_print( replxx, "%4d: %s\n", hm.exitStatus, he.text );
+			}
+			replxx_history_scan_stop( replxx, hs );
+		} else if (!strncmp(result, "/range", 6)) {
+			/* Display history entries added between two dates, `-` leaves the range open. */
+			char from[32] = "-";
+			char to[32] = "-";
+			sscanf( result + 6, "%31s %31s", from, to );
+			ReplxxHistoryScan* hs = replxx_history_range_start( replxx, strcmp( from, "-" ) ? from : NULL, strcmp( to, "-" ) ? to : NULL );
+			ReplxxHistoryEntry he;
+			while ( replxx_history_scan_next( replxx, hs, &he ) == 0 ) {
+				replxx_print( replxx, "%s %s\n", he.timestamp, he.text );
+			}
+			replxx_history_scan_stop( replxx, hs );
+		} else if (!strncmp(result, "/batch ", 7)) {
+			/* Import `;` separated groups of words, each group as one batch, saving history after each. */
+			char buf[256];
+			char const* lines[32];
+			char* group = buf;
+			strncpy( buf, result + 7, sizeof ( buf ) - 1 );
+			buf[sizeof ( buf ) - 1] = 0;
+			while ( group ) {
+				char* end = strchr( group, ';' );
+				char* word = NULL;
+				int count = 0;
+				if ( end ) {
+					*end++ = 0;
+				}
+				for ( word = strtok( group, " " ); word && ( count < 32 ); word = strtok( NULL, " " ) ) {
+					lines[count++] = word;
+				}
+				replxx_history_add_batch( replxx, lines, count );
+				replxx_history_save( replxx, file );
+				group = end;
+			}
 		} else if (!strncmp(result, "/unique", 8)) {
 			replxx_set_unique_history( replxx, 1 );
 		} else if (!strncmp(result, "/eb", 4)) {
@@ -229,7 +290,16 @@ int main( int argc, char** argv ) {
 		}
 		if (*result != '\0') {
 			replxx_print( replxx, quiet ? "%s\n" : "thanks for the input: %s\n", result );
-			replxx_history_add( replxx, result );
+			if ( ! strncmp( result, "false", 5 ) ) {
+				/* Like in a shell, `false` fails. */
+				ReplxxHistoryMetadata hm = { REPLXX_HISTORY_METADATA_EXIT_STATUS, 1, 0, NULL };
+				replxx_history_add_with_metadata( replxx, result, &hm );
+			} else {
+				replxx_history_add( replxx, result );
+			}
+			if ( sharedHistory ) {
+				replxx_history_save( replxx, file );
+			}
 		}
 	}
 	replxx_history_save( replxx, file );
@@ -11,6 +11,7 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <atomic>
 
 #include "replxx.hxx"
 #include "util.h"
@@ -76,6 +77,64 @@ public:
 	}
 };
 
+/*
+ * Scans published history snapshots on a thread of its own
+ * for as long as it is alive (also while input() runs),
+ * one more scan is done after it is stopped.
+ */
+class HistoryWatch {
+	std::thread _thread;
+	std::atomic<bool> _alive;
+	bool _consistent;
+	std::vector<std::string> _entries;
+	Replxx& _replxx;
+public:
+	HistoryWatch( Replxx& replxx_ )
+		: _thread()
+		, _alive( false )
+		, _consistent( true )
+		, _entries()
+		, _replxx( replxx_ ) {
+	}
+	bool alive( void ) const {
+		return ( _alive );
+	}
+	void start() {
+		_replxx.set_history_snapshots( true );
+		_alive = true;
+		_thread = std::thread( &HistoryWatch::run, this );
+	}
+	void stop() {
+		_alive = false;
+		_thread.join();
+		std::cout << "snapshots " << ( _consistent ? "consistent" : "inconsistent" ) << "\n";
+		for ( size_t i( 0 ); i < _entries.size(); ++ i ) {
+			std::cout << std::setw(4) << i << ": " << _entries[i] << "\n";
+		}
+	}
+	void run() {
+		bool alive( true );
+		while ( alive ) {
+			alive = _alive;
+			size_t seen( _entries.size() );
+			_entries.clear();
+			std::string timestamp;
+			Replxx::HistoryScan hs( _replxx.history_scan() );
+			while ( hs.next() ) {
+				Replxx::HistoryEntryView entry( hs.view() );
+				if ( timestamp.compare( 0, std::string::npos, entry.timestamp(), static_cast<size_t>( entry.timestamp_length() ) ) > 0 ) {
+					_consistent = false;
+				}
+				timestamp.assign( entry.timestamp(), static_cast<size_t>( entry.timestamp_length() ) );
+				_entries.emplace_back( entry.text(), static_cast<size_t>( entry.text_length() ) );
+			}
+			if ( _entries.size() < seen ) {
+				_consistent = false;
+			}
+		}
+	}
+};
+
 // prototypes
 Replxx::completions_t hook_completion(std::string const& context, int& contextLen, std::vector<std::string> const& user_data, bool);
 Replxx::hints_t hook_hint(std::string const& context, int& contextLen, Replxx::Color& color, std::vector<std::string> const& user_data, bool);
@@ -399,6 +458,7 @@ int main( int argc_, char** argv_ ) {
 	// init the repl
 	Replxx rx;
 	Tick tick( rx, keys, tickMessages, promptFan );
+	HistoryWatch historyWatch( rx );
 	rx.install_window_change_handler();
 
 	// the path to the history file
@@ -474,6 +534,8 @@ int main( int argc_, char** argv_ ) {
 	rx.bind_key_internal( Replxx::KEY::meta( Replxx::KEY::BACKSPACE ), "kill_to_whitespace_on_left" );
 	rx.bind_key_internal( Replxx::KEY::meta( 'p' ),                    "history_common_prefix_search" );
 	rx.bind_key_internal( Replxx::KEY::meta( 'n' ),                    "history_common_prefix_search" );
+	rx.bind_key_internal( Replxx::KEY::meta( 's' ),                    "history_fuzzy_search" );
+	rx.bind_key_internal( Replxx::KEY::meta( 'x' ),                    "history_regex_search" );
 	rx.bind_key_internal( Replxx::KEY::meta( 'd' ),                    "kill_to_end_of_word" );
 	rx.bind_key_internal( Replxx::KEY::meta( 'y' ),                    "yank_cycle" );
 	rx.bind_key_internal( Replxx::KEY::meta( 'u' ),                    "uppercase_word" );
@@ -581,6 +643,7 @@ int main( int argc_, char** argv_ ) {
 				<< ".exit\n\texit the repl\n"
 				<< ".clear\n\tclears the screen\n"
 				<< ".history\n\tdisplays the history output\n"
+				<< ".snapshot\n\tstart/stop scanning history snapshots on another thread\n"
 				<< ".prompt <str>\n\tset the repl prompt to <str>\n";
 
 			rx.history_add(input);
@@ -602,7 +665,18 @@ int main( int argc_, char** argv_ ) {
 			// display the current history
 			Replxx::HistoryScan hs( rx.history_scan() );
 			for ( int i( 0 ); hs.next(); ++ i ) {
-				std::cout << std::setw(4) << i << ": " << hs.get().text() << "\n";
+				std::cout << std::setw(4) << i << ": " << hs.view().text() << "\n";
+			}
+
+			rx.history_add(input);
+			continue;
+
+		} else if (input.compare(0, 9, ".snapshot") == 0) {
+			// toggle scanning of history snapshots on another thread
+			if ( historyWatch.alive() ) {
+				historyWatch.stop();
+			} else {
+				historyWatch.start();
 			}
 
 			rx.history_add(input);
@@ -640,6 +714,9 @@ int main( int argc_, char** argv_ ) {
 	if ( ! keys.empty() || tickMessages || promptFan ) {
 		tick.stop();
 	}
+	if ( historyWatch.alive() ) {
+		historyWatch.stop();
+	}
 
 	// save the history
 	rx.history_sync( history_file_path );
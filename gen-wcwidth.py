@@ -0,0 +1,160 @@
+#! /usr/bin/env python3
+#
+# Generates src/wcwidthtable.hxx, the character width table used by mk_wcwidth().
+#
+# Usage: ./gen-wcwidth.py [UCD-directory]
+#
+# UCD-directory has to contain UnicodeData.txt and EastAsianWidth.txt
+# from https://www.unicode.org/Public/UCD/latest/ucd/,
+# without it the Unicode database bundled with Python is used.
+#
+# Widths follow the rules of Markus Kuhn's wcwidth() (see src/wcwidth.cpp):
+#  - U+0000 is 0 columns wide, other C0/C1 controls and DEL are -1,
+#  - non-spacing (Mn), enclosing (Me) and format (Cf) characters other than
+#    U+00AD, Hangul Jamo medial vowels and final consonants (U+1160-U+11FF)
+#    and U+200B are 0 columns wide,
+#  - East Asian Wide (W) and Full-width (F) characters are 2 columns wide,
+#  - everything else is 1 column wide.
+#
+# Table has two levels, upper bits of a code point select a page
+# and each page packs widths of PAGE_SIZE code points, 2 bits each.
+
+import os
+import sys
+
+MAX_CODE_POINT = 0x110000
+PAGE_BITS = 8
+PAGE_SIZE = 1 << PAGE_BITS
+OUTPUT = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), "src", "wcwidthtable.hxx" )
+
+# unassigned code points in these blocks default to East Asian Wide
+DEFAULT_WIDE = [
+	( 0x3400, 0x4dbf ), ( 0x4e00, 0x9fff ), ( 0xf900, 0xfaff ), ( 0x20000, 0x2fffd ), ( 0x30000, 0x3fffd )
+]
+
+# encoding of widths in the table
+CODE = { 0: 0, 1: 1, 2: 2, -1: 3 }
+
+def parse_ranges( path_ ):
+	with open( path_, encoding = "utf-8" ) as f:
+		for line in f:
+			line = line.split( "#" )[0].strip()
+			if not line:
+				continue
+			fields = [ field.strip() for field in line.split( ";" ) ]
+			first, _, last = fields[0].partition( ".." )
+			yield int( first, 16 ), int( last or first, 16 ), fields
+
+def load_ucd( dir_ ):
+	categories = {}
+	rangeStart = None
+	for first, last, fields in parse_ranges( os.path.join( dir_, "UnicodeData.txt" ) ):
+		if fields[1].endswith( ", First>" ):
+			rangeStart = first
+			continue
+		if fields[1].endswith( ", Last>" ):
+			first, rangeStart = rangeStart, None
+		for cp in range( first, last + 1 ):
+			categories[cp] = fields[2]
+	eastAsianWidths = {}
+	for first, last, fields in parse_ranges( os.path.join( dir_, "EastAsianWidth.txt" ) ):
+		for cp in range( first, last + 1 ):
+			eastAsianWidths[cp] = fields[1]
+	# first line of the file is "# EastAsianWidth-<version>.txt"
+	with open( os.path.join( dir_, "EastAsianWidth.txt" ), encoding = "utf-8" ) as f:
+		version = f.readline().strip( "# \n" )[len( "EastAsianWidth-" ):-len( ".txt" )]
+	return (
+		lambda cp: categories.get( cp, "Cn" ),
+		lambda cp: eastAsianWidths.get( cp, "N" ),
+		version
+	)
+
+def load_bundled():
+	import unicodedata
+	return (
+		lambda cp: unicodedata.category( chr( cp ) ),
+		# bundled database reports bogus East Asian Width for unassigned code points
+		lambda cp: "N" if unicodedata.category( chr( cp ) ) == "Cn" else unicodedata.east_asian_width( chr( cp ) ),
+		unicodedata.unidata_version
+	)
+
+def width( cp_, category_, eastAsianWidth_ ):
+	if cp_ == 0:
+		return 0
+	if ( cp_ < 32 ) or ( 0x7f <= cp_ < 0xa0 ):
+		return -1
+	if ( cp_ != 0x00ad ) and ( category_( cp_ ) in ( "Mn", "Me", "Cf" ) ):
+		return 0
+	if ( 0x1160 <= cp_ <= 0x11ff ) or ( cp_ == 0x200b ):
+		return 0
+	if eastAsianWidth_( cp_ ) in ( "W", "F" ):
+		return 2
+	if ( category_( cp_ ) == "Cn" ) and any( first <= cp_ <= last for first, last in DEFAULT_WIDE ):
+		return 2
+	return 1
+
+def format_array( values_, perLine_ ):
+	lines = []
+	for i in range( 0, len( values_ ), perLine_ ):
+		lines.append( "\t" + ", ".join( "0x{:02x}".format( v ) for v in values_[i:i + perLine_] ) + "," )
+	return "\n".join( lines )
+
+def main():
+	category, eastAsianWidth, version = load_ucd( sys.argv[1] ) if len( sys.argv ) > 1 else load_bundled()
+	pages = []
+	pageIndex = {}
+	index = []
+	for base in range( 0, MAX_CODE_POINT, PAGE_SIZE ):
+		packed = [ 0 ] * ( PAGE_SIZE // 4 )
+		for cp in range( base, base + PAGE_SIZE ):
+			offset = cp - base
+			packed[offset // 4] |= CODE[width( cp, category, eastAsianWidth )] << ( ( offset % 4 ) * 2 )
+		packed = tuple( packed )
+		if packed not in pageIndex:
+			pageIndex[packed] = len( pages )
+			pages.append( packed )
+		index.append( pageIndex[packed] )
+	if len( pages ) > 256:
+		raise Exception( "too many distinct pages for 8 bit page index: {}".format( len( pages ) ) )
+	with open( OUTPUT, "w", encoding = "utf-8" ) as out:
+		out.write( """/* Generated by gen-wcwidth.py from Unicode {version}, do not edit. */
+
+#ifndef REPLXX_WCWIDTHTABLE_HXX_INCLUDED
+#define REPLXX_WCWIDTHTABLE_HXX_INCLUDED 1
+
+namespace replxx {{
+
+namespace wcwidth {{
+
+static constexpr int PAGE_BITS = {pageBits};
+static constexpr char32_t MAX_CODE_POINT = 0x{maxCodePoint:x};
+
+/* page for each ( 1 << PAGE_BITS ) code points */
+static constexpr unsigned char PAGE_INDEX[{indexSize}] = {{
+{index}
+}};
+
+/* widths of code points in a page, 2 bits each, 3 stands for -1 */
+static constexpr unsigned char PAGES[{pageCount}][{pageSize}] = {{
+{pages}
+}};
+
+}}
+
+}}
+
+#endif
+""".format(
+			version = version,
+			pageBits = PAGE_BITS,
+			maxCodePoint = MAX_CODE_POINT,
+			indexSize = len( index ),
+			index = format_array( index, 16 ),
+			pageCount = len( pages ),
+			pageSize = PAGE_SIZE // 4,
+			pages = "\n".join( "\t{{\n{}\n\t}},".format( format_array( page, 16 ).replace( "\t", "\t\t" ) ) for page in pages )
+		) )
+	print( "{}: {} pages, {} bytes".format( OUTPUT, len( pages ), len( index ) + len( pages ) * PAGE_SIZE // 4 ) )
+
+if __name__ == "__main__":
+	main()
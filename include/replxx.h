@@ -195,7 +195,9 @@ typedef enum {
 	REPLXX_ACTION_COMPLETE_PREVIOUS,
 	REPLXX_ACTION_COMMIT_LINE,
 	REPLXX_ACTION_ABORT_LINE,
-	REPLXX_ACTION_SEND_EOF
+	REPLXX_ACTION_SEND_EOF,
+	REPLXX_ACTION_HISTORY_FUZZY_SEARCH,
+	REPLXX_ACTION_HISTORY_REGEX_SEARCH
 } ReplxxAction;
 
 /*! \brief Possible results of key-press handler actions.
@@ -218,6 +220,56 @@ typedef struct ReplxxHistoryEntryTag {
 	char const* text;
 } ReplxxHistoryEntry;
 
+/*! \brief Non owning view of history entry along with lengths (in bytes) of its strings.
+ */
+typedef struct ReplxxHistoryEntryViewTag {
+	char const* timestamp;
+	int timestampLength;
+	char const* text;
+	int textLength;
+} ReplxxHistoryEntryView;
+
+/*! \brief Fields of history entry metadata.
+ */
+typedef enum {
+	REPLXX_HISTORY_METADATA_EXIT_STATUS = 1, /*!< Exit status of the command. */
+	REPLXX_HISTORY_METADATA_DURATION = 2,    /*!< Time (in milliseconds) the command took. */
+	REPLXX_HISTORY_METADATA_DIRECTORY = 4    /*!< Working directory of the command (UTF-8 encoded). */
+} ReplxxHistoryMetadataField;
+
+/*! \brief Optional structured metadata of a history entry.
+ *
+ * Only fields present in \e fields mask are meaningful.
+ */
+typedef struct ReplxxHistoryMetadataTag {
+	int fields;
+	int exitStatus;
+	long long duration;
+	char const* directory;
+} ReplxxHistoryMetadata;
+
+/*! \brief Criteria of history entries filter.
+ */
+typedef enum {
+	REPLXX_HISTORY_FILTER_EXIT_STATUS = 1,  /*!< Exit status equal to \e exitStatus. */
+	REPLXX_HISTORY_FILTER_MIN_DURATION = 2, /*!< Duration at least as long as \e minDuration. */
+	REPLXX_HISTORY_FILTER_DIRECTORY = 4,    /*!< Working directory equal to \e directory. */
+	REPLXX_HISTORY_FILTER_FAILED = 8,       /*!< Exit status other than 0. */
+	REPLXX_HISTORY_FILTER_WITHIN = 16       /*!< Added within \e within milliseconds from now. */
+} ReplxxHistoryFilterCriterion;
+
+/*! \brief Criteria selecting history entries by their metadata and age.
+ *
+ * Only criteria present in \e criteria mask are tested.
+ */
+typedef struct ReplxxHistoryFilterTag {
+	int criteria;
+	int exitStatus;
+	long long minDuration;
+	char const* directory;
+	long long within;
+} ReplxxHistoryFilter;
+
 /*! \brief Create Replxx library resource holder.
  *
  * Use replxx_end() to free resources acquired with this function.
@@ -466,6 +518,26 @@ int replxx_bind_key_internal( Replxx*, int code, char const* actionName );
 REPLXX_IMPEXP void replxx_set_preload_buffer( Replxx*, const char* preloadText );
 
 REPLXX_IMPEXP void replxx_history_add( Replxx*, const char* line );
+
+/*! \brief Add many lines to REPL's history at once.
+ *
+ * Result is the same as adding each of given lines with replxx_history_add(),
+ * but history is deduplicated and trimmed once for the whole batch.
+ *
+ * \param lines - lines to add, oldest first.
+ * \param count - number of lines to add.
+ */
+REPLXX_IMPEXP void replxx_history_add_batch( Replxx*, char const** lines, int count );
+
+/*! \brief Add a line along with its metadata to REPL's history.
+ *
+ * Metadata is a part of the history record, so it is persisted and merged
+ * along with it. To record outcome of a command add its line after it was run.
+ *
+ * \param line - line to add.
+ * \param metadata - exit status, duration and/or working directory of the command.
+ */
+REPLXX_IMPEXP void replxx_history_add_with_metadata( Replxx*, char const* line, ReplxxHistoryMetadata const* metadata );
 REPLXX_IMPEXP int replxx_history_size( Replxx* );
 
 /*! \brief Set set of word break characters.
@@ -490,6 +562,16 @@ REPLXX_IMPEXP void replxx_set_max_hint_rows( Replxx*, int count );
  */
 REPLXX_IMPEXP void replxx_set_hint_delay( Replxx*, int milliseconds );
 
+/*! \brief Enable/disable built-in history hints.
+ *
+ * If no hint callback is registered and this mode is enabled
+ * hints for the line being edited are history entries starting with it,
+ * most frecent (frequently and recently used) entries first.
+ *
+ * \param val - if set to non-zero built-in history hints are shown.
+ */
+REPLXX_IMPEXP void replxx_set_history_hints( Replxx*, int val );
+
 /*! \brief Set tab completion behavior.
  *
  * \param val - use double tab to invoke completions (if != 0).
@@ -525,6 +607,94 @@ REPLXX_IMPEXP void replxx_set_immediate_completion( Replxx*, int val );
  */
 REPLXX_IMPEXP void replxx_set_unique_history( Replxx*, int val );
 
+/*! \brief Enable/disable append-only journaled history persistence.
+ *
+ * In journal mode replxx_history_save() and replxx_history_sync() only append entries added
+ * since previous save (and tombstones of entries removed as duplicates)
+ * to the history file instead of rewriting it as a whole.
+ * The history file is compacted (fully rewritten) when number of records stored in it
+ * exceeds \e compactionRatio times number of entries in REPL's history.
+ * Journal is used only for the file that REPL's history was last loaded from or saved to.
+ *
+ * \param compactionRatio - records in file to live entries ratio triggering compaction, 0 disables journal mode.
+ */
+REPLXX_IMPEXP void replxx_set_history_journal( Replxx*, int compactionRatio );
+
+/*! \brief Select on-disk history file format.
+ *
+ * Binary history format stores fixed width timestamps and length prefixed UTF-8 entries
+ * followed by an index of entry offsets, so loading history from it reads
+ * only newest (up to maximum history size) entries.
+ * replxx_history_load() detects the format of the history file automatically.
+ * Binary history files are always fully rewritten, even in journal mode.
+ *
+ * \param val - if set to non-zero replxx_history_save() and replxx_history_sync() write history files in binary format.
+ */
+REPLXX_IMPEXP void replxx_set_history_binary_format( Replxx*, int val );
+
+/*! \brief Enable/disable asynchronous history persistence.
+ *
+ * In asynchronous mode replxx_history_save() and replxx_history_sync() only take a snapshot of REPL's history
+ * and queue it to a background writer thread, so they never wait for file locks or disk I/O.
+ * Pending requests for the same file are coalesced into one,
+ * completion of each request is reported through history save callback
+ * (return value of these calls only tells if the request was queued).
+ * Entries merged by asynchronous replxx_history_sync() are added to REPL's history
+ * on next call to replxx_input(), replxx_history_save() or replxx_history_sync().
+ * replxx_history_load() waits for pending requests to complete.
+ * Disabling asynchronous mode (and replxx_end()) waits for all pending requests to complete.
+ *
+ * \param val - if set to non-zero replxx_history_save() and replxx_history_sync() are asynchronous.
+ */
+REPLXX_IMPEXP void replxx_set_history_async( Replxx*, int val );
+
+/*! \brief Asynchronous history save completion callback type definition.
+ *
+ * The callback is invoked on background history writer thread
+ * after each asynchronous replxx_history_save() or replxx_history_sync() request was processed.
+ *
+ * \param filename - a path to the history file that was saved.
+ * \param success - non-zero iff history file was successfully written.
+ * \param userData - pointer to opaque user data block.
+ */
+typedef void (replxx_history_save_callback_t)( char const* filename, int success, void* userData );
+
+/*! \brief Register asynchronous history save completion callback.
+ *
+ * \param fn - user defined callback function.
+ * \param userData - pointer to opaque user data block to be passed into each invocation of the callback.
+ */
+REPLXX_IMPEXP void replxx_set_history_save_callback( Replxx*, replxx_history_save_callback_t* fn, void* userData );
+
+/*! \brief Enable/disable shared history mode.
+ *
+ * In shared mode the history file that REPL's history was last loaded from or saved to
+ * is watched for records appended to it by other processes (in journal mode),
+ * new records are merged into REPL's history at the beginning of each replxx_input() call
+ * and when user starts browsing or searching history,
+ * so entries saved by other REPL instances are available almost immediately.
+ * Only records appended since the file was last read are read,
+ * the whole file is read again only if it was replaced (e.g. compacted).
+ * Shared mode is not available on Windows.
+ *
+ * \param val - if set to non-zero REPL's history is shared with other processes.
+ */
+REPLXX_IMPEXP void replxx_set_history_shared( Replxx*, int val );
+
+/*! \brief Enable/disable publishing of history snapshots for other threads.
+ *
+ * In this mode an immutable copy of REPL's history is published
+ * after each history modifying call and when replxx_input() returns,
+ * replxx_history_scan_*() and replxx_history_size() read the most recently published copy
+ * and can be called from any thread, also while replxx_input() runs.
+ * Readers never block the thread that owns Replxx object,
+ * a scan keeps the copy it started with alive until the scan is stopped.
+ * A publication shares storage with REPL's history, only storage blocks modified afterwards are copied.
+ *
+ * \param val - if set to non-zero history snapshots are published.
+ */
+REPLXX_IMPEXP void replxx_set_history_snapshots( Replxx*, int val );
+
 /*! \brief Disable output coloring.
  *
  * \param val - if set to non-zero disable output colors.
@@ -537,12 +707,97 @@ REPLXX_IMPEXP void replxx_set_no_color( Replxx*, int val );
  */
 REPLXX_IMPEXP void replxx_set_indent_multiline( Replxx*, int val );
 
+/*! \brief Enable/disable differential rendering of user input.
+ *
+ * In this mode only cells that changed since the last refresh are redrawn,
+ * see Replxx::set_differential_rendering() for details.
+ *
+ * \param val - if set to non-zero only changed parts of input are redrawn.
+ */
+REPLXX_IMPEXP void replxx_set_differential_rendering( Replxx*, int val );
+
 /*! \brief Set maximum number of entries in history list.
  */
 REPLXX_IMPEXP void replxx_set_max_history_size( Replxx*, int len );
 REPLXX_IMPEXP ReplxxHistoryScan* replxx_history_scan_start( Replxx* );
+
+/*! \brief Start scan over history entries containing a match of given regular expression.
+ *
+ * Entries are scanned with replxx_history_scan_next()
+ * and the scan is released with replxx_history_scan_stop().
+ * Whole history is searched up front, see Replxx::history_grep() for details.
+ *
+ * \param pattern - regular expression (UTF-8 encoded).
+ * \return Scan over copies of matching entries, oldest first, NULL if pattern is not a valid regular expression.
+ */
+REPLXX_IMPEXP ReplxxHistoryScan* replxx_history_grep_start( Replxx*, char const* pattern );
+
+/*! \brief Start scan over history entries meeting given criteria.
+ *
+ * Entries are scanned with replxx_history_scan_next()
+ * and the scan is released with replxx_history_scan_stop().
+ * Whole history is filtered up front, see Replxx::history_filter() for details.
+ *
+ * \param filter - criteria that selected entries shall meet.
+ * \return Scan over copies of selected entries, oldest first.
+ */
+REPLXX_IMPEXP ReplxxHistoryScan* replxx_history_filter_start( Replxx*, ReplxxHistoryFilter const* filter );
+
+/*! \brief Start scan over history entries added within given time range.
+ *
+ * Start of the range is found by binary search and entries are not copied,
+ * see Replxx::history_range() for details.
+ *
+ * \param from - timestamp ("YYYY-MM-DD hh:mm:ss.mmm") of the oldest entry to scan (inclusive), NULL for no lower bound.
+ * \param to - timestamp ending the range (exclusive), NULL for no upper bound.
+ * \return Scan over entries in given range, oldest first.
+ */
+REPLXX_IMPEXP ReplxxHistoryScan* replxx_history_range_start( Replxx*, char const* from, char const* to );
+
+/*! \brief Start scan over records of given history file stored within given time range.
+ *
+ * Only records within the range are read from binary history files,
+ * see Replxx::history_file_range() for details.
+ *
+ * \param filename - a path to the history file.
+ * \param from - timestamp of the oldest record to scan (inclusive), NULL for no lower bound.
+ * \param to - timestamp ending the range (exclusive), NULL for no upper bound.
+ * \return Scan over copies of records in given range, oldest first, NULL if the file cannot be read.
+ */
+REPLXX_IMPEXP ReplxxHistoryScan* replxx_history_file_range_start( Replxx*, char const* filename, char const* from, char const* to );
 REPLXX_IMPEXP void replxx_history_scan_stop( Replxx*, ReplxxHistoryScan* );
-REPLXX_IMPEXP int replxx_history_scan_next( Replxx*, ReplxxHistoryScan*, ReplxxHistoryEntry* );
+
+/*! \brief Advance history scan to the next entry.
+ *
+ * Entry fields point to NUL terminated UTF-8 strings owned by the scan,
+ * they stay valid until the scan advances or history is modified,
+ * no memory is allocated and no text is converted by this call.
+ *
+ * \param historyEntry - fill this structure with next entry.
+ * \return 0 if there was next entry, -1 otherwise.
+ */
+REPLXX_IMPEXP int replxx_history_scan_next( Replxx*, ReplxxHistoryScan*, ReplxxHistoryEntry* historyEntry );
+
+/*! \brief Get view of the entry history scan is at.
+ *
+ * Timestamp and text point to the same NUL terminated UTF-8 strings
+ * as fields filled by replxx_history_scan_next(),
+ * this call additionally provides their lengths without scanning the strings.
+ * It may be called only after replxx_history_scan_next() returned 0.
+ *
+ * \param view - fill this structure with view of current entry.
+ */
+REPLXX_IMPEXP void replxx_history_scan_view( Replxx*, ReplxxHistoryScan*, ReplxxHistoryEntryView* view );
+
+/*! \brief Get metadata of the entry history scan is at.
+ *
+ * Directory points to NUL terminated UTF-8 string owned by the scan,
+ * it stays valid until the scan advances or history is modified.
+ *
+ * \param metadata - fill this structure with metadata of current entry.
+ * \return 0 if current entry has any metadata, -1 otherwise.
+ */
+REPLXX_IMPEXP int replxx_history_scan_metadata( Replxx*, ReplxxHistoryScan*, ReplxxHistoryMetadata* metadata );
 
 /*! \brief Synchronize REPL's history with given file.
  *
@@ -557,6 +812,8 @@ REPLXX_IMPEXP int replxx_history_scan_next( Replxx*, ReplxxHistoryScan*, ReplxxH
  *
  * \param filename - a path to the file with which REPL's current history should be synchronized.
  * \return 0 iff history file was successfully created, -1 otherwise.
+ * In asynchronous mode 0 only means that the request was queued,
+ * actual result is reported through history save callback.
  */
 REPLXX_IMPEXP int replxx_history_sync( Replxx*, const char* filename );
 
@@ -569,6 +826,8 @@ REPLXX_IMPEXP int replxx_history_sync( Replxx*, const char* filename );
  *
  * \param filename - a path to the file where REPL's history should be saved.
  * \return 0 iff history file was successfully created, -1 otherwise.
+ * In asynchronous mode 0 only means that the request was queued,
+ * actual result is reported through history save callback.
  */
 REPLXX_IMPEXP int replxx_history_save( Replxx*, const char* filename );
 
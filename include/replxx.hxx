@@ -210,7 +210,9 @@ public:
 		COMPLETE_PREVIOUS,
 		COMMIT_LINE,
 		ABORT_LINE,
-		SEND_EOF
+		SEND_EOF,
+		HISTORY_FUZZY_SEARCH,
+		HISTORY_REGEX_SEARCH
 	};
 	/*! \brief Possible results of key-press handler actions.
 	 */
@@ -259,6 +261,167 @@ public:
 			return ( _text );
 		}
 	};
+	/*! \brief Optional structured metadata of a history entry.
+	 *
+	 * Each field is either set or absent, only set fields are stored.
+	 */
+	class HistoryMetadata {
+	public:
+		enum FIELD {
+			EXIT_STATUS = 1, /*!< Exit status of the command. */
+			DURATION = 2,    /*!< Time (in milliseconds) the command took. */
+			DIRECTORY = 4    /*!< Working directory of the command (UTF-8 encoded). */
+		};
+	private:
+		int _fields;
+		int _exitStatus;
+		long long _duration;
+		std::string _directory;
+	public:
+		HistoryMetadata( void )
+			: _fields( 0 )
+			, _exitStatus( 0 )
+			, _duration( 0 )
+			, _directory() {
+		}
+		int fields( void ) const {
+			return ( _fields );
+		}
+		bool has( FIELD field_ ) const {
+			return ( ( _fields & field_ ) != 0 );
+		}
+		int exit_status( void ) const {
+			return ( _exitStatus );
+		}
+		long long duration( void ) const {
+			return ( _duration );
+		}
+		std::string const& directory( void ) const {
+			return ( _directory );
+		}
+		HistoryMetadata& set_exit_status( int exitStatus_ ) {
+			_exitStatus = exitStatus_;
+			_fields |= EXIT_STATUS;
+			return ( *this );
+		}
+		HistoryMetadata& set_duration( long long duration_ ) {
+			_duration = duration_;
+			_fields |= DURATION;
+			return ( *this );
+		}
+		HistoryMetadata& set_directory( std::string const& directory_ ) {
+			_directory = directory_;
+			_fields |= DIRECTORY;
+			return ( *this );
+		}
+		void clear( void ) {
+			_fields = 0;
+			_exitStatus = 0;
+			_duration = 0;
+			_directory.clear();
+		}
+	};
+	/*! \brief Criteria selecting history entries by their metadata and age.
+	 *
+	 * An entry is selected if it meets all criteria that were set,
+	 * entries lacking a metadata field tested by any of the criteria are never selected.
+	 */
+	class HistoryFilter {
+	public:
+		enum CRITERION {
+			EXIT_STATUS = 1,  /*!< Exit status equal to given one. */
+			MIN_DURATION = 2, /*!< Duration at least as long as given one. */
+			DIRECTORY = 4,    /*!< Working directory equal to given one. */
+			FAILED = 8,       /*!< Exit status other than 0. */
+			WITHIN = 16       /*!< Added within given number of milliseconds from now. */
+		};
+	private:
+		int _criteria;
+		int _exitStatus;
+		long long _minDuration;
+		std::string _directory;
+		long long _within;
+	public:
+		HistoryFilter( void )
+			: _criteria( 0 )
+			, _exitStatus( 0 )
+			, _minDuration( 0 )
+			, _directory()
+			, _within( 0 ) {
+		}
+		int criteria( void ) const {
+			return ( _criteria );
+		}
+		bool has( CRITERION criterion_ ) const {
+			return ( ( _criteria & criterion_ ) != 0 );
+		}
+		int exit_status( void ) const {
+			return ( _exitStatus );
+		}
+		long long min_duration( void ) const {
+			return ( _minDuration );
+		}
+		std::string const& directory( void ) const {
+			return ( _directory );
+		}
+		long long within( void ) const {
+			return ( _within );
+		}
+		HistoryFilter& set_exit_status( int exitStatus_ ) {
+			_exitStatus = exitStatus_;
+			_criteria |= EXIT_STATUS;
+			return ( *this );
+		}
+		HistoryFilter& set_failed( void ) {
+			_criteria |= FAILED;
+			return ( *this );
+		}
+		HistoryFilter& set_min_duration( long long minDuration_ ) {
+			_minDuration = minDuration_;
+			_criteria |= MIN_DURATION;
+			return ( *this );
+		}
+		HistoryFilter& set_directory( std::string const& directory_ ) {
+			_directory = directory_;
+			_criteria |= DIRECTORY;
+			return ( *this );
+		}
+		HistoryFilter& set_within( long long within_ ) {
+			_within = within_;
+			_criteria |= WITHIN;
+			return ( *this );
+		}
+	};
+	/*! \brief Non owning view of a history entry.
+	 *
+	 * Both timestamp and text are NUL terminated UTF-8 strings,
+	 * they stay valid until the history scan advances or history is modified.
+	 */
+	class HistoryEntryView {
+		char const* _timestamp;
+		int _timestampLength;
+		char const* _text;
+		int _textLength;
+	public:
+		HistoryEntryView( char const* timestamp_, int timestampLength_, char const* text_, int textLength_ )
+			: _timestamp( timestamp_ )
+			, _timestampLength( timestampLength_ )
+			, _text( text_ )
+			, _textLength( textLength_ ) {
+		}
+		char const* timestamp( void ) const {
+			return ( _timestamp );
+		}
+		int timestamp_length( void ) const {
+			return ( _timestampLength );
+		}
+		char const* text( void ) const {
+			return ( _text );
+		}
+		int text_length( void ) const {
+			return ( _textLength );
+		}
+	};
 	class HistoryScanImpl;
 	class HistoryScan {
 	public:
@@ -278,6 +441,21 @@ public:
 		HistoryScan& operator = ( HistoryScan&& ) = default;
 		bool next( void );
 		HistoryEntry const& get( void ) const;
+		/*! \brief Get current entry without copying it.
+		 *
+		 * Unlike get() this call neither allocates memory nor converts entry text.
+		 *
+		 * \return View of current history entry.
+		 */
+		HistoryEntryView view( void ) const;
+		/*! \brief Get metadata of current entry.
+		 *
+		 * Metadata is read from its own storage only when requested,
+		 * so scans that never call this pay nothing for it.
+		 *
+		 * \return Metadata of current history entry, with no fields set if it has none.
+		 */
+		HistoryMetadata const& metadata( void ) const;
 	private:
 		HistoryScan( HistoryScan const& ) = delete;
 		HistoryScan& operator = ( HistoryScan const& ) = delete;
@@ -361,6 +539,16 @@ public:
 	 */
 	typedef std::function<ACTION_RESULT ( char32_t code )> key_press_handler_t;
 
+	/*! \brief Asynchronous history save completion callback type definition.
+	 *
+	 * The callback is invoked on background history writer thread
+	 * after each asynchronous history_save() or history_sync() request was processed.
+	 *
+	 * \param filename - a path to the history file that was saved.
+	 * \param success - true iff history file was successfully written.
+	 */
+	typedef std::function<void ( std::string const& filename, bool success )> history_save_callback_t;
+
 	struct State {
 		char const* _text;
 		int _cursorPosition;
@@ -514,6 +702,26 @@ public:
 
 	void history_add( std::string const& line );
 
+	/*! \brief Add a line along with its metadata to REPL's history.
+	 *
+	 * Metadata is a part of the history record, so it is persisted and merged
+	 * along with it. To record outcome of a command add its line after it was run.
+	 *
+	 * \param line - line to add.
+	 * \param metadata - exit status, duration and/or working directory of the command.
+	 */
+	void history_add( std::string const& line, HistoryMetadata const& metadata );
+
+	/*! \brief Add many lines to REPL's history at once.
+	 *
+	 * Result is the same as adding each of given lines with history_add(),
+	 * but history is deduplicated and trimmed once for the whole batch,
+	 * so importing large histories takes time linear in number of lines.
+	 *
+	 * \param lines - lines to add, oldest first.
+	 */
+	void history_add_batch( std::vector<std::string> const& lines );
+
 	/*! \brief Synchronize REPL's history with given file.
 	 *
 	 * Synchronizing means loading existing history from given file,
@@ -527,6 +735,8 @@ public:
 	 *
 	 * \param filename - a path to the file with which REPL's current history should be synchronized.
 	 * \return True iff history file was successfully created.
+	 * In asynchronous mode true only means that the request was queued,
+	 * actual result is reported through history save callback.
 	 */
 	bool history_sync( std::string const& filename );
 
@@ -539,6 +749,8 @@ public:
 	 *
 	 * \param filename - a path to the file where REPL's history should be saved.
 	 * \return True iff history file was successfully created.
+	 * In asynchronous mode true only means that the request was queued,
+	 * actual result is reported through history save callback.
 	 */
 	bool history_save( std::string const& filename );
 
@@ -565,6 +777,69 @@ public:
 	int history_size( void ) const;
 	HistoryScan history_scan( void ) const;
 
+	/*! \brief Find history entries containing a match of given regular expression.
+	 *
+	 * Supported syntax covers literals, `.`, bracketed character classes,
+	 * `\d`, `\w`, `\s` (and negated forms), `^` and `$` anchors (at text boundaries),
+	 * groups, alternation and `*`, `+`, `?`, `{m,n}` quantifiers.
+	 * Matching is case insensitive if set_ignore_case() was enabled.
+	 *
+	 * Whole history is scanned in one linear pass per entry, split over a few worker threads.
+	 * If history snapshots are enabled (see set_history_snapshots())
+	 * the most recently published copy of history is searched,
+	 * so this call is safe to use on any thread.
+	 *
+	 * \param pattern - regular expression (UTF-8 encoded).
+	 * \return Scan over copies of matching entries, oldest first.
+	 * \throw std::runtime_error if pattern is not a valid regular expression.
+	 */
+	HistoryScan history_grep( std::string const& pattern );
+
+	/*! \brief Find history entries meeting given criteria.
+	 *
+	 * Metadata is stored column-wise, so each criterion is tested
+	 * by a linear pass over a single column of values.
+	 * If history snapshots are enabled (see set_history_snapshots())
+	 * the most recently published copy of history is searched,
+	 * so this call is safe to use on any thread.
+	 *
+	 * \param filter - criteria that selected entries shall meet.
+	 * \return Scan over copies of selected entries, oldest first.
+	 */
+	HistoryScan history_filter( HistoryFilter const& filter ) const;
+
+	/*! \brief Scan history entries added within given time range.
+	 *
+	 * History is kept in timestamp order, so start of the range is found
+	 * by binary search and entries are streamed (without copying) up to its end.
+	 * If history snapshots are enabled (see set_history_snapshots())
+	 * the most recently published copy of history is scanned,
+	 * so this call is safe to use on any thread.
+	 *
+	 * Timestamps have "YYYY-MM-DD hh:mm:ss.mmm" form (the same as HistoryEntry::timestamp()),
+	 * omitted trailing components are taken as zeros.
+	 *
+	 * \param from - timestamp of the oldest entry to scan (inclusive), empty for no lower bound.
+	 * \param to - timestamp ending the range (exclusive), empty for no upper bound.
+	 * \return Scan over entries in given range, oldest first.
+	 */
+	HistoryScan history_range( std::string const& from, std::string const& to ) const;
+
+	/*! \brief Scan records of given history file stored within given time range.
+	 *
+	 * The file is read as it is, independently of REPL's history.
+	 * Records of binary history files (see set_history_binary_format()) are located
+	 * by binary search over the record index stored in the file,
+	 * so only records within the range are read, text history files are read as a whole.
+	 *
+	 * \param filename - a path to the history file.
+	 * \param from - timestamp of the oldest record to scan (inclusive), empty for no lower bound.
+	 * \param to - timestamp ending the range (exclusive), empty for no upper bound.
+	 * \return Scan over copies of records in given range, oldest first.
+	 * \throw std::runtime_error if given file cannot be read.
+	 */
+	HistoryScan history_file_range( std::string const& filename, std::string const& from, std::string const& to ) const;
+
 	void set_preload_buffer( std::string const& preloadText );
 
 	/*! \brief Set set of word break characters.
@@ -589,6 +864,16 @@ public:
 	 */
 	void set_hint_delay( int milliseconds );
 
+	/*! \brief Enable/disable built-in history hints.
+	 *
+	 * If no hint callback is registered and this mode is enabled
+	 * hints for the line being edited are history entries starting with it,
+	 * most frecent (frequently and recently used) entries first.
+	 *
+	 * \param val - if set to true built-in history hints are shown.
+	 */
+	void set_history_hints( bool val );
+
 	/*! \brief Set tab completion behavior.
 	 *
 	 * \param val - use double tab to invoke completions.
@@ -624,6 +909,84 @@ public:
 	 */
 	void set_unique_history( bool val );
 
+	/*! \brief Enable/disable append-only journaled history persistence.
+	 *
+	 * In journal mode history_save() and history_sync() only append entries added
+	 * since previous save (and tombstones of entries removed as duplicates)
+	 * to the history file instead of rewriting it as a whole.
+	 * The history file is compacted (fully rewritten) when number of records stored in it
+	 * exceeds \e compactionRatio times number of entries in REPL's history.
+	 * Journal is used only for the file that REPL's history was last loaded from or saved to.
+	 *
+	 * \param compactionRatio - records in file to live entries ratio triggering compaction, 0 disables journal mode.
+	 */
+	void set_history_journal( int compactionRatio );
+
+	/*! \brief Select on-disk history file format.
+	 *
+	 * Binary history format stores fixed width timestamps and length prefixed UTF-8 entries
+	 * followed by an index of entry offsets, so loading history from it reads
+	 * only newest (up to maximum history size) entries.
+	 * history_load() detects the format of the history file automatically,
+	 * history_save( std::ostream& ) and history_load( std::istream& ) always use text format.
+	 * Binary history files are always fully rewritten, even in journal mode.
+	 *
+	 * \param val - if set to true history_save() and history_sync() write history files in binary format.
+	 */
+	void set_history_binary_format( bool val );
+
+	/*! \brief Enable/disable asynchronous history persistence.
+	 *
+	 * In asynchronous mode history_save() and history_sync() only take a snapshot of REPL's history
+	 * and queue it to a background writer thread, so they never wait for file locks or disk I/O.
+	 * Pending requests for the same file are coalesced into one,
+	 * completion of each request is reported through history save callback
+	 * (return value of these calls only tells if the request was queued).
+	 * Entries merged by asynchronous history_sync() are added to REPL's history
+	 * on next call to input(), history_save() or history_sync().
+	 * history_load() waits for pending requests to complete.
+	 * Disabling asynchronous mode (and destroying Replxx object) waits
+	 * for all pending requests to complete.
+	 *
+	 * \param val - if set to true history_save( std::string const& ) and history_sync() are asynchronous.
+	 */
+	void set_history_async( bool val );
+
+	/*! \brief Register asynchronous history save completion callback.
+	 *
+	 * \param fn - user defined callback function.
+	 */
+	void set_history_save_callback( history_save_callback_t const& fn );
+
+	/*! \brief Enable/disable shared history mode.
+	 *
+	 * In shared mode the history file that REPL's history was last loaded from or saved to
+	 * is watched for records appended to it by other processes (in journal mode),
+	 * new records are merged into REPL's history at the beginning of each input() call
+	 * and when user starts browsing or searching history,
+	 * so entries saved by other REPL instances are available almost immediately.
+	 * Only records appended since the file was last read are read,
+	 * the whole file is read again only if it was replaced (e.g. compacted).
+	 * Shared mode is not available on Windows.
+	 *
+	 * \param val - if set to true REPL's history is shared with other processes.
+	 */
+	void set_history_shared( bool val );
+
+	/*! \brief Enable/disable publishing of history snapshots for other threads.
+	 *
+	 * In this mode an immutable copy of REPL's history is published
+	 * after each history modifying call and when input() returns,
+	 * history_scan() and history_size() read the most recently published copy
+	 * and can be called from any thread, also while input() runs.
+	 * Readers never block the thread that owns Replxx object,
+	 * a scan keeps the copy it started with alive until the scan is destroyed.
+	 * A publication shares storage with REPL's history, only storage blocks modified afterwards are copied.
+	 *
+	 * \param val - if set to true history snapshots are published.
+	 */
+	void set_history_snapshots( bool val );
+
 	/*! \brief Disable output coloring.
 	 *
 	 * \param val - if set to non-zero disable output colors.
@@ -636,6 +999,19 @@ public:
 	 */
 	void set_indent_multiline( bool val );
 
+	/*! \brief Enable/disable differential rendering of user input.
+	 *
+	 * In this mode REPL remembers contents of the screen after each refresh
+	 * and on subsequent refreshes sends only cells that changed,
+	 * instead of redrawing the whole input (with hints) after every key press,
+	 * which considerably reduces traffic for long multi-line inputs on slow connections.
+	 * The whole input is still redrawn whenever anything else was written to the terminal.
+	 * Differential rendering is not available on Windows.
+	 *
+	 * \param val - if set to true only changed parts of input are redrawn.
+	 */
+	void set_differential_rendering( bool val );
+
 	/*! \brief Set maximum number of entries in history list.
 	 */
 	void set_max_history_size( int len );
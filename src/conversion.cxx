@@ -42,10 +42,14 @@ bool is8BitEncoding( is_8bit_encoding() );
 }
 
 ConversionResult copyString8to32(char32_t* dst, int dstSize, int& dstCount, const char* src) {
+	return copyString8to32( dst, dstSize, dstCount, src, static_cast<int>( strlen( src ) ) );
+}
+
+ConversionResult copyString8to32(char32_t* dst, int dstSize, int& dstCount, const char* src, int srcSize) {
 	ConversionResult res = ConversionResult::conversionOK;
 	if ( ! locale::is8BitEncoding ) {
 		const UTF8* sourceStart = reinterpret_cast<const UTF8*>(src);
-		const UTF8* sourceEnd = sourceStart + strlen(src);
+		const UTF8* sourceEnd = sourceStart + srcSize;
 		UTF32* targetStart = reinterpret_cast<UTF32*>(dst);
 		UTF32* targetEnd = targetStart + dstSize;
 
@@ -60,7 +64,7 @@ ConversionResult copyString8to32(char32_t* dst, int dstSize, int& dstCount, cons
 			}
 		}
 	} else {
-		for ( dstCount = 0; ( dstCount < dstSize ) && src[dstCount]; ++ dstCount ) {
+		for ( dstCount = 0; ( dstCount < dstSize ) && ( dstCount < srcSize ) && src[dstCount]; ++ dstCount ) {
 			dst[dstCount] = src[dstCount];
 		}
 	}
@@ -73,6 +77,31 @@ ConversionResult copyString8to32(char32_t* dst, int dstSize, int& dstCount, cons
 	);
 }
 
+/*
+ * Decode the first character of given UTF-8 text,
+ * returns number of bytes the character takes, 0 on malformed input.
+ */
+int copyChar8to32( char32_t& dst, char const* src, int srcSize ) {
+	if ( srcSize < 1 ) {
+		return ( 0 );
+	}
+	unsigned char lead( static_cast<unsigned char>( src[0] ) );
+	if ( ( lead < 0x80 ) || locale::is8BitEncoding ) {
+		dst = lead;
+		return ( 1 );
+	}
+	int len( lead >= 0xF0 ? 4 : ( lead >= 0xE0 ? 3 : 2 ) );
+	if ( len > srcSize ) {
+		return ( 0 );
+	}
+	const UTF8* sourceStart = reinterpret_cast<const UTF8*>( src );
+	UTF32* targetStart = reinterpret_cast<UTF32*>( &dst );
+	ConversionResult res = ConvertUTF8toUTF32(
+		&sourceStart, sourceStart + len, &targetStart, targetStart + 1, lenientConversion
+	);
+	return ( res == conversionOK ? len : 0 );
+}
+
 int copyString32to8( char* dst, int dstSize, const char32_t* src, int srcSize ) {
 	int resCount( 0 );
 	if ( ! locale::is8BitEncoding ) {
@@ -18,8 +18,10 @@ typedef unsigned char char8_t;
 namespace replxx {
 
 ConversionResult copyString8to32( char32_t* dst, int dstSize, int& dstCount, char const* src );
+ConversionResult copyString8to32( char32_t* dst, int dstSize, int& dstCount, char const* src, int srcSize );
 ConversionResult copyString8to32( char32_t* dst, int dstSize, int& dstCount, char8_t const* src );
 int copyString32to8( char* dst, int dstSize, char32_t const* src, int srcSize );
+int copyChar8to32( char32_t& dst, char const* src, int srcSize );
 
 namespace locale {
 extern bool is8BitEncoding;
@@ -0,0 +1,150 @@
+#include "display.hxx"
+#include "conversion.hxx"
+#include "util.hxx"
+
+namespace replxx {
+
+int mk_wcwidth( char32_t );
+
+Display::Display( void )
+	: _utf8()
+	, _columns()
+	, _escape( ESCAPE::NONE )
+	, _escapeLength( 0 )
+	, _unencodable( 0 )
+	, _input{ 0, 0, ESCAPE::NONE, 0, 0 } {
+}
+
+void Display::clear( void ) {
+	_utf8.clear();
+	_columns.clear();
+	_escape = ESCAPE::NONE;
+	_escapeLength = 0;
+	_unencodable = 0;
+	_input = Length{ 0, 0, ESCAPE::NONE, 0, 0 };
+}
+
+void Display::push_back( char32_t c_ ) {
+	if ( c_ < 0x80 ) {
+		_utf8.push_back( static_cast<char>( c_ ) );
+	} else {
+		char utf8[8];
+		int len( copyString32to8( utf8, static_cast<int>( sizeof ( utf8 ) ), &c_, 1 ) );
+		if ( len == 0 ) {
+			++ _unencodable;
+		}
+		_utf8.append( utf8, static_cast<size_t>( len ) );
+	}
+	measure( c_ );
+}
+
+/*
+ * Append an escape sequence (or any other plain ASCII text).
+ */
+void Display::append( char const* code_ ) {
+	for ( ; *code_; ++ code_ ) {
+		_utf8.push_back( *code_ );
+		measure( static_cast<char32_t>( *code_ ) );
+	}
+}
+
+void Display::mark_input_end( void ) {
+	_input = Length{ size(), static_cast<int>( _columns.size() ), _escape, _escapeLength, _unencodable };
+}
+
+void Display::trim_to_input( void ) {
+	_utf8.erase( static_cast<size_t>( _input._bytes ) );
+	_columns.erase( _columns.begin() + _input._columns, _columns.end() );
+	_escape = _input._escape;
+	_escapeLength = _input._escapeLength;
+	_unencodable = _input._unencodable;
+}
+
+/*
+ * Update the column map with next character,
+ * follows the rules of replxx::virtual_render().
+ */
+void Display::measure( char32_t c_ ) {
+	if ( _escape == ESCAPE::INTRODUCER ) {
+		_escape = ESCAPE::NONE;
+		if ( c_ == '[' ) {
+			_escape = ESCAPE::SEQUENCE;
+			_escapeLength = 0;
+			return;
+		}
+		/* not a sequence, ESC shows up as a visible character */
+		_columns.push_back( 2 );
+	} else if ( _escape == ESCAPE::SEQUENCE ) {
+		if ( ( c_ == ';' ) || ( ( c_ >= '0' ) && ( c_ <= '9' ) ) ) {
+			++ _escapeLength;
+			return;
+		}
+		_escape = ESCAPE::NONE;
+		if ( c_ == 'm' ) {
+			return;
+		}
+		_columns.push_back( static_cast<short>( 3 + _escapeLength ) );
+	}
+	short width( 0 );
+	if ( c_ == '\033' ) {
+		_escape = ESCAPE::INTRODUCER;
+		return;
+	} else if ( c_ == '\n' ) {
+		width = NEWLINE;
+	} else if ( c_ == '\r' ) {
+		width = CARRIAGE_RETURN;
+	} else if ( c_ == '\b' ) {
+		width = BACKSPACE;
+	} else if ( is_control_code( c_ ) ) {
+		width = 2;
+	} else {
+		int wcw( mk_wcwidth( c_ ) );
+		width = static_cast<short>( wcw < 0 ? STOP : wcw );
+	}
+	_columns.push_back( width );
+}
+
+/*
+ * Move the given position past the whole display on a screen
+ * with given number of columns, same as replxx::virtual_render().
+ */
+void Display::end_position( int& x_, int& y_, int screenColumns_ ) const {
+	bool wrapped( false );
+	auto advance_cursor = [&x_, &y_, &screenColumns_, &wrapped]( int by_ ) {
+		wrapped = false;
+		x_ += by_;
+		if ( x_ >= screenColumns_ ) {
+			x_ = 0;
+			++ y_;
+			wrapped = true;
+		}
+	};
+	for ( short width : _columns ) {
+		if ( ( width == NEWLINE ) || ( width == CARRIAGE_RETURN ) ) {
+			if ( ( width == NEWLINE ) && ! wrapped ) {
+				++ y_;
+			}
+			wrapped = false;
+			x_ = 0;
+		} else if ( width == BACKSPACE ) {
+			-- x_;
+			if ( x_ < 0 ) {
+				x_ = screenColumns_ - 1;
+				-- y_;
+			}
+		} else if ( width == STOP ) {
+			return;
+		} else {
+			advance_cursor( width );
+		}
+	}
+	/* escape sequence cut short by the end of the display */
+	if ( _escape == ESCAPE::INTRODUCER ) {
+		advance_cursor( 2 );
+	} else if ( ( _escape == ESCAPE::SEQUENCE ) && ( _escapeLength == 0 ) ) {
+		advance_cursor( 3 );
+	}
+}
+
+}
+
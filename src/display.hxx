@@ -0,0 +1,82 @@
+#ifndef REPLXX_DISPLAY_HXX_INCLUDED
+#define REPLXX_DISPLAY_HXX_INCLUDED 1
+
+#include <vector>
+#include <string>
+
+namespace replxx {
+
+/*
+ * Rendered input line with its hints, ready to be sent to the terminal.
+ *
+ * Characters and escape sequences are stored as UTF-8 bytes,
+ * so the display is written out without another transcoding pass.
+ * Screen width of every character is recorded in a parallel column map
+ * when the character is added, so the position of the end of the display
+ * is found without decoding the bytes again.
+ */
+class Display {
+	/* special entries of the column map */
+	enum : short {
+		NEWLINE = -1,
+		CARRIAGE_RETURN = -2,
+		BACKSPACE = -3,
+		STOP = -4 /* no further characters are laid out */
+	};
+	enum class ESCAPE {
+		NONE,
+		INTRODUCER, /* ESC */
+		SEQUENCE    /* ESC [ and parameters */
+	};
+	struct Length {
+		int _bytes;
+		int _columns;
+		ESCAPE _escape;
+		int _escapeLength;
+		int _unencodable;
+	};
+	typedef std::vector<short> columns_t;
+	std::string _utf8;
+	columns_t _columns; /* screen columns taken by each character */
+	ESCAPE _escape;     /* escape sequence left open by last character */
+	int _escapeLength;  /* number of parameter characters in open sequence */
+	int _unencodable;   /* number of characters without UTF-8 form */
+	Length _input;      /* part of display rendering the input itself */
+public:
+	Display( void );
+	void clear( void );
+	void push_back( char32_t );
+	void append( char const* );
+	void mark_input_end( void );
+	void trim_to_input( void );
+	void end_position( int&, int&, int ) const;
+	char const* data( void ) const {
+		return ( _utf8.data() );
+	}
+	int size( void ) const {
+		return ( static_cast<int>( _utf8.length() ) );
+	}
+	int input_size( void ) const {
+		return ( _input._bytes );
+	}
+	/*
+	 * A character without UTF-8 form voids whole write
+	 * of the part of display it belongs to, same as in Terminal::write32().
+	 */
+	bool encodable( void ) const {
+		return ( _unencodable == 0 );
+	}
+	bool input_encodable( void ) const {
+		return ( _input._unencodable == 0 );
+	}
+	bool hints_encodable( void ) const {
+		return ( _unencodable == _input._unencodable );
+	}
+private:
+	void measure( char32_t );
+};
+
+}
+
+#endif
+
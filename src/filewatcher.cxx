@@ -0,0 +1,116 @@
+#ifndef _WIN32
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#endif /* _WIN32 */
+
+#include "filewatcher.hxx"
+
+namespace replxx {
+
+FileWatcher::FileWatcher( void )
+	: _path()
+	, _name()
+	, _fd( -1 )
+	, _id( 0 )
+	, _size( -1 )
+	, _mtime( 0 ) {
+}
+
+FileWatcher::~FileWatcher( void ) {
+	stop();
+}
+
+void FileWatcher::watch( std::string const& path_ ) {
+	if ( path_ == _path ) {
+		return;
+	}
+	stop();
+	_path = path_;
+	std::string::size_type slash( _path.find_last_of( '/' ) );
+	_name = slash != std::string::npos ? _path.substr( slash + 1 ) : _path;
+#ifdef __linux__
+	std::string dir( slash == std::string::npos ? std::string( "." ) : ( slash == 0 ? std::string( "/" ) : _path.substr( 0, slash ) ) );
+	_fd = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if ( ( _fd >= 0 ) && ( ::inotify_add_watch( _fd, dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE ) < 0 ) ) {
+		::close( _fd );
+		_fd = -1;
+	}
+#endif
+	stat_changed();
+}
+
+void FileWatcher::stop( void ) {
+#ifndef _WIN32
+	if ( _fd >= 0 ) {
+		::close( _fd );
+	}
+#endif
+	_fd = -1;
+	_path.clear();
+	_name.clear();
+	_id = 0;
+	_size = -1;
+	_mtime = 0;
+}
+
+/*
+ * Tell if watched file was modified since previous call,
+ * never blocks.
+ */
+bool FileWatcher::changed( void ) {
+	if ( _path.empty() ) {
+		return ( false );
+	}
+#ifdef __linux__
+	if ( _fd >= 0 ) {
+		bool modified( false );
+		alignas( inotify_event ) char buf[4096];
+		while ( true ) {
+			ssize_t len( ::read( _fd, buf, sizeof ( buf ) ) );
+			if ( len <= 0 ) {
+				break;
+			}
+			for ( char const* p( buf ); p < ( buf + len ); ) {
+				inotify_event const* event( reinterpret_cast<inotify_event const*>( p ) );
+				if ( ( event->mask & IN_Q_OVERFLOW ) || ( ( event->len > 0 ) && ( _name == event->name ) ) ) {
+					modified = true;
+				}
+				p += sizeof ( inotify_event ) + event->len;
+			}
+		}
+		return ( modified );
+	}
+#endif
+	return ( stat_changed() );
+}
+
+bool FileWatcher::stat_changed( void ) {
+#ifndef _WIN32
+	struct stat st;
+	unsigned long long id( 0 );
+	long long size( -1 );
+	long long mtime( 0 );
+	if ( ::stat( _path.c_str(), &st ) == 0 ) {
+		id = static_cast<unsigned long long>( st.st_ino );
+		size = static_cast<long long>( st.st_size );
+		mtime = static_cast<long long>( st.st_mtime );
+	}
+	bool modified( ( id != _id ) || ( size != _size ) || ( mtime != _mtime ) );
+	_id = id;
+	_size = size;
+	_mtime = mtime;
+	return ( modified );
+#else
+	return ( false );
+#endif
+}
+
+}
+
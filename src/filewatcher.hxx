@@ -0,0 +1,41 @@
+#ifndef REPLXX_FILEWATCHER_HXX_INCLUDED
+#define REPLXX_FILEWATCHER_HXX_INCLUDED 1
+
+#include <string>
+
+namespace replxx {
+
+/*
+ * Non-blocking detection of modifications of a single file.
+ *
+ * On Linux the directory containing the file is watched with inotify
+ * (so the file being replaced by rename() is noticed too),
+ * on other POSIX systems file size, identity and modification time are compared,
+ * on Windows modifications are never reported.
+ */
+class FileWatcher {
+	std::string _path;
+	std::string _name;
+	int _fd;
+	unsigned long long _id;
+	long long _size;
+	long long _mtime;
+public:
+	FileWatcher( void );
+	~FileWatcher( void );
+	void watch( std::string const& );
+	void stop( void );
+	std::string const& path( void ) const {
+		return ( _path );
+	}
+	bool changed( void );
+private:
+	FileWatcher( FileWatcher const& ) = delete;
+	FileWatcher& operator = ( FileWatcher const& ) = delete;
+	bool stat_changed( void );
+};
+
+}
+
+#endif
+
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cwctype>
+
+#include "fuzzyindex.hxx"
+
+namespace replxx {
+
+namespace {
+
+/*
+ * Scoring scheme follows fzf:
+ * each matched character is worth SCORE_MATCH points,
+ * matches at word boundaries and camelCase humps get a bonus
+ * (doubled for the first character of the query),
+ * adjacent matches get a bonus and gaps between matches are penalized.
+ * More recent entries get up to RECENCY_BONUS points on top of their score.
+ */
+int const SCORE_MATCH( 16 );
+int const PENALTY_GAP_START( 3 );
+int const PENALTY_GAP_EXTENSION( 1 );
+int const BONUS_BOUNDARY( 8 );
+int const BONUS_CAMEL( 7 );
+int const BONUS_CONSECUTIVE( 4 );
+int const BONUS_FIRST_CHAR_MULTIPLIER( 2 );
+int const RECENCY_BONUS( 8 );
+
+int const BLOCK_SIZE( 64 );
+int const CHUNK_SIZE( BLOCK_SIZE * 256 );
+
+inline char32_t fold( char32_t c_ ) {
+	if ( c_ < 128 ) {
+		return ( ( ( c_ >= 'A' ) && ( c_ <= 'Z' ) ) ? c_ + ( 'a' - 'A' ) : c_ );
+	}
+	return ( static_cast<char32_t>( towlower( static_cast<wint_t>( c_ ) ) ) );
+}
+
+inline bool is_upper( char32_t c_ ) {
+	return ( c_ < 128 ? ( ( c_ >= 'A' ) && ( c_ <= 'Z' ) ) : ( iswupper( static_cast<wint_t>( c_ ) ) != 0 ) );
+}
+
+inline bool is_lower( char32_t c_ ) {
+	return ( c_ < 128 ? ( ( c_ >= 'a' ) && ( c_ <= 'z' ) ) : ( iswlower( static_cast<wint_t>( c_ ) ) != 0 ) );
+}
+
+inline bool is_digit( char32_t c_ ) {
+	return ( ( c_ >= '0' ) && ( c_ <= '9' ) );
+}
+
+inline bool is_word( char32_t c_ ) {
+	return ( is_lower( c_ ) || is_upper( c_ ) || is_digit( c_ ) || ( ( c_ >= 128 ) && ( iswalnum( static_cast<wint_t>( c_ ) ) != 0 ) ) );
+}
+
+/*
+ * Letters and digits get dedicated bits,
+ * other characters share remaining bits.
+ */
+inline int mask_bit( char32_t c_ ) {
+	char32_t c( fold( c_ ) );
+	if ( ( c >= 'a' ) && ( c <= 'z' ) ) {
+		return ( static_cast<int>( c - 'a' ) );
+	}
+	if ( is_digit( c ) ) {
+		return ( 26 + static_cast<int>( c - '0' ) );
+	}
+	if ( c < 128 ) {
+		return ( 36 + static_cast<int>( c % 20 ) );
+	}
+	return ( 56 + static_cast<int>( c % 8 ) );
+}
+
+inline int bonus( char32_t prev_, char32_t cur_ ) {
+	if ( ! is_word( prev_ ) ) {
+		return ( is_word( cur_ ) || ( prev_ == 0 ) ? BONUS_BOUNDARY : 0 );
+	}
+	if ( ( is_lower( prev_ ) && is_upper( cur_ ) ) || ( ! is_digit( prev_ ) && is_digit( cur_ ) ) ) {
+		return ( BONUS_CAMEL );
+	}
+	return ( 0 );
+}
+
+inline bool equal( char32_t l_, char32_t r_, bool ignoreCase_ ) {
+	return ( ( l_ == r_ ) || ( ignoreCase_ && ( fold( l_ ) == fold( r_ ) ) ) );
+}
+
+/*
+ * Bit i of the result is set if i-th mask contains all bits of the query mask,
+ * written as a branch free loop with fixed trip count so compilers vectorize it.
+ */
+inline FuzzyIndex::mask_t block_hits( FuzzyIndex::mask_t const* masks_, FuzzyIndex::mask_t query_ ) {
+	FuzzyIndex::mask_t hits( 0 );
+	for ( int i( 0 ); i < BLOCK_SIZE; ++ i ) {
+		hits |= static_cast<FuzzyIndex::mask_t>( ( masks_[i] & query_ ) == query_ ) << i;
+	}
+	return ( hits );
+}
+
+}
+
+FuzzyIndex::FuzzyIndex( void )
+	: _masks()
+	, _ids() {
+}
+
+FuzzyIndex::mask_t FuzzyIndex::mask( UnicodeStringView text_ ) {
+	mask_t m( 0 );
+	for ( char32_t c : text_ ) {
+		m |= mask_t( 1 ) << mask_bit( c );
+	}
+	return ( m );
+}
+
+void FuzzyIndex::add( id_t id_, UnicodeStringView text_ ) {
+	_masks.push_back( mask( text_ ) );
+	_ids.push_back( id_ );
+}
+
+/*
+ * Make given entry a candidate for queries matching given text too
+ * (used for entries with modified scratch text).
+ */
+void FuzzyIndex::widen( id_t id_, UnicodeStringView text_ ) {
+	ids_t::const_iterator it( std::lower_bound( _ids.begin(), _ids.end(), id_ ) );
+	if ( ( it != _ids.end() ) && ( *it == id_ ) ) {
+		_masks[static_cast<size_t>( it - _ids.begin() )] |= mask( text_ );
+	}
+}
+
+void FuzzyIndex::clear( void ) {
+	_masks.clear();
+	_ids.clear();
+}
+
+/*
+ * Find all entries matching given query, best (and most recent) matches first.
+ */
+void FuzzyIndex::search( UnicodeStringView query_, bool ignoreCase_, text_getter_t const& textGetter_, WorkerPool& workerPool_, matches_t& matches_ ) const {
+	matches_.clear();
+	mask_t queryMask( mask( query_ ) );
+	int size( static_cast<int>( _ids.size() ) );
+	int chunks( ( size + CHUNK_SIZE - 1 ) / CHUNK_SIZE );
+	std::vector<matches_t> chunkMatches( static_cast<size_t>( chunks ) );
+	workerPool_.run(
+		chunks,
+		[this, &query_, ignoreCase_, &textGetter_, queryMask, size, &chunkMatches]( int chunk_ ) {
+			matches_t& found( chunkMatches[static_cast<size_t>( chunk_ )] );
+			int from( chunk_ * CHUNK_SIZE );
+			int to( std::min( from + CHUNK_SIZE, size ) );
+			mask_t padded[BLOCK_SIZE];
+			int score( 0 );
+			for ( int block( from ); block < to; block += BLOCK_SIZE ) {
+				int blockSize( std::min( BLOCK_SIZE, to - block ) );
+				mask_t const* masks( _masks.data() + block );
+				if ( blockSize < BLOCK_SIZE ) {
+					std::fill( std::copy( masks, masks + blockSize, padded ), padded + BLOCK_SIZE, mask_t( 0 ) );
+					masks = padded;
+				}
+				mask_t hits( block_hits( masks, queryMask ) );
+				for ( int i( block ); ( hits != 0 ) && ( i < to ); ++ i, hits >>= 1 ) {
+					if ( ! ( hits & 1 ) ) {
+						continue;
+					}
+					UnicodeStringView text( textGetter_( _ids[static_cast<size_t>( i )] ) );
+					if ( ( text.length() > 0 ) && match( query_, text, ignoreCase_, score ) ) {
+						int recency( static_cast<int>( ( static_cast<long long>( i ) * RECENCY_BONUS ) / size ) );
+						found.emplace_back( _ids[static_cast<size_t>( i )], score + recency );
+					}
+				}
+			}
+			std::sort( found.begin(), found.end() );
+		}
+	);
+	std::vector<size_t> runs( 1, 0 );
+	for ( matches_t const& found : chunkMatches ) {
+		matches_.insert( matches_.end(), found.begin(), found.end() );
+		runs.push_back( matches_.size() );
+	}
+	while ( runs.size() > 2 ) {
+		std::vector<size_t> merged( 1, 0 );
+		for ( size_t i( 2 ); i < runs.size(); i += 2 ) {
+			std::inplace_merge( matches_.begin() + static_cast<long>( runs[i - 2] ), matches_.begin() + static_cast<long>( runs[i - 1] ), matches_.begin() + static_cast<long>( runs[i] ) );
+			merged.push_back( runs[i] );
+		}
+		if ( ( runs.size() % 2 ) == 0 ) {
+			merged.push_back( runs.back() );
+		}
+		runs.swap( merged );
+	}
+}
+
+/*
+ * Tell if all characters of the query occur (in order) in given text.
+ *
+ * The shortest window of the text ending at the first complete occurrence
+ * of the query is scored, positions of matched characters are optionally reported.
+ */
+bool FuzzyIndex::match( UnicodeStringView query_, UnicodeStringView text_, bool ignoreCase_, int& score_, positions_t* positions_ ) {
+	score_ = 0;
+	if ( positions_ ) {
+		positions_->clear();
+	}
+	int queryLen( query_.length() );
+	int textLen( text_.length() );
+	if ( queryLen == 0 ) {
+		return ( true );
+	}
+	if ( queryLen > textLen ) {
+		return ( false );
+	}
+	char32_t const* query( query_.get() );
+	char32_t const* text( text_.get() );
+	int q( 0 );
+	int end( -1 );
+	for ( int i( 0 ); i < textLen; ++ i ) {
+		if ( equal( text[i], query[q], ignoreCase_ ) && ( ++ q == queryLen ) ) {
+			end = i;
+			break;
+		}
+	}
+	if ( end < 0 ) {
+		return ( false );
+	}
+	int start( end );
+	q = queryLen - 1;
+	for ( int i( end ); i >= 0; -- i ) {
+		if ( equal( text[i], query[q], ignoreCase_ ) ) {
+			if ( q == 0 ) {
+				start = i;
+				break;
+			}
+			-- q;
+		}
+	}
+	int score( 0 );
+	int lastMatch( -2 );
+	bool inGap( false );
+	q = 0;
+	for ( int i( start ); i <= end; ++ i ) {
+		if ( ( q < queryLen ) && equal( text[i], query[q], ignoreCase_ ) ) {
+			int b( bonus( i > 0 ? text[i - 1] : 0, text[i] ) );
+			score += SCORE_MATCH + ( q == 0 ? b * BONUS_FIRST_CHAR_MULTIPLIER : b );
+			if ( lastMatch == ( i - 1 ) ) {
+				score += BONUS_CONSECUTIVE;
+			}
+			if ( positions_ ) {
+				positions_->push_back( i );
+			}
+			lastMatch = i;
+			inGap = false;
+			++ q;
+		} else {
+			score -= inGap ? PENALTY_GAP_EXTENSION : PENALTY_GAP_START;
+			inGap = true;
+		}
+	}
+	score_ = score;
+	return ( true );
+}
+
+}
+
@@ -0,0 +1,72 @@
+#ifndef REPLXX_FUZZYINDEX_HXX_INCLUDED
+#define REPLXX_FUZZYINDEX_HXX_INCLUDED 1
+
+#include <vector>
+#include <functional>
+
+#include "unicodestring.hxx"
+#include "workerpool.hxx"
+
+namespace replxx {
+
+/*
+ * Index for fuzzy (subsequence) search of history entries.
+ *
+ * For each entry a 64 bit mask of (case folded) character classes
+ * present in its text is kept in a contiguous array, so entries lacking
+ * any character class of the query are rejected by a mask test
+ * (processed in blocks of 64 entries) before their texts are ever looked at.
+ * Remaining candidates are scored with match() in chunks spread over a worker pool.
+ *
+ * Removed entries are not purged from the index,
+ * the owner is responsible for skipping (or rebuilding) stale identifiers.
+ */
+class FuzzyIndex {
+public:
+	typedef unsigned int id_t;
+	typedef unsigned long long mask_t;
+	typedef std::vector<int> positions_t;
+	class Match {
+		id_t _id;
+		int _score;
+	public:
+		Match( id_t id_, int score_ )
+			: _id( id_ )
+			, _score( score_ ) {
+		}
+		id_t id( void ) const {
+			return ( _id );
+		}
+		int score( void ) const {
+			return ( _score );
+		}
+		bool operator < ( Match const& other_ ) const {
+			return ( ( _score > other_._score ) || ( ( _score == other_._score ) && ( _id > other_._id ) ) );
+		}
+	};
+	typedef std::vector<Match> matches_t;
+	/*
+	 * Returns text of an entry with given identifier,
+	 * or an empty view if given entry shall be skipped.
+	 * Invoked concurrently from worker threads.
+	 */
+	typedef std::function<UnicodeStringView ( id_t )> text_getter_t;
+private:
+	typedef std::vector<mask_t> masks_t;
+	typedef std::vector<id_t> ids_t;
+	masks_t _masks;
+	ids_t _ids;
+public:
+	FuzzyIndex( void );
+	void add( id_t, UnicodeStringView );
+	void widen( id_t, UnicodeStringView );
+	void clear( void );
+	void search( UnicodeStringView, bool, text_getter_t const&, WorkerPool&, matches_t& ) const;
+	static mask_t mask( UnicodeStringView );
+	static bool match( UnicodeStringView, UnicodeStringView, bool, int&, positions_t* = nullptr );
+};
+
+}
+
+#endif
+
@@ -1,15 +1,23 @@
 #include <algorithm>
+#include <iterator>
 #include <memory>
+#include <vector>
 #include <fstream>
 #include <ostream>
 #include <istream>
 #include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cmath>
+#include <mutex>
+#include <unordered_set>
 
 #ifndef _WIN32
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #endif /* _WIN32 */
 
@@ -25,6 +33,38 @@ void delete_ReplxxHistoryScanImpl( Replxx::HistoryScanImpl* impl_ ) {
 	delete impl_;
 }
 static int const ETB = 0x17;
+
+/*
+ * Timestamps are stored as YYYYMMDDhhmmssmmm decimal numbers,
+ * converted from and to "YYYY-MM-DD hh:mm:ss.mmm" text form
+ * only when history is loaded from or saved to a text file.
+ */
+long long timestamp_to_int( char const* timestamp_, int len_ ) {
+	long long val( 0 );
+	for ( int i( 0 ); i < len_; ++ i ) {
+		if ( isdigit( timestamp_[i] ) ) {
+			val = val * 10 + ( timestamp_[i] - '0' );
+		}
+	}
+	return ( val );
+}
+
+static char const TIMESTAMP_FORMAT[] = "dddd-dd-dd dd:dd:dd.ddd";
+static int const TIMESTAMP_LENGTH( sizeof ( TIMESTAMP_FORMAT ) - 1 );
+
+/*
+ * Writes TIMESTAMP_LENGTH characters (without terminating NUL).
+ */
+void timestamp_from_int( char* timestamp_, long long val_ ) {
+	for ( int i( TIMESTAMP_LENGTH - 1 ); i >= 0; -- i ) {
+		if ( TIMESTAMP_FORMAT[i] == 'd' ) {
+			timestamp_[i] = static_cast<char>( '0' + val_ % 10 );
+			val_ /= 10;
+		} else {
+			timestamp_[i] = TIMESTAMP_FORMAT[i];
+		}
+	}
+}
 }
 
 static int const REPLXX_DEFAULT_HISTORY_MAX_LEN( 1000 );
@@ -38,83 +78,529 @@ bool Replxx::HistoryScan::next( void ) {
 }
 
 Replxx::HistoryScanImpl::HistoryScanImpl( History::entries_t const& entries_ )
-	: _entries( entries_ )
-	, _it( _entries.end() )
-	, _utf8Cache()
+	: _published()
+	, _entries( entries_ )
+	, _begin( _entries.begin() )
+	, _end( _entries.end() )
+	, _it( _end )
+	, _timestamp()
+	, _entryCache( std::string(), std::string() )
+	, _cacheValid( false )
+	, _metadataCache()
+	, _metadataCacheValid( false ) {
+}
+
+Replxx::HistoryScanImpl::HistoryScanImpl( History::published_t published_ )
+	: _published( std::move( published_ ) )
+	, _entries( *_published )
+	, _begin( _entries.begin() )
+	, _end( _entries.end() )
+	, _it( _end )
+	, _timestamp()
 	, _entryCache( std::string(), std::string() )
-	, _cacheValid( false ) {
+	, _cacheValid( false )
+	, _metadataCache()
+	, _metadataCacheValid( false ) {
 }
 
 Replxx::HistoryEntry const& Replxx::HistoryScan::get( void ) const {
 	return ( _impl->get() );
 }
 
+Replxx::HistoryEntryView Replxx::HistoryScan::view( void ) const {
+	return ( _impl->view() );
+}
+
+Replxx::HistoryMetadata const& Replxx::HistoryScan::metadata( void ) const {
+	return ( _impl->metadata() );
+}
+
+/*
+ * Limit the scan to entries with timestamps in [from_, to_) range,
+ * to_ not greater than 0 means no upper bound.
+ */
+void Replxx::HistoryScanImpl::seek( History::timestamp_t from_, History::timestamp_t to_ ) {
+	_begin = _entries.seek( from_ );
+	_end = to_ <= 0 ? _entries.end() : ( to_ > from_ ? _entries.seek( to_ ) : _begin );
+	_it = _end;
+}
+
 bool Replxx::HistoryScanImpl::next( void ) {
-	if ( _it == _entries.end() ) {
-		_it = _entries.begin();
+	if ( _it == _end ) {
+		_it = _begin;
 	} else {
 		++ _it;
 	}
 	_cacheValid = false;
-	return ( _it != _entries.end() );
+	_metadataCacheValid = false;
+	if ( _it == _end ) {
+		return ( false );
+	}
+	timestamp_from_int( _timestamp, _it->timestamp() );
+	_timestamp[TIMESTAMP_LENGTH] = 0;
+	return ( true );
 }
 
 Replxx::HistoryEntry const& Replxx::HistoryScanImpl::get( void ) const {
 	if ( _cacheValid ) {
 		return ( _entryCache );
 	}
-	_utf8Cache.assign( _it->text() );
-	_entryCache = Replxx::HistoryEntry( _it->timestamp(), _utf8Cache.get() );
+	_entryCache = Replxx::HistoryEntry(
+		std::string( _timestamp, static_cast<size_t>( TIMESTAMP_LENGTH ) ),
+		std::string( _it->utf8(), static_cast<size_t>( _it->utf8_length() ) )
+	);
 	_cacheValid = true;
 	return ( _entryCache );
 }
 
+Replxx::HistoryEntryView Replxx::HistoryScanImpl::view( void ) const {
+	return ( Replxx::HistoryEntryView( _timestamp, TIMESTAMP_LENGTH, _it->utf8(), _it->utf8_length() ) );
+}
+
+Replxx::HistoryMetadata const& Replxx::HistoryScanImpl::metadata( void ) const {
+	if ( ! _metadataCacheValid ) {
+		_entries.metadata( _it, _metadataCache );
+		_metadataCacheValid = true;
+	}
+	return ( _metadataCache );
+}
+
+/*
+ * If publishing is enabled scan is safe to use on any thread,
+ * it iterates over entries published most recently before the scan started.
+ */
 Replxx::HistoryScan::impl_t History::scan( void ) const {
+	published_t published( std::atomic_load( &_published ) );
+	if ( published ) {
+		return ( Replxx::HistoryScan::impl_t( new Replxx::HistoryScanImpl( std::move( published ) ), delete_ReplxxHistoryScanImpl ) );
+	}
 	return ( Replxx::HistoryScan::impl_t( new Replxx::HistoryScanImpl( _entries ), delete_ReplxxHistoryScanImpl ) );
 }
 
+/*
+ * Scan over entries with timestamps in [from_, to_) range,
+ * bounds of the range are found by binary search and entries are not copied.
+ */
+Replxx::HistoryScan::impl_t History::range( timestamp_t from_, timestamp_t to_ ) const {
+	Replxx::HistoryScan::impl_t impl( scan() );
+	impl->seek( from_, to_ );
+	return ( impl );
+}
+
+int History::published_size( void ) const {
+	published_t published( std::atomic_load( &_published ) );
+	return ( published ? published->size() : size() );
+}
+
+void History::set_publishing( bool publishing_ ) {
+	_publishing = publishing_;
+	if ( _publishing ) {
+		publish();
+	} else {
+		std::atomic_store( &_published, published_t() );
+	}
+}
+
+/*
+ * Called by the owning thread whenever history reaches a consistent state
+ * (after each history modifying API call and when input() returns).
+ */
+void History::publish( void ) {
+	if ( ! _publishing ) {
+		return;
+	}
+	std::shared_ptr<entries_t> published( std::make_shared<entries_t>() );
+	published->share( _entries );
+	std::atomic_store( &_published, published_t( std::move( published ) ) );
+}
+
 History::History( void )
 	: _entries()
+	, _locations()
+	, _index()
+	, _indexed( false )
+	, _staleIds( 0 )
+	, _scratches()
+	, _searchLevels()
+	, _prefixTree()
+	, _prefixIndexed( false )
+	, _frecencyTree()
+	, _frecencyIndexed( false )
+	, _fuzzyIndex()
+	, _fuzzyIndexed( false )
+	, _fuzzyStaleIds( 0 )
+	, _workerPool()
 	, _maxSize( REPLXX_DEFAULT_HISTORY_MAX_LEN )
 	, _current( _entries.begin() )
 	, _yankPos( _entries.end() )
 	, _previous( _entries.begin() )
 	, _recallMostRecent( false )
-	, _unique( true ) {
+	, _unique( true )
+	, _journalRatio( 0 )
+	, _journalPath()
+	, _journalOffset( -1 )
+	, _journalRecords( -1 )
+	, _journalId( 0 )
+	, _tombstones()
+	, _binary( false )
+	, _shared( false )
+	, _watcher()
+	, _published()
+	, _publishing( false ) {
 }
 
-void History::add( UnicodeString const& line, std::string const& when ) {
+namespace {
+
+/*
+ * Timestamp of the millisecond following given one.
+ */
+History::timestamp_t next_timestamp( History::timestamp_t timestamp_ ) {
+	if ( ( timestamp_ % 1000 ) < 999 ) {
+		return ( timestamp_ + 1 );
+	}
+	long long t( timestamp_ / 1000 );
+	int seconds( static_cast<int>( t % 100 ) + 1 );
+	t /= 100;
+	int minutes( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int hours( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int day( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int month( static_cast<int>( t % 100 ) );
+	long long year( t / 100 );
+	bool leap( ( ( year % 4 ) == 0 ) && ( ( ( year % 100 ) != 0 ) || ( ( year % 400 ) == 0 ) ) );
+	int days( month == 2 ? ( leap ? 29 : 28 ) : ( ( month == 4 ) || ( month == 6 ) || ( month == 9 ) || ( month == 11 ) ? 30 : 31 ) );
+	if ( seconds == 60 ) {
+		seconds = 0;
+		++ minutes;
+	}
+	if ( minutes == 60 ) {
+		minutes = 0;
+		++ hours;
+	}
+	if ( hours == 24 ) {
+		hours = 0;
+		++ day;
+	}
+	if ( day > days ) {
+		day = 1;
+		++ month;
+	}
+	if ( month > 12 ) {
+		month = 1;
+		++ year;
+	}
+	return ( ( ( ( ( ( year * 100 + month ) * 100 + day ) * 100 + hours ) * 100 + minutes ) * 100 + seconds ) * 1000 );
+}
+
+History::timestamp_t stamp_after( History::timestamp_t when_, History::timestamp_t latest_ ) {
+	return ( when_ > latest_ ? when_ : next_timestamp( latest_ ) );
+}
+
+/*
+ * Frecency of a text is a sum of weights of all its uses,
+ * weight of each use halves every FRECENCY_HALF_LIFE hours.
+ *
+ * Only relative order of frecencies matters, so instead of decaying all of them as time passes
+ * entries keep a rank: log2 of the sum of weights taken at a fixed point in time,
+ * i.e. log2( sum( 2^( t / FRECENCY_HALF_LIFE ) ) ) with t in hours since 1970,
+ * ranks never change as time passes and each new use updates only one entry.
+ */
+double const FRECENCY_HALF_LIFE( 24 * 7 );
+
+float frecency_rank( History::timestamp_t timestamp_ ) {
+	long long t( timestamp_ / 1000 );
+	int seconds( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int minutes( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int hours( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int day( static_cast<int>( t % 100 ) );
+	t /= 100;
+	int month( static_cast<int>( t % 100 ) );
+	long long year( t / 100 - ( month <= 2 ? 1 : 0 ) );
+	/* days since 1970-01-01 in proleptic Gregorian calendar */
+	long long era( ( year >= 0 ? year : year - 399 ) / 400 );
+	long long yearOfEra( year - era * 400 );
+	long long dayOfYear( ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1 );
+	long long days( era * 146097 + yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear - 719468 );
+	double h( static_cast<double>( days ) * 24 + hours + minutes / 60.0 + seconds / 3600.0 );
+	return ( static_cast<float>( std::max( h, 1.0 ) / FRECENCY_HALF_LIFE ) );
+}
+
+/*
+ * Rank of a sum of weights given their ranks, 0 stands for no uses.
+ */
+float frecency_add( float rank_, float use_ ) {
+	if ( rank_ <= 0 ) {
+		return ( use_ );
+	}
+	float hi( std::max( rank_, use_ ) );
+	float lo( std::min( rank_, use_ ) );
+	return ( hi + static_cast<float>( std::log2( 1.0 + std::exp2( lo - hi ) ) ) );
+}
+
+/*
+ * Entries loaded from history file have rank of a single use.
+ */
+float frecency_of( History::Entry const& entry_ ) {
+	return ( entry_.frecency() > 0 ? entry_.frecency() : frecency_rank( entry_.timestamp() ) );
+}
+
+/*
+ * Ranks are positive so their bit patterns are ordered as ranks are.
+ */
+PrefixTree::key_t frecency_key( History::entries_t::const_iterator it_ ) {
+	float rank( it_->frecency() );
+	std::uint32_t bits( 0 );
+	memcpy( &bits, &rank, sizeof ( bits ) );
+	return ( ( static_cast<PrefixTree::key_t>( bits ) << 32 ) | it_.id() );
+}
+
+}
+
+/*
+ * Timestamp given in "YYYY-MM-DD hh:mm:ss.mmm" form,
+ * omitted trailing components are taken as zeros (e.g. "2024-05" is 2024-05-00 00:00:00.000).
+ */
+History::timestamp_t History::parse_timestamp( std::string const& timestamp_ ) {
+	static int const DIGITS( 17 );
+	timestamp_t val( 0 );
+	int digits( 0 );
+	for ( char c : timestamp_ ) {
+		if ( isdigit( c ) && ( digits < DIGITS ) ) {
+			val = val * 10 + ( c - '0' );
+			++ digits;
+		}
+	}
+	if ( digits == 0 ) {
+		return ( 0 );
+	}
+	for ( ; digits < DIGITS; ++ digits ) {
+		val *= 10;
+	}
+	return ( val );
+}
+
+/*
+ * Timestamp of a new entry that replaces an entry stamped with `replaced_` (0 if none).
+ *
+ * New entries are stamped later than the last entry, so entries stay in timestamp order
+ * even if the clock did not advance in the meantime (or if the last entry was stamped in the future).
+ * Tombstone of the replaced record is matched by text and timestamp,
+ * so the new entry is stamped later than the replaced one too.
+ */
+History::timestamp_t History::stamp( timestamp_t when_, timestamp_t replaced_ ) {
+	return ( stamp_after( when_, std::max( replaced_, _entries.empty() ? 0 : _entries.back().timestamp() ) ) );
+}
+
+History::timestamp_t History::now( long long shift_ ) {
+	std::string now( now_ms_str( shift_ ) );
+	return ( timestamp_to_int( now.data(), static_cast<int>( now.length() ) ) );
+}
+
+void History::add( UnicodeString const& line, timestamp_t when, Replxx::HistoryMetadata const* metadata_ ) {
 	if ( _maxSize <= 0 ) {
 		return;
 	}
+	fingerprint_t fp( fingerprint( line ) );
+	float use( frecency_rank( when ) );
 	if ( ! _entries.empty() && ( line == _entries.back().text() ) ) {
-		_entries.back() = Entry( now_ms_str(), line );
+		float frecency( frecency_add( frecency_of( _entries.back() ), use ) );
+		add_tombstone( _entries.back() );
+		replace_last( line, fp, frecency );
+		if ( metadata_ ) {
+			_entries.set_metadata( last(), *metadata_ );
+		}
 		return;
 	}
-	remove_duplicate( line );
+	locations_t::iterator location( find_location( line, fp ) );
+	float frecency( frecency_add( location != _locations.end() ? frecency_of( *location->second ) : 0.0f, use ) );
+	when = stamp( when, remove_duplicate( line, fp ) );
 	trim_to_max_size();
 	_entries.emplace_back( when, line );
-	_locations.insert( make_pair( line, last() ) );
+	entries_t::iterator it( last() );
+	it->set_frecency( frecency );
+	if ( metadata_ ) {
+		_entries.set_metadata( it, *metadata_ );
+	}
+	register_entry( it );
+	set_location( it, fp );
 	if ( _current == _entries.end() ) {
 		_current = last();
 	}
 	_yankPos = _entries.end();
 }
 
+/*
+ * Add many lines at once, with the same effect as adding them one by one.
+ *
+ * Lines are deduplicated in one pass over the batch,
+ * lines that would be trimmed anyway are never stored,
+ * entries replaced by (or trimmed to make room for) lines of the batch
+ * are removed in one sweep and iterators are fixed up once.
+ */
+void History::add_batch( std::vector<UnicodeString> const& lines_, timestamp_t when_ ) {
+	if ( ( _maxSize <= 0 ) || lines_.empty() ) {
+		return;
+	}
+	int count( static_cast<int>( lines_.size() ) );
+	std::vector<fingerprint_t> fingerprints;
+	fingerprints.reserve( lines_.size() );
+	for ( UnicodeString const& line : lines_ ) {
+		fingerprints.push_back( fingerprint( line ) );
+	}
+	std::vector<int> added;
+	added.reserve( lines_.size() );
+	/*
+	 * Frecency of each added line combines frecency of the entry it replaces
+	 * with all its uses in the batch.
+	 */
+	std::vector<float> priors( lines_.size(), 0.0f );
+	std::vector<int> uses( lines_.size(), 1 );
+	timestamp_t replaced( 0 );
+	if ( _unique ) {
+		std::unordered_multimap<fingerprint_t, int> seen;
+		seen.reserve( lines_.size() );
+		for ( int i( count - 1 ); i >= 0; -- i ) {
+			UnicodeString const& line( lines_[static_cast<size_t>( i )] );
+			fingerprint_t fp( fingerprints[static_cast<size_t>( i )] );
+			bool duplicate( false );
+			for ( std::pair<std::unordered_multimap<fingerprint_t, int>::const_iterator, std::unordered_multimap<fingerprint_t, int>::const_iterator> r( seen.equal_range( fp ) ); r.first != r.second; ++ r.first ) {
+				if ( lines_[static_cast<size_t>( r.first->second )] == line ) {
+					++ uses[static_cast<size_t>( r.first->second )];
+					duplicate = true;
+					break;
+				}
+			}
+			if ( duplicate ) {
+				continue;
+			}
+			seen.emplace( fp, i );
+			added.push_back( i );
+			locations_t::iterator location( find_location( line, fp ) );
+			if ( location != _locations.end() ) {
+				priors[static_cast<size_t>( i )] = frecency_of( *location->second );
+				replaced = std::max( replaced, location->second->timestamp() );
+				add_tombstone( *location->second );
+				discard( location->second );
+			}
+		}
+		std::reverse( added.begin(), added.end() );
+	} else {
+		if ( ! _entries.empty() && ( _entries.back().text() == lines_.front() ) ) {
+			priors.front() = frecency_of( _entries.back() );
+			replaced = _entries.back().timestamp();
+			add_tombstone( _entries.back() );
+			discard( last() );
+		}
+		for ( int i( 0 ); i < count; ++ i ) {
+			if ( ( ( i + 1 ) == count ) || ( lines_[static_cast<size_t>( i )] != lines_[static_cast<size_t>( i + 1 )] ) ) {
+				added.push_back( i );
+			} else {
+				priors[static_cast<size_t>( i + 1 )] = priors[static_cast<size_t>( i )];
+				uses[static_cast<size_t>( i + 1 )] += uses[static_cast<size_t>( i )];
+			}
+		}
+	}
+	/*
+	 * Adding a line trims history to its maximum size before the line is stored,
+	 * so up to _maxSize + 1 entries remain.
+	 */
+	long long capacity( static_cast<long long>( _maxSize ) + 1 );
+	if ( static_cast<long long>( added.size() ) > capacity ) {
+		added.erase( added.begin(), added.end() - capacity );
+	}
+	for ( long long excess( size() + static_cast<long long>( added.size() ) - capacity ); excess > 0; -- excess ) {
+		discard( _entries.begin() );
+	}
+	/*
+	 * All lines of the batch share one timestamp,
+	 * later than timestamps of all entries they replace.
+	 */
+	when_ = stamp( when_, replaced );
+	float use( frecency_rank( when_ ) );
+	for ( int i : added ) {
+		size_t idx( static_cast<size_t>( i ) );
+		locations_t::iterator location( find_location( lines_[idx], fingerprints[idx] ) );
+		float prior( ( priors[idx] <= 0 ) && ( location != _locations.end() ) ? frecency_of( *location->second ) : priors[idx] );
+		_entries.emplace_back( when_, lines_[idx] );
+		entries_t::iterator it( last() );
+		it->set_frecency( frecency_add( prior, use + static_cast<float>( std::log2( uses[idx] ) ) ) );
+		register_entry( it );
+		if ( location != _locations.end() ) {
+			location->second = it;
+		} else {
+			_locations.emplace( fingerprints[idx], it );
+		}
+	}
+	settle();
+}
+
 #ifndef _WIN32
+/*
+ * Exclusive access to a history file, held by writers for the whole save
+ * and by readers for as long as they read memory mapped file content
+ * (the file is truncated when it is rewritten in place,
+ * reading a mapped page past the new end of the file raises SIGBUS).
+ *
+ * Lock files are locked per process, so threads of one process
+ * (e.g. background history writer) are serialized by a mutex first.
+ */
 class FileLock {
+	std::unique_lock<std::mutex> _threadLock;
 	std::string _path;
 	int _lockFd;
+	bool _locked;
+	static std::mutex& thread_mutex( void ) {
+		static std::mutex threadMutex;
+		return ( threadMutex );
+	}
 public:
+	/*
+	 * Lock file is removed by the process releasing the lock,
+	 * a lock acquired on a file that was removed in the meantime is retried.
+	 * Lock file is removed and unlocked only if the lock was really acquired.
+	 */
 	FileLock( std::string const& name_ )
-		: _path( name_ + ".lock" )
-		, _lockFd( ::open( _path.c_str(), O_CREAT | O_RDWR, 0600 ) ) {
-		static_cast<void>( ::lockf( _lockFd, F_LOCK, 0 ) == 0 );
+		: _threadLock( thread_mutex() )
+		, _path( name_ + ".lock" )
+		, _lockFd( -1 )
+		, _locked( false ) {
+		while ( ! _locked ) {
+			_lockFd = ::open( _path.c_str(), O_CREAT | O_RDWR, 0600 );
+			if ( _lockFd < 0 ) {
+				break;
+			}
+			int status( 0 );
+			do {
+				status = ::lockf( _lockFd, F_LOCK, 0 );
+			} while ( ( status != 0 ) && ( errno == EINTR ) );
+			struct stat locked;
+			struct stat current;
+			if ( ( status != 0 ) || ( ::fstat( _lockFd, &locked ) != 0 ) ) {
+				::close( _lockFd );
+				_lockFd = -1;
+				break;
+			}
+			_locked = ( ::stat( _path.c_str(), &current ) == 0 )
+				&& ( locked.st_dev == current.st_dev )
+				&& ( locked.st_ino == current.st_ino );
+			if ( ! _locked ) {
+				::close( _lockFd );
+				_lockFd = -1;
+			}
+		}
 	}
 	~FileLock( void ) {
+		if ( ! _locked ) {
+			return;
+		}
+		::unlink( _path.c_str() );
 		static_cast<void>( ::lockf( _lockFd, F_ULOCK, 0 ) == 0 );
 		::close( _lockFd );
-		::unlink( _path.c_str() );
 		return;
 	}
 };
@@ -122,113 +608,1178 @@ public:
 
 bool History::save( std::string const& filename, bool sync_ ) {
 #ifndef _WIN32
-	mode_t old_umask = umask( S_IXUSR | S_IRWXG | S_IRWXO );
 	FileLock fileLock( filename );
 #endif
+	if ( ( _journalRatio > 0 ) && journal_save( filename, sync_ ) ) {
+		return ( true );
+	}
 	entries_t entries;
 	locations_t locations;
+	scratches_t scratches;
 	if ( ! sync_ ) {
 		entries.swap( _entries );
 		locations.swap( _locations );
+		scratches.swap( _scratches );
 		_entries = entries;
 		reset_iters();
 	}
-	/* scope for ifstream object auto-close */ {
-		ifstream histFile( filename );
+	entries_t tombstones;
+	long long offset( 0 );
+	if ( do_load( filename, offset, _entries, tombstones ) > 0 ) {
+		remove_tombstoned( _entries, tombstones );
+	}
+	sort();
+	remove_duplicates();
+	trim_to_max_size();
+	std::string path( filename );
+#ifndef _WIN32
+	/*
+	 * In journal mode the compacted history file is replaced atomically
+	 * so other processes tailing it can notice that it was rewritten.
+	 */
+	if ( _journalRatio > 0 ) {
+		path.append( ".compact" );
+	}
+#endif
+	bool saved( false );
+	/* scope for ofstream object auto-close */ {
+#ifndef _WIN32
+		/*
+		 * History file is readable only by its owner,
+		 * it is created with explicit mode as process umask is shared by all threads.
+		 */
+		int fd( ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR ) );
+		if ( fd >= 0 ) {
+			static_cast<void>( ::fchmod( fd, S_IRUSR | S_IWUSR ) == 0 );
+			::close( fd );
+		}
+#endif
+		ofstream histFile( path, _binary ? ios::out | ios::binary : ios::out );
 		if ( histFile ) {
-			do_load( histFile );
+			if ( _binary ) {
+				save_binary( histFile );
+			} else {
+				save( histFile );
+			}
+			histFile.close();
+			saved = ! histFile.fail();
+		}
+	}
+#ifndef _WIN32
+	if ( ( path != filename ) && ( ! saved || ( ::rename( path.c_str(), filename.c_str() ) != 0 ) ) ) {
+		::unlink( path.c_str() );
+		saved = false;
+	}
+#endif
+	long long records( std::count_if( _entries.begin(), _entries.end(), []( Entry const& e ) { return ( ! e.text().is_empty() ); } ) );
+	if ( ! sync_ ) {
+		_entries = std::move( entries );
+		_locations = std::move( locations );
+		_scratches = std::move( scratches );
+		reindex();
+	}
+	reset_iters();
+	if ( ! saved ) {
+		return ( false );
+	}
+	journal_reset( filename, sync_ ? 0 : -1, _binary ? -1 : records );
+	return ( true );
+}
+
+namespace {
+
+/*
+ * Entry metadata is stored in a record line of its own between the timestamp line
+ * and the text of the entry, the line starts with a carriage return,
+ * so it is skipped by readers that do not know it (they cut lines at the first carriage return
+ * and ignore empty lines), and it never looks like a text of an entry.
+ */
+char const METADATA_MARKER[] = "\r#@# ";
+int const METADATA_MARKER_LENGTH( sizeof ( METADATA_MARKER ) - 1 );
+char const METADATA_EXIT_STATUS[] = "status";
+char const METADATA_DURATION[] = "duration";
+char const METADATA_DIRECTORY[] = "directory";
+
+/*
+ * Write given UTF-8 text with new lines replaced by ETB characters.
+ */
+void save_line( std::ostream& histFile_, char const* p, char const* e ) {
+	while ( p != e ) {
+		char const* eol( static_cast<char const*>( memchr( p, '\n', static_cast<size_t>( e - p ) ) ) );
+		if ( ! eol ) {
+			eol = e;
+		}
+		histFile_.write( p, eol - p );
+		if ( eol != e ) {
+			histFile_.put( static_cast<char>( ETB ) );
+			++ eol;
+		}
+		p = eol;
+	}
+}
+
+/*
+ * Entry text is written from its UTF-8 form,
+ * new lines in the text are written as ETB characters.
+ *
+ * Entry metadata record holds space separated `name=value` fields,
+ * directory field goes last as it extends to the end of the line.
+ */
+void save_entry( std::ostream& histFile_, char const* marker_, History::entries_t::const_iterator it_ ) {
+	char when[TIMESTAMP_LENGTH];
+	timestamp_from_int( when, it_->timestamp() );
+	histFile_ << marker_;
+	histFile_.write( when, TIMESTAMP_LENGTH );
+	histFile_.put( '\n' );
+	Replxx::HistoryMetadata metadata;
+	if ( it_.owner()->metadata( it_, metadata ) ) {
+		char const* separator( METADATA_MARKER );
+		if ( metadata.has( Replxx::HistoryMetadata::EXIT_STATUS ) ) {
+			histFile_ << separator << METADATA_EXIT_STATUS << '=' << metadata.exit_status();
+			separator = " ";
+		}
+		if ( metadata.has( Replxx::HistoryMetadata::DURATION ) ) {
+			histFile_ << separator << METADATA_DURATION << '=' << metadata.duration();
+			separator = " ";
+		}
+		if ( metadata.has( Replxx::HistoryMetadata::DIRECTORY ) ) {
+			std::string const& directory( metadata.directory() );
+			histFile_ << separator << METADATA_DIRECTORY << '=';
+			save_line( histFile_, directory.data(), directory.data() + directory.length() );
+		}
+		histFile_.put( '\n' );
+	}
+	save_line( histFile_, it_->utf8(), it_->utf8() + it_->utf8_length() );
+	histFile_.put( '\n' );
+}
+
+}
+
+void History::save( std::ostream& histFile ) {
+	_scratches.clear();
+	for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		if ( ! it->text().is_empty() ) {
+			save_entry( histFile, "### ", it );
+		}
+	}
+	histFile.flush();
+}
+
+/*
+ * Fast path of journal mode history persistence.
+ *
+ * Appends entries added since previous save (and tombstones of entries removed since then)
+ * to the history file, in synchronization mode records appended to the file
+ * by other processes since previous read are merged into in-memory history.
+ *
+ * Returns false if full rewrite of the history file is required.
+ */
+bool History::journal_save( std::string const& filename_, bool sync_ ) {
+#ifdef _WIN32
+	static_cast<void>( filename_ );
+	static_cast<void>( sync_ );
+	return ( false );
+#else
+	if ( _binary || ( _journalRecords < 0 ) || ( filename_ != _journalPath ) ) {
+		return ( false );
+	}
+	struct stat st;
+	if ( ( ::stat( filename_.c_str(), &st ) != 0 ) || ( static_cast<unsigned long long>( st.st_ino ) != _journalId ) ) {
+		return ( false );
+	}
+	long long fileSize( st.st_size );
+	if ( sync_ && ( ( _journalOffset < 0 ) || ( _journalOffset > fileSize ) ) ) {
+		return ( false );
+	}
+	if ( fileSize > 0 ) {
+		/*
+		 * Records appended after unterminated last line would be glued to it,
+		 * such file is rewritten as a whole.
+		 */
+		char last( 0 );
+		int fd( ::open( filename_.c_str(), O_RDONLY ) );
+		bool terminated( ( fd >= 0 ) && ( ::pread( fd, &last, 1, fileSize - 1 ) == 1 ) && ( last == '\n' ) );
+		if ( fd >= 0 ) {
+			::close( fd );
+		}
+		if ( ! terminated ) {
+			return ( false );
+		}
+	}
+	long long pending( static_cast<long long>( _tombstones.size() ) + _entries.unsaved_size() );
+	if ( ( _journalRecords + pending ) > ( static_cast<long long>( _journalRatio ) * std::max( size(), 1 ) ) ) {
+		return ( false );
+	}
+	/*
+	 * Unsaved entries are usually at the end of history,
+	 * but records merged from shared history file may be interleaved with them,
+	 * so the oldest unsaved entry is found by walking back from the end.
+	 */
+	entries_t::iterator unsaved( _entries.end() );
+	for ( int left( _entries.unsaved_size() ); left > 0; ) {
+		-- unsaved;
+		if ( ! unsaved->persisted() ) {
+			-- left;
+		}
+	}
+	entries_t tail;
+	entries_t tombstones;
+	if ( sync_ && ( _journalOffset < fileSize ) ) {
+		long long offset( _journalOffset );
+		long long records( do_load( filename_, offset, tail, tombstones ) );
+		if ( records < 0 ) {
+			return ( false );
+		}
+		_journalRecords += records;
+	}
+	/* scope for ofstream object auto-close */ {
+		ofstream histFile( filename_, ios::app );
+		if ( ! histFile ) {
+			return ( false );
+		}
+		long long records( static_cast<long long>( _tombstones.size() ) );
+		for ( entries_t::const_iterator it( _tombstones.begin() ), end( _tombstones.end() ); it != end; ++ it ) {
+			save_entry( histFile, "#!# ", it );
+		}
+		for ( entries_t::iterator it( unsaved ), end( _entries.end() ); it != end; ++ it ) {
+			if ( it->persisted() ) {
+				continue;
+			}
+			_scratches.erase( it.id() );
+			if ( ! it->text().is_empty() ) {
+				save_entry( histFile, "### ", it );
+				++ records;
+			}
+			_entries.set_persisted( it );
+		}
+		histFile.flush();
+		if ( ! histFile ) {
+			return ( false );
+		}
+		_journalRecords += records;
+	}
+	_tombstones.clear();
+	long long newSize( ( ::stat( filename_.c_str(), &st ) == 0 ) ? st.st_size : -1 );
+	if ( sync_ ) {
+		merge_tail( tail, tombstones );
+		reset_iters();
+		_journalOffset = newSize;
+	} else if ( _journalOffset == fileSize ) {
+		_journalOffset = newSize;
+	}
+	return ( true );
+#endif
+}
+
+/*
+ * Record that in-memory history is fully persisted in given file.
+ *
+ * offset_ is a size of history file reflected by in-memory history,
+ * 0 means current size of the file, -1 means that in-memory history
+ * does not reflect file content.
+ */
+void History::journal_reset( std::string const& filename_, long long offset_, long long records_ ) {
+	_journalPath = filename_;
+	_journalOffset = -1;
+	_journalRecords = records_;
+	_journalId = 0;
+	_tombstones.clear();
+	_entries.set_all_persisted();
+#ifndef _WIN32
+	struct stat st;
+	if ( ::stat( filename_.c_str(), &st ) != 0 ) {
+		_journalRecords = -1;
+		return;
+	}
+	_journalId = static_cast<unsigned long long>( st.st_ino );
+	if ( offset_ >= 0 ) {
+		_journalOffset = offset_ > 0 ? offset_ : static_cast<long long>( st.st_size );
+	}
+#else
+	static_cast<void>( offset_ );
+#endif
+	watch();
+}
+
+void History::watch( void ) {
+	if ( _shared && ! _journalPath.empty() ) {
+		_watcher.watch( _journalPath );
+	} else {
+		_watcher.stop();
+	}
+}
+
+/*
+ * Merge records appended to shared history file by other processes.
+ *
+ * errno is preserved, as it is a part of input() interface.
+ *
+ * Returns true if history was modified.
+ */
+bool History::refresh( void ) {
+	int savedErrno( errno );
+	bool refreshed( _shared && _watcher.changed() && tail() );
+	errno = savedErrno;
+	return ( refreshed );
+}
+
+/*
+ * Read records appended to the journal file since it was last read,
+ * the whole file is read if it was replaced (e.g. compacted by another process)
+ * or if in-memory history does not reflect its content.
+ */
+bool History::tail( void ) {
+#ifdef _WIN32
+	return ( false );
+#else
+	if ( _binary ) {
+		return ( false );
+	}
+	FileLock fileLock( _journalPath );
+	struct stat st;
+	if ( ::stat( _journalPath.c_str(), &st ) != 0 ) {
+		return ( false );
+	}
+	long long offset( _journalOffset );
+	bool replaced( ( static_cast<unsigned long long>( st.st_ino ) != _journalId ) || ( offset < 0 ) || ( offset > st.st_size ) );
+	if ( replaced ) {
+		offset = 0;
+	} else if ( offset == st.st_size ) {
+		return ( false );
+	}
+	entries_t tail;
+	entries_t tombstones;
+	long long records( do_load( _journalPath, offset, tail, tombstones ) );
+	if ( ( records < 0 ) || ( offset < 0 ) ) {
+		return ( false );
+	}
+	if ( replaced ) {
+		_journalId = static_cast<unsigned long long>( st.st_ino );
+		_journalRecords = records;
+	} else if ( _journalRecords >= 0 ) {
+		_journalRecords += records;
+	}
+	_journalOffset = offset;
+	return ( merge_tail( tail, tombstones ) );
+#endif
+}
+
+/*
+ * Merge records read from the journal file into history
+ * in time proportional to number of read records.
+ *
+ * Records already present in history (e.g. written by this process) are skipped,
+ * records out of timestamp order force full sort of history.
+ *
+ * Returns true if history was modified.
+ */
+bool History::merge_tail( entries_t& tail_, entries_t const& tombstones_ ) {
+	remove_tombstoned( tail_, tombstones_ );
+	bool modified( false );
+	for ( Entry const& t : tombstones_ ) {
+		locations_t::iterator l( find_location( t.text() ) );
+		if ( ( l != _locations.end() ) && ( l->second->timestamp() == t.timestamp() ) ) {
+			erase( l->second );
+			modified = true;
+		}
+	}
+	bool ordered( true );
+	for ( entries_t::iterator t( tail_.begin() ), end( tail_.end() ); t != end; ++ t ) {
+		Entry& e( *t );
+		locations_t::iterator l( find_location( e.text() ) );
+		if ( l != _locations.end() ) {
+			if ( l->second->timestamp() == e.timestamp() ) {
+				continue;
+			}
+			if ( _unique ) {
+				if ( e < *l->second ) {
+					continue;
+				}
+				erase( l->second );
+			}
+		}
+		if ( ! _entries.empty() && ( e < _entries.back() ) ) {
+			ordered = false;
+		}
+		tail_.set_persisted( t );
+		_entries.push_back( t );
+		entries_t::iterator it( last() );
+		register_entry( it );
+		set_location( it );
+		modified = true;
+	}
+	if ( ! modified ) {
+		return ( false );
+	}
+	if ( ! ordered ) {
+		sort();
+	}
+	trim_to_max_size();
+	reset_iters();
+	return ( true );
+}
+
+void History::add_tombstone( Entry const& entry_ ) {
+	if ( ( _journalRatio > 0 ) && entry_.persisted() ) {
+		_tombstones.push_back( entry_ );
+	}
+}
+
+void History::remove_tombstoned( entries_t& entries_, entries_t const& tombstones_ ) {
+	if ( tombstones_.empty() ) {
+		return;
+	}
+	typedef std::unordered_multimap<UnicodeStringView, timestamp_t> dead_t;
+	dead_t dead;
+	for ( Entry const& t : tombstones_ ) {
+		dead.insert( make_pair( t.text(), t.timestamp() ) );
+	}
+	for ( entries_t::iterator it( entries_.begin() ); it != entries_.end(); ) {
+		std::pair<dead_t::const_iterator, dead_t::const_iterator> r( dead.equal_range( it->text() ) );
+		if ( std::any_of( r.first, r.second, [&it]( dead_t::value_type const& d ) { return ( d.second == it->timestamp() ); } ) ) {
+			it = entries_.erase( it );
+		} else {
+			++ it;
+		}
+	}
+}
+
+namespace {
+
+bool is_field( char const* name_, char const* p_, char const* e_ ) {
+	return ( ( static_cast<size_t>( e_ - p_ ) == strlen( name_ ) ) && ( strncmp( name_, p_, static_cast<size_t>( e_ - p_ ) ) == 0 ) );
+}
+
+bool parse_number( char const* p_, char const* e_, long long& val_ ) {
+	bool negative( ( p_ != e_ ) && ( *p_ == '-' ) );
+	if ( negative ) {
+		++ p_;
+	}
+	if ( p_ == e_ ) {
+		return ( false );
+	}
+	val_ = 0;
+	for ( ; p_ != e_; ++ p_ ) {
+		if ( ! isdigit( *p_ ) ) {
+			return ( false );
+		}
+		val_ = val_ * 10 + ( *p_ - '0' );
+	}
+	if ( negative ) {
+		val_ = -val_;
+	}
+	return ( true );
+}
+
+/*
+ * Parse `name=value` metadata fields written by save_entry().
+ */
+bool parse_metadata( char const* p_, char const* e_, Replxx::HistoryMetadata& metadata_ ) {
+	metadata_.clear();
+	while ( p_ != e_ ) {
+		char const* eq( static_cast<char const*>( memchr( p_, '=', static_cast<size_t>( e_ - p_ ) ) ) );
+		if ( ! eq ) {
+			return ( false );
+		}
+		if ( is_field( METADATA_DIRECTORY, p_, eq ) ) {
+			std::string directory( eq + 1, e_ );
+			std::replace( directory.begin(), directory.end(), static_cast<char>( ETB ), '\n' );
+			metadata_.set_directory( directory );
+			break;
+		}
+		char const* end( static_cast<char const*>( memchr( eq, ' ', static_cast<size_t>( e_ - eq ) ) ) );
+		if ( ! end ) {
+			end = e_;
+		}
+		long long val( 0 );
+		if ( ! parse_number( eq + 1, end, val ) ) {
+			return ( false );
+		}
+		if ( is_field( METADATA_EXIT_STATUS, p_, eq ) ) {
+			metadata_.set_exit_status( static_cast<int>( val ) );
+		} else if ( is_field( METADATA_DURATION, p_, eq ) ) {
+			metadata_.set_duration( val );
+		} else {
+			return ( false );
+		}
+		p_ = end != e_ ? end + 1 : end;
+	}
+	return ( true );
+}
+
+/*
+ * Entry metadata record, possibly followed by carriage return of CR LF line ending.
+ */
+bool is_metadata( char const* s, int len_, Replxx::HistoryMetadata& metadata_ ) {
+	if ( ( len_ > 0 ) && ( s[len_ - 1] == '\r' ) ) {
+		-- len_;
+	}
+	return (
+		( len_ >= METADATA_MARKER_LENGTH )
+		&& ( strncmp( s, METADATA_MARKER, static_cast<size_t>( METADATA_MARKER_LENGTH ) ) == 0 )
+		&& parse_metadata( s + METADATA_MARKER_LENGTH, s + len_, metadata_ )
+	);
+}
+
+bool is_timestamp( char const* s, int len_, char marker_ = '#' ) {
+	static char const TIMESTAMP_PATTERN[] = "### dddd-dd-dd dd:dd:dd.ddd";
+	static int const TIMESTAMP_LENGTH( sizeof ( TIMESTAMP_PATTERN ) - 1 );
+	if ( ( len_ != TIMESTAMP_LENGTH ) || ( s[1] != marker_ ) ) {
+		return ( false );
+	}
+	for ( int i( 0 ); i < TIMESTAMP_LENGTH; ++ i ) {
+		if ( i == 1 ) {
+			continue;
+		} else if ( TIMESTAMP_PATTERN[i] == 'd' ) {
+			if ( ! isdigit( s[i] ) ) {
+				return ( false );
+			}
+		} else if ( s[i] != TIMESTAMP_PATTERN[i] ) {
+			return ( false );
+		}
+	}
+	return ( true );
+}
+
+/*
+ * Tombstone records (written in journal mode) mark entries
+ * that were removed from history as duplicates.
+ */
+bool is_tombstone( char const* s, int len_ ) {
+	return ( is_timestamp( s, len_, '!' ) );
+}
+
+/*
+ * Interprets consecutive lines of history file.
+ */
+class HistoryParser {
+	History::entries_t& _entries;
+	History::entries_t& _tombstones;
+	History::timestamp_t _when;
+	UnicodeString _text;
+	Replxx::HistoryMetadata _metadata;
+	bool _tombstone;
+	bool _pending;
+	long long _records;
+public:
+	HistoryParser( History::entries_t& entries_, History::entries_t& tombstones_ )
+		: _entries( entries_ )
+		, _tombstones( tombstones_ )
+		, _when( 0 )
+		, _text()
+		, _metadata()
+		, _tombstone( false )
+		, _pending( false )
+		, _records( 0 ) {
+	}
+	void line( char const* data_, int len_ ) {
+		Replxx::HistoryMetadata metadata;
+		if ( _pending && is_metadata( data_, len_, metadata ) ) {
+			_metadata = metadata;
+			return;
+		}
+		char const* eol( static_cast<char const*>( memchr( data_, '\r', static_cast<size_t>( len_ ) ) ) );
+		if ( eol ) {
+			len_ = static_cast<int>( eol - data_ );
+		}
+		if ( is_timestamp( data_, len_ ) || is_tombstone( data_, len_ ) ) {
+			_when = timestamp_to_int( data_ + 4, TIMESTAMP_LENGTH );
+			_metadata.clear();
+			_tombstone = data_[1] == '!';
+			_pending = true;
+			return;
+		}
+		if ( len_ > 0 ) {
+			_text.assign( data_, len_ );
+			std::replace( _text.begin(), _text.end(), char32_t( ETB ), char32_t( '\n' ) );
+			( _tombstone ? _tombstones : _entries ).emplace_back( _when, _text );
+			if ( ! _tombstone && ( _metadata.fields() != 0 ) ) {
+				History::entries_t::iterator it( _entries.end() );
+				_entries.set_metadata( -- it, _metadata );
+				_metadata.clear();
+			}
+			_tombstone = false;
+			_pending = false;
+			++ _records;
+		}
+	}
+	long long records( void ) const {
+		return ( _records );
+	}
+	/*
+	 * Timestamp line was read but text of the record was not read yet.
+	 */
+	bool pending( void ) const {
+		return ( _pending );
+	}
+};
+
+/*
+ * Read only view of whole file content.
+ *
+ * The file is memory mapped if possible, otherwise it is read into a buffer.
+ */
+class MappedFile {
+	char const* _data;
+	long long _size;
+	bool _mapped;
+	std::vector<char> _buffer;
+public:
+	MappedFile( std::string const& path_ )
+		: _data( nullptr )
+		, _size( -1 )
+		, _mapped( false )
+		, _buffer() {
+#ifndef _WIN32
+		int fd( ::open( path_.c_str(), O_RDONLY ) );
+		if ( fd < 0 ) {
+			return;
+		}
+		struct stat st;
+		if ( ::fstat( fd, &st ) == 0 ) {
+			_size = st.st_size;
+		}
+		if ( _size > 0 ) {
+			void* data( ::mmap( nullptr, static_cast<size_t>( _size ), PROT_READ, MAP_PRIVATE, fd, 0 ) );
+			if ( data != MAP_FAILED ) {
+				::madvise( data, static_cast<size_t>( _size ), MADV_SEQUENTIAL );
+				_data = static_cast<char const*>( data );
+				_mapped = true;
+			}
+		}
+		::close( fd );
+		if ( _mapped || ( _size <= 0 ) ) {
+			return;
+		}
+#endif
+		ifstream file( path_, ios::binary );
+		if ( ! file ) {
+			_size = -1;
+			return;
+		}
+		_buffer.assign( istreambuf_iterator<char>( file ), istreambuf_iterator<char>() );
+		_data = _buffer.data();
+		_size = static_cast<long long>( _buffer.size() );
+	}
+	~MappedFile( void ) {
+#ifndef _WIN32
+		if ( _mapped ) {
+			::munmap( const_cast<char*>( _data ), static_cast<size_t>( _size ) );
+		}
+#endif
+	}
+	bool is_open( void ) const {
+		return ( _size >= 0 );
+	}
+	char const* data( void ) const {
+		return ( _data );
+	}
+	long long size( void ) const {
+		return ( _size );
+	}
+private:
+	MappedFile( MappedFile const& ) = delete;
+	MappedFile& operator = ( MappedFile const& ) = delete;
+};
+
+/*
+ * Binary history file format (all integers are little endian):
+ *
+ * header:  "RPLXHIST" magic, u32 version, u32 reserved
+ * records: i64 timestamp, u32 UTF-8 text length, UTF-8 text
+ * index:   u64 offset of each record
+ * trailer: u64 record count, u64 index offset, "RPLXHIST" magic
+ *
+ * Timestamps are stored as YYYYMMDDhhmmssmmm decimal numbers,
+ * records are stored in timestamp order.
+ *
+ * In version 2 the highest bit of text length marks records followed by entry metadata:
+ * u8 field mask, i32 exit status, i64 duration, u32 UTF-8 directory length, UTF-8 directory
+ * (each value present only if its field is set).
+ * Version 1 is written if no entry has metadata.
+ */
+char const BINARY_HISTORY_MAGIC[] = "RPLXHIST";
+int const BINARY_HISTORY_MAGIC_SIZE( sizeof ( BINARY_HISTORY_MAGIC ) - 1 );
+unsigned long long const BINARY_HISTORY_VERSION( 1 );
+unsigned long long const BINARY_HISTORY_METADATA_VERSION( 2 );
+unsigned long long const BINARY_HISTORY_METADATA_BIT( 0x80000000ULL );
+long long const BINARY_HISTORY_HEADER_SIZE( BINARY_HISTORY_MAGIC_SIZE + 8 );
+long long const BINARY_HISTORY_RECORD_HEADER_SIZE( 12 );
+long long const BINARY_HISTORY_TRAILER_SIZE( 16 + BINARY_HISTORY_MAGIC_SIZE );
+
+unsigned long long read_le( char const* data_, int size_ ) {
+	unsigned long long val( 0 );
+	for ( int i( size_ - 1 ); i >= 0; -- i ) {
+		val <<= 8;
+		val |= static_cast<unsigned char>( data_[i] );
+	}
+	return ( val );
+}
+
+void write_le( std::ostream& out_, unsigned long long val_, int size_ ) {
+	char buf[8];
+	for ( int i( 0 ); i < size_; ++ i ) {
+		buf[i] = static_cast<char>( val_ & 0xff );
+		val_ >>= 8;
+	}
+	out_.write( buf, size_ );
+}
+
+bool is_binary_history( char const* data_, long long size_ ) {
+	return ( ( size_ >= BINARY_HISTORY_HEADER_SIZE ) && ( memcmp( data_, BINARY_HISTORY_MAGIC, BINARY_HISTORY_MAGIC_SIZE ) == 0 ) );
+}
+
+/*
+ * Load metadata block of binary history record starting at given offset,
+ * return offset past the block or -1 if the block is malformed.
+ */
+long long load_binary_metadata( char const* data_, long long end_, long long offset_, Replxx::HistoryMetadata& metadata_ ) {
+	metadata_.clear();
+	if ( ( offset_ + 1 ) > end_ ) {
+		return ( -1 );
+	}
+	int fields( static_cast<int>( read_le( data_ + offset_, 1 ) ) );
+	++ offset_;
+	if ( fields & Replxx::HistoryMetadata::EXIT_STATUS ) {
+		if ( ( offset_ + 4 ) > end_ ) {
+			return ( -1 );
+		}
+		metadata_.set_exit_status( static_cast<int>( static_cast<std::int32_t>( read_le( data_ + offset_, 4 ) ) ) );
+		offset_ += 4;
+	}
+	if ( fields & Replxx::HistoryMetadata::DURATION ) {
+		if ( ( offset_ + 8 ) > end_ ) {
+			return ( -1 );
+		}
+		metadata_.set_duration( static_cast<long long>( read_le( data_ + offset_, 8 ) ) );
+		offset_ += 8;
+	}
+	if ( fields & Replxx::HistoryMetadata::DIRECTORY ) {
+		if ( ( offset_ + 4 ) > end_ ) {
+			return ( -1 );
+		}
+		long long len( static_cast<long long>( read_le( data_ + offset_, 4 ) ) );
+		offset_ += 4;
+		if ( ( offset_ + len ) > end_ ) {
+			return ( -1 );
+		}
+		metadata_.set_directory( std::string( data_ + offset_, static_cast<size_t>( len ) ) );
+		offset_ += len;
+	}
+	return ( offset_ );
+}
+
+/*
+ * Load single binary history record starting at given offset,
+ * return offset of next record or -1 if the record is malformed.
+ */
+long long load_binary_record( char const* data_, long long end_, long long offset_, History::entries_t& entries_, UnicodeString& text_, bool extended_ ) {
+	if ( ( offset_ < BINARY_HISTORY_HEADER_SIZE ) || ( ( offset_ + BINARY_HISTORY_RECORD_HEADER_SIZE ) > end_ ) ) {
+		return ( -1 );
+	}
+	unsigned long long header( read_le( data_ + offset_ + 8, 4 ) );
+	bool hasMetadata( extended_ && ( ( header & BINARY_HISTORY_METADATA_BIT ) != 0 ) );
+	long long len( static_cast<long long>( extended_ ? header & ~BINARY_HISTORY_METADATA_BIT : header ) );
+	if ( ( offset_ + BINARY_HISTORY_RECORD_HEADER_SIZE + len ) > end_ ) {
+		return ( -1 );
+	}
+	long long next( offset_ + BINARY_HISTORY_RECORD_HEADER_SIZE + len );
+	Replxx::HistoryMetadata metadata;
+	if ( hasMetadata && ( ( next = load_binary_metadata( data_, end_, next, metadata ) ) < 0 ) ) {
+		return ( -1 );
+	}
+	text_.assign( data_ + offset_ + BINARY_HISTORY_RECORD_HEADER_SIZE, static_cast<int>( len ) );
+	entries_.emplace_back( static_cast<long long>( read_le( data_ + offset_, 8 ) ), text_ );
+	if ( hasMetadata ) {
+		History::entries_t::iterator it( entries_.end() );
+		entries_.set_metadata( -- it, metadata );
+	}
+	return ( next );
+}
+
+/*
+ * Position (in the index) of the first record with timestamp not less than given one,
+ * found by binary search over the index, records are stored in timestamp order.
+ */
+long long seek_binary( char const* data_, long long indexOffset_, long long count_, History::timestamp_t timestamp_ ) {
+	long long lo( 0 );
+	long long hi( count_ );
+	while ( lo < hi ) {
+		long long mid( lo + ( hi - lo ) / 2 );
+		long long offset( static_cast<long long>( read_le( data_ + indexOffset_ + mid * 8, 8 ) ) );
+		if (
+			( offset < BINARY_HISTORY_HEADER_SIZE )
+			|| ( ( offset + 8 ) > indexOffset_ )
+			|| ( static_cast<long long>( read_le( data_ + offset, 8 ) ) >= timestamp_ )
+		) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return ( lo );
+}
+
+/*
+ * Load newest limit_ records (all records if limit_ is negative) from binary history file.
+ *
+ * Records are located through the index, if the index is intact
+ * only records with timestamps in [from_, to_) range are read (to_ not greater than 0 means no upper bound),
+ * if the index is damaged all records are read sequentially.
+ */
+long long load_binary( char const* data_, long long size_, History::entries_t& entries_, int limit_, History::timestamp_t from_ = 0, History::timestamp_t to_ = 0 ) {
+	unsigned long long version( read_le( data_ + BINARY_HISTORY_MAGIC_SIZE, 4 ) );
+	if ( ( version != BINARY_HISTORY_VERSION ) && ( version != BINARY_HISTORY_METADATA_VERSION ) ) {
+		return ( 0 );
+	}
+	bool extended( version == BINARY_HISTORY_METADATA_VERSION );
+	long long count( 0 );
+	long long indexOffset( 0 );
+	bool indexed( false );
+	if ( size_ >= ( BINARY_HISTORY_HEADER_SIZE + BINARY_HISTORY_TRAILER_SIZE ) ) {
+		char const* trailer( data_ + size_ - BINARY_HISTORY_TRAILER_SIZE );
+		count = static_cast<long long>( read_le( trailer, 8 ) );
+		indexOffset = static_cast<long long>( read_le( trailer + 8, 8 ) );
+		indexed = ( memcmp( trailer + 16, BINARY_HISTORY_MAGIC, BINARY_HISTORY_MAGIC_SIZE ) == 0 )
+			&& ( indexOffset >= BINARY_HISTORY_HEADER_SIZE )
+			&& ( count >= 0 )
+			&& ( count == ( size_ - BINARY_HISTORY_TRAILER_SIZE - indexOffset ) / 8 )
+			&& ( ( indexOffset + count * 8 + BINARY_HISTORY_TRAILER_SIZE ) == size_ );
+	}
+	UnicodeString text;
+	long long records( 0 );
+	if ( indexed ) {
+		long long first( ( limit_ >= 0 ) && ( count > limit_ ) ? count - limit_ : 0 );
+		long long last( to_ > 0 ? seek_binary( data_, indexOffset, count, to_ ) : count );
+		if ( from_ > 0 ) {
+			first = std::max( first, seek_binary( data_, indexOffset, count, from_ ) );
+		}
+		for ( long long i( first ); i < last; ++ i ) {
+			long long offset( static_cast<long long>( read_le( data_ + indexOffset + i * 8, 8 ) ) );
+			if ( load_binary_record( data_, indexOffset, offset, entries_, text, extended ) < 0 ) {
+				break;
+			}
+			++ records;
+		}
+	} else {
+		long long offset( BINARY_HISTORY_HEADER_SIZE );
+		while ( ( offset = load_binary_record( data_, size_, offset, entries_, text, extended ) ) > 0 ) {
+			++ records;
+		}
+
+	}
+	return ( records );
+}
+
+}
+
+long long History::do_load( std::istream& histFile, entries_t& entries_, entries_t& tombstones_ ) {
+	string line;
+	HistoryParser parser( entries_, tombstones_ );
+	while ( getline( histFile, line ) ) {
+		parser.line( line.data(), static_cast<int>( line.length() ) );
+	}
+	return ( parser.records() );
+}
+
+/*
+ * Load history records stored in given file past given offset.
+ *
+ * The file is memory mapped and split into lines directly in the mapped memory,
+ * offset_ is updated to the end of the last complete record that was read
+ * (a timestamp not followed by record text yet is read next time), or to -1 if the file is stored in binary format (which cannot be read incrementally).
+ * Last line of the file does not need to be terminated with a newline.
+ * The format of the file is detected automatically,
+ * for binary files only newest limit_ records are loaded.
+ *
+ * Caller has to hold FileLock of the file.
+ *
+ * Returns number of loaded records, or -1 if the file could not be opened.
+ */
+long long History::do_load( std::string const& filename_, long long& offset_, entries_t& entries_, entries_t& tombstones_, int limit_ ) {
+	MappedFile mappedFile( filename_ );
+	if ( ! mappedFile.is_open() ) {
+		return ( -1 );
+	}
+	if ( is_binary_history( mappedFile.data(), mappedFile.size() ) ) {
+		if ( offset_ != 0 ) {
+			return ( -1 );
+		}
+		offset_ = -1;
+		return ( load_binary( mappedFile.data(), mappedFile.size(), entries_, limit_ ) );
+	}
+	if ( mappedFile.size() <= offset_ ) {
+		offset_ = mappedFile.size();
+		return ( 0 );
+	}
+	HistoryParser parser( entries_, tombstones_ );
+	char const* data( mappedFile.data() + offset_ );
+	char const* end( mappedFile.data() + mappedFile.size() );
+	char const* complete( data );
+	while ( data < end ) {
+		char const* eol( static_cast<char const*>( memchr( data, '\n', static_cast<size_t>( end - data ) ) ) );
+		if ( ! eol ) {
+			eol = end;
+		}
+		parser.line( data, static_cast<int>( eol - data ) );
+		data = eol != end ? eol + 1 : end;
+		if ( ! parser.pending() ) {
+			complete = data;
+		}
+	}
+	offset_ = complete - mappedFile.data();
+	return ( parser.records() );
+}
+
+/*
+ * Scan over copies of records stored in given history file with timestamps in [from_, to_) range.
+ *
+ * Range of records of binary history file is located by binary search over its record index,
+ * so only records in the range are read, text history files are read as a whole.
+ * Returns null scan if the file cannot be read.
+ */
+Replxx::HistoryScan::impl_t History::file_range( std::string const& filename_, timestamp_t from_, timestamp_t to_ ) {
+#ifndef _WIN32
+	FileLock fileLock( filename_ );
+#endif
+	std::shared_ptr<entries_t> entries( std::make_shared<entries_t>() );
+	bool binary( false );
+	/* scope for mapped file */ {
+		MappedFile mappedFile( filename_ );
+		if ( ! mappedFile.is_open() ) {
+			return ( Replxx::HistoryScan::impl_t( nullptr, delete_ReplxxHistoryScanImpl ) );
+		}
+		binary = is_binary_history( mappedFile.data(), mappedFile.size() );
+		if ( binary ) {
+			load_binary( mappedFile.data(), mappedFile.size(), *entries, -1, from_, to_ );
+		}
+	}
+	if ( ! binary ) {
+		entries_t tombstones;
+		long long offset( 0 );
+		if ( do_load( filename_, offset, *entries, tombstones ) < 0 ) {
+			return ( Replxx::HistoryScan::impl_t( nullptr, delete_ReplxxHistoryScanImpl ) );
+		}
+		remove_tombstoned( *entries, tombstones );
+		entries->sort();
+	}
+	Replxx::HistoryScan::impl_t impl( new Replxx::HistoryScanImpl( published_t( std::move( entries ) ) ), delete_ReplxxHistoryScanImpl );
+	impl->seek( from_, to_ );
+	return ( impl );
+}
+
+void History::save_binary( std::ostream& histFile ) {
+	bool extended( std::any_of( _entries.begin(), _entries.end(), []( Entry const& e ) { return ( e.has_metadata() ); } ) );
+	histFile.write( BINARY_HISTORY_MAGIC, BINARY_HISTORY_MAGIC_SIZE );
+	write_le( histFile, extended ? BINARY_HISTORY_METADATA_VERSION : BINARY_HISTORY_VERSION, 4 );
+	write_le( histFile, 0, 4 );
+	std::vector<unsigned long long> index;
+	unsigned long long offset( BINARY_HISTORY_HEADER_SIZE );
+	_scratches.clear();
+	Replxx::HistoryMetadata metadata;
+	for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		Entry const& h( *it );
+		if ( h.text().is_empty() ) {
+			continue;
+		}
+		bool hasMetadata( _entries.metadata( it, metadata ) );
+		index.push_back( offset );
+		write_le( histFile, static_cast<unsigned long long>( h.timestamp() ), 8 );
+		write_le( histFile, static_cast<unsigned long long>( h.utf8_length() ) | ( hasMetadata ? BINARY_HISTORY_METADATA_BIT : 0 ), 4 );
+		histFile.write( h.utf8(), h.utf8_length() );
+		offset += static_cast<unsigned long long>( BINARY_HISTORY_RECORD_HEADER_SIZE + h.utf8_length() );
+		if ( ! hasMetadata ) {
+			continue;
+		}
+		write_le( histFile, static_cast<unsigned long long>( metadata.fields() ), 1 );
+		++ offset;
+		if ( metadata.has( Replxx::HistoryMetadata::EXIT_STATUS ) ) {
+			write_le( histFile, static_cast<std::uint32_t>( metadata.exit_status() ), 4 );
+			offset += 4;
+		}
+		if ( metadata.has( Replxx::HistoryMetadata::DURATION ) ) {
+			write_le( histFile, static_cast<unsigned long long>( metadata.duration() ), 8 );
+			offset += 8;
+		}
+		if ( metadata.has( Replxx::HistoryMetadata::DIRECTORY ) ) {
+			std::string const& directory( metadata.directory() );
+			write_le( histFile, directory.length(), 4 );
+			histFile.write( directory.data(), static_cast<std::streamsize>( directory.length() ) );
+			offset += 4 + directory.length();
 		}
 	}
-	sort();
-	remove_duplicates();
-	trim_to_max_size();
-	ofstream histFile( filename );
-	if ( ! histFile ) {
-		return ( false );
+	for ( unsigned long long o : index ) {
+		write_le( histFile, o, 8 );
 	}
+	write_le( histFile, index.size(), 8 );
+	write_le( histFile, offset, 8 );
+	histFile.write( BINARY_HISTORY_MAGIC, BINARY_HISTORY_MAGIC_SIZE );
+	histFile.flush();
+}
+
+bool History::load( std::string const& filename ) {
 #ifndef _WIN32
-	umask( old_umask );
-	chmod( filename.c_str(), S_IRUSR | S_IWUSR );
+	FileLock fileLock( filename );
 #endif
-	save( histFile );
-	if ( ! sync_ ) {
-		_entries = std::move( entries );
-		_locations = std::move( locations );
+	clear();
+	entries_t tombstones;
+	long long fileSize( 0 );
+	long long records( do_load( filename, fileSize, _entries, tombstones, _maxSize ) );
+	if ( records < 0 ) {
+		return ( false );
 	}
-	reset_iters();
+	finish_load( tombstones );
+	journal_reset( filename, fileSize, fileSize >= 0 ? records : -1 );
 	return ( true );
 }
 
-void History::save( std::ostream& histFile ) {
-	Utf8String utf8;
-	UnicodeString us;
-	for ( Entry& h : _entries ) {
-		h.reset_scratch();
-		if ( ! h.text().is_empty() ) {
-			us.assign( h.text() );
-			std::replace( us.begin(), us.end(), char32_t( '\n' ), char32_t( ETB ) );
-			utf8.assign( us );
-			histFile << "### " << h.timestamp() << "\n" << utf8.get() << endl;
-		}
-	}
+void History::load( std::istream& histFile ) {
+	clear();
+	entries_t tombstones;
+	do_load( histFile, _entries, tombstones );
+	finish_load( tombstones );
+	_journalRecords = -1;
 }
 
-namespace {
+History::Snapshot::Snapshot( void )
+	: _entries()
+	, _tombstones()
+	, _maxSize( REPLXX_DEFAULT_HISTORY_MAX_LEN )
+	, _unique( true )
+	, _binary( false )
+	, _journalRatio( 0 )
+	, _journalPath()
+	, _journalOffset( -1 )
+	, _journalRecords( -1 )
+	, _journalId( 0 ) {
+}
 
-bool is_timestamp( std::string const& s ) {
-	static char const TIMESTAMP_PATTERN[] = "### dddd-dd-dd dd:dd:dd.ddd";
-	static int const TIMESTAMP_LENGTH( sizeof ( TIMESTAMP_PATTERN ) - 1 );
-	if ( s.length() != TIMESTAMP_LENGTH ) {
-		return ( false );
+/*
+ * Replace older, not yet saved snapshot of the same history.
+ *
+ * Entries and tombstones of the older snapshot were never written
+ * so they are still considered unsaved, journal state of the older snapshot
+ * describes the file before any of the pending changes so it is kept too.
+ */
+void History::Snapshot::supersede( Snapshot& older_ ) {
+	typedef std::unordered_multimap<UnicodeStringView, timestamp_t> unsaved_t;
+	unsaved_t unsaved;
+	for ( Entry const& e : older_._entries ) {
+		if ( ! e.persisted() ) {
+			unsaved.insert( make_pair( e.text(), e.timestamp() ) );
+		}
 	}
-	for ( int i( 0 ); i < TIMESTAMP_LENGTH; ++ i ) {
-		if ( TIMESTAMP_PATTERN[i] == 'd' ) {
-			if ( ! isdigit( s[i] ) ) {
-				return ( false );
-			}
-		} else if ( s[i] != TIMESTAMP_PATTERN[i] ) {
-			return ( false );
+	for ( entries_t::iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		Entry const& e( *it );
+		std::pair<unsaved_t::const_iterator, unsaved_t::const_iterator> r( unsaved.equal_range( e.text() ) );
+		if ( std::any_of( r.first, r.second, [&e]( unsaved_t::value_type const& u ) { return ( u.second == e.timestamp() ); } ) ) {
+			_entries.set_persisted( it, false );
 		}
 	}
-	return ( true );
+	for ( Entry const& t : _tombstones ) {
+		older_._tombstones.push_back( t );
+	}
+	_tombstones.swap( older_._tombstones );
+	_journalPath.swap( older_._journalPath );
+	_journalOffset = older_._journalOffset;
+	_journalRecords = older_._journalRecords;
+	_journalId = older_._journalId;
 }
 
+/*
+ * Copy history state to be saved to given file by background history writer.
+ *
+ * All entries are considered persisted from now on, and tombstones are handed
+ * over to the snapshot, so next snapshot carries only changes made after this one.
+ */
+void History::snapshot( Snapshot& snapshot_, std::string const& filename_ ) {
+	snapshot_._entries = _entries;
+	snapshot_._tombstones.clear();
+	snapshot_._tombstones.swap( _tombstones );
+	snapshot_._maxSize = _maxSize;
+	snapshot_._unique = _unique;
+	snapshot_._binary = _binary;
+	snapshot_._journalRatio = _journalRatio;
+	snapshot_._journalPath = _journalPath;
+	snapshot_._journalOffset = _journalOffset;
+	snapshot_._journalRecords = _journalRecords;
+	snapshot_._journalId = _journalId;
+	_entries.set_all_persisted();
+	if ( filename_ != _journalPath ) {
+		_journalPath = filename_;
+		_journalRecords = -1;
+		watch();
+	}
 }
 
-void History::do_load( std::istream& histFile ) {
-	string line;
-	string when( "0000-00-00 00:00:00.000" );
-	UnicodeString us;
-	while ( getline( histFile, line ).good() ) {
-		string::size_type eol( line.find_first_of( "\r\n" ) );
-		if ( eol != string::npos ) {
-			line.erase( eol );
-		}
-		if ( is_timestamp( line ) ) {
-			when.assign( line, 4, std::string::npos );
-			continue;
-		}
-		if ( ! line.empty() ) {
-			us.assign( line );
-			std::replace( us.begin(), us.end(), char32_t( ETB ), char32_t( '\n' ) );
-			_entries.emplace_back( when, us );
-		}
+/*
+ * Save history snapshot to given file, used by background history writer
+ * on its own replica of REPL's history.
+ *
+ * Journal state of the replica is kept between saves to the same file,
+ * it is taken from the snapshot when the replica was last saved to another file,
+ * and it is dropped (forcing full rewrite) when the snapshot does not reflect
+ * content of given file.
+ */
+bool History::save_snapshot( Snapshot const& snapshot_, std::string const& filename_, bool sync_ ) {
+	_maxSize = snapshot_._maxSize;
+	_unique = snapshot_._unique;
+	_binary = snapshot_._binary;
+	_journalRatio = snapshot_._journalRatio;
+	if ( snapshot_._journalPath != filename_ ) {
+		_journalRecords = -1;
+	} else if ( _journalPath != filename_ ) {
+		_journalPath = snapshot_._journalPath;
+		_journalOffset = snapshot_._journalOffset;
+		_journalRecords = snapshot_._journalRecords;
+		_journalId = snapshot_._journalId;
 	}
+	_entries = snapshot_._entries;
+	_tombstones = snapshot_._tombstones;
+	_scratches.clear();
+	reset_locations();
+	reindex();
+	reset_iters();
+	bool saved( save( filename_, sync_ ) );
+	if ( ! saved ) {
+		_journalRecords = -1;
+	}
+	return ( saved );
 }
 
-bool History::load( std::string const& filename ) {
-	ifstream histFile( filename );
-	if ( ! histFile ) {
-		clear();
-		return false;
+/*
+ * Merge result of asynchronous history synchronization into REPL's history.
+ *
+ * Entries added since the synchronized snapshot was taken are kept.
+ */
+void History::merge_synced( Snapshot const& synced_ ) {
+	typedef std::unordered_multimap<UnicodeStringView, timestamp_t> known_t;
+	entries_t entries( synced_._entries );
+	known_t known;
+	for ( Entry const& e : synced_._entries ) {
+		known.insert( make_pair( e.text(), e.timestamp() ) );
+	}
+	for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		Entry const& e( *it );
+		std::pair<known_t::const_iterator, known_t::const_iterator> r( known.equal_range( e.text() ) );
+		if ( std::none_of( r.first, r.second, [&e]( known_t::value_type const& k ) { return ( k.second == e.timestamp() ); } ) ) {
+			entries.push_back( it );
+		}
 	}
-	load(histFile);
-	return true;
+	remove_tombstoned( entries, _tombstones );
+	_entries.swap( entries );
+	_entries.sort();
+	_scratches.clear();
+	reset_locations();
+	reindex();
+	reset_iters();
+	remove_duplicates();
+	trim_to_max_size();
+	reset_iters();
 }
 
-void History::load( std::istream& histFile ) {
-	clear();
-	do_load( histFile );
+void History::finish_load( entries_t const& tombstones_ ) {
+	remove_tombstoned( _entries, tombstones_ );
 	sort();
 	remove_duplicates();
 	trim_to_max_size();
@@ -236,18 +1787,25 @@ void History::load( std::istream& histFile ) {
 	_yankPos = _entries.end();
 }
 
+/*
+ * Restore timestamp order of entries,
+ * entries appended directly to _entries get indexed too.
+ */
 void History::sort( void ) {
-	typedef std::vector<Entry> sortable_entries_t;
-	_locations.clear();
-	sortable_entries_t sortableEntries( _entries.begin(), _entries.end() );
-	std::stable_sort( sortableEntries.begin(), sortableEntries.end() );
-	_entries.clear();
-	_entries.insert( _entries.begin(), sortableEntries.begin(), sortableEntries.end() );
+	if ( _entries.sort() ) {
+		_scratches.clear();
+	}
+	reset_locations();
+	reindex();
 }
 
 void History::clear( void ) {
 	_locations.clear();
 	_entries.clear();
+	_scratches.clear();
+	reindex();
+	_tombstones.clear();
+	_journalOffset = -1;
 	_current = _entries.begin();
 	_recallMostRecent = false;
 }
@@ -304,19 +1862,459 @@ void History::restore_pos( void ) {
 	_current = _previous;
 }
 
+namespace {
+
+inline History::entry_id_t id_of( PrefixTree::key_t key_ ) {
+	return ( static_cast<History::entry_id_t>( key_ ) );
+}
+
+inline History::entry_id_t id_of( History::scratches_t::value_type const& scratch_ ) {
+	return ( scratch_.first );
+}
+
+/*
+ * Find identifier nearest to `from_` (or to the end of the container if `fromEnd_` is set)
+ * in given direction.
+ */
+template<typename ids_t>
+bool nearest_id( ids_t const& ids_, History::entry_id_t from_, bool back_, bool fromEnd_, History::entry_id_t& id_ ) {
+	typename ids_t::const_iterator it;
+	if ( back_ ) {
+		it = fromEnd_ ? ids_.end() : ids_.lower_bound( from_ );
+		if ( it == ids_.begin() ) {
+			return ( false );
+		}
+		-- it;
+	} else {
+		it = fromEnd_ ? ids_.begin() : ids_.upper_bound( from_ );
+		if ( it == ids_.end() ) {
+			return ( false );
+		}
+	}
+	id_ = id_of( *it );
+	return ( true );
+}
+
+}
+
+/*
+ * Find next (in given direction, wrapping around) entry starting with given prefix.
+ *
+ * Candidates come from the (case folded) prefix tree
+ * and from entries with modified scratch text,
+ * each candidate is verified against its current text.
+ */
 bool History::common_prefix_search( UnicodeString const& prefix_, int prefixSize_, bool back_, bool ignoreCase ) {
-	int step( back_ ? -1 : 1 );
-	entries_t::iterator it( moved( _current, step, true ) );
 	bool lowerCaseContext( std::none_of( prefix_.begin(), prefix_.end(), []( char32_t x ) { return iswupper( static_cast<wint_t>( x ) ); } ) );
-	while ( it != _current ) {
-		if ( it->text().starts_with( prefix_.begin(), prefix_.begin() + prefixSize_, ignoreCase && lowerCaseContext ? case_insensitive_equal : case_sensitive_equal ) ) {
+	bool (*equal)( char32_t, char32_t )( ignoreCase && lowerCaseContext ? case_insensitive_equal : case_sensitive_equal );
+	if ( ! _prefixIndexed ) {
+		for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+			_prefixTree.add( it.id(), it->text() );
+		}
+		_prefixIndexed = true;
+	}
+	PrefixTree::keys_t const* ids( _prefixTree.find( prefix_.get(), prefixSize_ ) );
+	entry_id_t current( _current.id() );
+	entry_id_t from( current );
+	bool wrapped( false );
+	bool restart( false );
+	while ( true ) {
+		entry_id_t candidate( 0 );
+		entry_id_t scratched( 0 );
+		bool found( ids && nearest_id( *ids, from, back_, restart, candidate ) );
+		if ( nearest_id( _scratches, from, back_, restart, scratched ) && ( ! found || ( back_ ? ( scratched > candidate ) : ( scratched < candidate ) ) ) ) {
+			candidate = scratched;
+			found = true;
+		}
+		restart = false;
+		if ( found && wrapped && ( back_ ? ( candidate <= current ) : ( candidate >= current ) ) ) {
+			return ( false );
+		}
+		if ( ! found ) {
+			if ( wrapped ) {
+				return ( false );
+			}
+			wrapped = true;
+			restart = true;
+			continue;
+		}
+		entries_t::iterator it( _entries.find( candidate ) );
+		if ( ( it != _entries.end() ) && text( it ).starts_with( prefix_.begin(), prefix_.begin() + prefixSize_, equal ) ) {
 			_current = it;
 			commit_index();
 			return ( true );
 		}
-		move( it, step, true );
+		from = candidate;
 	}
-	return ( false );
+}
+
+/*
+ * Find texts of entries (other than the line being edited) extending given prefix,
+ * most frecent first.
+ *
+ * Candidates are visited in rank order straight from the frecency tree,
+ * so the cost depends on prefix length and number of hints, not on history size.
+ */
+void History::hints( UnicodeString const& prefix_, bool ignoreCase_, int limit_, std::vector<UnicodeString>& hints_ ) {
+	hints_.clear();
+	if ( prefix_.is_empty() || ( limit_ <= 0 ) || ( size() < 2 ) ) {
+		return;
+	}
+	if ( ! _frecencyIndexed ) {
+		index_frecency();
+	}
+	PrefixTree::keys_t const* keys( _frecencyTree.find( prefix_.get(), prefix_.length() ) );
+	if ( ! keys ) {
+		return;
+	}
+	bool lowerCaseContext( std::none_of( prefix_.begin(), prefix_.end(), []( char32_t x ) { return iswupper( static_cast<wint_t>( x ) ); } ) );
+	bool (*equal)( char32_t, char32_t )( ignoreCase_ && lowerCaseContext ? case_insensitive_equal : case_sensitive_equal );
+	entry_id_t edited( last().id() );
+	std::unordered_set<UnicodeStringView> seen;
+	for ( PrefixTree::keys_t::const_reverse_iterator it( keys->rbegin() ), end( keys->rend() ); it != end; ++ it ) {
+		entry_id_t id( id_of( *it ) );
+		if ( id == edited ) {
+			continue;
+		}
+		UnicodeStringView text( _entries.find( id )->text() );
+		if (
+			( text.length() <= prefix_.length() )
+			|| ! text.starts_with( prefix_.begin(), prefix_.end(), equal )
+			|| ! seen.insert( text ).second
+		) {
+			continue;
+		}
+		hints_.emplace_back( text );
+		if ( static_cast<int>( hints_.size() ) == limit_ ) {
+			break;
+		}
+	}
+}
+
+/*
+ * Build frecency tree, entries without known frecency rank
+ * (e.g. loaded from history file) get one from their uses.
+ */
+void History::index_frecency( void ) {
+	std::unordered_map<UnicodeStringView, float> ranks;
+	for ( entries_t::iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		float& rank( ranks[it->text()] );
+		if ( it->frecency() <= 0 ) {
+			it->set_frecency( frecency_add( rank, frecency_rank( it->timestamp() ) ) );
+		}
+		rank = it->frecency();
+		_frecencyTree.add( frecency_key( it ), it->text() );
+	}
+	_frecencyIndexed = true;
+}
+
+/*
+ * Move to nearest entry (in given direction) containing given text.
+ *
+ * Behaves like move( bool ) but skips entries that do not contain given text.
+ */
+bool History::move_to_match( bool up_, UnicodeString const& text_, bool ignoreCase_ ) {
+	if ( _recallMostRecent && ! up_ ) {
+		return ( move( up_ ) );
+	}
+	_recallMostRecent = false;
+	std::vector<entry_id_t> const& ids( search_matches( text_, ignoreCase_ ) );
+	entry_id_t from( _current.id() );
+	std::vector<entry_id_t>::const_iterator it;
+	if ( up_ ) {
+		it = std::lower_bound( ids.begin(), ids.end(), from );
+		if ( it == ids.begin() ) {
+			return ( false );
+		}
+		-- it;
+	} else {
+		it = std::upper_bound( ids.begin(), ids.end(), from );
+		if ( it == ids.end() ) {
+			return ( false );
+		}
+	}
+	_current = _entries.find( *it );
+	return ( true );
+}
+
+/*
+ * Identifiers of all entries containing given text.
+ *
+ * Cached levels not extended by given text are dropped,
+ * a new level is filtered from the top remaining level,
+ * or, if there is none, from candidates found by the trigram index
+ * (or from all entries for texts too short to be looked up in the index).
+ */
+std::vector<History::entry_id_t> const& History::search_matches( UnicodeString const& text_, bool ignoreCase_ ) {
+	bool (*equal)( char32_t, char32_t )( ignoreCase_ ? case_insensitive_equal : case_sensitive_equal );
+	auto contains = [this, &text_, equal]( entry_id_t id_ ) {
+		UnicodeStringView t( text( _entries.find( id_ ) ) );
+		return ( std::search( t.begin(), t.end(), text_.begin(), text_.end(), equal ) != t.end() );
+	};
+	while (
+		! _searchLevels.empty()
+		&& (
+			! text_.starts_with( _searchLevels.back()._text.begin(), _searchLevels.back()._text.end() )
+			|| ( ignoreCase_ && ! _searchLevels.back()._ignoreCase )
+		)
+	) {
+		_searchLevels.pop_back();
+	}
+	if ( ! _searchLevels.empty() && ( _searchLevels.back()._text.length() == text_.length() ) && ( _searchLevels.back()._ignoreCase == ignoreCase_ ) ) {
+		return ( _searchLevels.back()._ids );
+	}
+	SearchLevel level( text_, ignoreCase_ );
+	if ( ! _searchLevels.empty() ) {
+		std::vector<entry_id_t> const& parent( _searchLevels.back()._ids );
+		std::copy_if( parent.begin(), parent.end(), std::back_inserter( level._ids ), contains );
+	} else if ( TrigramIndex::can_filter( text_ ) ) {
+		index_trigrams();
+		TrigramIndex::query_t query;
+		TrigramIndex::posting_list_t candidates;
+		if ( _index.query( text_, query ) ) {
+			TrigramIndex::collect( query, candidates );
+		}
+		for ( scratches_t::value_type const& scratch : _scratches ) {
+			candidates.push_back( scratch.first );
+		}
+		std::sort( candidates.begin(), candidates.end() );
+		candidates.erase( std::unique( candidates.begin(), candidates.end() ), candidates.end() );
+		for ( entry_id_t id : candidates ) {
+			if ( ( _entries.find( id ) != _entries.end() ) && contains( id ) ) {
+				level._ids.push_back( id );
+			}
+		}
+	} else {
+		for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+			if ( contains( it.id() ) ) {
+				level._ids.push_back( it.id() );
+			}
+		}
+	}
+	_searchLevels.push_back( std::move( level ) );
+	return ( _searchLevels.back()._ids );
+}
+
+void History::index_trigrams( void ) {
+	if ( _indexed ) {
+		return;
+	}
+	for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		_index.add( it.id(), it->text() );
+	}
+	_indexed = true;
+	_staleIds = 0;
+}
+
+/*
+ * Find entries containing all characters of given query (in order), best matches first.
+ *
+ * Only the most recent of entries with identical texts is reported,
+ * the last entry (the line being edited) is never reported,
+ * an empty query reports most recent entries.
+ */
+void History::fuzzy_search( UnicodeString const& query_, bool ignoreCase_, int limit_, fuzzy_matches_t& matches_ ) {
+	matches_.clear();
+	if ( _entries.empty() ) {
+		return;
+	}
+	if ( ! _fuzzyIndexed ) {
+		for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+			_fuzzyIndex.add( it.id(), text( it ) );
+		}
+		_fuzzyIndexed = true;
+		_fuzzyStaleIds = 0;
+	}
+	entries_t::iterator lastIt( last() );
+	std::unordered_set<UnicodeStringView> seen;
+	if ( query_.is_empty() ) {
+		for ( entries_t::iterator it( lastIt ); ( it != _entries.begin() ) && ( static_cast<int>( matches_.size() ) < limit_ ); ) {
+			-- it;
+			if ( seen.insert( text( it ) ).second ) {
+				matches_.emplace_back( it.id(), 0 );
+			}
+		}
+		return;
+	}
+	entry_id_t lastId( lastIt.id() );
+	_fuzzyIndex.search(
+		query_,
+		ignoreCase_,
+		[this, lastId]( entry_id_t id_ ) {
+			return ( id_ != lastId ? text( id_ ) : UnicodeStringView() );
+		},
+		_workerPool,
+		matches_
+	);
+	fuzzy_matches_t::iterator out( matches_.begin() );
+	for ( fuzzy_matches_t::const_iterator it( matches_.begin() ), end( matches_.end() ); ( it != end ) && ( ( out - matches_.begin() ) < limit_ ); ++ it ) {
+		if ( seen.insert( text( it->id() ) ).second ) {
+			*out = *it;
+			++ out;
+		}
+	}
+	matches_.erase( out, matches_.end() );
+}
+
+/*
+ * Find entries containing a match of given expression, most recent first.
+ *
+ * Only the most recent of entries with identical texts is reported,
+ * the last entry (the line being edited) is never reported,
+ * scores of reported matches are not used (always 0).
+ */
+void History::regex_search( Regex const& regex_, int limit_, fuzzy_matches_t& matches_ ) {
+	matches_.clear();
+	if ( _entries.empty() || ! regex_.valid() ) {
+		return;
+	}
+	Regex::ids_t candidates;
+	Regex::ids_t found;
+	regex_candidates( regex_, candidates );
+	entry_id_t lastId( last().id() );
+	regex_.search(
+		candidates,
+		[this, lastId]( entry_id_t id_ ) {
+			return ( id_ != lastId ? text( id_ ) : UnicodeStringView() );
+		},
+		_workerPool,
+		found
+	);
+	std::unordered_set<UnicodeStringView> seen;
+	for ( Regex::ids_t::const_reverse_iterator it( found.rbegin() ), end( found.rend() ); ( it != end ) && ( static_cast<int>( matches_.size() ) < limit_ ); ++ it ) {
+		if ( seen.insert( text( *it ) ).second ) {
+			matches_.emplace_back( *it, 0 );
+		}
+	}
+}
+
+/*
+ * Copy (in order) all entries containing a match of given expression.
+ *
+ * If publishing is enabled the published copy is scanned (on a worker pool of its own),
+ * so grep is safe to use on any thread, otherwise candidates are first
+ * narrowed with the trigram index.
+ * Returns no scan for an invalid expression.
+ */
+Replxx::HistoryScan::impl_t History::grep( Regex const& regex_ ) {
+	if ( ! regex_.valid() ) {
+		return ( Replxx::HistoryScan::impl_t( nullptr, delete_ReplxxHistoryScanImpl ) );
+	}
+	std::shared_ptr<entries_t> matched( std::make_shared<entries_t>() );
+	published_t published( std::atomic_load( &_published ) );
+	Regex::ids_t candidates;
+	Regex::ids_t found;
+	if ( published ) {
+		for ( entries_t::const_iterator it( published->begin() ), end( published->end() ); it != end; ++ it ) {
+			candidates.push_back( it.id() );
+		}
+		WorkerPool workerPool;
+		regex_.search(
+			candidates,
+			[&published]( entry_id_t id_ ) {
+				return ( published->find( id_ )->text() );
+			},
+			workerPool,
+			found
+		);
+	} else {
+		regex_candidates( regex_, candidates );
+		regex_.search(
+			candidates,
+			[this]( entry_id_t id_ ) {
+				return ( _entries.find( id_ )->text() );
+			},
+			_workerPool,
+			found
+		);
+	}
+	entries_t const& entries( published ? *published : _entries );
+	for ( entry_id_t id : found ) {
+		matched->push_back( entries.find( id ) );
+	}
+	return ( Replxx::HistoryScan::impl_t( new Replxx::HistoryScanImpl( published_t( std::move( matched ) ) ), delete_ReplxxHistoryScanImpl ) );
+}
+
+/*
+ * Copy entries meeting given criteria, from published copy of history if there is one.
+ */
+Replxx::HistoryScan::impl_t History::filter( Replxx::HistoryFilter const& filter_ ) const {
+	published_t published( std::atomic_load( &_published ) );
+	entries_t const& entries( published ? *published : _entries );
+	std::vector<entry_id_t> ids;
+	entries.filter( filter_, filter_.has( Replxx::HistoryFilter::WITHIN ) ? now( -filter_.within() ) : 0, ids );
+	std::shared_ptr<entries_t> selected( std::make_shared<entries_t>() );
+	for ( entry_id_t id : ids ) {
+		selected->push_back( entries.find( id ) );
+	}
+	return ( Replxx::HistoryScan::impl_t( new Replxx::HistoryScanImpl( published_t( std::move( selected ) ) ), delete_ReplxxHistoryScanImpl ) );
+}
+
+/*
+ * Identifiers (in order) of entries that may contain a match of given expression.
+ *
+ * Entries lacking any trigram of literals present in every match are skipped,
+ * entries with scratch texts are always candidates.
+ */
+void History::regex_candidates( Regex const& regex_, Regex::ids_t& candidates_ ) {
+	candidates_.clear();
+	Regex::literals_t const& literals( regex_.literals() );
+	bool filter( std::any_of( literals.begin(), literals.end(), []( UnicodeString const& l_ ) { return ( TrigramIndex::can_filter( l_ ) ); } ) );
+	if ( ! filter ) {
+		for ( entries_t::const_iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+			candidates_.push_back( it.id() );
+		}
+		return;
+	}
+	index_trigrams();
+	TrigramIndex::query_t query;
+	TrigramIndex::query_t literalQuery;
+	bool found( true );
+	for ( UnicodeString const& literal : literals ) {
+		if ( ! TrigramIndex::can_filter( literal ) ) {
+			continue;
+		}
+		if ( ! _index.query( literal, literalQuery ) ) {
+			found = false;
+			break;
+		}
+		query.insert( query.end(), literalQuery.begin(), literalQuery.end() );
+	}
+	if ( found ) {
+		std::sort(
+			query.begin(), query.end(),
+			[]( TrigramIndex::posting_list_t const* l_, TrigramIndex::posting_list_t const* r_ ) {
+				return ( l_->size() < r_->size() );
+			}
+		);
+		TrigramIndex::collect( query, candidates_ );
+	}
+	for ( scratches_t::value_type const& scratch : _scratches ) {
+		candidates_.push_back( scratch.first );
+	}
+	std::sort( candidates_.begin(), candidates_.end() );
+	candidates_.erase( std::unique( candidates_.begin(), candidates_.end() ), candidates_.end() );
+	candidates_.erase(
+		std::remove_if( candidates_.begin(), candidates_.end(), [this]( entry_id_t id_ ) { return ( _entries.find( id_ ) == _entries.end() ); } ),
+		candidates_.end()
+	);
+}
+
+UnicodeStringView History::text( entry_id_t id_ ) const {
+	entries_t::const_iterator it( _entries.find( id_ ) );
+	return ( it != _entries.end() ? text( it ) : UnicodeStringView() );
+}
+
+/*
+ * Make entry with given identifier the current one.
+ */
+bool History::select( entry_id_t id_ ) {
+	entries_t::iterator it( _entries.find( id_ ) );
+	if ( it == _entries.end() ) {
+		return ( false );
+	}
+	_current = it;
+	return ( true );
 }
 
 bool History::move( entries_t::iterator& it_, int by_, bool wrapped_ ) {
@@ -352,7 +2350,8 @@ History::entries_t::iterator History::moved( entries_t::iterator it_, int by_, b
 
 void History::erase( entries_t::iterator it_ ) {
 	bool invalidated( it_ == _current );
-	_locations.erase( it_->text() );
+	unregister_entry( it_ );
+	drop_location( it_ );
 	it_ = _entries.erase( it_ );
 	if ( invalidated ) {
 		_current = it_;
@@ -362,23 +2361,258 @@ void History::erase( entries_t::iterator it_ ) {
 	}
 	_yankPos = _entries.end();
 	_previous = _current;
+	if ( _entries.fragmented() ) {
+		compact();
+	}
+}
+
+/*
+ * Remove given entry without fixing up iterators and without reclaiming storage,
+ * used by bulk removals which call settle() when done.
+ */
+void History::discard( entries_t::iterator it_ ) {
+	unregister_entry( it_ );
+	drop_location( it_ );
+	_entries.erase( it_ );
+}
+
+/*
+ * Fix up iterators referring to entries removed with discard()
+ * and reclaim storage if it is worth it.
+ */
+void History::settle( void ) {
+	if ( _entries.find( _current.id() ) == _entries.end() ) {
+		_current = _entries.lower_bound( _current.id() );
+	}
+	if ( ( _current == _entries.end() ) && ! _entries.empty() ) {
+		-- _current;
+	}
+	_previous = _current;
+	_yankPos = _entries.end();
+	if ( _entries.fragmented() ) {
+		compact();
+	}
+}
+
+void History::register_entry( entries_t::iterator it_ ) {
+	_searchLevels.clear();
+	if ( _indexed ) {
+		_index.add( it_.id(), it_->text() );
+	}
+	if ( _prefixIndexed ) {
+		_prefixTree.add( it_.id(), it_->text() );
+	}
+	if ( _fuzzyIndexed ) {
+		_fuzzyIndex.add( it_.id(), it_->text() );
+	}
+	if ( _frecencyIndexed ) {
+		it_->set_frecency( frecency_of( *it_ ) );
+		_frecencyTree.add( frecency_key( it_ ), it_->text() );
+	}
+}
+
+void History::unregister_entry( entries_t::iterator it_ ) {
+	_searchLevels.clear();
+	_scratches.erase( it_.id() );
+	if ( _prefixIndexed ) {
+		_prefixTree.remove( it_.id(), it_->text() );
+	}
+	if ( _frecencyIndexed ) {
+		_frecencyTree.remove( frecency_key( it_ ), it_->text() );
+	}
+	if ( _indexed && ( ++ _staleIds > size() ) ) {
+		_index.clear();
+		_indexed = false;
+	}
+	if ( _fuzzyIndexed && ( ++ _fuzzyStaleIds > size() ) ) {
+		_fuzzyIndex.clear();
+		_fuzzyIndexed = false;
+	}
+}
+
+/*
+ * Drop search indexes, to be rebuilt on next search,
+ * needed after entries were renumbered.
+ */
+void History::reindex( void ) {
+	_index.clear();
+	_indexed = false;
+	_staleIds = 0;
+	_searchLevels.clear();
+	_prefixTree.clear();
+	_prefixIndexed = false;
+	_frecencyTree.clear();
+	_frecencyIndexed = false;
+	_fuzzyIndex.clear();
+	_fuzzyIndexed = false;
+	_fuzzyStaleIds = 0;
+}
+
+/*
+ * Reclaim storage of removed entries.
+ *
+ * Entries are renumbered so all iterators (and locations)
+ * referring to them are recreated.
+ */
+void History::compact( void ) {
+	int current( _entries.ordinal( _current ) );
+	int previous( _entries.ordinal( _previous ) );
+	int yankPos( _entries.ordinal( _yankPos ) );
+	typedef std::vector<std::pair<int, UnicodeString>> ordered_scratches_t;
+	ordered_scratches_t scratches;
+	for ( scratches_t::value_type& s : _scratches ) {
+		entries_t::iterator it( _entries.find( s.first ) );
+		if ( it != _entries.end() ) {
+			scratches.emplace_back( _entries.ordinal( it ), std::move( s.second ) );
+		}
+	}
+	_scratches.clear();
+	_entries.compact();
+	_current = _entries.nth( current );
+	_previous = _entries.nth( previous );
+	_yankPos = _entries.nth( yankPos );
+	for ( ordered_scratches_t::value_type& s : scratches ) {
+		_scratches[_entries.nth( s.first ).id()] = std::move( s.second );
+	}
+	reset_locations();
+	reindex();
+}
+
+void History::reset_locations( void ) {
+	_locations.clear();
+	_locations.reserve( static_cast<size_t>( _entries.size() ) );
+	for ( entries_t::iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
+		set_location( it );
+	}
+}
+
+/*
+ * 64-bit fingerprint of a text, code points are consumed in pairs
+ * and each 64-bit word is mixed into the state with a multiply-xorshift step.
+ */
+History::fingerprint_t History::fingerprint( UnicodeStringView text_ ) {
+	fingerprint_t const MULTIPLIER( 0xbf58476d1ce4e5b9ULL );
+	fingerprint_t h( 0x9e3779b97f4a7c15ULL ^ ( static_cast<fingerprint_t>( text_.length() ) * MULTIPLIER ) );
+	char32_t const* p( text_.get() );
+	char32_t const* e( p + text_.length() );
+	for ( ; ( e - p ) >= 2; p += 2 ) {
+		h = ( h ^ ( static_cast<fingerprint_t>( p[0] ) | ( static_cast<fingerprint_t>( p[1] ) << 32 ) ) ) * MULTIPLIER;
+		h ^= h >> 29;
+	}
+	if ( p != e ) {
+		h = ( h ^ static_cast<fingerprint_t>( *p ) ) * MULTIPLIER;
+	}
+	h ^= h >> 30;
+	h *= MULTIPLIER;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return ( h );
+}
+
+History::locations_t::iterator History::find_location( UnicodeStringView text_, fingerprint_t fingerprint_ ) {
+	std::pair<locations_t::iterator, locations_t::iterator> range( _locations.equal_range( fingerprint_ ) );
+	for ( ; range.first != range.second; ++ range.first ) {
+		if ( range.first->second->text() == text_ ) {
+			return ( range.first );
+		}
+	}
+	return ( _locations.end() );
+}
+
+History::locations_t::iterator History::find_location( UnicodeStringView text_ ) {
+	return ( find_location( text_, fingerprint( text_ ) ) );
+}
+
+/*
+ * Locate given entry unless another entry with the same text is already located.
+ */
+void History::add_location( entries_t::iterator it_, fingerprint_t fingerprint_ ) {
+	if ( find_location( it_->text(), fingerprint_ ) == _locations.end() ) {
+		_locations.emplace( fingerprint_, it_ );
+	}
+}
+
+/*
+ * Locate given entry replacing location of another entry with the same text.
+ */
+void History::set_location( entries_t::iterator it_, fingerprint_t fingerprint_ ) {
+	locations_t::iterator location( find_location( it_->text(), fingerprint_ ) );
+	if ( location != _locations.end() ) {
+		location->second = it_;
+	} else {
+		_locations.emplace( fingerprint_, it_ );
+	}
+}
+
+void History::set_location( entries_t::iterator it_ ) {
+	set_location( it_, fingerprint( it_->text() ) );
+}
+
+/*
+ * Forget location of given entry, if it is the located one for its text.
+ */
+void History::drop_location( entries_t::iterator it_ ) {
+	locations_t::iterator location( find_location( it_->text() ) );
+	if ( ( location != _locations.end() ) && ( location->second == it_ ) ) {
+		_locations.erase( location );
+	}
+}
+
+/*
+ * Replace last entry with a new one stamped with current time
+ * (see stamp(), `replaced_` is timestamp of other entry replaced by the new one),
+ * iterators referring to the last entry are moved to the new one.
+ */
+void History::replace_last( UnicodeString const& line_, fingerprint_t fingerprint_, float frecency_, timestamp_t replaced_ ) {
+	entries_t::iterator old( last() );
+	timestamp_t when( stamp( now(), replaced_ ) );
+	bool current( _current == old );
+	bool previous( _previous == old );
+	if ( _yankPos == old ) {
+		_yankPos = _entries.end();
+	}
+	drop_location( old );
+	unregister_entry( old );
+	_entries.erase( old );
+	_entries.emplace_back( when, line_ );
+	entries_t::iterator it( last() );
+	it->set_frecency( frecency_ );
+	register_entry( it );
+	add_location( it, fingerprint_ );
+	if ( current ) {
+		_current = it;
+	}
+	if ( previous ) {
+		_previous = it;
+	}
 }
 
 void History::trim_to_max_size( void ) {
+	if ( size() <= _maxSize ) {
+		return;
+	}
 	while ( size() > _maxSize ) {
-		erase( _entries.begin() );
+		discard( _entries.begin() );
 	}
+	settle();
 }
 
-void History::remove_duplicate( UnicodeString const& line_ ) {
+/*
+ * Returns timestamp of removed entry, 0 if there was none.
+ */
+History::timestamp_t History::remove_duplicate( UnicodeStringView line_, fingerprint_t fingerprint_ ) {
 	if ( ! _unique ) {
-		return;
+		return ( 0 );
 	}
-	locations_t::iterator it( _locations.find( line_ ) );
+	locations_t::iterator it( find_location( line_, fingerprint_ ) );
 	if ( it == _locations.end() ) {
-		return;
+		return ( 0 );
 	}
+	timestamp_t removed( it->second->timestamp() );
+	add_tombstone( *it->second );
 	erase( it->second );
+	return ( removed );
 }
 
 void History::remove_duplicates( void ) {
@@ -386,24 +2620,53 @@ void History::remove_duplicates( void ) {
 		return;
 	}
 	_locations.clear();
-	typedef std::pair<locations_t::iterator, bool> locations_insertion_result_t;
+	_scratches.clear();
 	for ( entries_t::iterator it( _entries.begin() ), end( _entries.end() ); it != end; ++ it ) {
-		it->reset_scratch();
-		locations_insertion_result_t locationsInsertionResult( _locations.insert( make_pair( it->text(), it ) ) );
-		if ( ! locationsInsertionResult.second ) {
-			_entries.erase( locationsInsertionResult.first->second );
-			locationsInsertionResult.first->second = it;
+		fingerprint_t fp( fingerprint( it->text() ) );
+		locations_t::iterator location( find_location( it->text(), fp ) );
+		if ( location != _locations.end() ) {
+			unregister_entry( location->second );
+			_entries.erase( location->second );
+			location->second = it;
+		} else {
+			_locations.emplace( fp, it );
 		}
 	}
 }
 
+/*
+ * Last entry holds the line being edited, it is replaced with given text
+ * before history is browsed.
+ *
+ * In shared mode new records from the journal file are merged before the last entry is re-added,
+ * so they are available for browsing immediately.
+ */
 void History::update_last( UnicodeString const& line_ ) {
+	int savedErrno( errno );
+	if ( _shared && _watcher.changed() ) {
+		erase( last() );
+		tail();
+		add( line_ );
+		reset_iters();
+		errno = savedErrno;
+		return;
+	}
+	errno = savedErrno;
+	fingerprint_t fp( fingerprint( line_ ) );
+	timestamp_t replaced( 0 );
 	if ( _unique ) {
-		_locations.erase( _entries.back().text() );
-		remove_duplicate( line_ );
-		_locations.insert( make_pair( line_, last() ) );
+		locations_t::iterator location( find_location( _entries.back().text() ) );
+		if ( location != _locations.end() ) {
+			_locations.erase( location );
+		}
+		replaced = remove_duplicate( line_, fp );
 	}
-	_entries.back() = Entry( now_ms_str(), line_ );
+	replace_last( line_, fp, 0.0f, replaced );
+}
+
+UnicodeStringView History::text( entries_t::const_iterator it_ ) const {
+	scratches_t::const_iterator scratch( _scratches.find( it_.id() ) );
+	return ( scratch != _scratches.end() ? UnicodeStringView( scratch->second ) : it_->text() );
 }
 
 void History::drop_last( void ) {
@@ -1,18 +1,27 @@
 #ifndef REPLXX_HISTORY_HXX_INCLUDED
 #define REPLXX_HISTORY_HXX_INCLUDED 1
 
-#include <list>
+#include <map>
+#include <vector>
+#include <memory>
 #include <unordered_map>
 
 #include "unicodestring.hxx"
 #include "utf8string.hxx"
 #include "conversion.hxx"
 #include "util.hxx"
+#include "historyentries.hxx"
+#include "trigramindex.hxx"
+#include "prefixtree.hxx"
+#include "fuzzyindex.hxx"
+#include "regex.hxx"
+#include "workerpool.hxx"
+#include "filewatcher.hxx"
 
 namespace std {
 template<>
-struct hash<replxx::UnicodeString> {
-	std::size_t operator()( replxx::UnicodeString const& us_ ) const {
+struct hash<replxx::UnicodeStringView> {
+	std::size_t operator()( replxx::UnicodeStringView const& us_ ) const {
 		std::size_t h( 0 );
 		char32_t const* p( us_.get() );
 		char32_t const* e( p + us_.length() );
@@ -30,37 +39,103 @@ namespace replxx {
 
 class History {
 public:
-	class Entry {
-		std::string _timestamp;
-		UnicodeString _text;
-		UnicodeString _scratch;
+	typedef HistoryEntries entries_t;
+	typedef HistoryEntries::Entry Entry;
+	typedef HistoryEntries::id_t entry_id_t;
+	typedef HistoryEntries::timestamp_t timestamp_t;
+	/*
+	 * Keys are 64-bit fingerprints of texts stored in _entries,
+	 * entries with colliding fingerprints are told apart by their texts.
+	 */
+	typedef unsigned long long fingerprint_t;
+	typedef std::unordered_multimap<fingerprint_t, entries_t::iterator> locations_t;
+	typedef std::map<entry_id_t, UnicodeString> scratches_t;
+	typedef FuzzyIndex::matches_t fuzzy_matches_t;
+	typedef std::shared_ptr<entries_t const> published_t;
+	/*
+	 * Self-contained copy of history state (entries, pending tombstones,
+	 * settings and journal state) handed over to and from background history writer.
+	 */
+	class Snapshot {
+		entries_t _entries;
+		entries_t _tombstones;
+		int _maxSize;
+		bool _unique;
+		bool _binary;
+		int _journalRatio;
+		std::string _journalPath;
+		long long _journalOffset;
+		long long _journalRecords;
+		unsigned long long _journalId;
 	public:
-		Entry( std::string const& timestamp_, UnicodeString const& text_ )
-			: _timestamp( timestamp_ )
-			, _text( text_ )
-			, _scratch( text_ ) {
-		}
-		std::string const& timestamp( void ) const {
-			return ( _timestamp );
-		}
-		UnicodeString const& text( void ) const {
-			return ( _scratch );
-		}
-		void set_scratch( UnicodeString const& s ) {
-			_scratch = s;
-		}
-		void reset_scratch( void ) {
-			_scratch = _text;
-		}
-		bool operator < ( Entry const& other_ ) const {
-			return ( _timestamp < other_._timestamp );
-		}
+		Snapshot( void );
+		void supersede( Snapshot& );
+	private:
+		friend class History;
 	};
-	typedef std::list<Entry> entries_t;
-	typedef std::unordered_map<UnicodeString, entries_t::iterator> locations_t;
 private:
 	entries_t _entries;
 	locations_t _locations;
+	/*
+	 * Trigram index used by incremental and regular expression history searches,
+	 * built on first search and updated when entries are added,
+	 * _staleIds counts identifiers of removed entries still present in the index.
+	 */
+	TrigramIndex _index;
+	bool _indexed;
+	int _staleIds;
+	/*
+	 * Texts of entries modified while browsing history (scratch texts),
+	 * created on first modification of given entry.
+	 * Entries with scratch text are always considered search candidates.
+	 */
+	scratches_t _scratches;
+	/*
+	 * Incremental history search narrowing cache.
+	 *
+	 * One level per searched text holding ascending identifiers of all entries
+	 * containing that text, text of each level extends text of the level below it,
+	 * so extending searched text filters only entries of the top level
+	 * and shortening it pops back to a cached level.
+	 * Levels are dropped whenever entries or their scratch texts change.
+	 */
+	class SearchLevel {
+		UnicodeString _text;
+		bool _ignoreCase;
+		std::vector<entry_id_t> _ids;
+	public:
+		SearchLevel( UnicodeString const& text_, bool ignoreCase_ )
+			: _text( text_ )
+			, _ignoreCase( ignoreCase_ )
+			, _ids() {
+		}
+	private:
+		friend class History;
+	};
+	typedef std::vector<SearchLevel> search_levels_t;
+	search_levels_t _searchLevels;
+	/*
+	 * Radix tree used by history common prefix search,
+	 * built on first search and updated when entries are added or removed.
+	 */
+	PrefixTree _prefixTree;
+	bool _prefixIndexed;
+	/*
+	 * Radix tree used by built-in history hints,
+	 * keyed by frecency ranks and identifiers of entries,
+	 * built on first use and updated when entries are added or removed.
+	 */
+	PrefixTree _frecencyTree;
+	bool _frecencyIndexed;
+	/*
+	 * Character class masks used by fuzzy history search,
+	 * built on first search and updated when entries are added,
+	 * scans of the index (and regular expression matching) are split over _workerPool.
+	 */
+	FuzzyIndex _fuzzyIndex;
+	bool _fuzzyIndexed;
+	int _fuzzyStaleIds;
+	WorkerPool _workerPool;
 	int _maxSize;
 	entries_t::iterator _current;
 	entries_t::const_iterator _yankPos;
@@ -75,19 +150,73 @@ private:
 	entries_t::iterator _previous;
 	bool _recallMostRecent;
 	bool _unique;
+	/*
+	 * Journal mode state.
+	 *
+	 * With _journalRatio set to 0 the history file is fully rewritten on each save,
+	 * otherwise only entries added since previous save and tombstones
+	 * of deduplicated entries are appended to the history file,
+	 * and the file is compacted (fully rewritten) only when number of records stored in it
+	 * exceeds _journalRatio times number of live entries.
+	 *
+	 * _journalOffset is a history file size up to which in-memory history
+	 * reflects file content (-1 if unknown),
+	 * _journalRecords is number of records stored in history file (-1 if unknown).
+	 */
+	int _journalRatio;
+	std::string _journalPath;
+	long long _journalOffset;
+	long long _journalRecords;
+	unsigned long long _journalId;
+	entries_t _tombstones;
+	bool _binary;
+	/*
+	 * In shared mode records appended to the journal file by other processes
+	 * are merged into history as soon as they are noticed by _watcher.
+	 */
+	bool _shared;
+	FileWatcher _watcher;
+	/*
+	 * Immutable copy of entries read by history scans (possibly on other threads),
+	 * replaced with atomic pointer swap by publish(), empty unless publishing is enabled.
+	 * The copy shares storage blocks with _entries, blocks are copied when _entries modify them.
+	 * Readers keep a reference to the copy they started with,
+	 * so the copy is destroyed by whichever thread releases it last.
+	 */
+	published_t _published;
+	bool _publishing;
 public:
 	History( void );
-	void add( UnicodeString const& line, std::string const& when = now_ms_str() );
+	static timestamp_t now( long long = 0 );
+	void add( UnicodeString const& line, timestamp_t when = now(), Replxx::HistoryMetadata const* = nullptr );
+	void add_batch( std::vector<UnicodeString> const&, timestamp_t = now() );
 	bool save( std::string const& filename, bool );
 	void save( std::ostream& histFile );
 	bool load( std::string const& filename );
 	void load( std::istream& histFile );
+	void snapshot( Snapshot&, std::string const& );
+	bool save_snapshot( Snapshot const&, std::string const&, bool );
+	void merge_synced( Snapshot const& );
 	void clear( void );
 	void set_max_size( int len );
 	void set_unique( bool unique_ ) {
 		_unique = unique_;
 		remove_duplicates();
 	}
+	void set_binary( bool binary_ ) {
+		_binary = binary_;
+	}
+	void set_journal( int ratio_ ) {
+		_journalRatio = ratio_ > 0 ? ratio_ : 0;
+		_tombstones.clear();
+	}
+	void set_shared( bool shared_ ) {
+		_shared = shared_;
+		watch();
+	}
+	void set_publishing( bool );
+	void publish( void );
+	bool refresh( void );
 	void reset_yank_iterator();
 	bool next_yank_position( void );
 	void reset_recall_most_recent( void ) {
@@ -104,28 +233,44 @@ public:
 	void drop_last( void );
 	bool is_last( void );
 	bool move( bool );
+	bool move_to_match( bool, UnicodeString const&, bool );
 	void set_current_scratch( UnicodeString const& s ) {
-		_current->set_scratch( s );
+		_scratches[_current.id()].assign( s );
+		_searchLevels.clear();
+		if ( _fuzzyIndexed ) {
+			_fuzzyIndex.widen( _current.id(), s );
+		}
 	}
 	void reset_scratches( void ) {
-		for ( Entry& entry : _entries ) {
-			entry.reset_scratch();
-		}
+		_scratches.clear();
+		_searchLevels.clear();
 	}
 	void reset_current_scratch( void ) {
-		_current->reset_scratch();
+		_scratches.erase( _current.id() );
+		_searchLevels.clear();
 	}
-	UnicodeString const& current( void ) const {
-		return ( _current->text() );
+	UnicodeStringView current( void ) const {
+		return ( text( _current ) );
 	}
-	UnicodeString const& yank_line( void ) const {
-		return ( _yankPos->text() );
+	UnicodeStringView yank_line( void ) const {
+		return ( text( _yankPos ) );
 	}
+	UnicodeStringView text( entry_id_t ) const;
+	bool select( entry_id_t );
 	void jump( bool, bool = true );
 	bool common_prefix_search( UnicodeString const&, int, bool, bool );
+	void fuzzy_search( UnicodeString const&, bool, int, fuzzy_matches_t& );
+	void regex_search( Regex const&, int, fuzzy_matches_t& );
+	Replxx::HistoryScan::impl_t grep( Regex const& );
+	Replxx::HistoryScan::impl_t filter( Replxx::HistoryFilter const& ) const;
+	Replxx::HistoryScan::impl_t range( timestamp_t, timestamp_t ) const;
+	static Replxx::HistoryScan::impl_t file_range( std::string const&, timestamp_t, timestamp_t );
+	static timestamp_t parse_timestamp( std::string const& );
+	void hints( UnicodeString const&, bool, int, std::vector<UnicodeString>& );
 	int size( void ) const {
 		return ( static_cast<int>( _entries.size() ) );
 	}
+	int published_size( void ) const;
 	Replxx::HistoryScan::impl_t scan( void ) const;
 	void save_pos( void );
 	void restore_pos( void );
@@ -135,25 +280,71 @@ private:
 	bool move( entries_t::iterator&, int, bool = false );
 	entries_t::iterator moved( entries_t::iterator, int, bool = false );
 	void erase( entries_t::iterator );
+	void discard( entries_t::iterator );
+	void settle( void );
+	UnicodeStringView text( entries_t::const_iterator ) const;
+	std::vector<entry_id_t> const& search_matches( UnicodeString const&, bool );
+	void index_trigrams( void );
+	void regex_candidates( Regex const&, Regex::ids_t& );
+	void register_entry( entries_t::iterator );
+	void unregister_entry( entries_t::iterator );
+	timestamp_t stamp( timestamp_t, timestamp_t = 0 );
+	void replace_last( UnicodeString const&, fingerprint_t, float, timestamp_t = 0 );
+	void reindex( void );
+	void index_frecency( void );
+	void reset_locations( void );
+	static fingerprint_t fingerprint( UnicodeStringView );
+	locations_t::iterator find_location( UnicodeStringView, fingerprint_t );
+	locations_t::iterator find_location( UnicodeStringView );
+	void add_location( entries_t::iterator, fingerprint_t );
+	void set_location( entries_t::iterator, fingerprint_t );
+	void set_location( entries_t::iterator );
+	void drop_location( entries_t::iterator );
+	void compact( void );
 	void trim_to_max_size( void );
-	void remove_duplicate( UnicodeString const& );
+	timestamp_t remove_duplicate( UnicodeStringView, fingerprint_t );
 	void remove_duplicates( void );
-	void do_load( std::istream& );
+	void add_tombstone( Entry const& );
+	static void remove_tombstoned( entries_t&, entries_t const& );
+	bool journal_save( std::string const&, bool );
+	void journal_reset( std::string const&, long long, long long );
+	void watch( void );
+	bool tail( void );
+	bool merge_tail( entries_t&, entries_t const& );
+	static long long do_load( std::istream&, entries_t&, entries_t& );
+	static long long do_load( std::string const&, long long&, entries_t&, entries_t&, int = -1 );
+	void save_binary( std::ostream& );
+	void finish_load( entries_t const& );
 	entries_t::iterator last( void );
 	void sort( void );
 	void reset_iters( void );
 };
 
 class Replxx::HistoryScanImpl {
+	History::published_t _published;
 	History::entries_t const& _entries;
+	/*
+	 * Scanned range of entries, _it is at _end before the scan starts.
+	 */
+	History::entries_t::const_iterator _begin;
+	History::entries_t::const_iterator _end;
 	History::entries_t::const_iterator _it;
-	mutable Utf8String _utf8Cache;
+	/*
+	 * Text form of current entry timestamp (NUL terminated).
+	 */
+	char _timestamp[24];
 	mutable Replxx::HistoryEntry _entryCache;
 	mutable bool _cacheValid;
+	mutable Replxx::HistoryMetadata _metadataCache;
+	mutable bool _metadataCacheValid;
 public:
 	HistoryScanImpl( History::entries_t const& );
+	HistoryScanImpl( History::published_t );
+	void seek( History::timestamp_t, History::timestamp_t );
 	bool next( void );
 	Replxx::HistoryEntry const& get( void ) const;
+	Replxx::HistoryEntryView view( void ) const;
+	Replxx::HistoryMetadata const& metadata( void ) const;
 };
 
 }
@@ -0,0 +1,853 @@
+#include <algorithm>
+#include <cstring>
+
+#include "historyentries.hxx"
+
+namespace replxx {
+
+namespace {
+
+int const ARENA_CHUNK_SIZE( 16384 );
+int const MIN_RING_SIZE( 16 );
+size_t const MAX_MERGED_RUNS( 16 );
+
+}
+
+HistoryEntries::Entry::Entry( void )
+	: _text( nullptr )
+	, _utf8( nullptr )
+	, _timestamp( 0 )
+	, _length( 0 )
+	, _utf8Length( 0 )
+	, _live( false )
+	, _persisted( false )
+	, _frecency( 0 )
+	, _metadata( -1 ) {
+}
+
+/*
+ * Append new blocks up to given number of blocks.
+ */
+template<typename block_t>
+void HistoryEntries::Blocks<block_t>::resize( size_t size_ ) {
+	size_t segments( ( size_ + SEGMENT_SIZE - 1 ) >> SEGMENT_BITS );
+	_segments.resize( segments );
+	_shared.resize( segments );
+	for ( size_t i( _size ); i < size_; ++ i ) {
+		size_t s( i >> SEGMENT_BITS );
+		if ( ! _segments[s] ) {
+			_segments[s] = std::make_shared<Segment>();
+		} else if ( _shared[s] ) {
+			unshare( s, i & ( SEGMENT_SIZE - 1 ) );
+		}
+		_segments[s]->_blocks[i & ( SEGMENT_SIZE - 1 )] = std::make_shared<block_t>();
+		_segments[s]->_shared[i & ( SEGMENT_SIZE - 1 )] = false;
+	}
+	_size = size_;
+}
+
+/*
+ * Refer to blocks of other sequence,
+ * blocks are copied by first modification done through either of the sequences.
+ */
+template<typename block_t>
+void HistoryEntries::Blocks<block_t>::share( Blocks& other_ ) {
+	_segments = other_._segments;
+	_shared.assign( _segments.size(), true );
+	other_._shared.assign( _segments.size(), true );
+	_size = other_._size;
+}
+
+/*
+ * Make b_-th block of s_-th segment (and the segment itself) private to this sequence,
+ * blocks of a segment being copied stay shared.
+ */
+template<typename block_t>
+void HistoryEntries::Blocks<block_t>::unshare( size_t s_, size_t b_ ) {
+	if ( _shared[s_] ) {
+		_segments[s_] = std::make_shared<Segment>( *_segments[s_] );
+		_segments[s_]->_shared.set();
+		_shared[s_] = false;
+	}
+	Segment& segment( *_segments[s_] );
+	if ( segment._shared[b_] && segment._blocks[b_] ) {
+		segment._blocks[b_] = std::make_shared<block_t>( *segment._blocks[b_] );
+	}
+	segment._shared[b_] = false;
+}
+
+template<typename block_t>
+void HistoryEntries::Blocks<block_t>::clear( void ) {
+	_segments.clear();
+	_shared.clear();
+	_size = 0;
+}
+
+template<typename block_t>
+void HistoryEntries::Blocks<block_t>::swap( Blocks& other_ ) {
+	_segments.swap( other_._segments );
+	_shared.swap( other_._shared );
+	std::swap( _size, other_._size );
+}
+
+/*
+ * Release chain of preceding chunks iteratively,
+ * so long chains do not overflow the stack.
+ */
+template<typename char_t>
+HistoryEntries::Arena<char_t>::Chunk::~Chunk( void ) {
+	std::shared_ptr<Chunk> prev( std::move( _prev ) );
+	while ( prev && ( prev.use_count() == 1 ) ) {
+		std::shared_ptr<Chunk> next( std::move( prev->_prev ) );
+		prev = std::move( next );
+	}
+}
+
+/*
+ * Allocate space for given number of characters,
+ * new chunk is at least as big as given size hint.
+ */
+template<typename char_t>
+char_t* HistoryEntries::Arena<char_t>::allocate( int len_, int hint_ ) {
+	if ( len_ > _free ) {
+		int chunkSize( std::max( std::max( len_, hint_ ), ARENA_CHUNK_SIZE ) );
+		_last = std::make_shared<Chunk>( new char_t[chunkSize], _last );
+		_pos = _last->_data.get();
+		_free = chunkSize;
+	}
+	char_t* data( _pos );
+	_pos += len_;
+	_free -= len_;
+	_size += len_;
+	return ( data );
+}
+
+/*
+ * Give back unused tail of the most recent allocation.
+ */
+template<typename char_t>
+void HistoryEntries::Arena<char_t>::shrink( int len_ ) {
+	_pos -= len_;
+	_free += len_;
+	_size -= len_;
+}
+
+/*
+ * Refer to chunks of other arena, new allocations go to chunks of its own.
+ */
+template<typename char_t>
+void HistoryEntries::Arena<char_t>::share( Arena const& other_ ) {
+	_last = other_._last;
+	_pos = nullptr;
+	_free = 0;
+	_size = other_._size;
+}
+
+template<typename char_t>
+void HistoryEntries::Arena<char_t>::clear( void ) {
+	_last.reset();
+	_pos = nullptr;
+	_free = 0;
+	_size = 0;
+}
+
+template<typename char_t>
+void HistoryEntries::Arena<char_t>::swap( Arena& other_ ) {
+	_last.swap( other_._last );
+	std::swap( _pos, other_._pos );
+	std::swap( _free, other_._free );
+	std::swap( _size, other_._size );
+}
+
+/*
+ * Append a row with no fields set for given entry, return its index.
+ */
+int HistoryEntries::Columns::add( id_t owner_, timestamp_t timestamp_ ) {
+	size_t row( static_cast<size_t>( _rows ) );
+	if ( ( row >> BLOCK_BITS ) == _blocks.size() ) {
+		_blocks.resize( _blocks.size() + 1 );
+	}
+	Block& block( _blocks.modify( row >> BLOCK_BITS ) );
+	row &= BLOCK_SIZE - 1;
+	block._fields[row] = 0;
+	block._owners[row] = owner_;
+	block._timestamps[row] = timestamp_;
+	block._exitStatuses[row] = 0;
+	block._durations[row] = 0;
+	block._directories[row] = 0;
+	return ( _rows ++ );
+}
+
+void HistoryEntries::Columns::set( int row_, Replxx::HistoryMetadata const& metadata_ ) {
+	size_t row( static_cast<size_t>( row_ ) );
+	Block& block( _blocks.modify( row >> BLOCK_BITS ) );
+	row &= BLOCK_SIZE - 1;
+	block._fields[row] = metadata_.fields();
+	block._exitStatuses[row] = metadata_.exit_status();
+	block._durations[row] = metadata_.duration();
+	block._directories[row] = 0;
+	if ( metadata_.has( Replxx::HistoryMetadata::DIRECTORY ) ) {
+		int id( directory_id( metadata_.directory() ) );
+		if ( id < 0 ) {
+			if ( _directories.size() == 0 ) {
+				_directories.resize( 1 );
+			}
+			Directories& directories( _directories.modify( 0 ) );
+			id = static_cast<int>( directories._names.size() );
+			directories._ids.emplace( metadata_.directory(), id );
+			directories._names.push_back( metadata_.directory() );
+		}
+		block._directories[row] = id;
+	}
+}
+
+void HistoryEntries::Columns::get( int row_, Replxx::HistoryMetadata& metadata_ ) const {
+	size_t row( static_cast<size_t>( row_ ) );
+	Block const& block( _blocks[row >> BLOCK_BITS] );
+	row &= BLOCK_SIZE - 1;
+	int fields( block._fields[row] );
+	metadata_.clear();
+	if ( fields & Replxx::HistoryMetadata::EXIT_STATUS ) {
+		metadata_.set_exit_status( block._exitStatuses[row] );
+	}
+	if ( fields & Replxx::HistoryMetadata::DURATION ) {
+		metadata_.set_duration( block._durations[row] );
+	}
+	if ( fields & Replxx::HistoryMetadata::DIRECTORY ) {
+		metadata_.set_directory( _directories[0]._names[static_cast<size_t>( block._directories[row] )] );
+	}
+}
+
+/*
+ * Drop all fields of given row.
+ */
+void HistoryEntries::Columns::erase( int row_ ) {
+	size_t row( static_cast<size_t>( row_ ) );
+	_blocks.modify( row >> BLOCK_BITS )._fields[row & ( BLOCK_SIZE - 1 )] = 0;
+}
+
+/*
+ * Point given row at its (renumbered) entry.
+ */
+void HistoryEntries::Columns::relink( int row_, id_t owner_ ) {
+	size_t row( static_cast<size_t>( row_ ) );
+	_blocks.modify( row >> BLOCK_BITS )._owners[row & ( BLOCK_SIZE - 1 )] = owner_;
+}
+
+/*
+ * Interned identifier of given directory, -1 if no row ever referred to it.
+ */
+int HistoryEntries::Columns::directory_id( std::string const& directory_ ) const {
+	if ( _directories.size() == 0 ) {
+		return ( -1 );
+	}
+	std::unordered_map<std::string, int> const& ids( _directories[0]._ids );
+	std::unordered_map<std::string, int>::const_iterator it( ids.find( directory_ ) );
+	return ( it != ids.end() ? it->second : -1 );
+}
+
+void HistoryEntries::Columns::share( Columns& other_ ) {
+	_blocks.share( other_._blocks );
+	_directories.share( other_._directories );
+	_rows = other_._rows;
+}
+
+void HistoryEntries::Columns::clear( void ) {
+	_blocks.clear();
+	_directories.clear();
+	_rows = 0;
+}
+
+void HistoryEntries::Columns::swap( Columns& other_ ) {
+	_blocks.swap( other_._blocks );
+	_directories.swap( other_._directories );
+	std::swap( _rows, other_._rows );
+}
+
+HistoryEntries::HistoryEntries( void )
+	: _ring()
+	, _first( 0 )
+	, _next( 0 )
+	, _size( 0 )
+	, _arena()
+	, _utf8Arena()
+	, _textSize( 0 )
+	, _utf8Size( 0 )
+	, _columns()
+	, _metadataSize( 0 )
+	, _unsavedSize( 0 ) {
+}
+
+HistoryEntries::HistoryEntries( HistoryEntries const& other_ )
+	: HistoryEntries() {
+	for ( const_iterator it( other_.begin() ), end( other_.end() ); it != end; ++ it ) {
+		push_back( it );
+	}
+}
+
+HistoryEntries::HistoryEntries( HistoryEntries&& other_ )
+	: HistoryEntries() {
+	swap( other_ );
+}
+
+HistoryEntries& HistoryEntries::operator = ( HistoryEntries const& other_ ) {
+	if ( &other_ != this ) {
+		HistoryEntries tmp( other_ );
+		swap( tmp );
+	}
+	return ( *this );
+}
+
+HistoryEntries& HistoryEntries::operator = ( HistoryEntries&& other_ ) {
+	swap( other_ );
+	return ( *this );
+}
+
+void HistoryEntries::swap( HistoryEntries& other_ ) {
+	_ring.swap( other_._ring );
+	std::swap( _first, other_._first );
+	std::swap( _next, other_._next );
+	std::swap( _size, other_._size );
+	_arena.swap( other_._arena );
+	_utf8Arena.swap( other_._utf8Arena );
+	std::swap( _textSize, other_._textSize );
+	std::swap( _utf8Size, other_._utf8Size );
+	_columns.swap( other_._columns );
+	std::swap( _metadataSize, other_._metadataSize );
+	std::swap( _unsavedSize, other_._unsavedSize );
+}
+
+/*
+ * Turn this into a read only copy of other entries sharing their storage,
+ * storage blocks are copied by first modification of other entries.
+ */
+void HistoryEntries::share( HistoryEntries& other_ ) {
+	_ring.share( other_._ring );
+	_first = other_._first;
+	_next = other_._next;
+	_size = other_._size;
+	_arena.share( other_._arena );
+	_utf8Arena.share( other_._utf8Arena );
+	_textSize = other_._textSize;
+	_utf8Size = other_._utf8Size;
+	_columns.share( other_._columns );
+	_metadataSize = other_._metadataSize;
+	_unsavedSize = other_._unsavedSize;
+}
+
+HistoryEntries::id_t HistoryEntries::next_live( id_t id_ ) const {
+	while ( id_ != _next ) {
+		++ id_;
+		if ( is_live( id_ ) ) {
+			break;
+		}
+	}
+	return ( id_ );
+}
+
+HistoryEntries::id_t HistoryEntries::prev_live( id_t id_ ) const {
+	while ( id_ != _first ) {
+		-- id_;
+		if ( is_live( id_ ) ) {
+			break;
+		}
+	}
+	return ( id_ );
+}
+
+/*
+ * Iterator to the first entry with identifier not less than given one,
+ * given identifier must not be newer than identifiers of all stored entries.
+ */
+HistoryEntries::iterator HistoryEntries::lower_bound( id_t id_ ) {
+	if ( ( id_ - _first ) > ( _next - _first ) ) {
+		return ( begin() );
+	}
+	return ( iterator( this, is_live( id_ ) || ( id_ == _next ) ? id_ : next_live( id_ ) ) );
+}
+
+/*
+ * Iterator to the first entry with timestamp not less than given one,
+ * found by binary search, entries must be in timestamp order.
+ *
+ * Positions are bisected over the whole identifier range,
+ * a position falling into a hole stands for the first entry following it.
+ */
+HistoryEntries::const_iterator HistoryEntries::seek( timestamp_t timestamp_ ) const {
+	id_t lo( 0 );
+	id_t hi( _next - _first );
+	while ( lo < hi ) {
+		id_t mid( lo + ( hi - lo ) / 2 );
+		id_t id( _first + mid );
+		if ( ! is_live( id ) ) {
+			id = next_live( id );
+		}
+		if ( ( id == _next ) || ( at( id )._timestamp >= timestamp_ ) ) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	id_t id( _first + lo );
+	return ( const_iterator( this, ( id == _next ) || is_live( id ) ? id : next_live( id ) ) );
+}
+
+void HistoryEntries::emplace_back( timestamp_t timestamp_, UnicodeStringView text_ ) {
+	append( timestamp_, text_ );
+}
+
+void HistoryEntries::push_back( Entry const& entry_ ) {
+	if ( ( _next - _first ) == capacity() ) {
+		grow();
+	}
+	Entry& e( at( _next ) );
+	store( e, entry_._text, entry_._length, entry_._utf8, entry_._utf8Length );
+	e._live = true;
+	e._persisted = entry_._persisted;
+	e._frecency = entry_._frecency;
+	e._metadata = -1;
+	e._timestamp = entry_._timestamp;
+	++ _next;
+	++ _size;
+	if ( ! e._persisted ) {
+		++ _unsavedSize;
+	}
+}
+
+/*
+ * Copy of given entry along with its metadata.
+ */
+void HistoryEntries::push_back( const_iterator it_ ) {
+	push_back( *it_ );
+	if ( it_->_metadata >= 0 ) {
+		Replxx::HistoryMetadata metadata;
+		it_.owner()->_columns.get( it_->_metadata, metadata );
+		set_metadata( iterator( this, _next - 1 ), metadata );
+	}
+}
+
+void HistoryEntries::set_metadata( iterator it_, Replxx::HistoryMetadata const& metadata_ ) {
+	Entry& e( *it_ );
+	if ( e._metadata < 0 ) {
+		if ( metadata_.fields() == 0 ) {
+			return;
+		}
+		e._metadata = _columns.add( it_.id(), e._timestamp );
+		++ _metadataSize;
+	}
+	_columns.set( e._metadata, metadata_ );
+}
+
+void HistoryEntries::set_persisted( iterator it_, bool persisted_ ) {
+	Entry& e( *it_ );
+	if ( e._persisted != persisted_ ) {
+		_unsavedSize += persisted_ ? -1 : 1;
+		e._persisted = persisted_;
+	}
+}
+
+void HistoryEntries::set_all_persisted( void ) {
+	for ( const_iterator it( begin() ), end( this->end() ); ( _unsavedSize > 0 ) && ( it != end ); ++ it ) {
+		if ( ! it->_persisted ) {
+			at( it.id() )._persisted = true;
+			-- _unsavedSize;
+		}
+	}
+}
+
+/*
+ * Read metadata of given entry, return false if it has none.
+ */
+bool HistoryEntries::metadata( const_iterator it_, Replxx::HistoryMetadata& metadata_ ) const {
+	if ( it_->_metadata < 0 ) {
+		metadata_.clear();
+		return ( false );
+	}
+	_columns.get( it_->_metadata, metadata_ );
+	return ( metadata_.fields() != 0 );
+}
+
+/*
+ * Identifiers (in storage order) of entries meeting given criteria,
+ * WITHIN criterion is tested against since_ timestamp.
+ *
+ * Each criterion is a branch free pass over a single column (block by block)
+ * narrowing the mask of selected rows, entries without metadata
+ * are looked at only if no metadata field is tested.
+ */
+void HistoryEntries::filter( Replxx::HistoryFilter const& filter_, timestamp_t since_, std::vector<id_t>& ids_ ) const {
+	typedef Replxx::HistoryFilter filter_t;
+	typedef Replxx::HistoryMetadata metadata_t;
+	ids_.clear();
+	bool within( filter_.has( filter_t::WITHIN ) );
+	int required( 0 );
+	if ( filter_.has( filter_t::EXIT_STATUS ) || filter_.has( filter_t::FAILED ) ) {
+		required |= metadata_t::EXIT_STATUS;
+	}
+	if ( filter_.has( filter_t::MIN_DURATION ) ) {
+		required |= metadata_t::DURATION;
+	}
+	if ( filter_.has( filter_t::DIRECTORY ) ) {
+		required |= metadata_t::DIRECTORY;
+	}
+	if ( required == 0 ) {
+		for ( const_iterator it( begin() ), end( this->end() ); it != end; ++ it ) {
+			if ( ! within || ( it->_timestamp >= since_ ) ) {
+				ids_.push_back( it.id() );
+			}
+		}
+		return;
+	}
+	int directory( filter_.has( filter_t::DIRECTORY ) ? _columns.directory_id( filter_.directory() ) : 0 );
+	if ( directory < 0 ) {
+		return;
+	}
+	int exitStatus( filter_.exit_status() );
+	long long minDuration( filter_.min_duration() );
+	unsigned char selected[BLOCK_SIZE];
+	size_t rows( static_cast<size_t>( _columns.rows() ) );
+	for ( size_t offset( 0 ); offset < rows; offset += BLOCK_SIZE ) {
+		Columns::Block const& block( _columns._blocks[offset >> BLOCK_BITS] );
+		size_t n( std::min( rows - offset, static_cast<size_t>( BLOCK_SIZE ) ) );
+		for ( size_t r( 0 ); r < n; ++ r ) {
+			selected[r] = ( block._fields[r] & required ) == required;
+		}
+		if ( within ) {
+			for ( size_t r( 0 ); r < n; ++ r ) {
+				selected[r] &= block._timestamps[r] >= since_;
+			}
+		}
+		if ( filter_.has( filter_t::EXIT_STATUS ) ) {
+			for ( size_t r( 0 ); r < n; ++ r ) {
+				selected[r] &= block._exitStatuses[r] == exitStatus;
+			}
+		}
+		if ( filter_.has( filter_t::FAILED ) ) {
+			for ( size_t r( 0 ); r < n; ++ r ) {
+				selected[r] &= block._exitStatuses[r] != 0;
+			}
+		}
+		if ( filter_.has( filter_t::MIN_DURATION ) ) {
+			for ( size_t r( 0 ); r < n; ++ r ) {
+				selected[r] &= block._durations[r] >= minDuration;
+			}
+		}
+		if ( filter_.has( filter_t::DIRECTORY ) ) {
+			for ( size_t r( 0 ); r < n; ++ r ) {
+				selected[r] &= block._directories[r] == directory;
+			}
+		}
+		for ( size_t r( 0 ); r < n; ++ r ) {
+			if ( selected[r] ) {
+				ids_.push_back( block._owners[r] );
+			}
+		}
+	}
+	id_t first( _first );
+	std::sort( ids_.begin(), ids_.end(), [first]( id_t l, id_t r ) { return ( ( l - first ) < ( r - first ) ); } );
+}
+
+HistoryEntries::Entry& HistoryEntries::append( timestamp_t timestamp_, UnicodeStringView text_ ) {
+	if ( ( _next - _first ) == capacity() ) {
+		grow();
+	}
+	Entry& e( at( _next ) );
+	store( e, text_ );
+	e._live = true;
+	e._persisted = false;
+	e._frecency = 0;
+	e._metadata = -1;
+	e._timestamp = timestamp_;
+	++ _next;
+	++ _size;
+	++ _unsavedSize;
+	return ( e );
+}
+
+HistoryEntries::iterator HistoryEntries::erase( iterator it_ ) {
+	id_t id( it_.id() );
+	Entry& e( at( id ) );
+	e._live = false;
+	-- _size;
+	if ( ! e._persisted ) {
+		-- _unsavedSize;
+	}
+	_textSize -= e._length;
+	_utf8Size -= e._utf8Length + 1;
+	if ( e._metadata >= 0 ) {
+		_columns.erase( e._metadata );
+		-- _metadataSize;
+	}
+	while ( ( _first != _next ) && ! at( _first )._live ) {
+		++ _first;
+	}
+	if ( _size == 0 ) {
+		clear();
+	}
+	return ( iterator( this, next_live( id ) ) );
+}
+
+void HistoryEntries::clear( void ) {
+	_ring.clear();
+	_first = _next;
+	_size = 0;
+	_arena.clear();
+	_utf8Arena.clear();
+	_textSize = 0;
+	_utf8Size = 0;
+	_columns.clear();
+	_metadataSize = 0;
+	_unsavedSize = 0;
+}
+
+/*
+ * Store given text and its UTF-8 form in the arenas.
+ */
+void HistoryEntries::store( Entry& entry_, UnicodeStringView text_ ) {
+	int len( text_.length() );
+	char32_t* text( len > 0 ? _arena.allocate( len ) : nullptr );
+	std::copy( text_.get(), text_.get() + len, text );
+	int capacity( len * 4 + 1 );
+	char* utf8( _utf8Arena.allocate( capacity ) );
+	int utf8Len( copyString32to8( utf8, capacity, text_.get(), len ) );
+	utf8[utf8Len] = 0;
+	_utf8Arena.shrink( capacity - ( utf8Len + 1 ) );
+	entry_._text = text;
+	entry_._length = len;
+	entry_._utf8 = utf8;
+	entry_._utf8Length = utf8Len;
+	_textSize += len;
+	_utf8Size += utf8Len + 1;
+}
+
+/*
+ * Store copies of already converted text,
+ * new arena chunks are at least as big as given size hints.
+ */
+void HistoryEntries::store( Entry& entry_, char32_t const* text_, int len_, char const* utf8_, int utf8Len_, long long textHint_, long long utf8Hint_ ) {
+	char32_t* text( len_ > 0 ? _arena.allocate( len_, static_cast<int>( textHint_ ) ) : nullptr );
+	std::copy( text_, text_ + len_, text );
+	char* utf8( _utf8Arena.allocate( utf8Len_ + 1, static_cast<int>( utf8Hint_ ) ) );
+	std::copy( utf8_, utf8_ + utf8Len_ + 1, utf8 );
+	entry_._text = text;
+	entry_._length = len_;
+	entry_._utf8 = utf8;
+	entry_._utf8Length = utf8Len_;
+	_textSize += len_;
+	_utf8Size += utf8Len_ + 1;
+}
+
+void HistoryEntries::grow( void ) {
+	ring_t ring;
+	ring.resize( std::max( _ring.size() * 2, static_cast<size_t>( 1 ) ) );
+	size_t mask( ( ring.size() << BLOCK_BITS ) - 1 );
+	HistoryEntries const& self( *this );
+	for ( id_t id( _first ); id != _next; ++ id ) {
+		size_t slot( id & mask );
+		ring.modify( slot >> BLOCK_BITS )._entries[slot & ( BLOCK_SIZE - 1 )] = self.at( id );
+	}
+	_ring.swap( ring );
+}
+
+/*
+ * Stable sort of entries by timestamp.
+ *
+ * Entries are expected to form few ascending runs
+ * (e.g. in-memory history followed by records read from history file),
+ * each run is merged in place into entries preceding it,
+ * unordered input falls back to regular sort.
+ *
+ * Returns false if entries were already sorted and were not renumbered.
+ */
+bool HistoryEntries::sort( void ) {
+	bool renumbered( reorder() );
+	if ( renumbered && ( _metadataSize > 0 ) ) {
+		relink();
+	}
+	return ( renumbered );
+}
+
+/*
+ * Point metadata rows back at their (renumbered) entries.
+ */
+void HistoryEntries::relink( void ) {
+	for ( id_t id( _first ); id != _next; ++ id ) {
+		Entry const& e( at( id ) );
+		if ( e._live && ( e._metadata >= 0 ) ) {
+			_columns.relink( e._metadata, id );
+		}
+	}
+}
+
+bool HistoryEntries::reorder( void ) {
+	bool renumbered( ( _next - _first ) != static_cast<id_t>( _size ) );
+	if ( renumbered ) {
+		squeeze();
+	}
+	std::vector<id_t> runs;
+	HistoryEntries const& self( *this );
+	for ( id_t id( _first + 1 ); ( _first != _next ) && ( id != _next ); ++ id ) {
+		if ( self.at( id ) < self.at( id - 1 ) ) {
+			runs.push_back( id );
+		}
+	}
+	if ( runs.empty() ) {
+		return ( renumbered );
+	}
+	if ( runs.size() > MAX_MERGED_RUNS ) {
+		buffer_t entries;
+		entries.reserve( static_cast<size_t>( _size ) );
+		for ( id_t id( _first ); id != _next; ++ id ) {
+			entries.push_back( at( id ) );
+		}
+		std::stable_sort( entries.begin(), entries.end() );
+		id_t id( _first );
+		for ( Entry const& e : entries ) {
+			at( id ) = e;
+			++ id;
+		}
+		return ( true );
+	}
+	runs.push_back( _next );
+	for ( size_t i( 0 ); ( i + 1 ) < runs.size(); ++ i ) {
+		merge( _first, runs[i], runs[i + 1] );
+	}
+	return ( true );
+}
+
+/*
+ * Move all entries towards the front of the ring so there are no holes between them.
+ */
+void HistoryEntries::squeeze( void ) {
+	id_t to( _first );
+	for ( id_t id( _first ); id != _next; ++ id ) {
+		if ( ! at( id )._live ) {
+			continue;
+		}
+		if ( id != to ) {
+			at( to ) = at( id );
+			at( id )._live = false;
+		}
+		++ to;
+	}
+	_next = to;
+}
+
+/*
+ * Merge two adjacent sorted ranges: [first_, mid_) and [mid_, last_),
+ * shorter of the two ranges is copied to a temporary buffer.
+ */
+void HistoryEntries::merge( id_t first_, id_t mid_, id_t last_ ) {
+	buffer_t buffer;
+	if ( ( mid_ - first_ ) <= ( last_ - mid_ ) ) {
+		for ( id_t id( first_ ); id != mid_; ++ id ) {
+			buffer.push_back( at( id ) );
+		}
+		buffer_t::const_iterator it( buffer.begin() );
+		id_t from( mid_ );
+		id_t to( first_ );
+		while ( it != buffer.end() ) {
+			if ( ( from != last_ ) && ( at( from ) < *it ) ) {
+				at( to ) = at( from );
+				++ from;
+			} else {
+				at( to ) = *it;
+				++ it;
+			}
+			++ to;
+		}
+	} else {
+		for ( id_t id( mid_ ); id != last_; ++ id ) {
+			buffer.push_back( at( id ) );
+		}
+		buffer_t::const_reverse_iterator it( buffer.rbegin() );
+		id_t from( mid_ );
+		id_t to( last_ );
+		while ( it != buffer.rend() ) {
+			if ( ( from != first_ ) && ( *it < at( from - 1 ) ) ) {
+				-- from;
+				-- to;
+				at( to ) = at( from );
+			} else {
+				-- to;
+				at( to ) = *it;
+				++ it;
+			}
+		}
+	}
+}
+
+/*
+ * Tell if holes and arena space of erased entries are worth reclaiming.
+ */
+bool HistoryEntries::fragmented( void ) const {
+	long long holes( static_cast<long long>( _next - _first ) - _size );
+	return (
+		( holes > ( _size + MIN_RING_SIZE ) )
+		|| ( ( _arena.size() - _textSize ) > ( _textSize + ARENA_CHUNK_SIZE ) )
+		|| ( ( _utf8Arena.size() - _utf8Size ) > ( _utf8Size + ARENA_CHUNK_SIZE ) )
+		|| ( ( _columns.rows() - _metadataSize ) > ( _metadataSize + MIN_RING_SIZE ) )
+	);
+}
+
+/*
+ * Renumber entries so there are no holes between them
+ * and move their texts to a single arena chunk,
+ * metadata rows of erased entries are dropped.
+ */
+void HistoryEntries::compact( void ) {
+	HistoryEntries compacted;
+	size_t blocks( 1 );
+	while ( ( blocks << BLOCK_BITS ) < static_cast<size_t>( _size ) ) {
+		blocks *= 2;
+	}
+	compacted._ring.resize( blocks );
+	compacted._first = compacted._next = _next;
+	HistoryEntries const& self( *this );
+	for ( id_t id( _first ); id != _next; ++ id ) {
+		Entry const& e( self.at( id ) );
+		if ( ! e._live ) {
+			continue;
+		}
+		Entry& c( compacted.at( compacted._next ) );
+		c = e;
+		compacted.store( c, e._text, e._length, e._utf8, e._utf8Length, _textSize, _utf8Size );
+		if ( e._metadata >= 0 ) {
+			Replxx::HistoryMetadata metadata;
+			_columns.get( e._metadata, metadata );
+			c._metadata = -1;
+			compacted.set_metadata( iterator( &compacted, compacted._next ), metadata );
+		}
+		++ compacted._next;
+		++ compacted._size;
+	}
+	compacted._unsavedSize = _unsavedSize;
+	swap( compacted );
+}
+
+/*
+ * Number of entries preceding given one.
+ */
+int HistoryEntries::ordinal( const_iterator it_ ) const {
+	if ( ( it_.id() - _first ) > ( _next - _first ) ) {
+		return ( _size );
+	}
+	int n( 0 );
+	for ( id_t id( _first ); id != it_.id(); ++ id ) {
+		if ( is_live( id ) ) {
+			++ n;
+		}
+	}
+	return ( n );
+}
+
+/*
+ * Iterator to n-th entry, valid only if there are no holes between entries
+ * (i.e. after sort() or compact()).
+ */
+HistoryEntries::iterator HistoryEntries::nth( int n_ ) {
+	return ( iterator( this, _first + static_cast<id_t>( std::min( std::max( n_, 0 ), _size ) ) ) );
+}
+
+}
+
@@ -0,0 +1,407 @@
+#ifndef REPLXX_HISTORYENTRIES_HXX_INCLUDED
+#define REPLXX_HISTORYENTRIES_HXX_INCLUDED 1
+
+#include <vector>
+#include <bitset>
+#include <memory>
+#include <iterator>
+#include <unordered_map>
+#include <cstddef>
+
+#include "replxx.hxx"
+#include "unicodestring.hxx"
+
+namespace replxx {
+
+/*
+ * Storage of history entries.
+ *
+ * Entries are compact fixed size records kept in a ring buffer,
+ * texts of all entries are stored in a shared character arena,
+ * along with NUL terminated UTF-8 copies of the texts kept in a byte arena,
+ * so entries can be saved and exported without conversion.
+ *
+ * Each entry is identified by an ascending (in storage order) identifier,
+ * the identifier (wrapped by an iterator) is a stable handle to the entry,
+ * it stays valid until the entry is erased or entries are renumbered by sort() or compact().
+ * Erased entries leave holes that are skipped by iterators,
+ * holes and arena space used by erased entries are reclaimed by compact().
+ *
+ * Optional metadata of entries is kept column-wise in separate arrays (see Columns),
+ * an entry refers to its row by index, so entries without metadata
+ * and scans that do not use it do not pay for it.
+ *
+ * Entries and metadata rows are kept in fixed size blocks,
+ * blocks and arena chunks can be shared with read only copies made by share(),
+ * so making such a copy (and modifying entries after it was made)
+ * does not cost a copy of each entry.
+ */
+class HistoryEntries {
+public:
+	typedef unsigned int id_t;
+	/*
+	 * Timestamps are stored as YYYYMMDDhhmmssmmm decimal numbers.
+	 */
+	typedef long long timestamp_t;
+	class Entry {
+		char32_t const* _text;
+		char const* _utf8;
+		timestamp_t _timestamp;
+		int _length;
+		int _utf8Length;
+		bool _live;
+		bool _persisted;
+		/*
+		 * Frecency rank maintained by History (0 if not known yet).
+		 */
+		float _frecency;
+		/*
+		 * Row of entry metadata in _columns, -1 if the entry has none.
+		 */
+		int _metadata;
+	public:
+		Entry( void );
+		timestamp_t timestamp( void ) const {
+			return ( _timestamp );
+		}
+		UnicodeStringView text( void ) const {
+			return ( UnicodeStringView( _text, _length ) );
+		}
+		char const* utf8( void ) const {
+			return ( _utf8 );
+		}
+		int utf8_length( void ) const {
+			return ( _utf8Length );
+		}
+		bool persisted( void ) const {
+			return ( _persisted );
+		}
+		float frecency( void ) const {
+			return ( _frecency );
+		}
+		void set_frecency( float frecency_ ) {
+			_frecency = frecency_;
+		}
+		bool has_metadata( void ) const {
+			return ( _metadata >= 0 );
+		}
+		bool operator < ( Entry const& other_ ) const {
+			return ( _timestamp < other_._timestamp );
+		}
+	private:
+		friend class HistoryEntries;
+	};
+	template<typename owner_t, typename entry_t>
+	class basic_iterator {
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef entry_t value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef entry_t* pointer;
+		typedef entry_t& reference;
+	private:
+		owner_t* _owner;
+		id_t _id;
+	public:
+		basic_iterator( void )
+			: _owner( nullptr )
+			, _id( 0 ) {
+		}
+		basic_iterator( owner_t* owner_, id_t id_ )
+			: _owner( owner_ )
+			, _id( id_ ) {
+		}
+		template<typename other_owner_t, typename other_entry_t>
+		basic_iterator( basic_iterator<other_owner_t, other_entry_t> const& other_ )
+			: _owner( other_.owner() )
+			, _id( other_.id() ) {
+		}
+		id_t id( void ) const {
+			return ( _id );
+		}
+		owner_t* owner( void ) const {
+			return ( _owner );
+		}
+		reference operator * ( void ) const {
+			return ( _owner->at( _id ) );
+		}
+		pointer operator -> ( void ) const {
+			return ( &_owner->at( _id ) );
+		}
+		basic_iterator& operator ++ ( void ) {
+			_id = _owner->next_live( _id );
+			return ( *this );
+		}
+		basic_iterator operator ++ ( int ) {
+			basic_iterator it( *this );
+			++ *this;
+			return ( it );
+		}
+		basic_iterator& operator -- ( void ) {
+			_id = _owner->prev_live( _id );
+			return ( *this );
+		}
+		basic_iterator operator -- ( int ) {
+			basic_iterator it( *this );
+			-- *this;
+			return ( it );
+		}
+		template<typename other_owner_t, typename other_entry_t>
+		bool operator == ( basic_iterator<other_owner_t, other_entry_t> const& other_ ) const {
+			return ( _id == other_.id() );
+		}
+		template<typename other_owner_t, typename other_entry_t>
+		bool operator != ( basic_iterator<other_owner_t, other_entry_t> const& other_ ) const {
+			return ( _id != other_.id() );
+		}
+	};
+	typedef basic_iterator<HistoryEntries, Entry> iterator;
+	typedef basic_iterator<HistoryEntries const, Entry const> const_iterator;
+private:
+	static int const BLOCK_BITS = 8;
+	static int const BLOCK_SIZE = 1 << BLOCK_BITS;
+	static int const SEGMENT_BITS = 6;
+	static int const SEGMENT_SIZE = 1 << SEGMENT_BITS;
+	typedef std::vector<Entry> buffer_t;
+	/*
+	 * Sequence of blocks that can be shared with copies made by share(),
+	 * a shared block is copied by its first modification.
+	 *
+	 * Blocks are grouped in segments of SEGMENT_SIZE blocks, segments are shared the same way,
+	 * so share() and the first modification of a block cost a pointer per segment
+	 * and a pointer per block of the modified segment.
+	 */
+	template<typename block_t>
+	class Blocks {
+		struct Segment {
+			std::shared_ptr<block_t> _blocks[SEGMENT_SIZE];
+			std::bitset<SEGMENT_SIZE> _shared;
+		};
+		std::vector<std::shared_ptr<Segment>> _segments;
+		std::vector<bool> _shared;
+		size_t _size;
+	public:
+		Blocks( void )
+			: _segments()
+			, _shared()
+			, _size( 0 ) {
+		}
+		size_t size( void ) const {
+			return ( _size );
+		}
+		block_t const& operator [] ( size_t i_ ) const {
+			return ( *_segments[i_ >> SEGMENT_BITS]->_blocks[i_ & ( SEGMENT_SIZE - 1 )] );
+		}
+		block_t& modify( size_t i_ ) {
+			size_t s( i_ >> SEGMENT_BITS );
+			size_t b( i_ & ( SEGMENT_SIZE - 1 ) );
+			if ( _shared[s] || _segments[s]->_shared[b] ) {
+				unshare( s, b );
+			}
+			return ( *_segments[s]->_blocks[b] );
+		}
+		void resize( size_t );
+		void share( Blocks& );
+		void clear( void );
+		void swap( Blocks& );
+	private:
+		void unshare( size_t, size_t );
+	};
+	struct EntryBlock {
+		Entry _entries[BLOCK_SIZE];
+	};
+	typedef Blocks<EntryBlock> ring_t;
+	/*
+	 * Append only storage of character sequences allocated in big chunks.
+	 *
+	 * Each chunk keeps the chunk allocated before it alive,
+	 * so a copy made by share() refers to all chunks through the last one,
+	 * chunks shared with a copy are never written by the copy.
+	 */
+	template<typename char_t>
+	class Arena {
+		struct Chunk {
+			std::unique_ptr<char_t[]> _data;
+			std::shared_ptr<Chunk> _prev;
+			Chunk( char_t* data_, std::shared_ptr<Chunk> const& prev_ )
+				: _data( data_ )
+				, _prev( prev_ ) {
+			}
+			~Chunk( void );
+		};
+		std::shared_ptr<Chunk> _last;
+		char_t* _pos;
+		int _free;
+		long long _size;
+	public:
+		Arena( void )
+			: _last()
+			, _pos( nullptr )
+			, _free( 0 )
+			, _size( 0 ) {
+		}
+		long long size( void ) const {
+			return ( _size );
+		}
+		char_t* allocate( int, int = 0 );
+		void shrink( int );
+		void share( Arena const& );
+		void clear( void );
+		void swap( Arena& );
+	};
+	/*
+	 * Metadata of entries stored column-wise, one row per entry with any metadata,
+	 * so filters read only the columns of the fields they test.
+	 *
+	 * Absent fields hold zeros, directories are interned,
+	 * rows of erased entries have no fields and are reclaimed by compact().
+	 * _owners hold identifiers of entries owning the rows,
+	 * _timestamps hold copies of their timestamps.
+	 *
+	 * Columns are split into blocks of BLOCK_SIZE rows,
+	 * interned directory names are kept in a single block of their own.
+	 */
+	class Columns {
+		struct Block {
+			int _fields[BLOCK_SIZE];
+			id_t _owners[BLOCK_SIZE];
+			timestamp_t _timestamps[BLOCK_SIZE];
+			int _exitStatuses[BLOCK_SIZE];
+			long long _durations[BLOCK_SIZE];
+			int _directories[BLOCK_SIZE];
+		};
+		struct Directories {
+			std::vector<std::string> _names;
+			std::unordered_map<std::string, int> _ids;
+		};
+		Blocks<Block> _blocks;
+		Blocks<Directories> _directories;
+		int _rows;
+	public:
+		Columns( void )
+			: _blocks()
+			, _directories()
+			, _rows( 0 ) {
+		}
+		int rows( void ) const {
+			return ( _rows );
+		}
+		int add( id_t, timestamp_t );
+		void set( int, Replxx::HistoryMetadata const& );
+		void get( int, Replxx::HistoryMetadata& ) const;
+		void erase( int );
+		void relink( int, id_t );
+		int directory_id( std::string const& ) const;
+		void share( Columns& );
+		void clear( void );
+		void swap( Columns& );
+	private:
+		friend class HistoryEntries;
+	};
+	/*
+	 * _ring capacity is always a power of 2, an entry with identifier `id`
+	 * is stored in slot `id & ( capacity() - 1 )`,
+	 * identifiers of stored entries (and holes) are in [_first, _next) range.
+	 */
+	ring_t _ring;
+	id_t _first;
+	id_t _next;
+	int _size;
+	Arena<char32_t> _arena;
+	Arena<char> _utf8Arena;
+	long long _textSize;
+	long long _utf8Size;
+	Columns _columns;
+	int _metadataSize;
+	/*
+	 * Number of live entries not marked as persisted.
+	 */
+	int _unsavedSize;
+public:
+	HistoryEntries( void );
+	HistoryEntries( HistoryEntries const& );
+	HistoryEntries( HistoryEntries&& );
+	HistoryEntries& operator = ( HistoryEntries const& );
+	HistoryEntries& operator = ( HistoryEntries&& );
+	void swap( HistoryEntries& );
+	void share( HistoryEntries& );
+	iterator begin( void ) {
+		return ( iterator( this, _first ) );
+	}
+	iterator end( void ) {
+		return ( iterator( this, _next ) );
+	}
+	const_iterator begin( void ) const {
+		return ( const_iterator( this, _first ) );
+	}
+	const_iterator end( void ) const {
+		return ( const_iterator( this, _next ) );
+	}
+	bool empty( void ) const {
+		return ( _size == 0 );
+	}
+	int size( void ) const {
+		return ( _size );
+	}
+	int unsaved_size( void ) const {
+		return ( _unsavedSize );
+	}
+	Entry& back( void ) {
+		return ( at( prev_live( _next ) ) );
+	}
+	iterator find( id_t id_ ) {
+		return ( is_live( id_ ) ? iterator( this, id_ ) : end() );
+	}
+	const_iterator find( id_t id_ ) const {
+		return ( is_live( id_ ) ? const_iterator( this, id_ ) : end() );
+	}
+	iterator lower_bound( id_t );
+	const_iterator seek( timestamp_t ) const;
+	void emplace_back( timestamp_t, UnicodeStringView );
+	void push_back( Entry const& );
+	void push_back( const_iterator );
+	void set_metadata( iterator, Replxx::HistoryMetadata const& );
+	void set_persisted( iterator, bool = true );
+	void set_all_persisted( void );
+	bool metadata( const_iterator, Replxx::HistoryMetadata& ) const;
+	void filter( Replxx::HistoryFilter const&, timestamp_t, std::vector<id_t>& ) const;
+	iterator erase( iterator );
+	void clear( void );
+	bool sort( void );
+	bool fragmented( void ) const;
+	void compact( void );
+	int ordinal( const_iterator ) const;
+	iterator nth( int );
+private:
+	template<typename owner_t, typename entry_t>
+	friend class basic_iterator;
+	size_t capacity( void ) const {
+		return ( _ring.size() << BLOCK_BITS );
+	}
+	Entry& at( id_t id_ ) {
+		size_t slot( id_ & ( capacity() - 1 ) );
+		return ( _ring.modify( slot >> BLOCK_BITS )._entries[slot & ( BLOCK_SIZE - 1 )] );
+	}
+	Entry const& at( id_t id_ ) const {
+		size_t slot( id_ & ( capacity() - 1 ) );
+		return ( _ring[slot >> BLOCK_BITS]._entries[slot & ( BLOCK_SIZE - 1 )] );
+	}
+	bool is_live( id_t id_ ) const {
+		return ( ( ( id_ - _first ) < ( _next - _first ) ) && at( id_ )._live );
+	}
+	id_t next_live( id_t ) const;
+	id_t prev_live( id_t ) const;
+	Entry& append( timestamp_t, UnicodeStringView );
+	bool reorder( void );
+	void relink( void );
+	void squeeze( void );
+	void merge( id_t, id_t, id_t );
+	void store( Entry&, UnicodeStringView );
+	void store( Entry&, char32_t const*, int, char const*, int, long long = 0, long long = 0 );
+	void grow( void );
+};
+
+}
+
+#endif
+
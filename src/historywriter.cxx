@@ -0,0 +1,136 @@
+#include <exception>
+
+#include "historywriter.hxx"
+
+namespace replxx {
+
+HistoryWriter::HistoryWriter( callback_t const& callback_ )
+	: _replica()
+	, _jobs()
+	, _synced()
+	, _generation( 0 )
+	, _callback( callback_ )
+	, _busy( false )
+	, _stop( false )
+	, _mutex()
+	, _cond()
+	, _thread() {
+	_thread = std::thread( &HistoryWriter::run, this );
+}
+
+/*
+ * All pending save requests are completed before the writer thread is stopped.
+ */
+HistoryWriter::~HistoryWriter( void ) {
+	/* scope for lock */ {
+		std::lock_guard<std::mutex> l( _mutex );
+		_stop = true;
+	}
+	_cond.notify_all();
+	_thread.join();
+}
+
+void HistoryWriter::set_callback( callback_t const& callback_ ) {
+	std::lock_guard<std::mutex> l( _mutex );
+	_callback = callback_;
+}
+
+/*
+ * Queue saving (or synchronizing) given history to given file.
+ *
+ * The snapshot is taken on the caller's thread,
+ * it supersedes pending snapshot for the same file if there is one.
+ *
+ * Returns false if the writer is being stopped and does not accept new requests.
+ */
+bool HistoryWriter::save( History& history_, std::string const& filename_, bool sync_ ) {
+	snapshot_t snapshot( new History::Snapshot() );
+	history_.snapshot( *snapshot, filename_ );
+	/* scope for lock */ {
+		std::lock_guard<std::mutex> l( _mutex );
+		if ( _stop ) {
+			return ( false );
+		}
+		for ( Job& job : _jobs ) {
+			if ( job._filename == filename_ ) {
+				snapshot->supersede( *job._snapshot );
+				job._snapshot = std::move( snapshot );
+				job._sync = job._sync || sync_;
+				job._generation = _generation;
+				return ( true );
+			}
+		}
+		_jobs.emplace_back( filename_, sync_, std::move( snapshot ), _generation );
+	}
+	_cond.notify_all();
+	return ( true );
+}
+
+/*
+ * Merge result of the most recent completed history synchronization into given history.
+ */
+void HistoryWriter::adopt( History& history_ ) {
+	snapshot_t synced;
+	/* scope for lock */ {
+		std::lock_guard<std::mutex> l( _mutex );
+		synced.swap( _synced );
+	}
+	if ( synced ) {
+		history_.merge_synced( *synced );
+	}
+}
+
+void HistoryWriter::discard( void ) {
+	std::lock_guard<std::mutex> l( _mutex );
+	++ _generation;
+	_synced.reset();
+}
+
+/*
+ * Wait until all queued save requests are completed.
+ */
+void HistoryWriter::flush( void ) {
+	std::unique_lock<std::mutex> l( _mutex );
+	_cond.wait( l, [this]() { return ( _jobs.empty() && ! _busy ); } );
+}
+
+void HistoryWriter::run( void ) {
+	std::unique_lock<std::mutex> l( _mutex );
+	while ( true ) {
+		_cond.wait( l, [this]() { return ( _stop || ! _jobs.empty() ); } );
+		if ( _jobs.empty() ) {
+			break;
+		}
+		Job job( std::move( _jobs.front() ) );
+		_jobs.pop_front();
+		_busy = true;
+		l.unlock();
+		bool saved( false );
+		snapshot_t synced;
+		try {
+			saved = _replica.save_snapshot( *job._snapshot, job._filename, job._sync );
+			if ( saved && job._sync ) {
+				synced.reset( new History::Snapshot() );
+				_replica.snapshot( *synced, job._filename );
+			}
+		} catch ( std::exception const& ) {
+			saved = false;
+			synced.reset();
+		}
+		l.lock();
+		if ( synced && ( job._generation == _generation ) ) {
+			_synced = std::move( synced );
+		}
+		callback_t callback( _callback );
+		l.unlock();
+		if ( callback ) {
+			callback( job._filename, saved );
+		}
+		l.lock();
+		_busy = false;
+		_cond.notify_all();
+	}
+}
+
+}
+
@@ -0,0 +1,79 @@
+#ifndef REPLXX_HISTORYWRITER_HXX_INCLUDED
+#define REPLXX_HISTORYWRITER_HXX_INCLUDED 1
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "replxx.hxx"
+#include "history.hxx"
+
+namespace replxx {
+
+/*
+ * Background persistence of REPL's history.
+ *
+ * Save requests carry snapshots of REPL's history and are queued
+ * to a dedicated writer thread, pending requests for the same file are coalesced.
+ * The writer keeps its own replica of REPL's history that is saved to the history file
+ * (so journal mode works as in synchronous mode),
+ * completion of each save is reported through a callback invoked on the writer thread.
+ * Result of history synchronization is kept until REPL's thread merges it
+ * into REPL's history with adopt().
+ */
+class HistoryWriter {
+public:
+	typedef Replxx::history_save_callback_t callback_t;
+private:
+	typedef std::unique_ptr<History::Snapshot> snapshot_t;
+	class Job {
+		std::string _filename;
+		bool _sync;
+		snapshot_t _snapshot;
+		unsigned long long _generation;
+	public:
+		Job( std::string const& filename_, bool sync_, snapshot_t&& snapshot_, unsigned long long generation_ )
+			: _filename( filename_ )
+			, _sync( sync_ )
+			, _snapshot( std::move( snapshot_ ) )
+			, _generation( generation_ ) {
+		}
+	private:
+		friend class HistoryWriter;
+	};
+	typedef std::deque<Job> jobs_t;
+	History _replica;
+	jobs_t _jobs;
+	snapshot_t _synced;
+	/*
+	 * Incremented when pending synchronization results become obsolete,
+	 * (e.g. REPL's history was cleared or reloaded).
+	 */
+	unsigned long long _generation;
+	callback_t _callback;
+	bool _busy;
+	bool _stop;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	std::thread _thread;
+public:
+	HistoryWriter( callback_t const& );
+	~HistoryWriter( void );
+	void set_callback( callback_t const& );
+	bool save( History&, std::string const&, bool );
+	void adopt( History& );
+	void discard( void );
+	void flush( void );
+private:
+	HistoryWriter( HistoryWriter const& ) = delete;
+	HistoryWriter& operator = ( HistoryWriter const& ) = delete;
+	void run( void );
+};
+
+}
+
+#endif
+
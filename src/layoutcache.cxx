@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "layoutcache.hxx"
+#include "util.hxx"
+
+namespace replxx {
+
+namespace {
+
+static int const CHECKPOINT_INTERVAL( 64 );
+
+/*
+ * Index following the character or escape sequence starting at `pos_`,
+ * split the same way replxx::virtual_render() splits it.
+ */
+int token_end( char32_t const* text_, int pos_, int len_ ) {
+	if ( text_[pos_] != '\033' ) {
+		return ( pos_ + 1 );
+	}
+	++ pos_;
+	if ( ( pos_ >= len_ ) || ( text_[pos_] != '[' ) ) {
+		return ( pos_ );
+	}
+	++ pos_;
+	while ( ( pos_ < len_ ) && ( ( text_[pos_] == ';' ) || ( ( text_[pos_] >= '0' ) && ( text_[pos_] <= '9' ) ) ) ) {
+		++ pos_;
+	}
+	return ( ( pos_ < len_ ) && ( text_[pos_] == 'm' ) ? pos_ + 1 : pos_ );
+}
+
+}
+
+LayoutCache::LayoutCache( void )
+	: _checkpoints()
+	, _x( 0 )
+	, _y( 0 )
+	, _screenColumns( 0 )
+	, _promptLen( 0 ) {
+}
+
+void LayoutCache::invalidate( int from_ ) {
+	if ( _checkpoints.empty() ) {
+		return;
+	}
+	checkpoints_t::iterator it(
+		std::upper_bound(
+			_checkpoints.begin() + 1, _checkpoints.end(), from_,
+			[]( int pos_, Checkpoint const& checkpoint_ ) {
+				return ( pos_ < checkpoint_._pos );
+			}
+		)
+	);
+	_checkpoints.erase( it, _checkpoints.end() );
+}
+
+/*
+ * Add a checkpoint following the last one,
+ * returns false if there is no place for it before `len_`.
+ *
+ * Layout can be resumed only after a plain character
+ * (escape sequences look ahead past their end)
+ * that did not wrap the line (virtual_render() always starts unwrapped).
+ */
+bool LayoutCache::extend( char32_t const* text_, int len_ ) {
+	Checkpoint const last( _checkpoints.back() );
+	int target( last._pos + CHECKPOINT_INTERVAL );
+	int pos( last._pos );
+	while ( pos < len_ ) {
+		char32_t c( text_[pos] );
+		pos = token_end( text_, pos, len_ );
+		if ( ( c == '\033' ) || ( c == '\b' ) || ( ( pos < target ) && ( c != '\n' ) ) ) {
+			continue;
+		}
+		int x( last._x );
+		int y( last._y );
+		virtual_render( text_ + last._pos, pos - last._pos, x, y, _screenColumns, _promptLen );
+		if ( ( x == 0 ) && ( c != '\n' ) && ( c != '\r' ) ) {
+			continue;
+		}
+		_checkpoints.push_back( Checkpoint{ pos, x, y } );
+		return ( true );
+	}
+	return ( false );
+}
+
+/*
+ * Same as replxx::virtual_render( text_, len_, x_, y_, screenColumns_, promptLen_ )
+ * for successive prefixes of one text.
+ */
+void LayoutCache::position( char32_t const* text_, int len_, int& x_, int& y_, int screenColumns_, int promptLen_ ) {
+	if (
+		_checkpoints.empty()
+		|| ( x_ != _x )
+		|| ( y_ != _y )
+		|| ( screenColumns_ != _screenColumns )
+		|| ( promptLen_ != _promptLen )
+	) {
+		_checkpoints.assign( 1, Checkpoint{ 0, x_, y_ } );
+		_x = x_;
+		_y = y_;
+		_screenColumns = screenColumns_;
+		_promptLen = promptLen_;
+	}
+	while ( ( _checkpoints.back()._pos < len_ ) && extend( text_, len_ ) ) {
+	}
+	checkpoints_t::const_iterator it(
+		std::upper_bound(
+			_checkpoints.begin(), _checkpoints.end(), len_,
+			[]( int pos_, Checkpoint const& checkpoint_ ) {
+				return ( pos_ < checkpoint_._pos );
+			}
+		)
+	);
+	Checkpoint const& checkpoint( *( it - 1 ) );
+	x_ = checkpoint._x;
+	y_ = checkpoint._y;
+	virtual_render( text_ + checkpoint._pos, len_ - checkpoint._pos, x_, y_, screenColumns_, promptLen_ );
+}
+
+}
+
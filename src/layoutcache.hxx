@@ -0,0 +1,42 @@
+#ifndef REPLXX_LAYOUTCACHE_HXX_INCLUDED
+#define REPLXX_LAYOUTCACHE_HXX_INCLUDED 1
+
+#include <vector>
+
+namespace replxx {
+
+/*
+ * Screen positions of input characters as computed by replxx::virtual_render(),
+ * remembered at checkpoints (line starts and every few dozen characters),
+ * so that the position of a character is found by laying out
+ * only the text that follows the nearest checkpoint before it.
+ *
+ * Owner has to call invalidate() with index of the first changed character
+ * on every change of the text, checkpoints past that index are dropped.
+ * Change of layout parameters (starting position, screen width, indentation)
+ * is detected automatically.
+ */
+class LayoutCache {
+	struct Checkpoint {
+		int _pos; /* number of characters laid out */
+		int _x;
+		int _y;
+	};
+	typedef std::vector<Checkpoint> checkpoints_t;
+	checkpoints_t _checkpoints;
+	int _x;
+	int _y;
+	int _screenColumns;
+	int _promptLen;
+public:
+	LayoutCache( void );
+	void invalidate( int = 0 );
+	void position( char32_t const*, int, int&, int&, int, int );
+private:
+	bool extend( char32_t const*, int );
+};
+
+}
+
+#endif
+
@@ -0,0 +1,128 @@
+#include <cwctype>
+
+#include "prefixtree.hxx"
+
+namespace replxx {
+
+namespace {
+
+inline char32_t fold( char32_t c_ ) {
+	return ( static_cast<char32_t>( towlower( static_cast<wint_t>( c_ ) ) ) );
+}
+
+}
+
+PrefixTree::PrefixTree( void )
+	: _root() {
+}
+
+void PrefixTree::add( key_t key_, UnicodeStringView text_ ) {
+	char32_t const* s( text_.get() );
+	int len( text_.length() );
+	Node* node( &_root );
+	node->_keys.insert( key_ );
+	int i( 0 );
+	while ( i < len ) {
+		char32_t c( fold( s[i] ) );
+		children_t::iterator it( node->_children.find( c ) );
+		if ( it == node->_children.end() ) {
+			std::unique_ptr<Node> child( new Node() );
+			for ( ; i < len; ++ i ) {
+				child->_label.push_back( fold( s[i] ) );
+			}
+			child->_keys.insert( key_ );
+			node->_children.emplace( c, std::move( child ) );
+			return;
+		}
+		Node* child( it->second.get() );
+		int labelLen( static_cast<int>( child->_label.size() ) );
+		int common( 0 );
+		while ( ( common < labelLen ) && ( ( i + common ) < len ) && ( child->_label[common] == fold( s[i + common] ) ) ) {
+			++ common;
+		}
+		if ( common < labelLen ) {
+			std::unique_ptr<Node> mid( new Node() );
+			mid->_label.assign( child->_label.begin(), child->_label.begin() + common );
+			mid->_keys = child->_keys;
+			child->_label.erase( child->_label.begin(), child->_label.begin() + common );
+			char32_t key( child->_label.front() );
+			mid->_children.emplace( key, std::move( it->second ) );
+			it->second = std::move( mid );
+			child = it->second.get();
+		}
+		child->_keys.insert( key_ );
+		node = child;
+		i += common;
+	}
+}
+
+void PrefixTree::remove( key_t key_, UnicodeStringView text_ ) {
+	char32_t const* s( text_.get() );
+	int len( text_.length() );
+	Node* node( &_root );
+	if ( node->_keys.erase( key_ ) == 0 ) {
+		return;
+	}
+	int i( 0 );
+	while ( i < len ) {
+		children_t::iterator it( node->_children.find( fold( s[i] ) ) );
+		if ( it == node->_children.end() ) {
+			return;
+		}
+		Node* child( it->second.get() );
+		child->_keys.erase( key_ );
+		if ( child->_keys.empty() ) {
+			node->_children.erase( it );
+			break;
+		}
+		i += static_cast<int>( child->_label.size() );
+		node = child;
+	}
+	/*
+	 * Keep the tree compressed: merge a node that no entry ends at
+	 * with its only child.
+	 */
+	if ( ( node != &_root ) && ( node->_children.size() == 1 ) ) {
+		Node* child( node->_children.begin()->second.get() );
+		if ( child->_keys.size() == node->_keys.size() ) {
+			std::unique_ptr<Node> only( std::move( node->_children.begin()->second ) );
+			node->_label.insert( node->_label.end(), only->_label.begin(), only->_label.end() );
+			node->_children = std::move( only->_children );
+		}
+	}
+}
+
+void PrefixTree::clear( void ) {
+	_root._children.clear();
+	_root._keys.clear();
+}
+
+/*
+ * Find keys of all entries starting with given (case folded) prefix.
+ *
+ * Returns nullptr if no entry starts with given prefix.
+ */
+PrefixTree::keys_t const* PrefixTree::find( char32_t const* prefix_, int len_ ) const {
+	Node const* node( &_root );
+	int i( 0 );
+	while ( i < len_ ) {
+		children_t::const_iterator it( node->_children.find( fold( prefix_[i] ) ) );
+		if ( it == node->_children.end() ) {
+			return ( nullptr );
+		}
+		node = it->second.get();
+		for ( char32_t c : node->_label ) {
+			if ( i == len_ ) {
+				break;
+			}
+			if ( c != fold( prefix_[i] ) ) {
+				return ( nullptr );
+			}
+			++ i;
+		}
+	}
+	return ( ! node->_keys.empty() ? &node->_keys : nullptr );
+}
+
+}
+
@@ -0,0 +1,51 @@
+#ifndef REPLXX_PREFIXTREE_HXX_INCLUDED
+#define REPLXX_PREFIXTREE_HXX_INCLUDED 1
+
+#include <set>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "unicodestring.hxx"
+
+namespace replxx {
+
+/*
+ * Compressed radix tree over (case folded) texts of history entries.
+ *
+ * Each node holds an ascending set of keys
+ * of all entries whose text passes through that node,
+ * so entries starting with given prefix are found in O(prefix length)
+ * and visited in key order in O(log n) per entry.
+ * Keys are entry identifiers (history order)
+ * optionally combined with a rank stored in high 32 bits (rank order).
+ */
+class PrefixTree {
+public:
+	typedef unsigned long long key_t;
+	typedef std::set<key_t> keys_t;
+private:
+	struct Node;
+	typedef std::vector<char32_t> label_t;
+	typedef std::map<char32_t, std::unique_ptr<Node>> children_t;
+	struct Node {
+		label_t _label;
+		children_t _children;
+		keys_t _keys;
+	};
+	Node _root;
+public:
+	PrefixTree( void );
+	void add( key_t, UnicodeStringView );
+	void remove( key_t, UnicodeStringView );
+	void clear( void );
+	keys_t const* find( char32_t const*, int ) const;
+private:
+	PrefixTree( PrefixTree const& ) = delete;
+	PrefixTree& operator = ( PrefixTree const& ) = delete;
+};
+
+}
+
+#endif
+
@@ -69,6 +69,8 @@ int Prompt::indentation() const {
 //
 const UnicodeString forwardSearchBasePrompt("(i-search)`");
 const UnicodeString reverseSearchBasePrompt("(reverse-i-search)`");
+const UnicodeString fuzzySearchBasePrompt("(fuzzy-search)`");
+const UnicodeString regexSearchBasePrompt("(regex-search)`");
 const UnicodeString endSearchBasePrompt("': ");
 
 DynamicPrompt::DynamicPrompt( Terminal& terminal_, int initialDirection )
@@ -81,7 +83,7 @@ DynamicPrompt::DynamicPrompt( Terminal& terminal_, int initialDirection )
 void DynamicPrompt::updateSearchPrompt(void) {
 	update_screen_columns();
 	const UnicodeString* basePrompt =
-			(_direction > 0) ? &forwardSearchBasePrompt : &reverseSearchBasePrompt;
+			(_direction == 2) ? &regexSearchBasePrompt : (_direction > 0) ? &forwardSearchBasePrompt : ( _direction < 0 ? &reverseSearchBasePrompt : &fuzzySearchBasePrompt );
 	_text.assign( *basePrompt ).append( _searchText ).append( endSearchBasePrompt );
 	update_state();
 }
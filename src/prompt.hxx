@@ -35,7 +35,7 @@ public:
 //
 struct DynamicPrompt : public Prompt {
 	UnicodeString _searchText; // text we are searching for
-	int _direction;            // current search _direction, 1=forward, -1=reverse
+	int _direction;            // current search _direction, 1=forward, -1=reverse, 0=fuzzy, 2=regex
 
 	DynamicPrompt( Terminal&, int initialDirection );
 	void updateSearchPrompt(void);
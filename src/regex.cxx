@@ -0,0 +1,898 @@
+#include <algorithm>
+#include <map>
+#include <cctype>
+#include <cwctype>
+
+#include "regex.hxx"
+
+namespace replxx {
+
+namespace {
+
+char32_t const MAX_CHAR( 0x10ffff );
+/*
+ * Characters with case mappings are all in the first two planes.
+ */
+char32_t const MAX_CASED_CHAR( 0x1ffff );
+int const MAX_REPEAT( 1000 );
+int const MAX_DEPTH( 256 );
+int const MAX_NFA_STATES( 10000 );
+int const MAX_DFA_STATES( 2000 );
+int const CHUNK_SIZE( 4096 );
+
+inline char32_t fold( char32_t c_ ) {
+	if ( c_ < 128 ) {
+		return ( ( ( c_ >= 'A' ) && ( c_ <= 'Z' ) ) ? c_ + ( 'a' - 'A' ) : c_ );
+	}
+	return ( static_cast<char32_t>( towlower( static_cast<wint_t>( c_ ) ) ) );
+}
+
+/*
+ * Set of characters kept as sorted, disjoint ranges.
+ */
+class CharSet {
+public:
+	typedef std::pair<char32_t, char32_t> range_t;
+	typedef std::vector<range_t> ranges_t;
+private:
+	ranges_t _ranges;
+public:
+	CharSet( void )
+		: _ranges() {
+	}
+	ranges_t const& ranges( void ) const {
+		return ( _ranges );
+	}
+	void add( char32_t lo_, char32_t hi_ ) {
+		_ranges.emplace_back( lo_, hi_ );
+	}
+	void add( CharSet const& other_ ) {
+		_ranges.insert( _ranges.end(), other_._ranges.begin(), other_._ranges.end() );
+	}
+	void normalize( void ) {
+		std::sort( _ranges.begin(), _ranges.end() );
+		ranges_t::iterator out( _ranges.begin() );
+		for ( ranges_t::const_iterator it( _ranges.begin() ), end( _ranges.end() ); it != end; ++ it ) {
+			if ( ( out != _ranges.begin() ) && ( it->first <= ( out - 1 )->second + 1 ) ) {
+				( out - 1 )->second = std::max( ( out - 1 )->second, it->second );
+			} else {
+				*out = *it;
+				++ out;
+			}
+		}
+		_ranges.erase( out, _ranges.end() );
+	}
+	/*
+	 * Add lower case forms of all characters,
+	 * texts are folded to lower case before matching.
+	 */
+	void add_folded( void ) {
+		ranges_t folded;
+		for ( range_t const& r : _ranges ) {
+			for ( char32_t c( r.first ), hi( std::min( r.second, MAX_CASED_CHAR ) ); c <= hi; ++ c ) {
+				char32_t f( fold( c ) );
+				if ( ( f < r.first ) || ( f > r.second ) ) {
+					folded.emplace_back( f, f );
+				}
+			}
+		}
+		_ranges.insert( _ranges.end(), folded.begin(), folded.end() );
+		normalize();
+	}
+	void negate( void ) {
+		ranges_t negated;
+		char32_t from( 0 );
+		for ( range_t const& r : _ranges ) {
+			if ( r.first > from ) {
+				negated.emplace_back( from, r.first - 1 );
+			}
+			from = r.second + 1;
+		}
+		if ( from <= MAX_CHAR ) {
+			negated.emplace_back( from, MAX_CHAR );
+		}
+		_ranges.swap( negated );
+	}
+	void finalize( bool ignoreCase_, bool negated_ ) {
+		normalize();
+		if ( ignoreCase_ ) {
+			add_folded();
+		}
+		if ( negated_ ) {
+			negate();
+		}
+	}
+	bool contains( char32_t c_ ) const {
+		ranges_t::const_iterator it(
+			std::upper_bound(
+				_ranges.begin(), _ranges.end(), c_,
+				[]( char32_t c, range_t const& r ) {
+					return ( c < r.first );
+				}
+			)
+		);
+		return ( ( it != _ranges.begin() ) && ( ( it - 1 )->second >= c_ ) );
+	}
+};
+
+/*
+ * Abstract syntax tree node, children are indices in node pool.
+ */
+class Node {
+public:
+	enum class TYPE {
+		EMPTY,
+		SET,
+		BEGIN,
+		END,
+		CONCATENATION,
+		ALTERNATIVE,
+		REPEAT
+	};
+	TYPE _type;
+	int _set;
+	/*
+	 * Plain (not escaped class, nor bracketed) character of the pattern, 0 otherwise.
+	 */
+	char32_t _literal;
+	int _min;
+	int _max;
+	std::vector<int> _children;
+	Node( TYPE type_ )
+		: _type( type_ )
+		, _set( -1 )
+		, _literal( 0 )
+		, _min( 1 )
+		, _max( 1 )
+		, _children() {
+	}
+};
+
+typedef std::vector<Node> nodes_t;
+typedef std::vector<CharSet> sets_t;
+
+/*
+ * Recursive descent parser of pattern into a node pool.
+ */
+class Parser {
+	UnicodeStringView _pattern;
+	int _pos;
+	int _depth;
+	bool _ignoreCase;
+	nodes_t& _nodes;
+	sets_t& _sets;
+public:
+	Parser( UnicodeStringView pattern_, bool ignoreCase_, nodes_t& nodes_, sets_t& sets_ )
+		: _pattern( pattern_ )
+		, _pos( 0 )
+		, _depth( 0 )
+		, _ignoreCase( ignoreCase_ )
+		, _nodes( nodes_ )
+		, _sets( sets_ ) {
+	}
+	bool parse( int& root_ ) {
+		return ( alternative( root_ ) && ( _pos == _pattern.length() ) );
+	}
+private:
+	bool at_end( void ) const {
+		return ( _pos >= _pattern.length() );
+	}
+	char32_t peek( int offset_ = 0 ) const {
+		return ( ( _pos + offset_ ) < _pattern.length() ? _pattern[_pos + offset_] : 0 );
+	}
+	int add_node( Node::TYPE type_ ) {
+		_nodes.emplace_back( type_ );
+		return ( static_cast<int>( _nodes.size() ) - 1 );
+	}
+	int add_set( CharSet& set_, bool negated_, char32_t literal_ = 0 ) {
+		set_.finalize( _ignoreCase, negated_ );
+		_sets.push_back( std::move( set_ ) );
+		int node( add_node( Node::TYPE::SET ) );
+		_nodes[static_cast<size_t>( node )]._set = static_cast<int>( _sets.size() ) - 1;
+		_nodes[static_cast<size_t>( node )]._literal = literal_;
+		return ( node );
+	}
+	int add_list( Node::TYPE type_, std::vector<int>& children_ ) {
+		if ( children_.empty() ) {
+			return ( add_node( Node::TYPE::EMPTY ) );
+		}
+		if ( children_.size() == 1 ) {
+			return ( children_.front() );
+		}
+		int node( add_node( type_ ) );
+		_nodes[static_cast<size_t>( node )]._children.swap( children_ );
+		return ( node );
+	}
+	bool alternative( int& node_ ) {
+		std::vector<int> branches;
+		while ( true ) {
+			int branch( 0 );
+			if ( ! concatenation( branch ) ) {
+				return ( false );
+			}
+			branches.push_back( branch );
+			if ( peek() != '|' ) {
+				break;
+			}
+			++ _pos;
+		}
+		node_ = add_list( Node::TYPE::ALTERNATIVE, branches );
+		return ( true );
+	}
+	bool concatenation( int& node_ ) {
+		std::vector<int> items;
+		while ( ! at_end() && ( peek() != '|' ) && ( peek() != ')' ) ) {
+			int item( 0 );
+			if ( ! repetition( item ) ) {
+				return ( false );
+			}
+			items.push_back( item );
+		}
+		node_ = add_list( Node::TYPE::CONCATENATION, items );
+		return ( true );
+	}
+	bool repetition( int& node_ ) {
+		if ( ! atom( node_ ) ) {
+			return ( false );
+		}
+		while ( ! at_end() ) {
+			int min( 0 );
+			int max( -1 );
+			char32_t c( peek() );
+			if ( c == '*' ) {
+				++ _pos;
+			} else if ( c == '+' ) {
+				min = 1;
+				++ _pos;
+			} else if ( c == '?' ) {
+				max = 1;
+				++ _pos;
+			} else if ( ( c != '{' ) || ! bounds( min, max ) ) {
+				break;
+			}
+			if ( peek() == '?' ) {
+				++ _pos;
+			}
+			if ( ( min > MAX_REPEAT ) || ( max > MAX_REPEAT ) || ( ( max >= 0 ) && ( max < min ) ) ) {
+				return ( false );
+			}
+			int node( add_node( Node::TYPE::REPEAT ) );
+			Node& n( _nodes[static_cast<size_t>( node )] );
+			n._min = min;
+			n._max = max;
+			n._children.push_back( node_ );
+			node_ = node;
+		}
+		return ( true );
+	}
+	/*
+	 * Parse `{m}`, `{m,}` or `{m,n}`, anything else is taken literally.
+	 */
+	bool bounds( int& min_, int& max_ ) {
+		int pos( _pos + 1 );
+		auto number = [this, &pos]( int& value_ ) {
+			int start( pos );
+			value_ = 0;
+			while ( ( pos < _pattern.length() ) && ( _pattern[pos] >= '0' ) && ( _pattern[pos] <= '9' ) ) {
+				value_ = std::min( value_ * 10 + static_cast<int>( _pattern[pos] - '0' ), MAX_REPEAT + 1 );
+				++ pos;
+			}
+			return ( pos > start );
+		};
+		if ( ! number( min_ ) ) {
+			return ( false );
+		}
+		max_ = min_;
+		if ( ( pos < _pattern.length() ) && ( _pattern[pos] == ',' ) ) {
+			++ pos;
+			if ( ! number( max_ ) ) {
+				max_ = -1;
+			}
+		}
+		if ( ( pos >= _pattern.length() ) || ( _pattern[pos] != '}' ) ) {
+			return ( false );
+		}
+		_pos = pos + 1;
+		return ( true );
+	}
+	bool atom( int& node_ ) {
+		char32_t c( peek() );
+		CharSet set;
+		switch ( c ) {
+			case '(': {
+				++ _pos;
+				if ( peek() == '?' ) {
+					if ( peek( 1 ) != ':' ) {
+						return ( false );
+					}
+					_pos += 2;
+				}
+				if ( ++ _depth > MAX_DEPTH ) {
+					return ( false );
+				}
+				if ( ! alternative( node_ ) || ( peek() != ')' ) ) {
+					return ( false );
+				}
+				-- _depth;
+				++ _pos;
+			} break;
+			case '[': {
+				return ( bracket( node_ ) );
+			}
+			case '.': {
+				++ _pos;
+				set.add( '\n', '\n' );
+				node_ = add_set( set, true );
+			} break;
+			case '^': {
+				++ _pos;
+				node_ = add_node( Node::TYPE::BEGIN );
+			} break;
+			case '$': {
+				++ _pos;
+				node_ = add_node( Node::TYPE::END );
+			} break;
+			case '*':
+			case '+':
+			case '?': {
+				return ( false );
+			}
+			case '\\': {
+				char32_t literal( 0 );
+				bool negated( false );
+				if ( ! escape( set, negated, literal ) ) {
+					return ( false );
+				}
+				node_ = add_set( set, negated, literal );
+			} break;
+			default: {
+				++ _pos;
+				set.add( c, c );
+				node_ = add_set( set, false, c );
+			}
+		}
+		return ( true );
+	}
+	/*
+	 * Parse escape sequence, either a character class
+	 * (possibly negated) or an escaped character (stored in literal_).
+	 */
+	bool escape( CharSet& set_, bool& negated_, char32_t& literal_ ) {
+		++ _pos;
+		if ( at_end() ) {
+			return ( false );
+		}
+		char32_t c( peek() );
+		++ _pos;
+		negated_ = ( c == 'D' ) || ( c == 'W' ) || ( c == 'S' );
+		switch ( c ) {
+			case 'd':
+			case 'D': {
+				set_.add( '0', '9' );
+			} break;
+			case 'w':
+			case 'W': {
+				set_.add( '0', '9' );
+				set_.add( 'A', 'Z' );
+				set_.add( '_', '_' );
+				set_.add( 'a', 'z' );
+			} break;
+			case 's':
+			case 'S': {
+				set_.add( '\t', '\r' );
+				set_.add( ' ', ' ' );
+			} break;
+			case 't': literal_ = '\t'; break;
+			case 'n': literal_ = '\n'; break;
+			case 'r': literal_ = '\r'; break;
+			case 'f': literal_ = '\f'; break;
+			case 'v': literal_ = '\v'; break;
+			default: {
+				if ( ( c < 128 ) && isalnum( static_cast<int>( c ) ) ) {
+					return ( false );
+				}
+				literal_ = c;
+			}
+		}
+		if ( literal_ ) {
+			set_.add( literal_, literal_ );
+		}
+		return ( true );
+	}
+	bool bracket( int& node_ ) {
+		++ _pos;
+		bool negated( peek() == '^' );
+		if ( negated ) {
+			++ _pos;
+		}
+		CharSet set;
+		bool first( true );
+		while ( true ) {
+			if ( at_end() ) {
+				return ( false );
+			}
+			char32_t lo( peek() );
+			if ( ( lo == ']' ) && ! first ) {
+				++ _pos;
+				break;
+			}
+			first = false;
+			if ( lo == '\\' ) {
+				CharSet escaped;
+				bool escapedNegated( false );
+				lo = 0;
+				if ( ! escape( escaped, escapedNegated, lo ) ) {
+					return ( false );
+				}
+				if ( ! lo ) {
+					escaped.finalize( false, escapedNegated );
+					set.add( escaped );
+					continue;
+				}
+			} else {
+				++ _pos;
+			}
+			char32_t hi( lo );
+			if ( ( peek() == '-' ) && ( peek( 1 ) != ']' ) && ( ( _pos + 1 ) < _pattern.length() ) ) {
+				++ _pos;
+				hi = peek();
+				if ( hi == '\\' ) {
+					CharSet escaped;
+					bool escapedNegated( false );
+					hi = 0;
+					if ( ! escape( escaped, escapedNegated, hi ) || ! hi ) {
+						return ( false );
+					}
+				} else {
+					++ _pos;
+				}
+				if ( hi < lo ) {
+					return ( false );
+				}
+			}
+			set.add( lo, hi );
+		}
+		node_ = add_set( set, negated );
+		return ( true );
+	}
+};
+
+/*
+ * Thompson NFA built from the syntax tree.
+ */
+class Nfa {
+public:
+	class State {
+	public:
+		enum class TYPE {
+			SET,
+			SPLIT,
+			BEGIN,
+			END,
+			MATCH
+		};
+		TYPE _type;
+		int _set;
+		int _out;
+		int _out1;
+		State( TYPE type_, int set_, int out_, int out1_ )
+			: _type( type_ )
+			, _set( set_ )
+			, _out( out_ )
+			, _out1( out1_ ) {
+		}
+	};
+	typedef std::vector<State> states_t;
+	typedef std::vector<int> state_set_t;
+private:
+	nodes_t const& _nodes;
+	states_t _states;
+	int _start;
+	bool _overflow;
+	std::vector<int> _marks;
+	int _mark;
+public:
+	Nfa( nodes_t const& nodes_, int root_ )
+		: _nodes( nodes_ )
+		, _states()
+		, _start( 0 )
+		, _overflow( false )
+		, _marks()
+		, _mark( 0 ) {
+		_start = build( root_, add_state( State::TYPE::MATCH, -1, -1, -1 ) );
+		_marks.resize( _states.size() );
+	}
+	bool valid( void ) const {
+		return ( ! _overflow );
+	}
+	int start( void ) const {
+		return ( _start );
+	}
+	State const& state( int state_ ) const {
+		return ( _states[static_cast<size_t>( state_ )] );
+	}
+	/*
+	 * Replace given seed states with sorted set of non-SPLIT states
+	 * reachable from them with epsilon transitions.
+	 */
+	void closure( state_set_t& states_ ) {
+		++ _mark;
+		state_set_t stack;
+		stack.swap( states_ );
+		while ( ! stack.empty() ) {
+			int s( stack.back() );
+			stack.pop_back();
+			if ( ( s < 0 ) || ( _marks[static_cast<size_t>( s )] == _mark ) ) {
+				continue;
+			}
+			_marks[static_cast<size_t>( s )] = _mark;
+			State const& st( state( s ) );
+			if ( st._type == State::TYPE::SPLIT ) {
+				stack.push_back( st._out1 );
+				stack.push_back( st._out );
+			} else {
+				states_.push_back( s );
+			}
+		}
+		std::sort( states_.begin(), states_.end() );
+	}
+private:
+	int add_state( State::TYPE type_, int set_, int out_, int out1_ ) {
+		if ( static_cast<int>( _states.size() ) >= MAX_NFA_STATES ) {
+			_overflow = true;
+			return ( out_ );
+		}
+		_states.emplace_back( type_, set_, out_, out1_ );
+		return ( static_cast<int>( _states.size() ) - 1 );
+	}
+	/*
+	 * Build states matching given node followed by state `out_`,
+	 * return the entry state.
+	 */
+	int build( int node_, int out_ ) {
+		if ( _overflow ) {
+			return ( out_ );
+		}
+		Node const& node( _nodes[static_cast<size_t>( node_ )] );
+		switch ( node._type ) {
+			case Node::TYPE::EMPTY: {
+				return ( out_ );
+			}
+			case Node::TYPE::SET: {
+				return ( add_state( State::TYPE::SET, node._set, out_, -1 ) );
+			}
+			case Node::TYPE::BEGIN: {
+				return ( add_state( State::TYPE::BEGIN, -1, out_, -1 ) );
+			}
+			case Node::TYPE::END: {
+				return ( add_state( State::TYPE::END, -1, out_, -1 ) );
+			}
+			case Node::TYPE::CONCATENATION: {
+				for ( std::vector<int>::const_reverse_iterator it( node._children.rbegin() ), end( node._children.rend() ); it != end; ++ it ) {
+					out_ = build( *it, out_ );
+				}
+				return ( out_ );
+			}
+			case Node::TYPE::ALTERNATIVE: {
+				int entry( build( node._children.back(), out_ ) );
+				for ( std::vector<int>::const_reverse_iterator it( node._children.rbegin() + 1 ), end( node._children.rend() ); it != end; ++ it ) {
+					int branch( build( *it, out_ ) );
+					entry = add_state( State::TYPE::SPLIT, -1, branch, entry );
+				}
+				return ( entry );
+			}
+			case Node::TYPE::REPEAT: {
+				int child( node._children.front() );
+				int entry( out_ );
+				if ( node._max < 0 ) {
+					int loop( add_state( State::TYPE::SPLIT, -1, -1, out_ ) );
+					if ( _overflow ) {
+						return ( out_ );
+					}
+					int body( build( child, loop ) );
+					_states[static_cast<size_t>( loop )]._out = body;
+					entry = loop;
+				} else {
+					for ( int i( node._min ); i < node._max; ++ i ) {
+						int body( build( child, entry ) );
+						entry = add_state( State::TYPE::SPLIT, -1, body, out_ );
+					}
+				}
+				for ( int i( 0 ); i < node._min; ++ i ) {
+					entry = build( child, entry );
+				}
+				return ( entry );
+			}
+		}
+		return ( out_ );
+	}
+};
+
+/*
+ * Subset construction of complete transition table.
+ *
+ * Symbols below `classCount_` stand for character classes (represented by
+ * their lowest characters), followed by beginning and end of text symbols,
+ * which do not consume characters, so states that do not expect them stay active
+ * and transitions on them are followed until no new state is reached.
+ * Beginning of text is only ever fed to the start state and nothing follows
+ * end of text, so only these transitions are built and end of text leads
+ * either to the dead state or to a state holding just the NFA match state.
+ * Unanchored automaton restarts the NFA at every character.
+ */
+bool determinize(
+	Nfa& nfa_, sets_t const& sets_, std::vector<char32_t> const& representatives_, bool anchored_,
+	std::vector<int>& transitions_, std::vector<bool>& accepting_, int& start_
+) {
+	typedef Nfa::state_set_t state_set_t;
+	typedef Nfa::State::TYPE TYPE;
+	int classCount( static_cast<int>( representatives_.size() ) );
+	int symbolCount( classCount + 2 );
+	std::map<state_set_t, int> ids;
+	std::vector<state_set_t const*> sets;
+	transitions_.clear();
+	accepting_.clear();
+	auto intern = [&]( state_set_t& states_ ) {
+		std::pair<std::map<state_set_t, int>::iterator, bool> inserted( ids.insert( std::make_pair( std::move( states_ ), static_cast<int>( sets.size() ) ) ) );
+		if ( inserted.second ) {
+			state_set_t const& states( inserted.first->first );
+			sets.push_back( &states );
+			transitions_.resize( sets.size() * static_cast<size_t>( symbolCount ), 0 );
+			accepting_.push_back(
+				std::any_of( states.begin(), states.end(), [&nfa_]( int s_ ) { return ( nfa_.state( s_ )._type == TYPE::MATCH ); } )
+			);
+		}
+		return ( inserted.first->second );
+	};
+	state_set_t states;
+	intern( states );
+	states.clear();
+	states.push_back( nfa_.start() );
+	nfa_.closure( states );
+	start_ = intern( states );
+	for ( size_t dfaState( 1 ); dfaState < sets.size(); ++ dfaState ) {
+		if ( sets.size() > static_cast<size_t>( MAX_DFA_STATES ) ) {
+			return ( false );
+		}
+		for ( int symbol( 0 ); symbol < classCount; ++ symbol ) {
+			states.clear();
+			for ( int s : *sets[dfaState] ) {
+				Nfa::State const& st( nfa_.state( s ) );
+				if ( ( st._type == TYPE::SET ) && sets_[static_cast<size_t>( st._set )].contains( representatives_[static_cast<size_t>( symbol )] ) ) {
+					states.push_back( st._out );
+				}
+			}
+			if ( ! anchored_ ) {
+				states.push_back( nfa_.start() );
+			}
+			nfa_.closure( states );
+			int target( intern( states ) );
+			transitions_[dfaState * static_cast<size_t>( symbolCount ) + static_cast<size_t>( symbol )] = target;
+		}
+		for ( int symbol( classCount ); symbol < symbolCount; ++ symbol ) {
+			TYPE assertion( symbol == classCount ? TYPE::BEGIN : TYPE::END );
+			if ( ( assertion == TYPE::BEGIN ) && ( static_cast<int>( dfaState ) != start_ ) ) {
+				continue;
+			}
+			states = *sets[dfaState];
+			size_t size( 0 );
+			while ( size != states.size() ) {
+				size = states.size();
+				for ( size_t i( 0 ); i < size; ++ i ) {
+					Nfa::State const& st( nfa_.state( states[i] ) );
+					if ( st._type == assertion ) {
+						states.push_back( st._out );
+					}
+				}
+				nfa_.closure( states );
+			}
+			if ( assertion == TYPE::END ) {
+				states.erase(
+					std::remove_if( states.begin(), states.end(), [&nfa_]( int s_ ) { return ( nfa_.state( s_ )._type != TYPE::MATCH ); } ),
+					states.end()
+				);
+			}
+			int target( intern( states ) );
+			transitions_[dfaState * static_cast<size_t>( symbolCount ) + static_cast<size_t>( symbol )] = target;
+		}
+	}
+	return ( true );
+}
+
+/*
+ * Collect runs of plain characters that every match has to contain.
+ */
+void collect_literals( nodes_t const& nodes_, int node_, UnicodeString& run_, Regex::literals_t& literals_ ) {
+	auto flush = [&run_, &literals_]() {
+		if ( run_.length() >= 3 ) {
+			literals_.push_back( run_ );
+		}
+		run_.clear();
+	};
+	Node const& node( nodes_[static_cast<size_t>( node_ )] );
+	switch ( node._type ) {
+		case Node::TYPE::EMPTY: {
+		} break;
+		case Node::TYPE::SET: {
+			if ( node._literal ) {
+				run_.push_back( node._literal );
+			} else {
+				flush();
+			}
+		} break;
+		case Node::TYPE::CONCATENATION: {
+			for ( int child : node._children ) {
+				collect_literals( nodes_, child, run_, literals_ );
+			}
+		} break;
+		case Node::TYPE::REPEAT: {
+			if ( node._min > 0 ) {
+				collect_literals( nodes_, node._children.front(), run_, literals_ );
+			} else {
+				flush();
+			}
+			if ( node._max != 1 ) {
+				flush();
+			}
+		} break;
+		case Node::TYPE::BEGIN:
+		case Node::TYPE::END:
+		case Node::TYPE::ALTERNATIVE: {
+			flush();
+		} break;
+	}
+}
+
+}
+
+Regex::Regex( void )
+	: _boundaries()
+	, _asciiClasses( 128, 0 )
+	, _symbolCount( 0 )
+	, _search()
+	, _anchored()
+	, _literals()
+	, _ignoreCase( false )
+	, _valid( false ) {
+}
+
+/*
+ * Compile given pattern, returns false (and leaves the expression invalid)
+ * on syntax errors and for patterns needing too big automata.
+ */
+bool Regex::compile( UnicodeStringView pattern_, bool ignoreCase_ ) {
+	_valid = false;
+	_ignoreCase = ignoreCase_;
+	_literals.clear();
+	nodes_t nodes;
+	sets_t sets;
+	int root( 0 );
+	Parser parser( pattern_, ignoreCase_, nodes, sets );
+	if ( ! parser.parse( root ) ) {
+		return ( false );
+	}
+	Nfa nfa( nodes, root );
+	if ( ! nfa.valid() ) {
+		return ( false );
+	}
+	_boundaries.assign( 1, 0 );
+	for ( CharSet const& set : sets ) {
+		for ( CharSet::range_t const& r : set.ranges() ) {
+			_boundaries.push_back( r.first );
+			if ( r.second < MAX_CHAR ) {
+				_boundaries.push_back( r.second + 1 );
+			}
+		}
+	}
+	std::sort( _boundaries.begin(), _boundaries.end() );
+	_boundaries.erase( std::unique( _boundaries.begin(), _boundaries.end() ), _boundaries.end() );
+	_symbolCount = static_cast<int>( _boundaries.size() ) + 2;
+	for ( char32_t c( 0 ); c < 128; ++ c ) {
+		_asciiClasses[static_cast<size_t>( c )] = static_cast<int>( std::upper_bound( _boundaries.begin(), _boundaries.end(), c ) - _boundaries.begin() ) - 1;
+	}
+	if (
+		! determinize( nfa, sets, _boundaries, false, _search._transitions, _search._accepting, _search._start )
+		|| ! determinize( nfa, sets, _boundaries, true, _anchored._transitions, _anchored._accepting, _anchored._start )
+	) {
+		return ( false );
+	}
+	UnicodeString run;
+	collect_literals( nodes, root, run, _literals );
+	if ( run.length() >= 3 ) {
+		_literals.push_back( run );
+	}
+	_valid = true;
+	return ( true );
+}
+
+int Regex::symbol( char32_t c_ ) const {
+	if ( _ignoreCase ) {
+		c_ = fold( c_ );
+	}
+	if ( c_ < 128 ) {
+		return ( _asciiClasses[static_cast<size_t>( c_ )] );
+	}
+	return ( static_cast<int>( std::upper_bound( _boundaries.begin(), _boundaries.end(), c_ ) - _boundaries.begin() ) - 1 );
+}
+
+/*
+ * Tell if given text contains a match.
+ */
+bool Regex::match( UnicodeStringView text_ ) const {
+	if ( ! _valid ) {
+		return ( false );
+	}
+	int classCount( _symbolCount - 2 );
+	int state( step( _search, _search._start, classCount ) );
+	if ( _search._accepting[static_cast<size_t>( state )] ) {
+		return ( true );
+	}
+	for ( char32_t c : text_ ) {
+		state = step( _search, state, symbol( c ) );
+		if ( _search._accepting[static_cast<size_t>( state )] ) {
+			return ( true );
+		}
+	}
+	state = step( _search, state, classCount + 1 );
+	return ( _search._accepting[static_cast<size_t>( state )] );
+}
+
+/*
+ * Find leftmost-longest match in given text, [start_, end_) is its range.
+ */
+bool Regex::find( UnicodeStringView text_, int& start_, int& end_ ) const {
+	if ( ! match( text_ ) ) {
+		return ( false );
+	}
+	int classCount( _symbolCount - 2 );
+	int len( text_.length() );
+	for ( int from( 0 ); from <= len; ++ from ) {
+		int state( from == 0 ? step( _anchored, _anchored._start, classCount ) : _anchored._start );
+		int matchEnd( _anchored._accepting[static_cast<size_t>( state )] ? from : -1 );
+		for ( int i( from ); ( i < len ) && ( state != 0 ); ++ i ) {
+			state = step( _anchored, state, symbol( text_[i] ) );
+			if ( _anchored._accepting[static_cast<size_t>( state )] ) {
+				matchEnd = i + 1;
+			}
+		}
+		if ( _anchored._accepting[static_cast<size_t>( step( _anchored, state, classCount + 1 ) )] ) {
+			matchEnd = len;
+		}
+		if ( matchEnd >= 0 ) {
+			start_ = from;
+			end_ = matchEnd;
+			return ( true );
+		}
+	}
+	return ( false );
+}
+
+/*
+ * Find (in order) identifiers of candidates with texts containing a match,
+ * candidates are split in chunks matched over given worker pool.
+ */
+void Regex::search( ids_t const& candidates_, text_getter_t const& textGetter_, WorkerPool& workerPool_, ids_t& found_ ) const {
+	found_.clear();
+	int size( static_cast<int>( candidates_.size() ) );
+	int chunks( ( size + CHUNK_SIZE - 1 ) / CHUNK_SIZE );
+	std::vector<ids_t> chunkFound( static_cast<size_t>( chunks ) );
+	workerPool_.run(
+		chunks,
+		[this, &candidates_, &textGetter_, size, &chunkFound]( int chunk_ ) {
+			ids_t& found( chunkFound[static_cast<size_t>( chunk_ )] );
+			for ( int i( chunk_ * CHUNK_SIZE ), to( std::min( i + CHUNK_SIZE, size ) ); i < to; ++ i ) {
+				id_t id( candidates_[static_cast<size_t>( i )] );
+				UnicodeStringView text( textGetter_( id ) );
+				if ( ( text.length() > 0 ) && match( text ) ) {
+					found.push_back( id );
+				}
+			}
+		}
+	);
+	for ( ids_t const& found : chunkFound ) {
+		found_.insert( found_.end(), found.begin(), found.end() );
+	}
+}
+
+}
+
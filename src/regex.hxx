@@ -0,0 +1,94 @@
+#ifndef REPLXX_REGEX_HXX_INCLUDED
+#define REPLXX_REGEX_HXX_INCLUDED 1
+
+#include <vector>
+#include <functional>
+
+#include "unicodestring.hxx"
+#include "workerpool.hxx"
+
+namespace replxx {
+
+/*
+ * Regular expression compiled to a deterministic automaton over char32_t.
+ *
+ * Supported syntax: literals, `.`, character classes (`[a-z]`, `[^...]`),
+ * `\d`, `\w`, `\s` (and negated `\D`, `\W`, `\S`), `^` and `$` (anchored at
+ * text boundaries), groups (`(...)`, `(?:...)`), alternation (`|`)
+ * and quantifiers (`*`, `+`, `?`, `{m}`, `{m,}`, `{m,n}`, lazy forms are accepted
+ * but match the same), back references and look-arounds are not supported.
+ *
+ * Characters are mapped to classes of characters indistinguishable by the pattern,
+ * the automaton is built eagerly from a Thompson NFA by subset construction
+ * with one transition table row per state and one column per character class,
+ * so each text is matched in one linear pass without any allocation,
+ * and a compiled expression can be used concurrently from many threads.
+ */
+class Regex {
+public:
+	typedef unsigned int id_t;
+	typedef std::vector<id_t> ids_t;
+	typedef std::vector<UnicodeString> literals_t;
+	/*
+	 * Returns text of an entry with given identifier,
+	 * or an empty view if given entry shall be skipped.
+	 * Invoked concurrently from worker threads.
+	 */
+	typedef std::function<UnicodeStringView ( id_t )> text_getter_t;
+private:
+	/*
+	 * Transition table, row of state `s` starts at `s * _symbolCount`,
+	 * state 0 is the dead state.
+	 */
+	class Automaton {
+		std::vector<int> _transitions;
+		std::vector<bool> _accepting;
+		int _start;
+	public:
+		Automaton( void )
+			: _transitions()
+			, _accepting()
+			, _start( 0 ) {
+		}
+	private:
+		friend class Regex;
+	};
+	typedef std::vector<char32_t> boundaries_t;
+	/*
+	 * Character class `k` covers [_boundaries[k], _boundaries[k + 1]) range,
+	 * two extra symbols stand for beginning and end of text.
+	 */
+	boundaries_t _boundaries;
+	std::vector<int> _asciiClasses;
+	int _symbolCount;
+	Automaton _search;
+	Automaton _anchored;
+	literals_t _literals;
+	bool _ignoreCase;
+	bool _valid;
+public:
+	Regex( void );
+	bool compile( UnicodeStringView, bool );
+	bool valid( void ) const {
+		return ( _valid );
+	}
+	/*
+	 * Literal substrings (at least 3 characters long) present in every match.
+	 */
+	literals_t const& literals( void ) const {
+		return ( _literals );
+	}
+	bool match( UnicodeStringView ) const;
+	bool find( UnicodeStringView, int&, int& ) const;
+	void search( ids_t const&, text_getter_t const&, WorkerPool&, ids_t& ) const;
+private:
+	int symbol( char32_t ) const;
+	int step( Automaton const& automaton_, int state_, int symbol_ ) const {
+		return ( automaton_._transitions[static_cast<size_t>( state_ * _symbolCount + symbol_ )] );
+	}
+};
+
+}
+
+#endif
+
@@ -85,6 +85,7 @@
 
 #include <algorithm>
 #include <cstdarg>
+#include <stdexcept>
 
 #ifdef _WIN32
 
@@ -154,6 +155,14 @@ void Replxx::history_add( std::string const& line ) {
 	_impl->history_add( line );
 }
 
+void Replxx::history_add( std::string const& line, HistoryMetadata const& metadata ) {
+	_impl->history_add( line, metadata );
+}
+
+void Replxx::history_add_batch( std::vector<std::string> const& lines ) {
+	_impl->history_add_batch( lines );
+}
+
 bool Replxx::history_sync( std::string const& filename ) {
 	return ( _impl->history_sync( filename ) );
 }
@@ -186,6 +195,30 @@ Replxx::HistoryScan Replxx::history_scan( void ) const {
 	return ( _impl->history_scan() );
 }
 
+Replxx::HistoryScan Replxx::history_grep( std::string const& pattern ) {
+	HistoryScan::impl_t impl( _impl->history_grep( pattern ) );
+	if ( ! impl ) {
+		throw std::runtime_error( std::string( "replxx: Invalid regular expression: " ).append( pattern ) );
+	}
+	return ( HistoryScan( std::move( impl ) ) );
+}
+
+Replxx::HistoryScan Replxx::history_filter( HistoryFilter const& filter ) const {
+	return ( _impl->history_filter( filter ) );
+}
+
+Replxx::HistoryScan Replxx::history_range( std::string const& from, std::string const& to ) const {
+	return ( _impl->history_range( from, to ) );
+}
+
+Replxx::HistoryScan Replxx::history_file_range( std::string const& filename, std::string const& from, std::string const& to ) const {
+	HistoryScan::impl_t impl( _impl->history_file_range( filename, from, to ) );
+	if ( ! impl ) {
+		throw std::runtime_error( std::string( "replxx: Cannot read history file: " ).append( filename ) );
+	}
+	return ( HistoryScan( std::move( impl ) ) );
+}
+
 void Replxx::set_preload_buffer( std::string const& preloadText ) {
 	_impl->set_preload_buffer( preloadText );
 }
@@ -202,6 +235,10 @@ void Replxx::set_hint_delay( int milliseconds ) {
 	_impl->set_hint_delay( milliseconds );
 }
 
+void Replxx::set_history_hints( bool val ) {
+	_impl->set_history_hints( val );
+}
+
 void Replxx::set_completion_count_cutoff( int count ) {
 	_impl->set_completion_count_cutoff( count );
 }
@@ -226,6 +263,30 @@ void Replxx::set_unique_history( bool val ) {
 	_impl->set_unique_history( val );
 }
 
+void Replxx::set_history_journal( int compactionRatio_ ) {
+	_impl->set_history_journal( compactionRatio_ );
+}
+
+void Replxx::set_history_binary_format( bool val ) {
+	_impl->set_history_binary_format( val );
+}
+
+void Replxx::set_history_async( bool val ) {
+	_impl->set_history_async( val );
+}
+
+void Replxx::set_history_save_callback( history_save_callback_t const& fn ) {
+	_impl->set_history_save_callback( fn );
+}
+
+void Replxx::set_history_shared( bool val ) {
+	_impl->set_history_shared( val );
+}
+
+void Replxx::set_history_snapshots( bool val ) {
+	_impl->set_history_snapshots( val );
+}
+
 void Replxx::set_no_color( bool val ) {
 	_impl->set_no_color( val );
 }
@@ -234,6 +295,10 @@ void Replxx::set_indent_multiline( bool val ) {
 	_impl->set_indent_multiline( val );
 }
 
+void Replxx::set_differential_rendering( bool val ) {
+	_impl->set_differential_rendering( val );
+}
+
 void Replxx::set_max_history_size( int len ) {
 	_impl->set_max_history_size( len );
 }
@@ -552,6 +617,29 @@ void replxx_history_add( ::Replxx* replxx_, const char* line ) {
 	replxx->history_add( line );
 }
 
+void replxx_history_add_with_metadata( ::Replxx* replxx_, char const* line, ReplxxHistoryMetadata const* metadata_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx::Replxx::HistoryMetadata metadata;
+	if ( metadata_->fields & REPLXX_HISTORY_METADATA_EXIT_STATUS ) {
+		metadata.set_exit_status( metadata_->exitStatus );
+	}
+	if ( metadata_->fields & REPLXX_HISTORY_METADATA_DURATION ) {
+		metadata.set_duration( metadata_->duration );
+	}
+	if ( metadata_->fields & REPLXX_HISTORY_METADATA_DIRECTORY ) {
+		metadata.set_directory( metadata_->directory );
+	}
+	replxx->history_add( line, metadata );
+}
+
+void replxx_history_add_batch( ::Replxx* replxx_, char const** lines, int count ) {
+	if ( count <= 0 ) {
+		return;
+	}
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->history_add_batch( std::vector<std::string>( lines, lines + count ) );
+}
+
 void replxx_set_max_history_size( ::Replxx* replxx_, int len ) {
 	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
 	replxx->set_max_history_size( len );
@@ -567,6 +655,11 @@ void replxx_set_hint_delay( ::Replxx* replxx_, int milliseconds ) {
 	replxx->set_hint_delay( milliseconds );
 }
 
+void replxx_set_history_hints( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_hints( val ? true : false );
+}
+
 void replxx_set_completion_count_cutoff( ::Replxx* replxx_, int count ) {
 	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
 	replxx->set_completion_count_cutoff( count );
@@ -597,6 +690,11 @@ void replxx_set_indent_multiline( ::Replxx* replxx_, int val ) {
 	replxx->set_indent_multiline( val ? true : false );
 }
 
+void replxx_set_differential_rendering( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_differential_rendering( val ? true : false );
+}
+
 void replxx_set_beep_on_ambiguous_completion( ::Replxx* replxx_, int val ) {
 	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
 	replxx->set_beep_on_ambiguous_completion( val ? true : false );
@@ -612,6 +710,40 @@ void replxx_set_unique_history( ::Replxx* replxx_, int val ) {
 	replxx->set_unique_history( val ? true : false );
 }
 
+void replxx_set_history_journal( ::Replxx* replxx_, int compactionRatio_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_journal( compactionRatio_ );
+}
+
+void replxx_set_history_binary_format( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_binary_format( val ? true : false );
+}
+
+void replxx_set_history_async( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_async( val ? true : false );
+}
+
+void history_save_fwd( replxx_history_save_callback_t fn, std::string const& filename_, bool success_, void* userData_ ) {
+	fn( filename_.c_str(), success_ ? 1 : 0, userData_ );
+}
+
+void replxx_set_history_save_callback( ::Replxx* replxx_, replxx_history_save_callback_t* fn, void* userData ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_save_callback( std::bind( &history_save_fwd, fn, _1, _2, userData ) );
+}
+
+void replxx_set_history_shared( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_shared( val ? true : false );
+}
+
+void replxx_set_history_snapshots( ::Replxx* replxx_, int val ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx->set_history_snapshots( val ? true : false );
+}
+
 void replxx_enable_bracketed_paste( ::Replxx* replxx_ ) {
 	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
 	replxx->enable_bracketed_paste();
@@ -627,6 +759,42 @@ ReplxxHistoryScan* replxx_history_scan_start( ::Replxx* replxx_ ) {
 	return ( reinterpret_cast<ReplxxHistoryScan*>( replxx->history_scan().release() ) );
 }
 
+ReplxxHistoryScan* replxx_history_grep_start( ::Replxx* replxx_, char const* pattern_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	return ( reinterpret_cast<ReplxxHistoryScan*>( replxx->history_grep( pattern_ ).release() ) );
+}
+
+ReplxxHistoryScan* replxx_history_filter_start( ::Replxx* replxx_, ReplxxHistoryFilter const* filter_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	replxx::Replxx::HistoryFilter filter;
+	if ( filter_->criteria & REPLXX_HISTORY_FILTER_EXIT_STATUS ) {
+		filter.set_exit_status( filter_->exitStatus );
+	}
+	if ( filter_->criteria & REPLXX_HISTORY_FILTER_MIN_DURATION ) {
+		filter.set_min_duration( filter_->minDuration );
+	}
+	if ( filter_->criteria & REPLXX_HISTORY_FILTER_DIRECTORY ) {
+		filter.set_directory( filter_->directory );
+	}
+	if ( filter_->criteria & REPLXX_HISTORY_FILTER_FAILED ) {
+		filter.set_failed();
+	}
+	if ( filter_->criteria & REPLXX_HISTORY_FILTER_WITHIN ) {
+		filter.set_within( filter_->within );
+	}
+	return ( reinterpret_cast<ReplxxHistoryScan*>( replxx->history_filter( filter ).release() ) );
+}
+
+ReplxxHistoryScan* replxx_history_range_start( ::Replxx* replxx_, char const* from_, char const* to_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	return ( reinterpret_cast<ReplxxHistoryScan*>( replxx->history_range( from_ ? from_ : "", to_ ? to_ : "" ).release() ) );
+}
+
+ReplxxHistoryScan* replxx_history_file_range_start( ::Replxx* replxx_, char const* filename_, char const* from_, char const* to_ ) {
+	replxx::Replxx::ReplxxImpl* replxx( reinterpret_cast<replxx::Replxx::ReplxxImpl*>( replxx_ ) );
+	return ( reinterpret_cast<ReplxxHistoryScan*>( replxx->history_file_range( filename_, from_ ? from_ : "", to_ ? to_ : "" ).release() ) );
+}
+
 void replxx_history_scan_stop( ::Replxx*, ReplxxHistoryScan* historyScan_ ) {
 	delete reinterpret_cast<replxx::Replxx::HistoryScanImpl*>( historyScan_ );
 }
@@ -635,13 +803,32 @@ int replxx_history_scan_next( ::Replxx*, ReplxxHistoryScan* historyScan_, Replxx
 	replxx::Replxx::HistoryScanImpl* historyScan( reinterpret_cast<replxx::Replxx::HistoryScanImpl*>( historyScan_ ) );
 	bool hasNext( historyScan->next() );
 	if ( hasNext ) {
-		replxx::Replxx::HistoryEntry const& historyEntry( historyScan->get() );
-		historyEntry_->timestamp = historyEntry.timestamp().c_str();
-		historyEntry_->text = historyEntry.text().c_str();
+		replxx::Replxx::HistoryEntryView historyEntry( historyScan->view() );
+		historyEntry_->timestamp = historyEntry.timestamp();
+		historyEntry_->text = historyEntry.text();
 	}
 	return ( hasNext ? 0 : -1 );
 }
 
+void replxx_history_scan_view( ::Replxx*, ReplxxHistoryScan* historyScan_, ReplxxHistoryEntryView* view_ ) {
+	replxx::Replxx::HistoryScanImpl* historyScan( reinterpret_cast<replxx::Replxx::HistoryScanImpl*>( historyScan_ ) );
+	replxx::Replxx::HistoryEntryView historyEntry( historyScan->view() );
+	view_->timestamp = historyEntry.timestamp();
+	view_->timestampLength = historyEntry.timestamp_length();
+	view_->text = historyEntry.text();
+	view_->textLength = historyEntry.text_length();
+}
+
+int replxx_history_scan_metadata( ::Replxx*, ReplxxHistoryScan* historyScan_, ReplxxHistoryMetadata* metadata_ ) {
+	replxx::Replxx::HistoryScanImpl* historyScan( reinterpret_cast<replxx::Replxx::HistoryScanImpl*>( historyScan_ ) );
+	replxx::Replxx::HistoryMetadata const& metadata( historyScan->metadata() );
+	metadata_->fields = metadata.fields();
+	metadata_->exitStatus = metadata.exit_status();
+	metadata_->duration = metadata.duration();
+	metadata_->directory = metadata.directory().c_str();
+	return ( metadata.fields() != 0 ? 0 : -1 );
+}
+
 /* Save the history in the specified file. On success 0 is returned
  * otherwise -1 is returned. */
 int replxx_history_sync( ::Replxx* replxx_, const char* filename ) {
@@ -40,6 +40,8 @@ using namespace replxx::color;
 
 namespace replxx {
 
+int mk_wcwidth( char32_t );
+
 namespace {
 
 namespace action_names {
@@ -96,9 +98,16 @@ char const COMPLETE_LINE[]                     = "complete_line";
 char const HISTORY_INCREMENTAL_SEARCH[]        = "history_incremental_search";
 char const HISTORY_SEEDED_INCREMENTAL_SEARCH[] = "history_seeded_incremental_search";
 char const HISTORY_COMMON_PREFIX_SEARCH[]      = "history_common_prefix_search";
+char const HISTORY_FUZZY_SEARCH[]              = "history_fuzzy_search";
+char const HISTORY_REGEX_SEARCH[]              = "history_regex_search";
 }
 
 static int const REPLXX_MAX_HINT_ROWS( 4 );
+/*
+ * Maximum number of matches listed and kept by fuzzy and regular expression history searches.
+ */
+static int const REPLXX_SEARCH_ROWS( 10 );
+static int const REPLXX_SEARCH_MATCHES( 1000 );
 /*
  * All whitespaces and all non-alphanumerical characters from ASCII range
  * with an exception of an underscore ('_').
@@ -144,24 +153,46 @@ public:
 	}
 };
 
+/*
+ * Collects everything written to the terminal within the scope
+ * so that one redraw reaches the terminal as a single write.
+ */
+class FrameGuard {
+	Terminal& _terminal;
+public:
+	FrameGuard( Terminal& terminal_ )
+		: _terminal( terminal_ ) {
+		_terminal.begin_frame();
+	}
+	~FrameGuard( void ) {
+		try {
+			_terminal.end_frame();
+		} catch ( ... ) {
+		}
+	}
+};
+
 }
 
 Replxx::ReplxxImpl::ReplxxImpl( FILE*, FILE*, FILE* )
 	: _utf8Buffer()
 	, _data()
 	, _pos( 0 )
+	, _layoutCache()
 	, _display()
-	, _displayInputLength( 0 )
 	, _hint()
 	, _prefix( 0 )
 	, _hintSelection( -1 )
 	, _history()
+	, _historyWriter()
+	, _historySaveCallback()
 	, _killRing()
 	, _lastRefreshTime( now_us() )
 	, _refreshSkipped( false )
 	, _lastYankSize( 0 )
 	, _maxHintRows( REPLXX_MAX_HINT_ROWS )
 	, _hintDelay( 0 )
+	, _historyHints( false )
 	, _wordBreakChars( defaultWordBreakChars )
 	, _subwordBreakChars( defaultSubwordBreakChars )
 	, _completionCountCutoff( 100 )
@@ -173,11 +204,13 @@ Replxx::ReplxxImpl::ReplxxImpl( FILE*, FILE*, FILE* )
 	, _bracketedPaste( false )
 	, _noColor( false )
 	, _indentMultiline( true )
+	, _differentialRendering( false )
 	, _namedActions()
 	, _keyPressHandlers()
 	, _terminal()
 	, _currentThread()
 	, _prompt( _terminal )
+	, _screen()
 	, _completionCallback( nullptr )
 	, _highlighterCallback( nullptr )
 	, _hintCallback( nullptr )
@@ -258,6 +291,8 @@ Replxx::ReplxxImpl::ReplxxImpl( FILE*, FILE*, FILE* )
 	_namedActions[action_names::HISTORY_INCREMENTAL_SEARCH]        = std::bind( &ReplxxImpl::invoke, this, Replxx::ACTION::HISTORY_INCREMENTAL_SEARCH,        _1 );
 	_namedActions[action_names::HISTORY_SEEDED_INCREMENTAL_SEARCH] = std::bind( &ReplxxImpl::invoke, this, Replxx::ACTION::HISTORY_SEEDED_INCREMENTAL_SEARCH, _1 );
 	_namedActions[action_names::HISTORY_COMMON_PREFIX_SEARCH]      = std::bind( &ReplxxImpl::invoke, this, Replxx::ACTION::HISTORY_COMMON_PREFIX_SEARCH,      _1 );
+	_namedActions[action_names::HISTORY_FUZZY_SEARCH]              = std::bind( &ReplxxImpl::invoke, this, Replxx::ACTION::HISTORY_FUZZY_SEARCH,              _1 );
+	_namedActions[action_names::HISTORY_REGEX_SEARCH]              = std::bind( &ReplxxImpl::invoke, this, Replxx::ACTION::HISTORY_REGEX_SEARCH,              _1 );
 
 	bind_key( Replxx::KEY::control( 'A' ),                 _namedActions.at( action_names::MOVE_CURSOR_TO_BEGINING_OF_LINE ) );
 	bind_key( Replxx::KEY::HOME + 0,                       _namedActions.at( action_names::MOVE_CURSOR_TO_BEGINING_OF_LINE ) );
@@ -334,6 +369,7 @@ Replxx::ReplxxImpl::ReplxxImpl( FILE*, FILE*, FILE* )
 }
 
 Replxx::ReplxxImpl::~ReplxxImpl( void ) {
+	_historyWriter.reset();
 	disable_bracketed_paste();
 }
 
@@ -372,6 +408,8 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::invoke( Replxx::ACTION action_, char32
 		case ( Replxx::ACTION::HISTORY_INCREMENTAL_SEARCH ):        return ( action( NOOP, &Replxx::ReplxxImpl::incremental_history_search, code ) );
 		case ( Replxx::ACTION::HISTORY_SEEDED_INCREMENTAL_SEARCH ): return ( action( NOOP, &Replxx::ReplxxImpl::incremental_history_search, code ) );
 		case ( Replxx::ACTION::HISTORY_COMMON_PREFIX_SEARCH ):      return ( action( RESET_KILL_ACTION | DONT_RESET_PREFIX, &Replxx::ReplxxImpl::common_prefix_search, code ) );
+		case ( Replxx::ACTION::HISTORY_FUZZY_SEARCH ):              return ( action( NOOP, &Replxx::ReplxxImpl::fuzzy_history_search, code ) );
+		case ( Replxx::ACTION::HISTORY_REGEX_SEARCH ):              return ( action( NOOP, &Replxx::ReplxxImpl::regex_history_search, code ) );
 		case ( Replxx::ACTION::HINT_NEXT ):                         return ( action( NOOP, &Replxx::ReplxxImpl::hint_next, code ) );
 		case ( Replxx::ACTION::HINT_PREVIOUS ):                     return ( action( NOOP, &Replxx::ReplxxImpl::hint_previous, code ) );
 		case ( Replxx::ACTION::CAPITALIZE_WORD ):                   return ( action( RESET_KILL_ACTION | HISTORY_RECALL_MOST_RECENT, &Replxx::ReplxxImpl::capitalize_word<false>, code ) );
@@ -420,6 +458,7 @@ Replxx::State Replxx::ReplxxImpl::get_state( void ) const {
 }
 
 void Replxx::ReplxxImpl::set_state( Replxx::State const& state_ ) {
+	_layoutCache.invalidate();
 	_data.assign( state_.text() );
 	if ( state_.cursor_position() >= 0 ) {
 		_pos = min( state_.cursor_position(), _data.length() );
@@ -466,6 +505,7 @@ char32_t Replxx::ReplxxImpl::read_char( HINT_ACTION hintAction_ ) {
 		}
 
 		std::lock_guard<std::mutex> l( _mutex );
+		FrameGuard frameGuard( _terminal );
 		_terminal.set_cursor_visible( false );
 		clear_self_to_end_of_screen();
 
@@ -501,11 +541,11 @@ void Replxx::ReplxxImpl::clear( void ) {
 	_completions.clear();
 	_completionContextLength = 0;
 	_completionSelection = -1;
+	_layoutCache.invalidate();
 	_data.clear();
 	_hintSelection = -1;
 	_hint = UnicodeString();
 	_display.clear();
-	_displayInputLength = 0;
 }
 
 void Replxx::ReplxxImpl::call_modify_callback( void ) {
@@ -521,6 +561,7 @@ void Replxx::ReplxxImpl::call_modify_callback( void ) {
 		_modifyCallback( line, pos );
 	}
 	if ( ( pos != _pos ) || ( line != origLine ) ) {
+		_layoutCache.invalidate();
 		_data.assign( line.c_str() );
 		_pos = min( pos, _data.length() );
 		_modifiedState = true;
@@ -650,6 +691,9 @@ char const* Replxx::ReplxxImpl::input( std::string const& prompt ) {
 		_prompt.set_text( UnicodeString( prompt ) );
 		_currentThread = std::this_thread::get_id();
 		l.unlock();
+		if ( _historyWriter ) {
+			_historyWriter->adopt( _history );
+		}
 		clear();
 		if ( !_preloadedBuffer.empty() ) {
 			preload_puffer( _preloadedBuffer.c_str() );
@@ -677,6 +721,7 @@ char const* Replxx::ReplxxImpl::finalize_input( char const* retVal_ ) {
 	}
 	_currentThread = std::thread::id();
 	_terminal.disable_raw_mode();
+	_history.publish();
 	return ( retVal_ );
 }
 
@@ -733,16 +778,13 @@ void Replxx::ReplxxImpl::set_prompt( std::string prompt ) {
 }
 
 void Replxx::ReplxxImpl::preload_puffer(const char* preloadText) {
+	_layoutCache.invalidate();
 	_data.assign( preloadText );
 	_prefix = _pos = _data.length();
 }
 
 void Replxx::ReplxxImpl::set_color( Replxx::Color color_ ) {
-	char const* code( ansi_color( color_ ) );
-	while ( *code ) {
-		_display.push_back( *code );
-		++ code;
-	}
+	_display.append( ansi_color( color_ ) );
 }
 
 void Replxx::ReplxxImpl::indent( void ) {
@@ -773,7 +815,7 @@ void Replxx::ReplxxImpl::render( char32_t ch ) {
 
 void Replxx::ReplxxImpl::render( HINT_ACTION hintAction_ ) {
 	if ( hintAction_ == HINT_ACTION::TRIM ) {
-		_display.erase( _display.begin() + _displayInputLength, _display.end() );
+		_display.trim_to_input();
 		_modifiedState = false;
 		return;
 	}
@@ -786,7 +828,7 @@ void Replxx::ReplxxImpl::render( HINT_ACTION hintAction_ ) {
 		for ( char32_t ch : _data ) {
 			render( ch );
 		}
-		_displayInputLength = static_cast<int>( _display.size() );
+		_display.mark_input_end();
 		_modifiedState = false;
 		return;
 	}
@@ -810,7 +852,7 @@ void Replxx::ReplxxImpl::render( HINT_ACTION hintAction_ ) {
 		render( _data[i] );
 	}
 	set_color( Replxx::Color::DEFAULT );
-	_displayInputLength = static_cast<int>( _display.size() );
+	_display.mark_input_end();
 	_modifiedState = false;
 	return;
 }
@@ -819,7 +861,7 @@ void Replxx::ReplxxImpl::handle_hints( HINT_ACTION hintAction_ ) {
 	if ( _noColor ) {
 		return;
 	}
-	if ( ! _hintCallback ) {
+	if ( ! _hintCallback && ! _historyHints ) {
 		return;
 	}
 	if ( ( _hintDelay > 0 ) && ( hintAction_ != HINT_ACTION::REPAINT ) ) {
@@ -839,10 +881,16 @@ void Replxx::ReplxxImpl::handle_hints( HINT_ACTION hintAction_ ) {
 	_utf8Buffer.assign( _data, _pos );
 	if ( ( _utf8Buffer != _hintSeed ) || ( _hintContextLenght < 0 ) ) {
 		_hintSeed.assign( _utf8Buffer );
-		_hintContextLenght = context_length();
 		_hintColor = Replxx::Color::GRAY;
-		IOModeGuard ioModeGuard( _terminal );
-		_hintsCache = call_hinter( _utf8Buffer.get(), _hintContextLenght, _hintColor );
+		if ( !! _hintCallback ) {
+			_hintContextLenght = context_length();
+			IOModeGuard ioModeGuard( _terminal );
+			_hintsCache = call_hinter( _utf8Buffer.get(), _hintContextLenght, _hintColor );
+		} else {
+			/* built-in history hints complete whole line */
+			_hintContextLenght = _pos;
+			_history.hints( _data, _ignoreCase, max( _maxHintRows, 1 ), _hintsCache );
+		}
 	}
 	int hintCount( static_cast<int>( _hintsCache.size() ) );
 	if ( hintCount == 1 ) {
@@ -974,6 +1022,15 @@ int Replxx::ReplxxImpl::virtual_render( char32_t const* buffer_, int len_, int&
 	return ( replxx::virtual_render( buffer_, len_, xPos_, yPos_, prompt.screen_columns(), _indentMultiline ? prompt.indentation() : 0 ) );
 }
 
+/*
+ * Screen position following first `len_` characters of the input,
+ * same as virtual_render( _data.get(), len_, ... ), but only the text
+ * past the nearest cached checkpoint is laid out.
+ */
+void Replxx::ReplxxImpl::input_position( int len_, int& xPos_, int& yPos_ ) {
+	_layoutCache.position( _data.get(), len_, xPos_, yPos_, _prompt.screen_columns(), _indentMultiline ? _prompt.indentation() : 0 );
+}
+
 /**
  * Refresh the user's input line: the prompt is already onscreen and is not
  * redrawn here screen position
@@ -992,7 +1049,7 @@ void Replxx::ReplxxImpl::refresh_line( HINT_ACTION hintAction_ ) {
 	// calculate the desired position of the cursor
 	int xCursorPos( _prompt.indentation() );
 	int yCursorPos( 0 );
-	virtual_render( _data.get(), _pos, xCursorPos, yCursorPos );
+	input_position( _pos, xCursorPos, yCursorPos );
 
 	// calculate the position of the end of the input line
 	int xEndOfInput( _prompt.indentation() );
@@ -1001,32 +1058,42 @@ void Replxx::ReplxxImpl::refresh_line( HINT_ACTION hintAction_ ) {
 	// also newlines belonging to hints part of display shall be ignored
 	// with respect to extra indent for multiline inputs
 	// in other words _display should not be re-indented
-	replxx::virtual_render( _display.data(), static_cast<int>( _display.size() ), xEndOfInput, yEndOfInput, _prompt.screen_columns(), 0 );
+	_display.end_position( xEndOfInput, yEndOfInput, _prompt.screen_columns() );
 
-	// position at the end of the prompt, clear to end of previous input
+	FrameGuard frameGuard( _terminal );
 	_terminal.set_cursor_visible( false );
-	_terminal.jump_cursor(
-		_prompt.indentation(), // 0-based on Win32
-		-( _prompt._cursorRowOffset - _prompt._extraLines )
-	);
-	// display the input line
-	if ( _hasNewlines ) {
-		_terminal.clear_screen( Terminal::CLEAR_SCREEN::TO_END );
-		_terminal.write32( _display.data(), static_cast<int>( _display.size() ) );
-	} else {
-		_terminal.write32( _display.data(), _displayInputLength );
-		_terminal.clear_screen( Terminal::CLEAR_SCREEN::TO_END );
-		_terminal.write32( _display.data() + _displayInputLength, static_cast<int>( _display.size() ) - _displayInputLength );
-	}
+	// with differential rendering only cells that changed since last refresh are sent
+	int cursorRow( _prompt._cursorRowOffset - _prompt._extraLines );
+	if ( ! _differentialRendering || ! _display.encodable() || ! _screen.update( _display.data(), _display.size(), _prompt.indentation(), _prompt.screen_columns(), _terminal, cursorRow ) ) {
+		// position at the end of the prompt, clear to end of previous input
+		_terminal.jump_cursor(
+			_prompt.indentation(), // 0-based on Win32
+			-cursorRow
+		);
+		// display the input line
+		if ( _hasNewlines ) {
+			_terminal.clear_screen( Terminal::CLEAR_SCREEN::TO_END );
+			_terminal.write8( _display.data(), _display.encodable() ? _display.size() : 0 );
+		} else {
+			int inputSize( _display.input_size() );
+			_terminal.write8( _display.data(), _display.input_encodable() ? inputSize : 0 );
+			_terminal.clear_screen( Terminal::CLEAR_SCREEN::TO_END );
+			_terminal.write8( _display.data() + inputSize, _display.hints_encodable() ? _display.size() - inputSize : 0 );
+		}
 #ifndef _WIN32
-	// we have to generate our own newline on line wrap
-	if ( ( xEndOfInput == 0 ) && ( yEndOfInput > 0 ) && ! _data.is_empty() && ( _data.back() != '\n' ) ) {
-		_terminal.write8( "\n", 1 );
-	}
+		// we have to generate our own newline on line wrap
+		if ( ( xEndOfInput == 0 ) && ( yEndOfInput > 0 ) && ! _data.is_empty() && ( _data.back() != '\n' ) ) {
+			_terminal.write8( "\n", 1 );
+		}
 #endif
+		cursorRow = yEndOfInput;
+	}
 	// position the cursor
-	_terminal.jump_cursor( xCursorPos, -( yEndOfInput - yCursorPos ) );
+	_terminal.jump_cursor( xCursorPos, -( cursorRow - yCursorPos ) );
 	_terminal.set_cursor_visible( true );
+	if ( _differentialRendering ) {
+		_screen.commit( _terminal, xCursorPos );
+	}
 	_prompt._cursorRowOffset = _prompt._extraLines + yCursorPos; // remember row for next pass
 	_lastRefreshTime = now_us();
 	_oldPos = _pos;
@@ -1037,12 +1104,16 @@ void Replxx::ReplxxImpl::move_cursor( void ) {
 	// calculate the desired position of the cursor
 	int xCursorPos( _prompt.indentation() );
 	int yCursorPos( 0 );
-	virtual_render( _data.get(), _pos, xCursorPos, yCursorPos );
+	input_position( _pos, xCursorPos, yCursorPos );
 	// position the cursor
+	FrameGuard frameGuard( _terminal );
 	_terminal.jump_cursor( xCursorPos, -( _prompt._cursorRowOffset - _prompt._extraLines - yCursorPos ) );
 	_prompt._cursorRowOffset = _prompt._extraLines + yCursorPos;
 	_oldPos = _pos;
 	_moveCursor = false;
+	if ( _differentialRendering ) {
+		_screen.sync( _terminal, xCursorPos );
+	}
 }
 
 int Replxx::ReplxxImpl::context_length() {
@@ -1057,6 +1128,7 @@ int Replxx::ReplxxImpl::context_length() {
 }
 
 void Replxx::ReplxxImpl::repaint( void ) {
+	FrameGuard frameGuard( _terminal );
 	_prompt.write();
 	for ( int i( _prompt._extraLines ); i < _prompt._cursorRowOffset; ++ i ) {
 		_terminal.write8( "\n", 1 );
@@ -1166,6 +1238,7 @@ char32_t Replxx::ReplxxImpl::do_complete_line( bool showCompletions_ ) {
 			}
 		}
 		_pos -= _completionContextLength;
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos, _completionContextLength );
 		_data.insert( _pos, *cand, 0, longestCommonPrefix );
 		_completionContextLength = longestCommonPrefix;
@@ -1347,6 +1420,7 @@ char32_t Replxx::ReplxxImpl::do_complete_line( bool showCompletions_ ) {
 }
 
 int Replxx::ReplxxImpl::get_input_line( void ) {
+	_history.refresh();
 	// The latest history entry is always our current buffer
 	if ( _data.length() > 0 ) {
 		_history.add( _data );
@@ -1452,8 +1526,10 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::insert_character( char32_t c ) {
 		return ( Replxx::ACTION_RESULT::CONTINUE );
 	}
 	if ( ! _overwrite || ( _pos >= _data.length() ) ) {
+		_layoutCache.invalidate( _pos );
 		_data.insert( _pos, c );
 	} else {
+		_layoutCache.invalidate( _pos );
 		_data[_pos] = c;
 	}
 	_oldPos = _pos;
@@ -1468,17 +1544,17 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::insert_character( char32_t c ) {
 	}
 	int xCursorPos( _prompt.indentation() );
 	int yCursorPos( 0 );
-	virtual_render( _data.get(), _data.length(), xCursorPos, yCursorPos );
+	input_position( _data.length(), xCursorPos, yCursorPos );
 	if (
 		( _pos == _data.length() )
 		&& ! _modifiedState
-		&& ( _noColor || ! ( !! _highlighterCallback || !! _hintCallback ) )
+		&& ( _noColor || ! ( !! _highlighterCallback || !! _hintCallback || _historyHints ) )
 		&& ( yCursorPos == 0 )
 	) {
 		/* Avoid a full assign of the line in the
 		 * trivial case. */
 		render( c );
-		_displayInputLength = static_cast<int>( _display.size() );
+		_display.mark_input_end();
 		_terminal.write32( reinterpret_cast<char32_t*>( &c ), 1 );
 	} else {
 		refresh_line();
@@ -1571,6 +1647,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_word_to_left( char32_t ) {
 			-- _pos;
 		}
 		_killRing.kill( _data.get() + _pos, startingPos - _pos, false);
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos, startingPos - _pos );
 		refresh_line();
 	}
@@ -1589,6 +1666,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_word_to_right( char32_t ) {
 			++ endingPos;
 		}
 		_killRing.kill( _data.get() + _pos, endingPos - _pos, true );
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos, endingPos - _pos );
 		refresh_line();
 	}
@@ -1606,6 +1684,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_to_whitespace_to_left( char32_t )
 			-- _pos;
 		}
 		_killRing.kill( _data.get() + _pos, startingPos - _pos, false );
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos, startingPos - _pos );
 		refresh_line();
 	}
@@ -1623,6 +1702,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_to_end_of_line( char32_t ) {
 	}
 
 	_killRing.kill( _data.get() + _pos, to - _pos, true );
+	_layoutCache.invalidate( _pos );
 	_data.erase( _pos, to - _pos );
 	return ( Replxx::ACTION_RESULT::CONTINUE );
 }
@@ -1642,6 +1722,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_to_begining_of_line( char32_t ) {
 		}
 	}
 	_killRing.kill( _data.get() + newPos, _pos - newPos, false );
+	_layoutCache.invalidate( newPos );
 	_data.erase( newPos, _pos - newPos );
 	_pos = newPos;
 	refresh_line();
@@ -1652,6 +1733,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::kill_to_begining_of_line( char32_t ) {
 Replxx::ACTION_RESULT Replxx::ReplxxImpl::yank( char32_t ) {
 	UnicodeString* restoredText( _killRing.yank() );
 	if ( restoredText ) {
+		_layoutCache.invalidate( _pos );
 		_data.insert( _pos, *restoredText, 0, restoredText->length() );
 		_pos += restoredText->length();
 		refresh_line();
@@ -1675,6 +1757,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::yank_cycle( char32_t ) {
 		return ( Replxx::ACTION_RESULT::CONTINUE );
 	}
 	_pos -= _lastYankSize;
+	_layoutCache.invalidate( _pos );
 	_data.erase( _pos, _lastYankSize );
 	_data.insert( _pos, *restoredText, 0, restoredText->length() );
 	_pos += restoredText->length();
@@ -1691,7 +1774,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::yank_last_arg( char32_t ) {
 	if ( _history.next_yank_position() ) {
 		_lastYankSize = 0;
 	}
-	UnicodeString const& histLine( _history.yank_line() );
+	UnicodeStringView histLine( _history.yank_line() );
 	int endPos( histLine.length() );
 	while ( ( endPos > 0 ) && isspace( histLine[endPos - 1] ) ) {
 		-- endPos;
@@ -1701,8 +1784,10 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::yank_last_arg( char32_t ) {
 		-- startPos;
 	}
 	_pos -= _lastYankSize;
+	_layoutCache.invalidate( _pos );
 	_data.erase( _pos, _lastYankSize );
 	_lastYankSize = endPos - startPos;
+	_layoutCache.invalidate( _pos );
 	_data.insert( _pos, histLine, startPos, _lastYankSize );
 	_pos += _lastYankSize;
 	refresh_line();
@@ -1718,12 +1803,14 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::capitalize_word( char32_t ) {
 		}
 		if (_pos < _data.length() && !is_word_break_character<subword>( _data[_pos] ) ) {
 			if ( iswlower( static_cast<wint_t>( _data[_pos] ) ) ) {
+				_layoutCache.invalidate( _pos );
 				_data[_pos] = static_cast<char32_t>( towupper( static_cast<wint_t>( _data[_pos] ) ) );
 			}
 			++_pos;
 		}
 		while (_pos < _data.length() && !is_word_break_character<subword>( _data[_pos] ) ) {
 			if ( iswupper( static_cast<wint_t>( _data[_pos] ) ) ) {
+				_layoutCache.invalidate( _pos );
 				_data[_pos] = static_cast<char32_t>( towlower( static_cast<wint_t>( _data[_pos] ) ) );
 			}
 			++_pos;
@@ -1742,6 +1829,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::lowercase_word( char32_t ) {
 		}
 		while (_pos < _data.length() && !is_word_break_character<subword>( _data[_pos] ) ) {
 			if ( iswupper( static_cast<wint_t>( _data[_pos] ) ) ) {
+				_layoutCache.invalidate( _pos );
 				_data[_pos] = static_cast<char32_t>( towlower( static_cast<wint_t>( _data[_pos] ) ) );
 			}
 			++ _pos;
@@ -1760,6 +1848,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::uppercase_word( char32_t ) {
 		}
 		while ( _pos < _data.length() && !is_word_break_character<subword>( _data[_pos] ) ) {
 			if ( iswlower( static_cast<wint_t>( _data[_pos] ) ) ) {
+				_layoutCache.invalidate( _pos );
 				_data[_pos] = static_cast<char32_t>( towupper( static_cast<wint_t>( _data[_pos] ) ) );
 			}
 			++ _pos;
@@ -1774,6 +1863,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::transpose_characters( char32_t ) {
 	if ( _pos > 0 && _data.length() > 1 ) {
 		size_t leftCharPos = ( _pos == _data.length() ) ? _pos - 2 : _pos - 1;
 		char32_t aux = _data[leftCharPos];
+		_layoutCache.invalidate( static_cast<int>( leftCharPos ) );
 		_data[leftCharPos] = _data[leftCharPos + 1];
 		_data[leftCharPos + 1] = aux;
 		if ( _pos != _data.length() ) {
@@ -1802,6 +1892,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::abort_line( char32_t keyCode_ ) {
 // DEL, delete the character under the cursor
 Replxx::ACTION_RESULT Replxx::ReplxxImpl::delete_character( char32_t ) {
 	if ( ( _data.length() > 0 ) && ( _pos < _data.length() ) ) {
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos );
 		refresh_line();
 	}
@@ -1822,6 +1913,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::send_eof( char32_t key_ ) {
 Replxx::ACTION_RESULT Replxx::ReplxxImpl::backspace_character( char32_t ) {
 	if ( _pos > 0 ) {
 		-- _pos;
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos );
 		refresh_line();
 	}
@@ -1953,6 +2045,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::history_move( bool previous_ ) {
 	if ( ! _history.move( previous_ ) ) {
 		return ( Replxx::ACTION_RESULT::CONTINUE );
 	}
+	_layoutCache.invalidate();
 	_data.assign( _history.current() );
 	_pos = _data.length();
 	refresh_line();
@@ -1996,6 +2089,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::history_restore_current( char32_t ) {
 	// if not already recalling, there is nothing to restore.
 	if ( ! _history.is_last() ) {
 		_history.reset_current_scratch();
+		_layoutCache.invalidate();
 		_data.assign( _history.current() );
 		_pos = _data.length();
 		refresh_line();
@@ -2008,6 +2102,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::history_restore( char32_t ) {
 	_history.reset_scratches();
 	// if not already recalling, there is nothing to restore.
 	if ( ! _history.is_last() ) {
+		_layoutCache.invalidate();
 		_data.assign( _history.current() );
 		_pos = _data.length();
 		refresh_line();
@@ -2025,6 +2120,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::history_jump( bool back_ ) {
 	if ( ! _history.is_empty() ) {
 		_history.set_current_scratch( _data );
 		_history.jump( back_ );
+		_layoutCache.invalidate();
 		_data.assign( _history.current() );
 		_pos = _data.length();
 		refresh_line();
@@ -2063,6 +2159,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::verbatim_insert( char32_t ) {
 	static int const MAX_ESC_SEQ( 32 );
 	char32_t buf[MAX_ESC_SEQ];
 	int len( _terminal.read_verbatim( buf, MAX_ESC_SEQ ) );
+	_layoutCache.invalidate( _pos );
 	_data.insert( _pos, UnicodeString( buf, len ), 0, len );
 	_pos += len;
 	return ( Replxx::ACTION_RESULT::CONTINUE );
@@ -2115,10 +2212,12 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::complete( bool previous_ ) {
 	if ( _completionSelection != -1 ) {
 		int oldCompletionLength( max( _completions[_completionSelection].text().length() - _completionContextLength, 0 ) );
 		_pos -= oldCompletionLength;
+		_layoutCache.invalidate( _pos );
 		_data.erase( _pos, oldCompletionLength );
 	}
 	if ( newSelection != -1 ) {
 		int newCompletionLength( max( _completions[newSelection].text().length() - _completionContextLength, 0 ) );
+		_layoutCache.invalidate( _pos );
 		_data.insert( _pos, _completions[newSelection].text(), _completionContextLength, newCompletionLength );
 		_pos += newCompletionLength;
 	}
@@ -2145,6 +2244,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::common_prefix_search( char32_t startCh
 			_data, _prefix, ( startChar == ( Replxx::KEY::meta( 'p' ) ) ) || ( startChar == ( Replxx::KEY::meta( 'P' ) ) ), _ignoreCase
 		)
 	) {
+		_layoutCache.invalidate();
 		_data.assign( _history.current() );
 		_pos = _data.length();
 		refresh_line();
@@ -2344,7 +2444,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::incremental_history_search( char32_t s
 				if ( found ) {
 					historyLinePosition = lineSearchPos;
 					break;
-				} else if ( _history.move( dp._direction < 0 ) ) {
+				} else if ( _history.move_to_match( dp._direction < 0, dp._searchText, ignoreCase ) ) {
 					activeHistoryLine.assign( _history.current() );
 					lineSearchPos = ( dp._direction > 0 ) ? 0 : ( activeHistoryLine.length() - dp._searchText.length() );
 				} else {
@@ -2373,6 +2473,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::incremental_history_search( char32_t s
 	pb.update_screen_columns();
 	if ( useSearchedLine && ( activeHistoryLine.length() > 0 ) ) {
 		_history.commit_index();
+		_layoutCache.invalidate();
 		_data.assign( activeHistoryLine );
 		_pos = historyLinePosition;
 		_modifiedState = true;
@@ -2385,6 +2486,219 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::incremental_history_search( char32_t s
 	return ( Replxx::ACTION_RESULT::CONTINUE );
 }
 
+/**
+ * Fuzzy history search -- take over the prompt and keyboard as the user
+ * types a query, history entries containing all characters of the query
+ * (in order, not necessarily adjacent) are listed below the prompt,
+ * best matches first, and the selected one is shown as the input line.
+ * The selection is moved with up/down arrows (or ctrl-P/ctrl-N, ctrl-R/ctrl-S),
+ * other action characters accept the selected line and are passed on to the main loop,
+ * ctrl-C and ctrl-G abort the search.
+ */
+Replxx::ACTION_RESULT Replxx::ReplxxImpl::fuzzy_history_search( char32_t ) {
+	return ( listed_history_search( false ) );
+}
+
+/**
+ * Regular expression history search -- same as fuzzy history search,
+ * but the query is a regular expression (recompiled on each change),
+ * history entries containing a match are listed most recent first.
+ * Nothing is listed while the query is not a valid expression.
+ */
+Replxx::ACTION_RESULT Replxx::ReplxxImpl::regex_history_search( char32_t ) {
+	return ( listed_history_search( true ) );
+}
+
+Replxx::ACTION_RESULT Replxx::ReplxxImpl::listed_history_search( bool regex_ ) {
+	if ( _history.is_last() ) {
+		_history.update_last( _data );
+	}
+	_history.save_pos();
+	clear_self_to_end_of_screen();
+	DynamicPrompt dp( _terminal, regex_ ? 2 : 0 );
+	Prompt* oldPrompt( &_prompt );
+	Regex regex;
+	History::fuzzy_matches_t matches;
+	UnicodeString rows;
+	UnicodeString activeHistoryLine;
+	int selection( 0 );
+	bool searchAgain( true );
+	bool useSearchedLine( true );
+	bool ignoreCase( false );
+	char32_t c( 0 );
+	while ( true ) {
+		if ( searchAgain ) {
+			ignoreCase = _ignoreCase || std::none_of( dp._searchText.begin(), dp._searchText.end(), []( char32_t x ) { return iswupper( static_cast<wint_t>( x ) ); } );
+			if ( regex_ ) {
+				regex.compile( dp._searchText, ignoreCase );
+				_history.regex_search( regex, REPLXX_SEARCH_MATCHES, matches );
+			} else {
+				_history.fuzzy_search( dp._searchText, ignoreCase, REPLXX_SEARCH_MATCHES, matches );
+			}
+			selection = 0;
+			searchAgain = false;
+		}
+		activeHistoryLine.assign( matches.empty() ? UnicodeStringView() : _history.text( matches[static_cast<size_t>( selection )].id() ) );
+		render_search_matches( dp._searchText, ignoreCase, regex_ ? &regex : nullptr, matches, selection, rows );
+		dynamic_refresh( *oldPrompt, dp, activeHistoryLine.get(), activeHistoryLine.length(), activeHistoryLine.length(), rows.get(), rows.length() );
+		oldPrompt = &dp;
+		c = read_char();
+		bool keepLooping( true );
+		switch ( c ) {
+			case 0: break;
+			// these characters move the selection
+			case Replxx::KEY::UP:
+			case Replxx::KEY::control( 'P' ):
+			case Replxx::KEY::control( 'R' ): {
+				if ( ( selection + 1 ) < static_cast<int>( matches.size() ) ) {
+					++ selection;
+				} else {
+					beep();
+				}
+			} break;
+			case Replxx::KEY::DOWN:
+			case Replxx::KEY::control( 'N' ):
+			case Replxx::KEY::control( 'S' ): {
+				if ( selection > 0 ) {
+					-- selection;
+				} else {
+					beep();
+				}
+			} break;
+
+			// these characters revert the input line to its previous state
+			case Replxx::KEY::control( 'C' ):
+			case Replxx::KEY::control( 'G' ):
+			case Replxx::KEY::control( 'L' ): {
+				keepLooping = false;
+				useSearchedLine = false;
+				if ( c != Replxx::KEY::control( 'L' ) ) {
+					c = -1;
+				}
+			} break;
+
+#ifndef _WIN32
+			case Replxx::KEY::control( 'Z' ): {
+				/* IOModeGuard scope */ {
+					IOModeGuard ioModeGuard( _terminal );
+					raise( SIGSTOP );
+				}
+			} break;
+#endif
+
+			// these characters modify the query
+			case Replxx::KEY::BACKSPACE: {
+				if ( dp._searchText.length() > 0 ) {
+					dp._searchText.erase( dp._searchText.length() - 1 );
+					dp.updateSearchPrompt();
+					searchAgain = true;
+				} else {
+					beep();
+				}
+			} break;
+
+			default: {
+				if ( ! is_control_code( c ) && ( c < static_cast<int>( Replxx::KEY::BASE ) ) ) {
+					dp._searchText.insert( dp._searchText.length(), c );
+					dp.updateSearchPrompt();
+					searchAgain = true;
+				} else {
+					// all other action characters keep the selected text
+					keepLooping = false;
+				}
+			}
+		}
+		if ( ! keepLooping ) {
+			break;
+		}
+	}
+
+	// leaving history search, restore previous prompt, maybe make selected line current
+	Prompt pb( _terminal );
+	UnicodeString tempUnicode( &_prompt._text[_prompt._lastLinePosition], _prompt._text.length() - _prompt._lastLinePosition );
+	pb.set_text( tempUnicode );
+	pb.update_screen_columns();
+	if ( useSearchedLine && ! matches.empty() && _history.select( matches[static_cast<size_t>( selection )].id() ) ) {
+		_history.commit_index();
+		_layoutCache.invalidate();
+		_data.assign( _history.current() );
+		_pos = _data.length();
+		_modifiedState = true;
+	} else {
+		_history.restore_pos();
+	}
+	dynamic_refresh( pb, _prompt, _data.get(), _data.length(), _pos );
+	emulate_key_press( c ); // pass a character or -1 back to main loop
+	return ( Replxx::ACTION_RESULT::CONTINUE );
+}
+
+/*
+ * Render rows listing fuzzy (or, if `regex_` is given, regular expression)
+ * search matches to be displayed below the prompt.
+ *
+ * Displayed rows follow the selection, the selected row is marked,
+ * matched characters are highlighted and rows are truncated to screen width.
+ */
+void Replxx::ReplxxImpl::render_search_matches( UnicodeString const& query_, bool ignoreCase_, Regex const* regex_, History::fuzzy_matches_t const& matches_, int selection_, UnicodeString& rows_ ) {
+	static UnicodeString const highlight( ansi_color( Replxx::Color::BRIGHTMAGENTA ) );
+	static UnicodeString const reset( ansi_color( Replxx::Color::DEFAULT ) );
+	static UnicodeString const selected( "> " );
+	static UnicodeString const unselected( "  " );
+	rows_.clear();
+	int rowCount( std::min( std::min( REPLXX_SEARCH_ROWS, _terminal.get_screen_rows() - 2 ), static_cast<int>( matches_.size() ) ) );
+	int first( std::max( selection_ - rowCount + 1, 0 ) );
+	int maxCol( _prompt.screen_columns() - 1 );
+	FuzzyIndex::positions_t positions;
+	int score( 0 );
+	for ( int row( first ); row < ( first + rowCount ); ++ row ) {
+		UnicodeStringView text( _history.text( matches_[static_cast<size_t>( row )].id() ) );
+		if ( regex_ ) {
+			int start( 0 );
+			int end( 0 );
+			positions.clear();
+			if ( regex_->find( text, start, end ) ) {
+				for ( int i( start ); i < end; ++ i ) {
+					positions.push_back( i );
+				}
+			}
+		} else {
+			FuzzyIndex::match( query_, text, ignoreCase_, score, &positions );
+		}
+#ifdef _WIN32
+		rows_.push_back( '\r' );
+#endif
+		rows_.push_back( '\n' );
+		rows_.append( row == selection_ ? selected : unselected );
+		int col( selected.length() );
+		FuzzyIndex::positions_t::const_iterator matched( positions.begin() );
+		for ( int i( 0 ); i < text.length(); ++ i ) {
+			char32_t ch( text[i] );
+			if ( ch == '\n' ) {
+				break;
+			}
+			if ( is_control_code( ch ) ) {
+				ch = ' ';
+			}
+			int width( std::max( mk_wcwidth( ch ), 0 ) );
+			if ( ( col + width ) > maxCol ) {
+				break;
+			}
+			bool isMatched( ( matched != positions.end() ) && ( *matched == i ) );
+			if ( isMatched ) {
+				++ matched;
+			}
+			if ( isMatched && ! _noColor ) {
+				rows_.append( highlight );
+			}
+			rows_.push_back( ch );
+			if ( isMatched && ! _noColor ) {
+				rows_.append( reset );
+			}
+			col += width;
+		}
+	}
+}
+
 // ctrl-L, clear screen and redisplay line
 Replxx::ACTION_RESULT Replxx::ReplxxImpl::clear_screen( char32_t c ) {
 	_terminal.clear_screen( Terminal::CLEAR_SCREEN::WHOLE );
@@ -2409,6 +2723,7 @@ Replxx::ACTION_RESULT Replxx::ReplxxImpl::bracketed_paste( char32_t ) {
 		}
 		buf.push_back( c );
 	}
+	_layoutCache.invalidate( _pos );
 	_data.insert( _pos, buf, 0, buf.length() );
 	_pos += buf.length();
 	return ( Replxx::ACTION_RESULT::CONTINUE );
@@ -2425,9 +2740,31 @@ bool Replxx::ReplxxImpl::is_word_break_character( char32_t char_ ) const {
 
 void Replxx::ReplxxImpl::history_add( std::string const& line ) {
 	_history.add( UnicodeString( line ) );
+	_history.publish();
+}
+
+void Replxx::ReplxxImpl::history_add( std::string const& line, Replxx::HistoryMetadata const& metadata ) {
+	_history.add( UnicodeString( line ), History::now(), &metadata );
+	_history.publish();
+}
+
+void Replxx::ReplxxImpl::history_add_batch( std::vector<std::string> const& lines_ ) {
+	std::vector<UnicodeString> lines;
+	lines.reserve( lines_.size() );
+	for ( std::string const& line : lines_ ) {
+		lines.emplace_back( line );
+	}
+	_history.add_batch( lines );
+	_history.publish();
 }
 
 bool Replxx::ReplxxImpl::history_save( std::string const& filename ) {
+	if ( _historyWriter ) {
+		_historyWriter->adopt( _history );
+		bool queued( _historyWriter->save( _history, filename, false ) );
+		_history.publish();
+		return ( queued );
+	}
 	return ( _history.save( filename, false ) );
 }
 
@@ -2436,29 +2773,69 @@ void Replxx::ReplxxImpl::history_save( std::ostream& out ) {
 }
 
 bool Replxx::ReplxxImpl::history_sync( std::string const& filename ) {
-	return ( _history.save( filename, true ) );
+	if ( _historyWriter ) {
+		_historyWriter->adopt( _history );
+		bool queued( _historyWriter->save( _history, filename, true ) );
+		_history.publish();
+		return ( queued );
+	}
+	bool saved( _history.save( filename, true ) );
+	_history.publish();
+	return ( saved );
 }
 
 bool Replxx::ReplxxImpl::history_load( std::string const& filename ) {
-	return ( _history.load( filename ) );
+	if ( _historyWriter ) {
+		_historyWriter->flush();
+		_historyWriter->discard();
+	}
+	bool loaded( _history.load( filename ) );
+	_history.publish();
+	return ( loaded );
 }
 
 void Replxx::ReplxxImpl::history_load( std::istream& in ) {
+	if ( _historyWriter ) {
+		_historyWriter->discard();
+	}
 	_history.load( in );
+	_history.publish();
 }
 
 void Replxx::ReplxxImpl::history_clear( void ) {
+	if ( _historyWriter ) {
+		_historyWriter->discard();
+	}
 	_history.clear();
+	_history.publish();
 }
 
 int Replxx::ReplxxImpl::history_size( void ) const {
-	return ( _history.size() );
+	return ( _history.published_size() );
 }
 
 Replxx::HistoryScan::impl_t Replxx::ReplxxImpl::history_scan( void ) const {
 	return ( _history.scan() );
 }
 
+Replxx::HistoryScan::impl_t Replxx::ReplxxImpl::history_grep( std::string const& pattern_ ) {
+	Regex regex;
+	regex.compile( UnicodeString( pattern_ ), _ignoreCase );
+	return ( _history.grep( regex ) );
+}
+
+Replxx::HistoryScan::impl_t Replxx::ReplxxImpl::history_filter( Replxx::HistoryFilter const& filter_ ) const {
+	return ( _history.filter( filter_ ) );
+}
+
+Replxx::HistoryScan::impl_t Replxx::ReplxxImpl::history_range( std::string const& from_, std::string const& to_ ) const {
+	return ( _history.range( History::parse_timestamp( from_ ), History::parse_timestamp( to_ ) ) );
+}
+
+Replxx::HistoryScan::impl_t Replxx::ReplxxImpl::history_file_range( std::string const& filename_, std::string const& from_, std::string const& to_ ) const {
+	return ( History::file_range( filename_, History::parse_timestamp( from_ ), History::parse_timestamp( to_ ) ) );
+}
+
 void Replxx::ReplxxImpl::set_modify_callback( Replxx::modify_callback_t const& fn ) {
 	_modifyCallback = fn;
 }
@@ -2477,6 +2854,7 @@ void Replxx::ReplxxImpl::set_hint_callback( Replxx::hint_callback_t const& fn )
 
 void Replxx::ReplxxImpl::set_max_history_size( int len ) {
 	_history.set_max_size( len );
+	_history.publish();
 }
 
 void Replxx::ReplxxImpl::set_completion_count_cutoff( int count ) {
@@ -2491,6 +2869,10 @@ void Replxx::ReplxxImpl::set_hint_delay( int hintDelay_ ) {
 	_hintDelay = hintDelay_;
 }
 
+void Replxx::ReplxxImpl::set_history_hints( bool val ) {
+	_historyHints = val;
+}
+
 void Replxx::ReplxxImpl::set_word_break_characters( char const* wordBreakers ) {
 	_wordBreakChars = wordBreakers;
 }
@@ -2517,6 +2899,41 @@ void Replxx::ReplxxImpl::set_immediate_completion( bool val ) {
 
 void Replxx::ReplxxImpl::set_unique_history( bool val ) {
 	_history.set_unique( val );
+	_history.publish();
+}
+
+void Replxx::ReplxxImpl::set_history_journal( int compactionRatio_ ) {
+	_history.set_journal( compactionRatio_ );
+}
+
+void Replxx::ReplxxImpl::set_history_binary_format( bool val ) {
+	_history.set_binary( val );
+}
+
+void Replxx::ReplxxImpl::set_history_async( bool val ) {
+	if ( val && ! _historyWriter ) {
+		_historyWriter.reset( new HistoryWriter( _historySaveCallback ) );
+	} else if ( ! val && _historyWriter ) {
+		_historyWriter->flush();
+		_historyWriter->adopt( _history );
+		_historyWriter.reset();
+		_history.publish();
+	}
+}
+
+void Replxx::ReplxxImpl::set_history_shared( bool val ) {
+	_history.set_shared( val );
+}
+
+void Replxx::ReplxxImpl::set_history_snapshots( bool val ) {
+	_history.set_publishing( val );
+}
+
+void Replxx::ReplxxImpl::set_history_save_callback( Replxx::history_save_callback_t const& fn ) {
+	_historySaveCallback = fn;
+	if ( _historyWriter ) {
+		_historyWriter->set_callback( fn );
+	}
 }
 
 void Replxx::ReplxxImpl::set_no_color( bool val ) {
@@ -2527,6 +2944,15 @@ void Replxx::ReplxxImpl::set_indent_multiline( bool val ) {
 	_indentMultiline = val;
 }
 
+void Replxx::ReplxxImpl::set_differential_rendering( bool val ) {
+#ifndef _WIN32
+	_differentialRendering = val;
+	_screen.invalidate();
+#else
+	static_cast<void>( val );
+#endif
+}
+
 /**
  * Display the dynamic incremental search prompt and the current user input
  * line.
@@ -2535,8 +2961,11 @@ void Replxx::ReplxxImpl::set_indent_multiline( bool val ) {
  * @param buf32 input buffer to be displayed
  * @param len   count of characters in the buffer
  * @param pos   current cursor position within the buffer (0 <= pos <= len)
+ * @param tail32  optional text displayed after the input line (e.g. list of matches)
+ * @param tailLen count of characters in the tail
  */
-void Replxx::ReplxxImpl::dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, char32_t* buf32, int len, int pos) {
+void Replxx::ReplxxImpl::dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, char32_t* buf32, int len, int pos, char32_t const* tail32, int tailLen) {
+	FrameGuard frameGuard( _terminal );
 	clear_self_to_end_of_screen( &oldPrompt );
 	// calculate the position of the end of the prompt
 	int xEndOfPrompt( 0 );
@@ -2553,6 +2982,11 @@ void Replxx::ReplxxImpl::dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, c
 	int yEndOfInput( yCursorPos );
 	virtual_render( buf32 + pos, len - pos, xEndOfInput, yEndOfInput, &newPrompt );
 
+	// calculate the position of the end of the tail displayed below the input line
+	int xEndOfTail( xEndOfInput );
+	int yEndOfTail( yEndOfInput );
+	replxx::virtual_render( tail32, tailLen, xEndOfTail, yEndOfTail, newPrompt.screen_columns(), 0 );
+
 	// display the prompt
 	newPrompt.write();
 
@@ -2565,10 +2999,13 @@ void Replxx::ReplxxImpl::dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, c
 		_terminal.write8( "\n", 1 );
 	}
 #endif
+	if ( tailLen > 0 ) {
+		_terminal.write32( tail32, tailLen );
+	}
 	// position the cursor
 	_terminal.jump_cursor(
 		xCursorPos, // 0-based on Win32
-		-( yEndOfInput - yCursorPos )
+		-( yEndOfTail - yCursorPos )
 	);
 	newPrompt._cursorRowOffset = newPrompt._extraLines + yCursorPos; // remember row for next pass
 }
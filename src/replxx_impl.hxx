@@ -43,9 +43,13 @@
 
 #include "replxx.hxx"
 #include "history.hxx"
+#include "historywriter.hxx"
 #include "killring.hxx"
 #include "utf8string.hxx"
 #include "prompt.hxx"
+#include "display.hxx"
+#include "layoutcache.hxx"
+#include "screen.hxx"
 
 namespace replxx {
 
@@ -79,7 +83,6 @@ public:
 	typedef std::vector<UnicodeString> hints_t;
 	typedef std::unique_ptr<char[]> utf8_buffer_t;
 	typedef std::unique_ptr<char32_t[]> input_buffer_t;
-	typedef std::vector<char32_t> display_t;
 	typedef std::deque<char32_t> key_presses_t;
 	typedef std::deque<std::string> messages_t;
 	enum class HINT_ACTION {
@@ -106,18 +109,21 @@ private:
 	mutable Utf8String     _utf8Buffer;
 	UnicodeString  _data;
 	int _pos;    // character position in buffer ( 0 <= _pos <= _data[_line].length() )
-	display_t      _display;
-	int _displayInputLength;
+	LayoutCache    _layoutCache; // screen positions of characters in _data, invalidated on every change of _data
+	Display        _display;
 	UnicodeString  _hint;
 	int _prefix; // prefix length used in common prefix search
 	int _hintSelection; // Currently selected hint.
 	History _history;
+	std::unique_ptr<HistoryWriter> _historyWriter;
+	Replxx::history_save_callback_t _historySaveCallback;
 	KillRing _killRing;
 	int long long _lastRefreshTime;
 	bool _refreshSkipped;
 	int _lastYankSize;
 	int _maxHintRows;
 	int _hintDelay;
+	bool _historyHints;
 	std::string _wordBreakChars;
 	std::string _subwordBreakChars;
 	int _completionCountCutoff;
@@ -129,11 +135,13 @@ private:
 	bool _bracketedPaste;
 	bool _noColor;
 	bool _indentMultiline;
+	bool _differentialRendering;
 	named_actions_t _namedActions;
 	key_press_handlers_t _keyPressHandlers;
 	Terminal _terminal;
 	std::thread::id _currentThread;
 	Prompt _prompt;
+	Screen _screen;
 	Replxx::modify_callback_t _modifyCallback;
 	Replxx::completion_callback_t _completionCallback;
 	Replxx::highlighter_callback_t _highlighterCallback;
@@ -167,6 +175,8 @@ public:
 	void set_hint_callback( Replxx::hint_callback_t const& fn );
 	char const* input( std::string const& prompt );
 	void history_add( std::string const& line );
+	void history_add( std::string const& line, Replxx::HistoryMetadata const& metadata );
+	void history_add_batch( std::vector<std::string> const& lines );
 	bool history_sync( std::string const& filename );
 	bool history_save( std::string const& filename );
 	void history_save( std::ostream& out );
@@ -174,19 +184,31 @@ public:
 	void history_load( std::istream& in );
 	void history_clear( void );
 	Replxx::HistoryScan::impl_t history_scan( void ) const;
+	Replxx::HistoryScan::impl_t history_grep( std::string const& );
+	Replxx::HistoryScan::impl_t history_filter( Replxx::HistoryFilter const& ) const;
+	Replxx::HistoryScan::impl_t history_range( std::string const&, std::string const& ) const;
+	Replxx::HistoryScan::impl_t history_file_range( std::string const&, std::string const&, std::string const& ) const;
 	int history_size( void ) const;
 	void set_preload_buffer(std::string const& preloadText);
 	void set_word_break_characters( char const* wordBreakers );
 	void set_subword_break_characters( char const* subwordBreakers );
 	void set_max_hint_rows( int count );
 	void set_hint_delay( int milliseconds );
+	void set_history_hints( bool );
 	void set_double_tab_completion( bool val );
 	void set_complete_on_empty( bool val );
 	void set_beep_on_ambiguous_completion( bool val );
 	void set_immediate_completion( bool val );
 	void set_unique_history( bool );
+	void set_history_journal( int );
+	void set_history_binary_format( bool );
+	void set_history_async( bool );
+	void set_history_save_callback( Replxx::history_save_callback_t const& );
+	void set_history_shared( bool );
+	void set_history_snapshots( bool );
 	void set_no_color( bool val );
 	void set_indent_multiline( bool val );
+	void set_differential_rendering( bool val );
 	void set_max_history_size( int len );
 	void set_completion_count_cutoff( int len );
 	int install_window_change_handler( void );
@@ -265,6 +287,9 @@ private:
 	Replxx::ACTION_RESULT complete( bool );
 	Replxx::ACTION_RESULT incremental_history_search( char32_t startChar );
 	Replxx::ACTION_RESULT common_prefix_search( char32_t startChar );
+	Replxx::ACTION_RESULT fuzzy_history_search( char32_t );
+	Replxx::ACTION_RESULT regex_history_search( char32_t );
+	Replxx::ACTION_RESULT listed_history_search( bool );
 	Replxx::ACTION_RESULT bracketed_paste( char32_t startChar );
 	char32_t read_char( HINT_ACTION = HINT_ACTION::SKIP );
 	char const* read_from_stdin( void );
@@ -276,6 +301,7 @@ private:
 	void move_cursor( void );
 	void indent( void );
 	int virtual_render( char32_t const*, int, int&, int&, Prompt const* = nullptr );
+	void input_position( int, int&, int& );
 	void render( char32_t );
 	void render( HINT_ACTION );
 	void handle_hints( HINT_ACTION );
@@ -288,7 +314,8 @@ private:
 	void repaint( void );
 	template <bool subword>
 	bool is_word_break_character( char32_t ) const;
-	void dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, char32_t* buf32, int len, int pos);
+	void dynamic_refresh(Prompt& oldPrompt, Prompt& newPrompt, char32_t* buf32, int len, int pos, char32_t const* tail32 = nullptr, int tailLen = 0);
+	void render_search_matches( UnicodeString const&, bool, Regex const*, History::fuzzy_matches_t const&, int, UnicodeString& );
 	char const* finalize_input( char const* );
 	void clear_self_to_end_of_screen( Prompt const* = nullptr );
 	typedef struct {
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "screen.hxx"
+#include "conversion.hxx"
+#include "util.hxx"
+
+namespace replxx {
+
+int mk_wcwidth( char32_t );
+
+namespace {
+
+/*
+ * Unchanged cells between two changed runs of a row are rewritten
+ * when this is not longer than an explicit cursor movement.
+ */
+static int const MAX_REWRITTEN_GAP( 5 );
+
+}
+
+Screen::Screen( void )
+	: _current()
+	, _next()
+	, _styles( 1, "\033[0m" )
+	, _sgr()
+	, _buffer()
+	, _columns( 0 )
+	, _origin( 0 )
+	, _rowsOnScreen( 0 )
+	, _cursorColumn( -1 )
+	, _row( 0 )
+	, _column( -1 )
+	, _style( 0 )
+	, _writeCount( 0 )
+	, _valid( false )
+	, _laidOut( false ) {
+}
+
+void Screen::invalidate( void ) {
+	_valid = false;
+}
+
+void Screen::sync( Terminal& terminal_, int cursorColumn_ ) {
+	_writeCount = terminal_.write_count();
+	_cursorColumn = cursorColumn_;
+}
+
+void Screen::add_row( Frame& frame_ ) {
+	frame_._cells.resize( frame_._cells.size() + static_cast<size_t>( _columns ), Cell{ ' ', 0 } );
+	frame_._lengths.push_back( 0 );
+}
+
+int Screen::style( void ) {
+	styles_t::iterator it( std::find( _styles.begin(), _styles.end(), _sgr ) );
+	if ( it != _styles.end() ) {
+		return ( static_cast<int>( it - _styles.begin() ) );
+	}
+	_styles.push_back( _sgr );
+	return ( static_cast<int>( _styles.size() - 1 ) );
+}
+
+/*
+ * Lay out the display the same way replxx::virtual_render() does,
+ * returns false if the terminal could place some character differently.
+ */
+bool Screen::layout( char const* display_, int size_, int origin_, int columns_ ) {
+	_next._cells.clear();
+	_next._lengths.clear();
+	_columns = columns_;
+	_sgr.clear();
+	add_row( _next );
+	int x( origin_ );
+	int y( 0 );
+	int style( 0 );
+	bool wrapped( false );
+	bool sgrPending( false );
+	for ( int i( 0 ); i < size_; ) {
+		char32_t c( 0 );
+		int len( copyChar8to32( c, display_ + i, size_ - i ) );
+		if ( len == 0 ) {
+			return ( false );
+		}
+		if ( c == '\n' ) {
+			if ( ! wrapped ) {
+				add_row( _next );
+				++ y;
+			}
+			x = 0;
+			wrapped = false;
+			++ i;
+			continue;
+		}
+		if ( c == '\033' ) {
+			int end( i + 1 );
+			if ( ( end >= size_ ) || ( display_[end] != '[' ) ) {
+				return ( false );
+			}
+			++ end;
+			while ( ( end < size_ ) && ( ( display_[end] == ';' ) || ( ( display_[end] >= '0' ) && ( display_[end] <= '9' ) ) ) ) {
+				++ end;
+			}
+			if ( ( end >= size_ ) || ( display_[end] != 'm' ) ) {
+				return ( false );
+			}
+			/* a sequence starting with reset overrides all preceding ones */
+			if ( ! sgrPending || ( ( display_[i + 2] == '0' ) && ( ( display_[i + 3] == ';' ) || ( display_[i + 3] == 'm' ) ) ) ) {
+				_sgr.clear();
+			}
+			_sgr.append( display_ + i, static_cast<size_t>( end + 1 - i ) );
+			i = end + 1;
+			sgrPending = true;
+			continue;
+		}
+		i += len;
+		if ( is_control_code( c ) ) {
+			return ( false );
+		}
+		int width( mk_wcwidth( c ) );
+		if ( ( width <= 0 ) || ( ( x + width ) > columns_ ) ) {
+			return ( false );
+		}
+		if ( sgrPending ) {
+			style = this->style();
+			sgrPending = false;
+		}
+		Cell* cell( _next._cells.data() + y * columns_ + x );
+		cell[0] = Cell{ c, style };
+		if ( width > 1 ) {
+			cell[1] = Cell{ 0, style };
+		}
+		x += width;
+		_next._lengths.back() = x;
+		wrapped = false;
+		if ( x >= columns_ ) {
+			add_row( _next );
+			++ y;
+			x = 0;
+			wrapped = true;
+		}
+	}
+	return ( true );
+}
+
+void Screen::set_style( int style_ ) {
+	if ( style_ != _style ) {
+		_buffer.append( _styles[static_cast<size_t>( style_ )] );
+		_style = style_;
+	}
+}
+
+void Screen::move_to( int column_, int row_ ) {
+	char seq[32];
+	if ( row_ < _row ) {
+		int len( _row - row_ > 1 ? snprintf( seq, sizeof ( seq ), "\033[%dA", _row - row_ ) : snprintf( seq, sizeof ( seq ), "\033[A" ) );
+		_buffer.append( seq, static_cast<size_t>( len ) );
+		_row = row_;
+	} else if ( row_ > _row ) {
+		int existing( std::min( row_, _rowsOnScreen - 1 ) );
+		if ( existing > _row ) {
+			int len( existing - _row > 1 ? snprintf( seq, sizeof ( seq ), "\033[%dB", existing - _row ) : snprintf( seq, sizeof ( seq ), "\033[B" ) );
+			_buffer.append( seq, static_cast<size_t>( len ) );
+			_row = existing;
+		}
+		/* rows below the input area have to be scrolled in */
+		if ( _row < row_ ) {
+			set_style( 0 );
+			_buffer.append( static_cast<size_t>( row_ - _row ), '\n' );
+			_row = row_;
+			_column = 0;
+			_rowsOnScreen = _row + 1;
+		}
+	}
+	if ( column_ == _column ) {
+		return;
+	}
+	if ( column_ == 0 ) {
+		_buffer.push_back( '\r' );
+	} else {
+		int len( snprintf( seq, sizeof ( seq ), "\033[%dG", column_ + 1 ) );
+		_buffer.append( seq, static_cast<size_t>( len ) );
+	}
+	_column = column_;
+}
+
+/*
+ * Send only the difference between last frame and given display,
+ * `cursorRow_` is the row of input area the cursor is in before
+ * and after sending.
+ * Returns false if the caller has to redraw whole input area.
+ */
+bool Screen::update( char const* display_, int size_, int origin_, int columns_, Terminal& terminal_, int& cursorRow_ ) {
+	bool sameGeometry( ( columns_ == _columns ) && ( origin_ == _origin ) );
+	_laidOut = layout( display_, size_, origin_, columns_ );
+	_origin = origin_;
+	bool usable(
+		_valid
+		&& _laidOut
+		&& sameGeometry
+		&& ( _writeCount == terminal_.write_count() )
+		&& ( cursorRow_ < _rowsOnScreen )
+	);
+	int height( std::max( _rowsOnScreen, _next.rows() ) );
+	if ( usable && ( height > 1 ) && ( height > terminal_.get_screen_rows() ) ) {
+		usable = false;
+	}
+	if ( ! usable ) {
+		_rowsOnScreen = 0;
+		return ( false );
+	}
+	_buffer.clear();
+	_row = cursorRow_;
+	_column = _cursorColumn;
+	_style = 0;
+	char utf8[8];
+	for ( int y( 0 ); y < _next.rows(); ++ y ) {
+		int newLength( _next._lengths[static_cast<size_t>( y )] );
+		int end( std::max( y < _current.rows() ? _current._lengths[static_cast<size_t>( y )] : 0, newLength ) );
+		int x( y > 0 ? 0 : _origin );
+		while ( x < end ) {
+			while ( ( x < end ) && ( cell( _current, y, x ) == cell( _next, y, x ) ) ) {
+				++ x;
+			}
+			if ( x >= end ) {
+				break;
+			}
+			int runEnd( x + 1 );
+			for ( int k( runEnd ), gap( 0 ); ( k < end ) && ( gap <= MAX_REWRITTEN_GAP ); ++ k ) {
+				if ( cell( _current, y, k ) != cell( _next, y, k ) ) {
+					runEnd = k + 1;
+					gap = 0;
+				} else {
+					++ gap;
+				}
+			}
+			/* never split a wide character */
+			if ( ( runEnd < newLength ) && ( cell( _next, y, runEnd )._char == 0 ) ) {
+				++ runEnd;
+			}
+			move_to( x, y );
+			int writeEnd( std::min( runEnd, newLength ) );
+			for ( int k( x ); k < writeEnd; ++ k ) {
+				Cell const& c( cell( _next, y, k ) );
+				if ( c._char == 0 ) {
+					continue;
+				}
+				set_style( c._style );
+				int len( copyString32to8( utf8, static_cast<int>( sizeof ( utf8 ) ), &c._char, 1 ) );
+				_buffer.append( utf8, static_cast<size_t>( len ) );
+			}
+			/* cursor stays in the last column after writing to it */
+			_column = writeEnd < _columns ? std::max( writeEnd, x ) : -1;
+			if ( runEnd > newLength ) {
+				set_style( 0 );
+				_buffer.append( "\033[K" );
+				break;
+			}
+			x = runEnd;
+		}
+	}
+	for ( int y( _next.rows() ); y < _current.rows(); ++ y ) {
+		if ( _current._lengths[static_cast<size_t>( y )] > 0 ) {
+			move_to( 0, _next.rows() );
+			set_style( 0 );
+			_buffer.append( "\033[J" );
+			break;
+		}
+	}
+	/* rows ending the frame without any cells still have to exist */
+	if ( _rowsOnScreen < _next.rows() ) {
+		move_to( 0, _next.rows() - 1 );
+	}
+	set_style( 0 );
+	if ( ! _buffer.empty() ) {
+		terminal_.write8( _buffer.data(), static_cast<int>( _buffer.size() ) );
+	}
+	cursorRow_ = _row;
+	return ( true );
+}
+
+/*
+ * Make the frame passed to last update() the one on the screen,
+ * must be called after the cursor is positioned in given column.
+ */
+void Screen::commit( Terminal& terminal_, int cursorColumn_ ) {
+	if ( ! _laidOut ) {
+		_valid = false;
+		return;
+	}
+	_current._cells.swap( _next._cells );
+	_current._lengths.swap( _next._lengths );
+	/*
+	 * Full redraw erases the screen right after the input,
+	 * which on most terminals also erases a character just written to the last column,
+	 * so last columns of full rows are not trusted.
+	 */
+	if ( _rowsOnScreen == 0 ) {
+		static Cell const unknown{ static_cast<char32_t>( -1 ), -1 };
+		for ( int y( 0 ); y < _current.rows(); ++ y ) {
+			if ( _current._lengths[static_cast<size_t>( y )] < _columns ) {
+				continue;
+			}
+			Cell* last( _current._cells.data() + ( y + 1 ) * _columns - 1 );
+			if ( last->_char == 0 ) {
+				last[-1] = unknown;
+			}
+			*last = unknown;
+		}
+	}
+	_rowsOnScreen = std::max( _rowsOnScreen, _current.rows() );
+	_writeCount = terminal_.write_count();
+	_cursorColumn = cursorColumn_;
+	_valid = true;
+}
+
+}
+
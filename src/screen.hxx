@@ -0,0 +1,90 @@
+#ifndef REPLXX_SCREEN_HXX_INCLUDED
+#define REPLXX_SCREEN_HXX_INCLUDED 1
+
+#include <vector>
+#include <string>
+
+#include "terminal.hxx"
+
+namespace replxx {
+
+/*
+ * Cell grid of the input area (everything that follows the prompt)
+ * as it was last sent to the terminal.
+ *
+ * Each refresh lays out new display in a second grid and compares it with
+ * the last one row by row, only runs of changed cells are sent,
+ * joined with shortest cursor movements, stale row tails are erased
+ * with erase-line and rows left below new frame with erase-display.
+ *
+ * The grid is trusted only as long as nothing else writes to the terminal
+ * (see Terminal::write_count()) and the screen keeps its width,
+ * displays that cannot be laid out exactly (raw control codes, zero width
+ * characters, wide characters split by line wrap) and frames taller than
+ * the screen are left to caller's full redraw.
+ */
+class Screen {
+	struct Cell {
+		char32_t _char; /* 0 in second column of a wide character */
+		int _style;     /* index into Screen::_styles */
+		bool operator == ( Cell const& other_ ) const {
+			return ( ( _char == other_._char ) && ( _style == other_._style ) );
+		}
+		bool operator != ( Cell const& other_ ) const {
+			return ( ! operator == ( other_ ) );
+		}
+	};
+	typedef std::vector<Cell> cells_t;
+	typedef std::vector<int> lengths_t;
+	typedef std::vector<std::string> styles_t;
+	struct Frame {
+		cells_t _cells;     /* `_columns` cells for each row */
+		lengths_t _lengths; /* number of used cells in each row */
+		int rows( void ) const {
+			return ( static_cast<int>( _lengths.size() ) );
+		}
+	};
+	Frame _current;
+	Frame _next;
+	styles_t _styles;   /* SGR sequences, style 0 is the default one */
+	std::string _sgr;   /* SGR sequences collected since last printable character */
+	std::string _buffer;
+	int _columns;
+	int _origin;        /* first column of input in first row */
+	int _rowsOnScreen;  /* rows of input area known to exist on the screen */
+	int _cursorColumn;  /* where the cursor was left after last refresh */
+	int _row;           /* cursor position while sending a frame, */
+	int _column;        /* column is -1 when not known */
+	int _style;
+	int unsigned _writeCount;
+	bool _valid;
+	bool _laidOut;
+public:
+	Screen( void );
+	bool update( char const*, int, int, int, Terminal&, int& );
+	void commit( Terminal&, int );
+	void sync( Terminal&, int );
+	void invalidate( void );
+private:
+	bool layout( char const*, int, int, int );
+	int style( void );
+	Cell const& cell( Frame const& frame_, int row_, int column_ ) const {
+		static Cell const blank{ ' ', 0 };
+		return (
+			( row_ < frame_.rows() ) && ( column_ < frame_._lengths[static_cast<size_t>( row_ )] )
+				? frame_._cells[static_cast<size_t>( row_ * _columns + column_ )]
+				: blank
+		);
+	}
+	void move_to( int, int );
+	void set_style( int );
+	void add_row( Frame& );
+private:
+	Screen( Screen const& ) = delete;
+	Screen& operator = ( Screen const& ) = delete;
+};
+
+}
+
+#endif
+
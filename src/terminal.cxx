@@ -99,7 +99,9 @@ Terminal::Terminal( void )
 	, _interrupt()
 #endif
 	, _rawMode( false )
-	, _utf8() {
+	, _frame()
+	, _frameDepth( 0 )
+	, _writeCount( 0 ) {
 #ifdef _WIN32
 	_interrupt = CreateEvent( nullptr, true, false, TEXT( "replxx_interrupt_event" ) );
 #else
@@ -120,12 +122,56 @@ Terminal::~Terminal( void ) {
 }
 
 void Terminal::write32( char32_t const* text32, int len32 ) {
-	_utf8.assign( text32, len32 );
-	write8( _utf8.get(), _utf8.size() );
+	++ _writeCount;
+	/* transcode straight into the frame buffer */
+	size_t pos( _frame.size() );
+	int capacity( len32 * 4 );
+	_frame.resize( pos + static_cast<size_t>( capacity ) );
+	int len( copyString32to8( _frame.data() + pos, capacity, text32, len32 ) );
+	_frame.resize( pos + static_cast<size_t>( len ) );
+	if ( _frameDepth == 0 ) {
+		flush();
+	}
 	return;
 }
 
 void Terminal::write8( char const* data_, int size_ ) {
+	++ _writeCount;
+	if ( _frameDepth > 0 ) {
+		_frame.insert( _frame.end(), data_, data_ + size_ );
+		return;
+	}
+	write_out( data_, size_ );
+	return;
+}
+
+/*
+ * Output written between begin_frame() and matching end_frame() is collected
+ * and sent to the terminal with a single write, frames can nest.
+ */
+void Terminal::begin_frame( void ) {
+	++ _frameDepth;
+}
+
+void Terminal::end_frame( void ) {
+	if ( ( _frameDepth > 0 ) && ( -- _frameDepth == 0 ) ) {
+		flush();
+	}
+}
+
+void Terminal::flush( void ) {
+	if ( _frame.empty() ) {
+		return;
+	}
+	std::vector<char> frame;
+	frame.swap( _frame );
+	write_out( frame.data(), static_cast<int>( frame.size() ) );
+	/* keep the allocation for the next frame */
+	frame.clear();
+	_frame.swap( frame );
+}
+
+void Terminal::write_out( char const* data_, int size_ ) {
 #ifdef _WIN32
 	bool temporarilyEnabled( false );
 	if ( _consoleOut == INVALID_HANDLE_VALUE ) {
@@ -677,19 +723,27 @@ void Terminal::notify_event( EVENT_TYPE eventType_ ) {
  * Clear the screen ONLY (no redisplay of anything)
  */
 void Terminal::clear_screen( CLEAR_SCREEN clearScreen_ ) {
+	++ _writeCount;
 #ifdef _WIN32
 	if ( _autoEscape ) {
 #endif
 		if ( clearScreen_ == CLEAR_SCREEN::WHOLE ) {
 			char const clearCode[] = "\033c\033[H\033[2J\033[0m";
-			static_cast<void>( write(1, clearCode, sizeof ( clearCode ) - 1) >= 0 );
+			_frame.insert( _frame.end(), clearCode, clearCode + sizeof ( clearCode ) - 1 );
 		} else {
 			char const clearCode[] = "\033[J";
-			static_cast<void>( write(1, clearCode, sizeof ( clearCode ) - 1) >= 0 );
+			_frame.insert( _frame.end(), clearCode, clearCode + sizeof ( clearCode ) - 1 );
+		}
+		if ( _frameDepth == 0 ) {
+			try {
+				flush();
+			} catch ( ... ) {
+			}
 		}
 		return;
 #ifdef _WIN32
 	}
+	flush();
 	COORD coord = { 0, 0 };
 	CONSOLE_SCREEN_BUFFER_INFO inf;
 	HANDLE consoleOut( _consoleOut != INVALID_HANDLE_VALUE ? _consoleOut : GetStdHandle( STD_OUTPUT_HANDLE ) );
@@ -715,6 +769,8 @@ void Terminal::clear_screen( CLEAR_SCREEN clearScreen_ ) {
 
 void Terminal::jump_cursor( int xPos_, int yOffset_ ) {
 #ifdef _WIN32
+	/* console API calls act immediately, pending output has to go first */
+	flush();
 	CONSOLE_SCREEN_BUFFER_INFO inf;
 	GetConsoleScreenBufferInfo( _consoleOut, &inf );
 	inf.dwCursorPosition.X = xPos_;
@@ -737,6 +793,7 @@ void Terminal::jump_cursor( int xPos_, int yOffset_ ) {
 
 #ifdef _WIN32
 void Terminal::set_cursor_visible( bool visible_ ) {
+	flush();
 	CONSOLE_CURSOR_INFO     cursorInfo;
 	GetConsoleCursorInfo( _consoleOut, &cursorInfo );
 	cursorInfo.bVisible = visible_;
@@ -2,9 +2,9 @@
 #define REPLXX_IO_HXX_INCLUDED 1
 
 #include <deque>
+#include <vector>
 
 #ifdef _WIN32
-#include <vector>
 #include <windows.h>
 #else
 #include <termios.h>
@@ -42,7 +42,9 @@ private:
 	int _interrupt[2];
 #endif
 	bool _rawMode; /* for destructor to check if restore is needed */
-	Utf8String _utf8;
+	std::vector<char> _frame; /* output collected between begin_frame() and end_frame() */
+	int _frameDepth;
+	int unsigned _writeCount; /* number of output operations, lets callers detect foreign output */
 public:
 	enum class CLEAR_SCREEN {
 		WHOLE,
@@ -66,11 +68,18 @@ public:
 	void notify_event( EVENT_TYPE );
 	void jump_cursor( int, int );
 	void set_cursor_visible( bool );
+	void begin_frame( void );
+	void end_frame( void );
+	int unsigned write_count( void ) const {
+		return ( _writeCount );
+	}
 #ifndef _WIN32
 	int read_verbatim( char32_t*, int );
 	int install_window_change_handler( void );
 #endif
 private:
+	void flush( void );
+	void write_out( char const*, int );
 	void enable_out( void );
 	void disable_out( void );
 private:
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cwctype>
+
+#include "trigramindex.hxx"
+
+namespace replxx {
+
+namespace {
+
+inline unsigned long long fold( char32_t c_ ) {
+	return ( static_cast<unsigned long long>( towlower( static_cast<wint_t>( c_ ) ) ) & 0x1fffffu );
+}
+
+template<typename callback_t>
+void for_each_trigram( UnicodeStringView text_, callback_t callback_ ) {
+	int len( text_.length() );
+	if ( len < 3 ) {
+		return;
+	}
+	char32_t const* s( text_.get() );
+	unsigned long long trigram( ( fold( s[0] ) << 21 ) | fold( s[1] ) );
+	for ( int i( 2 ); i < len; ++ i ) {
+		trigram = ( ( trigram << 21 ) | fold( s[i] ) ) & 0x7fffffffffffffffull;
+		callback_( trigram );
+	}
+}
+
+}
+
+TrigramIndex::TrigramIndex( void )
+	: _postings() {
+}
+
+void TrigramIndex::add( id_t id_, UnicodeStringView text_ ) {
+	for_each_trigram(
+		text_,
+		[this, id_]( trigram_t trigram_ ) {
+			posting_list_t& postingList( _postings[trigram_] );
+			if ( postingList.empty() || ( postingList.back() != id_ ) ) {
+				postingList.push_back( id_ );
+			}
+		}
+	);
+}
+
+void TrigramIndex::clear( void ) {
+	_postings.clear();
+}
+
+/*
+ * Collect posting lists of all trigrams of given text.
+ *
+ * Returns false if some trigram is not present in any entry.
+ */
+bool TrigramIndex::query( UnicodeStringView text_, query_t& query_ ) const {
+	query_.clear();
+	bool found( true );
+	for_each_trigram(
+		text_,
+		[this, &query_, &found]( trigram_t trigram_ ) {
+			if ( ! found ) {
+				return;
+			}
+			postings_t::const_iterator it( _postings.find( trigram_ ) );
+			if ( it == _postings.end() ) {
+				found = false;
+				return;
+			}
+			if ( std::find( query_.begin(), query_.end(), &it->second ) == query_.end() ) {
+				query_.push_back( &it->second );
+			}
+		}
+	);
+	std::sort(
+		query_.begin(), query_.end(),
+		[]( posting_list_t const* l_, posting_list_t const* r_ ) {
+			return ( l_->size() < r_->size() );
+		}
+	);
+	return ( found && ! query_.empty() );
+}
+
+/*
+ * Find nearest identifier (before `from_` if `back_` is set, or after it otherwise)
+ * present in all posting lists of given query.
+ */
+bool TrigramIndex::find( query_t const& query_, id_t from_, bool back_, id_t& found_ ) {
+	if ( query_.empty() ) {
+		return ( false );
+	}
+	id_t bound( from_ );
+	if ( back_ ) {
+		if ( bound == 0 ) {
+			return ( false );
+		}
+		-- bound;
+	} else {
+		++ bound;
+	}
+	bool moved( true );
+	while ( moved ) {
+		moved = false;
+		for ( posting_list_t const* postingList : query_ ) {
+			if ( back_ ) {
+				posting_list_t::const_iterator it( std::upper_bound( postingList->begin(), postingList->end(), bound ) );
+				if ( it == postingList->begin() ) {
+					return ( false );
+				}
+				-- it;
+				if ( *it != bound ) {
+					bound = *it;
+					moved = true;
+				}
+			} else {
+				posting_list_t::const_iterator it( std::lower_bound( postingList->begin(), postingList->end(), bound ) );
+				if ( it == postingList->end() ) {
+					return ( false );
+				}
+				if ( *it != bound ) {
+					bound = *it;
+					moved = true;
+				}
+			}
+		}
+	}
+	found_ = bound;
+	return ( true );
+}
+
+/*
+ * Collect identifiers present in all posting lists of given query.
+ */
+void TrigramIndex::collect( query_t const& query_, posting_list_t& ids_ ) {
+	ids_.clear();
+	if ( query_.empty() ) {
+		return;
+	}
+	for ( id_t id : *query_.front() ) {
+		bool present( true );
+		for ( query_t::const_iterator it( query_.begin() + 1 ), end( query_.end() ); present && ( it != end ); ++ it ) {
+			present = std::binary_search( ( *it )->begin(), ( *it )->end(), id );
+		}
+		if ( present ) {
+			ids_.push_back( id );
+		}
+	}
+}
+
+}
+
@@ -0,0 +1,44 @@
+#ifndef REPLXX_TRIGRAMINDEX_HXX_INCLUDED
+#define REPLXX_TRIGRAMINDEX_HXX_INCLUDED 1
+
+#include <vector>
+#include <unordered_map>
+
+#include "unicodestring.hxx"
+
+namespace replxx {
+
+/*
+ * Inverted index of (case folded) character trigrams of history entries.
+ *
+ * Each trigram maps to an ascending list of identifiers of entries containing it,
+ * so entries that may contain given text are found by intersecting
+ * posting lists of all trigrams of that text.
+ * Removed entries are not purged from posting lists,
+ * the owner is responsible for skipping (or rebuilding) stale identifiers.
+ */
+class TrigramIndex {
+public:
+	typedef unsigned int id_t;
+	typedef std::vector<id_t> posting_list_t;
+	typedef std::vector<posting_list_t const*> query_t;
+private:
+	typedef unsigned long long trigram_t;
+	typedef std::unordered_map<trigram_t, posting_list_t> postings_t;
+	postings_t _postings;
+public:
+	TrigramIndex( void );
+	static bool can_filter( UnicodeString const& text_ ) {
+		return ( text_.length() >= 3 );
+	}
+	void add( id_t, UnicodeStringView );
+	void clear( void );
+	bool query( UnicodeStringView, query_t& ) const;
+	static bool find( query_t const&, id_t, bool, id_t& );
+	static void collect( query_t const&, posting_list_t& );
+};
+
+}
+
+#endif
+
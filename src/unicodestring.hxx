@@ -2,6 +2,7 @@
 #define REPLXX_UNICODESTRING_HXX_INCLUDED
 
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <cwctype>
 #include <cassert>
@@ -18,6 +19,56 @@ inline bool case_insensitive_equal( char32_t l, char32_t r ) {
 	return towlower( static_cast<wint_t>( l ) ) == towlower( static_cast<wint_t>( r ) );
 }
 
+/*
+ * Non owning view of a sequence of code points,
+ * used to access text stored in shared buffers without copying it.
+ */
+class UnicodeStringView {
+	char32_t const* _data;
+	int _len;
+public:
+	UnicodeStringView( void )
+		: _data( nullptr )
+		, _len( 0 ) {
+	}
+	UnicodeStringView( char32_t const* data_, int len_ )
+		: _data( data_ )
+		, _len( len_ ) {
+	}
+	char32_t const* get( void ) const {
+		return ( _data );
+	}
+	int length( void ) const {
+		return ( _len );
+	}
+	bool is_empty( void ) const {
+		return ( _len == 0 );
+	}
+	char32_t const* begin( void ) const {
+		return ( _data );
+	}
+	char32_t const* end( void ) const {
+		return ( _data + _len );
+	}
+	char32_t operator[]( int pos ) const {
+		assert( ( pos >= 0 ) && ( pos < _len ) );
+		return ( _data[pos] );
+	}
+	template <class iterator_t, class BinaryPredicate>
+	bool starts_with( iterator_t first_, iterator_t last_, BinaryPredicate&& pred ) const {
+		return (
+			( std::distance( first_, last_ ) <= _len )
+			&& ( std::equal( first_, last_, _data, std::forward<BinaryPredicate>( pred ) ) )
+		);
+	}
+	friend bool operator == ( UnicodeStringView const& left_, UnicodeStringView const& right_ ) {
+		return ( ( left_._len == right_._len ) && std::equal( left_.begin(), left_.end(), right_.begin() ) );
+	}
+	friend bool operator != ( UnicodeStringView const& left_, UnicodeStringView const& right_ ) {
+		return ( ! ( left_ == right_ ) );
+	}
+};
+
 class UnicodeString {
 public:
 	typedef std::vector<char32_t> data_buffer_t;
@@ -67,6 +118,10 @@ public:
 		_data.assign( src, src + len );
 	}
 
+	explicit UnicodeString( UnicodeStringView src )
+		: _data( src.begin(), src.end() ) {
+	}
+
 	explicit UnicodeString( int len )
 		: _data() {
 		_data.resize( len );
@@ -89,11 +144,24 @@ public:
 		return *this;
 	}
 
+	UnicodeString& assign( char const* str_, int byteCount_ ) {
+		_data.resize( byteCount_ );
+		int len( 0 );
+		copyString8to32( _data.data(), byteCount_, len, str_, byteCount_ );
+		_data.resize( len );
+		return *this;
+	}
+
 	UnicodeString& assign( UnicodeString const& other_ ) {
 		_data = other_._data;
 		return *this;
 	}
 
+	UnicodeString& assign( UnicodeStringView other_ ) {
+		_data.assign( other_.begin(), other_.end() );
+		return *this;
+	}
+
 	explicit UnicodeString( UnicodeString const& ) = default;
 	UnicodeString& operator = ( UnicodeString const& ) = default;
 	UnicodeString( UnicodeString&& ) = default;
@@ -129,6 +197,11 @@ public:
 		return *this;
 	}
 
+	UnicodeString& insert( int pos_, UnicodeStringView str_, int offset_, int len_ ) {
+		_data.insert( _data.begin() + pos_, str_.begin() + offset_, str_.begin() + offset_ + len_ );
+		return *this;
+	}
+
 	UnicodeString& insert( int pos_, char32_t c_ ) {
 		_data.insert( _data.begin() + pos_, c_ );
 		return *this;
@@ -220,6 +293,10 @@ public:
 	char32_t back( void ) const {
 		return ( _data.back() );
 	}
+
+	operator UnicodeStringView ( void ) const {
+		return ( UnicodeStringView( _data.data(), length() ) );
+	}
 };
 
 }
@@ -41,6 +41,10 @@ public:
 		assign( str_.get(), len_ );
 	}
 
+	void assign( UnicodeStringView str_ ) {
+		assign( str_.get(), str_.length() );
+	}
+
 	void assign( char32_t const* str_, int len_ ) {
 		int len( len_ * 4 );
 		realloc( len );
@@ -44,6 +44,7 @@ int virtual_render( char32_t const* display_, int size_, int& x_, int& y_, int s
 			if ( ( c == '\n' ) && ! wrapped ) {
 				++ y_;
 			}
+			wrapped = false;
 			x_ = promptLen_;
 			++ pos;
 			continue;
@@ -159,8 +160,11 @@ char const* ansi_color( Replxx::Color color_ ) {
 	return colorBuffer;
 }
 
-std::string now_ms_str( void ) {
-	std::chrono::milliseconds ms( std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now().time_since_epoch() ) );
+/*
+ * Current local time shifted by given number of milliseconds.
+ */
+std::string now_ms_str( long long shift_ ) {
+	std::chrono::milliseconds ms( std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now().time_since_epoch() ) + std::chrono::milliseconds( shift_ ) );
 	time_t t( ms.count() / 1000 );
 	tm broken;
 #ifdef _WIN32
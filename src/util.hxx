@@ -24,7 +24,7 @@ inline char32_t control_to_human( char32_t key ) {
 
 int virtual_render( char32_t const*, int, int&, int&, int, int, char32_t* = nullptr, int* = nullptr );
 char const* ansi_color( Replxx::Color );
-std::string now_ms_str( void );
+std::string now_ms_str( long long = 0 );
 
 }
 
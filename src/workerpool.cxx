@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "workerpool.hxx"
+
+namespace replxx {
+
+namespace {
+
+unsigned const MAX_CONCURRENCY( 4 );
+
+}
+
+WorkerPool::WorkerPool( void )
+	: _threads()
+	, _task( nullptr )
+	, _chunks( 0 )
+	, _nextChunk( 0 )
+	, _pendingChunks( 0 )
+	, _started( false )
+	, _stop( false )
+	, _mutex()
+	, _work()
+	, _done() {
+}
+
+WorkerPool::~WorkerPool( void ) {
+	/* scope for lock */ {
+		std::lock_guard<std::mutex> l( _mutex );
+		_stop = true;
+	}
+	_work.notify_all();
+	for ( std::thread& t : _threads ) {
+		t.join();
+	}
+}
+
+/*
+ * Number of threads (including the calling one) processing chunks.
+ */
+int WorkerPool::concurrency( void ) const {
+	return ( static_cast<int>( std::max( std::min( std::thread::hardware_concurrency(), MAX_CONCURRENCY ), 1u ) ) );
+}
+
+/*
+ * Invoke given task for each chunk number in [0, chunks_) range,
+ * return when the task finished for all chunks.
+ */
+void WorkerPool::run( int chunks_, task_t const& task_ ) {
+	if ( chunks_ <= 0 ) {
+		return;
+	}
+	if ( ( chunks_ == 1 ) || ( concurrency() == 1 ) ) {
+		for ( int i( 0 ); i < chunks_; ++ i ) {
+			task_( i );
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> l( _mutex );
+	if ( ! _started ) {
+		for ( int i( 1 ); i < concurrency(); ++ i ) {
+			_threads.emplace_back( &WorkerPool::work, this );
+		}
+		_started = true;
+	}
+	_task = &task_;
+	_chunks = chunks_;
+	_nextChunk = 0;
+	_pendingChunks = chunks_;
+	_work.notify_all();
+	process( l );
+	_done.wait( l, [this]() { return ( _pendingChunks == 0 ); } );
+	_task = nullptr;
+}
+
+void WorkerPool::work( void ) {
+	std::unique_lock<std::mutex> l( _mutex );
+	while ( true ) {
+		_work.wait( l, [this]() { return ( _stop || ( _task && ( _nextChunk < _chunks ) ) ); } );
+		if ( _stop ) {
+			break;
+		}
+		process( l );
+	}
+}
+
+/*
+ * Process not yet taken chunks, the lock is released while processing a chunk.
+ */
+void WorkerPool::process( std::unique_lock<std::mutex>& lock_ ) {
+	while ( _task && ( _nextChunk < _chunks ) ) {
+		int chunk( _nextChunk );
+		++ _nextChunk;
+		task_t const& task( *_task );
+		lock_.unlock();
+		task( chunk );
+		lock_.lock();
+		-- _pendingChunks;
+		if ( _pendingChunks == 0 ) {
+			_done.notify_all();
+		}
+	}
+}
+
+}
+
@@ -0,0 +1,48 @@
+#ifndef REPLXX_WORKERPOOL_HXX_INCLUDED
+#define REPLXX_WORKERPOOL_HXX_INCLUDED 1
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace replxx {
+
+/*
+ * Small pool of worker threads used to split CPU heavy scans of history into chunks.
+ *
+ * Threads are started on first use, the calling thread takes part
+ * in processing of chunks and run() returns when all chunks are processed.
+ */
+class WorkerPool {
+public:
+	typedef std::function<void ( int )> task_t;
+private:
+	typedef std::vector<std::thread> threads_t;
+	threads_t _threads;
+	task_t const* _task;
+	int _chunks;
+	int _nextChunk;
+	int _pendingChunks;
+	bool _started;
+	bool _stop;
+	std::mutex _mutex;
+	std::condition_variable _work;
+	std::condition_variable _done;
+public:
+	WorkerPool( void );
+	~WorkerPool( void );
+	int concurrency( void ) const;
+	void run( int, task_t const& );
+private:
+	WorkerPool( WorkerPool const& ) = delete;
+	WorkerPool& operator = ( WorkerPool const& ) = delete;
+	void work( void );
+	void process( std::unique_lock<std::mutex>& );
+};
+
+}
+
+#endif
+
@@ -7,6 +7,7 @@ import os
 import subprocess
 import signal
 import time
+import struct
 
 keytab = {
 	"<home>": "\033[1~",
@@ -83,9 +84,11 @@ keytab = {
 	"<m-n>": "\033n",
 	"<m-p>": "\033p",
 	"<m-r>": "\033r",
+	"<m-s>": "\033s",
 	"<m-u>": "\033u",
 	"<m-U>": "\033U",
 	"<m-w>": "\033w",
+	"<m-x>": "\033x",
 	"<m-y>": "\033y",
 	"<m-.>": "\033.",
 	"<m-backspace>": "\033\177",
@@ -136,6 +139,9 @@ termseq = {
 	"\x1b[H": "<mvhm>",
 	"\x1b[2J": "<clr>",
 	"\x1b[J": "<ceos>",
+	"\x1b[K": "<ceol>",
+	"\x1b[A": "<u1>",
+	"\x1b[B": "<d1>",
 	"\x1b[0;22;30m": "<black>",
 	"\x1b[0;22;31m": "<red>",
 	"\x1b[0;22;32m": "<green>",
@@ -327,6 +333,85 @@ class ReplxxTests( unittest.TestCase ):
 			"<rst><ceos><c21><c9>aóą Ϩ 𓢀  󃔀  <rst><ceos><c21>\r\n"
 			"aóą Ϩ 𓢀  󃔀  \r\n"
 		)
+	def test_wide_and_combining_at_wrap( self_ ):
+		self_.check_scenario(
+			"<up><left><left><left><left><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>9<rst>e\u0301中yz<rst><ceos><c5><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>9<rst>e\u0301中yz<rst><ceos><c4><c3><c1><c1><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>9<rst>e\u0301中yz<rst><ceos><c5><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>9<rst>e\u0301中yz<rst><ceos><c5>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx9e\u0301中yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx9e\u0301中yz\n",
+			dimensions = ( 10, 40 )
+		)
+		self_.check_scenario(
+			"<up><left><left><left><home><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz<rst><ceos><c2><c1><u1><c40><c9>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz<rst><ceos><c3>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx中yz\n",
+			dimensions = ( 10, 40 )
+		)
+		self_.check_scenario(
+			"<up><left><left><left><home><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c2><c1><c1><u1><c9>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c3>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz\n",
+			dimensions = ( 10, 40 )
+		)
+		self_.check_scenario(
+			"<up><left><left><left><home><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c4><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c3><c2><c2><u1><c9>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c4><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz<rst><ceos><c4>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxe\u0301yz\n",
+			dimensions = ( 10, 40 )
+		)
+	def test_emoji_width_at_wrap( self_ ):
+		self_.check_scenario(
+			"<up><left><left><left><home><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c2><c1><u1><c39><c9>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz\n",
+			dimensions = ( 10, 40 )
+		)
+		self_.check_scenario(
+			"<up><left><left><left><home><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c2><c1><u1><c40><c9>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3><u1>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz<rst><ceos><c3>\r\n"
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\U0001FAE0yz\n",
+			dimensions = ( 10, 40 )
+		)
+	def test_edit_past_layout_checkpoint( self_ ):
+		self_.check_scenario(
+			"<up><home><right><right><right><right><right>中<end><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><left><backspace>z<home><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><right><del><end><cr><c-d>",
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c33><u2>"
+			"<c9>xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><u2><c9><c10><c11><c12><c13><c14>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><u2><c16>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c35><u2>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c34><c33><c32><c31><c30><c29><c28><c27><c26><c25><c24><c23><c22><c21><c20><c19><c18><c17><c16><c15><c14><c13><c12><c11><c10><c9><c8><c7><c6><c5><u2>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c4><u2>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>1234<rst>yyyyyyyyyzyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c5><u2><c9><c10><c11><c12><c13><c14><c16><c17><c18><c19><c20><c21><c22><c23><c24><c25><c26><c27><c28><c29><c30><c31><c32><c33><c34><c35><c36><c37><c38><c39><c40><d1><c1><c2><c3><c4><c5><c6><c7><c8><c9><c10><c11><c12><c13><c14><c15><c16><c17><c18><c19><c20><c21><c22><c23><c24><c25><c26><c27><c28><c29><c30><c31><c32><u1>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>134<rst>yyyyyyyyyzyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><u1><c32><u1>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>134<rst>yyyyyyyyyzyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c34><u2>"
+			"<c9>xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx<yellow>134<rst>yyyyyyyyyzyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy<rst><ceos><c34>\r\n"
+			"xxxxx中xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx134yyyyyyyyyzyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy\r\n",
+			"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx1234yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy\n",
+			dimensions = ( 10, 40 )
+		)
 	@unittest.skipIf( skip( "8bit_encoding" ), "broken platform" )
 	def test_8bit_encoding( self_ ):
 		LC_CTYPE = "LC_CTYPE"
@@ -393,6 +478,38 @@ class ReplxxTests( unittest.TestCase ):
 			"first second\r\n",
 			"first second\n"
 		)
+	def test_frame_wrapped_redraw( self_ ):
+		self_.check_scenario(
+			"<up><home><c-right><c-right><end><left><c-l><c-a>x<cr><c-d>",
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9><u2>"
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><u2><c9><c10><c15>"
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9><u2>"
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c8>"
+			"<RIS><mvhm><clr><rst><brightgreen>replxx<rst>> "
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c8><u2><c9>"
+			"<c9>xa very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><u2><c10>"
+			"<c9>xa very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c10>\r\n"
+			"xa very long line of user input, wider then current terminal, the line is wrapped\r\n",
+			"a very long line of user input, wider then current terminal, the line is wrapped\n",
+			dimensions = ( 10, 40 )
+		)
+		self_.check_scenario(
+			"<up><c-l><c-r>wid<c-l><cr><c-d>",
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9>"
+			"<RIS><mvhm><clr><rst><brightgreen>replxx<rst>> "
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9><u2><c1><ceos><u2><c1><ceos>"
+			"(reverse-i-search)`': a very long line of user input, wider then current terminal, the line is wrapped<c23><u2><c1><ceos>"
+			"(reverse-i-search)`w': a very long line of user input, wider then current terminal, the line is wrapped<c17><u2><c1><ceos>"
+			"(reverse-i-search)`wi': a very long line of user input, wider then current terminal, the line is wrapped<u1><c17><u1><c1><ceos>"
+			"(reverse-i-search)`wid': a very long line of user input, wider then current terminal, the line is wrapped<u1><c18><c1><ceos>"
+			"<brightgreen>replxx<rst>> a very long line of user input, wider then current terminal, the line is wrapped<c9>"
+			"<RIS><mvhm><clr><rst><brightgreen>replxx<rst>> "
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9><u2>"
+			"<c9>a very long line of user input, wider then current terminal, the line is wrapped<rst><ceos><c9>\r\n"
+			"a very long line of user input, wider then current terminal, the line is wrapped\r\n",
+			"a very long line of user input, wider then current terminal, the line is wrapped\n",
+			dimensions = ( 10, 40 )
+		)
 	def test_backspace( self_ ):
 		self_.check_scenario(
 			"<up><c-a><m-f><c-right><backspace><backspace><backspace><backspace><cr><c-d>",
@@ -942,6 +1059,80 @@ class ReplxxTests( unittest.TestCase ):
 			"fake\nsome very long line of text, much longer then a witdth of a terminal, seriously\nanother fake",
 			dimensions = ( 24, 64 )
 		)
+	def test_history_search_indexed( self_ ):
+		history = "".join( "filler {}\n".format( i ) for i in range( 50 ) )
+		history = history.replace( "filler 7\n", "Xyzzy alfa\n" ).replace( "filler 20\n", "żółwik\n" )
+		history = history.replace( "filler 30\n", "plugh xYZzy\n" ).replace( "filler 44\n", "xyz zy\n" )
+		self_.check_scenario(
+			"qyzzy<cr><up><up><c-e>yzz<down><down><c-r>yzz<c-r><c-r><cr><c-r>yzz<c-r><c-r><c-r><cr><c-d>",
+			"<c9>q<rst><ceos><c10><c9>qy<rst><ceos><c11><c9>qyz<rst><ceos><c12><c9>qyzz<rst><ceos><c13><c9>qyzzy<rst><ceos><c14><c9>qyzzy<rst><ceos><c14>\r\n"
+			"qyzzy\r\n"
+			"<brightgreen>replxx<rst>> <c9>qyzzy<rst><ceos><c14><c9>filler <yellow>49<rst><ceos><c18><c9>filler <yellow>49<rst>y<rst><ceos><c19><c9>filler <yellow>49<rst>yz<rst><ceos><c20><c9>filler <yellow>49<rst>yzz<rst><ceos><c21><c9>qyzzy<rst><ceos><c14><c9><rst><ceos><c9><c1><ceos>"
+			"<c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`y': qyzzy<c28>"
+			"<c1><ceos>(reverse-i-search)`yz': qyzzy<c26>"
+			"<c1><ceos>(reverse-i-search)`yzz': qyzzy<c27>"
+			"<c1><ceos>(reverse-i-search)`yzz': filler 49yzz<c35>"
+			"<c1><ceos>(reverse-i-search)`yzz': Xyzzy alfa<c27><c1><ceos><brightgreen>replxx<rst>> Xyzzy alfa<c10><c9>Xyzzy alfa<rst><ceos><c10><c9>Xyzzy alfa<rst><ceos><c19>\r\n"
+			"Xyzzy alfa\r\n"
+			"<brightgreen>replxx<rst>> <c1><ceos>"
+			"<c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`y': Xyzzy alfa<c28>"
+			"<c1><ceos>(reverse-i-search)`yz': Xyzzy alfa<c26>"
+			"<c1><ceos>(reverse-i-search)`yzz': Xyzzy alfa<c27>"
+			"<c1><ceos>(reverse-i-search)`yzz': qyzzy<c27>"
+			"<c1><ceos>(reverse-i-search)`yzz': filler 49yzz<c35><bell>"
+			"<c1><ceos>(reverse-i-search)`yzz': <c26><c1><ceos><brightgreen>replxx<rst>> <c9><c9><ceos><c9>\r\n",
+			history
+		)
+		self_.check_scenario(
+			"<c-r>ółw<cr><c-d>",
+			"<c1><ceos><c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`ó': żółwik<c25>"
+			"<c1><ceos>(reverse-i-search)`ół': żółwik<c26>"
+			"<c1><ceos>(reverse-i-search)`ółw': żółwik<c27>"
+			"<c1><ceos><brightgreen>replxx<rst>> żółwik<c10><c9>żółwik<rst><ceos><c10><c9>żółwik<rst><ceos><c15>\r\n"
+			"żółwik\r\n",
+			history
+		)
+	def test_history_search_narrowing( self_ ):
+		words = [ "abcd", "abxy", "abcz", "zabc", "xab", "abyz", "qqq", "abcd", "cab", "ab" ] * 3
+		history = "".join( "{} {}\n".format( w, i ) for i, w in enumerate( words ) )
+		self_.check_scenario(
+			"<c-r>abc<c-r><c-r><backspace><backspace>y<c-r><backspace><backspace>c<c-r><cr><c-d>",
+			"<c1><ceos><c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`a': ab 29<c24>"
+			"<c1><ceos>(reverse-i-search)`ab': ab 29<c25>"
+			"<c1><ceos>(reverse-i-search)`abc': abcd 27<c26>"
+			"<c1><ceos>(reverse-i-search)`abc': zabc 23<c27>"
+			"<c1><ceos>(reverse-i-search)`abc': abcz 22<c26>"
+			"<c1><ceos>(reverse-i-search)`ab': ab 29<c25>"
+			"<c1><ceos>(reverse-i-search)`a': ab 29<c24><bell>"
+			"<c1><ceos>(reverse-i-search)`ay': <c25><bell>"
+			"<c1><ceos>(reverse-i-search)`ay': <c25>"
+			"<c1><ceos>(reverse-i-search)`a': ab 29<c24>"
+			"<c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`c': cab 28<c24>"
+			"<c1><ceos>(reverse-i-search)`c': abcd 27<c26><c1><ceos><brightgreen>replxx<rst>> abcd 27<c11><c9>abcd <yellow>27<rst><ceos><c11><c9>abcd <yellow>27<rst><ceos><c16>\r\n"
+			"abcd 27\r\n",
+			history
+		)
+		self_.check_scenario(
+			"<c-r>abc<c-r><c-r>d<backspace><backspace><backspace>x<c-r><cr><c-d>",
+			"<c1><ceos><c1><ceos>(reverse-i-search)`': <c23>"
+			"<c1><ceos>(reverse-i-search)`a': ab 29<c24>"
+			"<c1><ceos>(reverse-i-search)`ab': ab 29<c25>"
+			"<c1><ceos>(reverse-i-search)`abc': abcd 27<c26>"
+			"<c1><ceos>(reverse-i-search)`abc': zabc 23<c27>"
+			"<c1><ceos>(reverse-i-search)`abc': abcz 22<c26>"
+			"<c1><ceos>(reverse-i-search)`abcd': abcd 20<c27>"
+			"<c1><ceos>(reverse-i-search)`abc': abcd 27<c26>"
+			"<c1><ceos>(reverse-i-search)`ab': ab 29<c25>"
+			"<c1><ceos>(reverse-i-search)`a': ab 29<c24><bell>"
+			"<c1><ceos>(reverse-i-search)`ax': <c25><bell>"
+			"<c1><ceos>(reverse-i-search)`ax': <c25><c1><ceos><brightgreen>replxx<rst>> <c9><c9><ceos><c9>\r\n",
+			history
+		)
 	def test_history_prefix_search_backward( self_ ):
 		self_.check_scenario(
 			"repl<m-p><m-p><cr><c-d>",
@@ -972,6 +1163,44 @@ class ReplxxTests( unittest.TestCase ):
 			"repl_echo golf\n"
 			"final thoughts\n"
 		)
+	def test_history_prefix_search_indexed( self_ ):
+		history = "replace\nrep\nReplica\nreply all\nother\nrepl\nREPLY\nrepast\nrelay\n"
+		self_.check_scenario(
+			"repl<m-p><m-p><m-p><m-p><m-p><m-n><cr><c-d>",
+			"<c9>r<rst><ceos><c10><c9>re<rst><ceos><c11><c9>rep<rst><ceos><c12><c9>repl<rst><ceos><c13>"
+			"<c9>repl<rst><ceos><c13><c9>reply all<rst><ceos><c18><c9>replace<rst><ceos><c16>"
+			"<c9>repl<rst><ceos><c13><c9>reply all<rst><ceos><c18><c9>repl<rst><ceos><c13>"
+			"<c9>repl<rst><ceos><c13>\r\n"
+			"repl\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1"
+		)
+		self_.check_scenario(
+			"repl<m-p><m-p><m-p><m-p><m-p><m-p><cr><c-d>",
+			"<c9>r<rst><ceos><c10><c9>re<rst><ceos><c11><c9>rep<rst><ceos><c12><c9>repl<rst><ceos><c13>"
+			"<c9>REPLY<rst><ceos><c14><c9>REPLY<rst><ceos><c14>\r\n"
+			"REPLY\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1 i1"
+		)
+		self_.check_scenario(
+			"replay<cr>reply all<cr>repl<m-p><m-p><m-p><m-p><cr><c-d>",
+			"<c9>r<rst><ceos><c10><c9>re<rst><ceos><c11><c9>rep<rst><ceos><c12><c9>repl<rst><ceos><c13>"
+			"<c9>repla<rst><ceos><c14><c9>replay<rst><ceos><c15><c9>replay<rst><ceos><c15>\r\n"
+			"replay\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>r<rst><ceos><c10><c9>re<rst><ceos><c11><c9>rep<rst><ceos><c12><c9>repl<rst><ceos><c13>"
+			"<c9>reply<rst><ceos><c14><c9>reply <rst><ceos><c15><c9>reply a<rst><ceos><c16><c9>reply al<rst><ceos><c17>"
+			"<c9>reply all<rst><ceos><c18><c9>reply all<rst><ceos><c18>\r\n"
+			"reply all\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>r<rst><ceos><c10><c9>re<rst><ceos><c11><c9>rep<rst><ceos><c12><c9>repl<rst><ceos><c13>"
+			"<c9>reply all<rst><ceos><c18><c9>replay<rst><ceos><c15><c9>repl<rst><ceos><c13>"
+			"<c9>replace<rst><ceos><c16><c9>replace<rst><ceos><c16>\r\n"
+			"replace\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1"
+		)
 	def test_history_listing( self_ ):
 		self_.check_scenario(
 			"<up><cr><c-d>",
@@ -1114,6 +1343,51 @@ class ReplxxTests( unittest.TestCase ):
 			"a\nb\nc\nb\nc\nd\na\nc\nc\na\n",
 			command = ReplxxTests._cSample_ + " u0 q1"
 		)
+	def test_history_add_edited_last( self_ ):
+		self_.check_scenario(
+			[ "<up>x<down>threex<cr>", rapid( "/history<cr><c-d>" ) ],
+			"<c9>three<rst><ceos><c14><c9>threex<rst><ceos><c15><c9><rst><ceos><c9>"
+			"<c9>t<rst><ceos><c10><c9>th<rst><ceos><c11><c9>thr<rst><ceos><c12><c9>thre<rst><ceos><c13>"
+			"<c9>three<rst><ceos><c14><c9>threex<rst><ceos><c15><c9>threex<rst><ceos><c15>\r\n"
+			"threex\r\n"
+			"<brightgreen>replxx<rst>> <c9>/<rst><ceos><c10><c9>/history<rst><ceos><c17>\r\n"
+			"   0: one\r\n"
+			"   1: two\r\n"
+			"   2: three\r\n"
+			"   3: threex\r\n"
+			"/history\r\n",
+			command = ReplxxTests._cSample_ + " q1"
+		)
+	def test_history_unique_fingerprint_collision( self_ ):
+		# Both lines have the same 64-bit fingerprint in history's dedup index.
+		a = "Rktxaa"
+		b = "4wYx餦惄"
+		self_.check_scenario(
+			[ rapid( b + "<cr>" ), rapid( a + "<cr>" ), rapid( "/history<cr><c-d>" ) ],
+			"<c9><brightmagenta>4<rst><ceos><c10><c9><brightmagenta>4<rst>wYx餦惄<rst><ceos><c17>\r\n"
+			"4wYx餦惄\r\n"
+			"<brightgreen>replxx<rst>> <c9>R<rst><ceos><c10><c9>Rktxaa<rst><ceos><c15>\r\n"
+			"Rktxaa\r\n"
+			"<brightgreen>replxx<rst>> <c9>/<rst><ceos><c10><c9>/history<rst><ceos><c17>\r\n"
+			"   0: other\r\n"
+			"   1: 4wYx餦惄\r\n"
+			"   2: Rktxaa\r\n"
+			"/history\r\n",
+			a + "\n" + b + "\nother\n",
+			command = ReplxxTests._cSample_ + " q1 u1"
+		)
+		with open( "replxx_history.txt", "r" ) as f:
+			lines = [ l for l in f.read().split( "\n" ) if l and not l.startswith( "### " ) ]
+		self_.assertEqual( lines, [ "other", b, a, "/history" ] )
+		self_.check_scenario(
+			rapid( "/history<cr><c-d>" ),
+			"<c9>/<rst><ceos><c10><c9>/history<rst><ceos><c17>\r\n"
+			"   0: 4wYx餦惄\r\n"
+			"   1: Rktxaa\r\n"
+			"/history\r\n",
+			a + "\n" + b + "\n" + a + "\n" + b + "\n" + a + "\n",
+			command = ReplxxTests._cSample_ + " q1 u1"
+		)
 	def test_history_recall_most_recent( self_ ):
 		self_.check_scenario(
 			"<pgup><down><cr><down><cr><c-d>",
@@ -1919,6 +2193,41 @@ class ReplxxTests( unittest.TestCase ):
 			"han\r\n",
 			command = [ ReplxxTests._cSample_, "q1", "H200" ]
 		)
+	def test_history_hints( self_ ):
+		self_.check_scenario(
+			"gi<cr>git push<cr>gi<cr><c-d>",
+			"<c9>g<rst><ceos>\r\n"
+			"        <gray>go<rst>\r\n"
+			"        <gray>git status<rst>\r\n"
+			"        <gray>git push<rst><u3><c10><c9>gi<rst><ceos>\r\n"
+			"        <gray>git status<rst>\r\n"
+			"        <gray>git push<rst><u2><c11><c9>gi<rst><ceos><c11>\r\n"
+			"gi\r\n"
+			"<brightgreen>replxx<rst>> <c9>g<rst><ceos>\r\n"
+			"        <gray>gi<rst>\r\n"
+			"        <gray>go<rst>\r\n"
+			"        <gray>git status<rst><u3><c10><c9>gi<rst><ceos>\r\n"
+			"        <gray>git status<rst>\r\n"
+			"        <gray>git push<rst><u2><c11><c9>git<rst><ceos>\r\n"
+			"        <gray>git status<rst>\r\n"
+			"        <gray>git push<rst><u2><c12><c9>git <rst><ceos>\r\n"
+			"        <gray>git status<rst>\r\n"
+			"        <gray>git push<rst><u2><c13><c9>git "
+			"p<rst><ceos><gray>ush<rst><c14><c9>git "
+			"pu<rst><ceos><gray>sh<rst><c15><c9>git "
+			"pus<rst><ceos><gray>h<rst><c16><c9>git push<rst><ceos><c17><c9>git "
+			"push<rst><ceos><c17>\r\n"
+			"git push\r\n"
+			"<brightgreen>replxx<rst>> <c9>g<rst><ceos>\r\n"
+			"        <gray>git push<rst>\r\n"
+			"        <gray>gi<rst>\r\n"
+			"        <gray>go<rst><u3><c10><c9>gi<rst><ceos>\r\n"
+			"        <gray>git push<rst>\r\n"
+			"        <gray>git status<rst><u2><c11><c9>gi<rst><ceos><c11>\r\n"
+			"gi\r\n",
+			"git push\ngit status\ngo\n",
+			command = [ ReplxxTests._cSample_, "q1", "N", "r1", "h3" ]
+		)
 	def test_complete_next( self_ ):
 		self_.check_scenario(
 			"<up><c-n><c-n><c-p><c-p><c-p><cr><c-d>",
@@ -2079,6 +2388,400 @@ class ReplxxTests( unittest.TestCase ):
 			"<c9>zoom<rst><ceos><c13><c9>zoom<rst><ceos><c13>\r\n"
 			"zoom\r\n"
 		)
+	def test_history_journal( self_ ):
+		self_.check_scenario(
+			"one<cr>four<cr><c-d>",
+			"<c9>o<rst><ceos><c10><c9>on<rst><ceos><c11><c9>one<rst><ceos><c12><c9>one<rst><ceos><c12>\r\n"
+			"one\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>f<rst><ceos><c10><c9>fo<rst><ceos><c11><c9>fou<rst><ceos><c12><c9>four<rst><ceos><c13><c9>four<rst><ceos><c13>\r\n"
+			"four\r\n",
+			"### 0000-00-00 00:00:00.003\n"
+			"three\n"
+			"### 0000-00-00 00:00:00.001\n"
+			"one\n",
+			command = ReplxxTests._cSample_ + " q1 j4"
+		)
+		with open( "replxx_history.txt", "r" ) as f:
+			data = f.read().split( "\n" )
+			self_.assertSequenceEqual(
+				data[:6],
+				[
+					"### 0000-00-00 00:00:00.003",
+					"three",
+					"### 0000-00-00 00:00:00.001",
+					"one",
+					"#!# 0000-00-00 00:00:00.001",
+					"one"
+				]
+			)
+			self_.assertSequenceEqual( [ data[7], data[9], data[10] ], [ "one", "four", "" ] )
+			self_.assertEqual( len( data ), 11 )
+	def test_history_journal_readd( self_ ):
+		self_.check_scenario(
+			rapid( "/batch a b;a;b;a;b<cr><c-d>" ),
+			"<c9>/<rst><ceos><c10><c9>/batch a b;a;b;a;b<rst><ceos><c27>\r\n"
+			"/batch a b;a;b;a;b\r\n",
+			"### 2999-12-31 23:59:59.999\n"
+			"a\n",
+			command = ReplxxTests._cSample_ + " q1 j4"
+		)
+		with open( "replxx_history.txt", "r" ) as f:
+			history = f.read()
+		self_.check_scenario(
+			rapid( "/range 3000 -<cr><c-d>" ),
+			"<c9>/<rst><ceos><c10><c9>/range <brightmagenta>3000<rst> -<rst><ceos><c22>\r\n"
+			"3000-01-01 00:00:00.003 a\r\n"
+			"3000-01-01 00:00:00.004 b\r\n"
+			"3000-01-01 00:00:00.005 /batch a b;a;b;a;b\r\n"
+			"/range 3000 -\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1 j4"
+		)
+	def test_history_load_large( self_ ):
+		history = "".join(
+			"### {:04d}-{:02d}-{:02d} {:02d}:00:00.000\r\nentry {}\r\n".format(
+				2000 + i // 8064, 1 + ( i // 672 ) % 12, 1 + ( i // 24 ) % 28, i % 24, i
+			) for i in range( 50000 )
+		) + (
+			"### 2010-05-05 10:00:00.000\r\n"
+			"before last\r\n"
+			"### 2010-05-05 11:00:00.000\r\n"
+			"last"
+		)
+		self_.check_scenario(
+			rapid( "/range 2010 2011<cr><c-d>" ),
+			"<c9>/<rst><ceos><c10><c9>/range <brightmagenta>2010<rst> <brightmagenta>2011<rst><ceos><c25>\r\n"
+			"2010-05-05 10:00:00.000 before last\r\n"
+			"2010-05-05 11:00:00.000 last\r\n"
+			"/range 2010 2011\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1 s60000"
+		)
+		with open( "replxx_history.txt", "r", newline = "" ) as f:
+			lines = f.read().split( "\n" )
+		self_.assertNotIn( "\r", "".join( lines ) )
+		self_.assertEqual( lines[:4], [ "### 2000-01-01 00:00:00.000", "entry 0", "### 2000-01-01 01:00:00.000", "entry 1" ] )
+		self_.assertEqual( lines[50000:50002], [ "### 2003-02-06 16:00:00.000", "entry 25000" ] )
+		self_.assertEqual( lines[100002:100004], [ "### 2010-05-05 11:00:00.000", "last" ] )
+		self_.assertEqual( len( [ l for l in lines if l.startswith( "### " ) ] ), 50003 )
+		self_.check_scenario(
+			rapid( "x<cr><c-d>" ),
+			"<c9>x<rst><ceos><c10><c9>x<rst><ceos><c10>\r\n"
+			"x\r\n",
+			"### 2010-05-05 11:00:00.000\r\n"
+			"last",
+			command = ReplxxTests._cSample_ + " q1 j4"
+		)
+		with open( "replxx_history.txt", "r", newline = "" ) as f:
+			lines = f.read().split( "\n" )
+		self_.assertEqual( lines[:2], [ "### 2010-05-05 11:00:00.000", "last" ] )
+		self_.assertEqual( lines[3:], [ "x", "" ] )
+	def test_history_readd_order( self_ ):
+		self_.check_scenario(
+			"a<cr>b<cr>/range 2999 -<cr><c-d>",
+			"<c9>a<rst><ceos><c10><c9>a<rst><ceos><c10>\r\n"
+			"a\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>b<rst><ceos><c10><c9>b<rst><ceos><c10>\r\n"
+			"b\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>/<rst><ceos><c10><c9>/r<rst><ceos><c11><c9>/ra<rst><ceos><c12><c9>/ran<rst><ceos><c13><c9>/rang<rst><ceos><c14><c9>/range<rst><ceos><c15><c9>/range <rst><ceos><c16><c9>/range <brightmagenta>2<rst><ceos><c17><c9>/range <brightmagenta>29<rst><ceos><c18><c9>/range <brightmagenta>299<rst><ceos><c19><c9>/range <brightmagenta>2999<rst><ceos><c20><c9>/range <brightmagenta>2999<rst> <rst><ceos><c21><c9>/range <brightmagenta>2999<rst> -<rst><ceos><c22><c9>/range <brightmagenta>2999<rst> -<rst><ceos><c22>\r\n"
+			"3000-01-01 00:00:00.000 a\r\n"
+			"3000-01-01 00:00:00.001 b\r\n"
+			"/range 2999 -\r\n",
+			"### 2999-12-31 23:59:59.999\n"
+			"a\n",
+			command = ReplxxTests._cSample_ + " q1"
+		)
+	def test_history_timestamp_rollover( self_ ):
+		typed = (
+			"<c9>a<rst><ceos><c10><c9>a<rst><ceos><c10>\r\n"
+			"a\r\n"
+			"<brightgreen>replxx<rst>> <c9>/<rst><ceos><c10><c9>/range <brightmagenta>2990<rst> -<rst><ceos><c22>\r\n"
+		)
+		for fmt in [ "f0", "f1" ]:
+			for last, stamp in [
+				( "2999-04-30 23:59:59.999", "2999-05-01 00:00:00.000" ),
+				( "2996-02-28 23:59:59.999", "2996-02-29 00:00:00.000" ),
+				( "2999-02-28 23:59:59.999", "2999-03-01 00:00:00.000" ),
+				( "2999-12-31 23:59:59.999", "3000-01-01 00:00:00.000" )
+			]:
+				self_.check_scenario(
+					[ "a<cr>", rapid( "/range 2990 -<cr><c-d>" ) ],
+					typed
+					+ "2990-05-01 00:00:00.000 older\r\n"
+					+ last + " last\r\n"
+					+ stamp + " a\r\n"
+					+ "/range 2990 -\r\n",
+					"### " + last + "\nlast\n"
+					"### 2990-05-01 00:00:00.000\nolder\n",
+					command = ReplxxTests._cSample_ + " q1 " + fmt
+				)
+				if fmt == "f0":
+					with open( "replxx_history.txt", "r" ) as f:
+						stamps = [ l for l in f.read().split( "\n" ) if l.startswith( "### " ) ]
+					self_.assertEqual( stamps[:3], [ "### 2990-05-01 00:00:00.000", "### " + last, "### " + stamp ] )
+	def test_history_batch_equivalence( self_ ):
+		lines = "A B A C D B B E".split()
+		batch = "/batch " + " ".join( lines )
+		history = "### 2000-01-01 00:00:00.000\nC\n### 2000-01-01 00:00:01.000\nF\n"
+		def expected( unique, maxSize, last ):
+			entries = [ "C", "F" ]
+			for line in lines + [ last ]:
+				if unique and line in entries:
+					entries.remove( line )
+				elif entries and entries[-1] == line:
+					entries.pop()
+				entries = entries[-( maxSize - 1 ):] if len( entries ) >= maxSize else entries
+				entries.append( line )
+			return "".join( "{:4d}: {}\r\n".format( i, e ) for i, e in enumerate( entries ) )
+		listing = "<brightgreen>replxx<rst>> <c9>/<rst><ceos><c10><c9>/history<rst><ceos><c17>\r\n"
+		for unique, maxSize in [ ( 1, 4 ), ( 0, 4 ), ( 1, 20 ), ( 0, 20 ) ]:
+			command = ReplxxTests._cSample_ + " q1 u{} s{}".format( unique, maxSize )
+			self_.check_scenario(
+				[ rapid( batch + "<cr>" ), rapid( "/history<cr><c-d>" ) ],
+				"<c9>/<rst><ceos><c10><c9>" + batch + "<rst><ceos><c31>\r\n"
+				+ batch + "\r\n"
+				+ listing
+				+ expected( unique, maxSize, batch )
+				+ "/history\r\n",
+				history,
+				command = command
+			)
+			self_.check_scenario(
+				[ l + "<cr>" for l in lines ] + [ rapid( "/batch <cr>" ), rapid( "/history<cr><c-d>" ) ],
+				"<brightgreen>replxx<rst>> ".join(
+					"<c9>{0}<rst><ceos><c10><c9>{0}<rst><ceos><c10>\r\n{0}\r\n".format( l ) for l in lines
+				)
+				+ "<brightgreen>replxx<rst>> <c9>/<rst><ceos><c10><c9>/batch <rst><ceos><c16>\r\n/batch \r\n"
+				+ listing
+				+ expected( unique, maxSize, "/batch " )
+				+ "/history\r\n",
+				history,
+				command = command
+			)
+	def test_history_async( self_ ):
+		self_.check_scenario(
+			"one<cr>four<cr><c-d>",
+			"<c9>o<rst><ceos><c10><c9>on<rst><ceos><c11><c9>one<rst><ceos><c12><c9>one<rst><ceos><c12>\r\n"
+			"one\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>f<rst><ceos><c10><c9>fo<rst><ceos><c11><c9>fou<rst><ceos><c12><c9>four<rst><ceos><c13><c9>four<rst><ceos><c13>\r\n"
+			"four\r\n",
+			"### 0000-00-00 00:00:00.003\n"
+			"three\n"
+			"### 0000-00-00 00:00:00.001\n"
+			"one\n",
+			command = ReplxxTests._cSample_ + " q1 j4 a1"
+		)
+		with open( "replxx_history.txt", "r" ) as f:
+			data = f.read().split( "\n" )
+			self_.assertSequenceEqual(
+				data[:6],
+				[
+					"### 0000-00-00 00:00:00.003",
+					"three",
+					"### 0000-00-00 00:00:00.001",
+					"one",
+					"#!# 0000-00-00 00:00:00.001",
+					"one"
+				]
+			)
+			self_.assertSequenceEqual( [ data[7], data[9], data[10] ], [ "one", "four", "" ] )
+			self_.assertEqual( len( data ), 11 )
+		os.chmod( "replxx_history.txt", 0o644 )
+		self_.check_scenario(
+			"one<cr><c-d>",
+			"<c9>o<rst><ceos><c10><c9>on<rst><ceos><c11><c9>one<rst><ceos><c12><c9>one<rst><ceos><c12>\r\n"
+			"one\r\n",
+			"### 0000-00-00 00:00:00.001\n"
+			"one\n",
+			command = ReplxxTests._cSample_ + " q1 a1"
+		)
+		self_.assertEqual( os.stat( "replxx_history.txt" ).st_mode & 0o777, 0o600 )
+	def test_history_shared( self_ ):
+		with open( "replxx_history.txt", "w" ) as f:
+			f.write( "### 0000-00-00 00:00:00.001\none\n" )
+		self_._replxx = pexpect.spawn( ReplxxTests._cSample_ + " q1 j4 l1", maxread = 1, encoding = "utf-8", dimensions = ( 25, 80 ) )
+		self_._replxx.expect( ReplxxTests._prompt_ )
+		with open( "replxx_history.txt", "a" ) as f:
+			f.write( "### 0000-00-00 00:00:00.002\nshared\n" )
+		self_.send_str( sym_to_raw( "<up><cr><c-d>" ), 0.002 )
+		self_._replxx.expect( ReplxxTests._prompt_ + ReplxxTests._end_ )
+		self_.assertSequenceEqual(
+			seq_to_sym( self_._replxx.before ),
+			"<c9>shared<rst><ceos><c15><c9>shared<rst><ceos><c15>\r\n"
+			"shared\r\n"
+		)
+	def test_history_binary_format( self_ ):
+		self_.check_scenario(
+			"four<cr><c-d>",
+			"<c9>f<rst><ceos><c10><c9>fo<rst><ceos><c11><c9>fou<rst><ceos><c12><c9>four<rst><ceos><c13><c9>four<rst><ceos><c13>\r\n"
+			"four\r\n",
+			"### 0000-00-00 00:00:00.003\n"
+			"three\n"
+			"### 0000-00-00 00:00:00.001\n"
+			"one\n"
+			"### 0000-00-00 00:00:00.002\n"
+			"two\x17lines\n",
+			command = ReplxxTests._cSample_ + " q1 f1"
+		)
+		with open( "replxx_history.txt", "rb" ) as f:
+			data = f.read()
+			self_.assertSequenceEqual( data[:16], b"RPLXHIST\x01\x00\x00\x00\x00\x00\x00\x00" )
+			self_.assertSequenceEqual( data[-8:], b"RPLXHIST" )
+			count, indexOffset = struct.unpack( "<QQ", data[-24:-8] )
+			self_.assertEqual( count, 4 )
+			records = []
+			for offset in struct.unpack( "<{}Q".format( count ), data[indexOffset:indexOffset + count * 8] ):
+				timestamp, length = struct.unpack( "<qI", data[offset:offset + 12] )
+				records.append( ( timestamp, data[offset + 12:offset + 12 + length].decode( "utf-8" ) ) )
+			self_.assertSequenceEqual( records[:3], [ ( 1, "one" ), ( 2, "two\nlines" ), ( 3, "three" ) ] )
+			self_.assertEqual( records[3][1], "four" )
+	def test_history_metadata( self_ ):
+		history = (
+			"### 0000-00-00 00:00:00.001\n"
+			"\r#@# status=2 duration=5 directory=/tmp/a b\n"
+			"one\n"
+			"### 0000-00-00 00:00:00.002\n"
+			"two\n"
+		)
+		self_.check_scenario(
+			"false three<cr>/failed<cr><c-d>",
+			"<c9>f<rst><ceos><c10><c9>fa<rst><ceos><c11><c9>fal<rst><ceos><c12><c9>fals<rst><ceos><c13><c9>false<rst><ceos><c14><c9>false <rst><ceos><c15><c9>false t<rst><ceos><c16><c9>false th<rst><ceos><c17><c9>false thr<rst><ceos><c18><c9>false thre<rst><ceos><c19><c9>false three<rst><ceos><c20><c9>false three<rst><ceos><c20>\r\n"
+			"false three\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9>/<rst><ceos><c10><c9>/f<rst><ceos><c11><c9>/fa<rst><ceos><c12><c9>/fai<rst><ceos><c13><c9>/fail<rst><ceos><c14><c9>/faile<rst><ceos><c15><c9>/failed<rst><ceos><c16><c9>/failed<rst><ceos><c16>\r\n"
+			"   2: one\r\n"
+			"   1: false three\r\n"
+			"/failed\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1"
+		)
+		with open( "replxx_history.txt", "r", newline = "" ) as f:
+			data = f.read().split( "\n" )
+			self_.assertSequenceEqual( data[:5], history.split( "\n" )[:5] )
+			self_.assertEqual( len( data[5] ), 27 )
+			self_.assertSequenceEqual( data[6:8], [ "\r#@# status=1", "false three" ] )
+			self_.assertEqual( len( data[8] ), 27 )
+			self_.assertEqual( data[9], "/failed" )
+			# readers not aware of metadata records cut lines at carriage return and skip empty lines
+			entries = [ l.split( "\r" )[0] for l in data ]
+			entries = [ l for l in entries if l and not re.match( "^### \\d{4}-\\d{2}-\\d{2} \\d{2}:\\d{2}:\\d{2}\\.\\d{3}$", l ) ]
+			self_.assertSequenceEqual( entries, [ "one", "two", "false three", "/failed" ] )
+		self_.check_scenario(
+			"/failed<cr><c-d>",
+			"<c9>/<rst><ceos><c10><c9>/f<rst><ceos><c11><c9>/fa<rst><ceos><c12><c9>/fai<rst><ceos><c13><c9>/fail<rst><ceos><c14><c9>/faile<rst><ceos><c15><c9>/failed<rst><ceos><c16><c9>/failed<rst><ceos><c16>\r\n"
+			"   2: one\r\n"
+			"/failed\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1 f1"
+		)
+		with open( "replxx_history.txt", "rb" ) as f:
+			data = f.read()
+			self_.assertSequenceEqual( data[:12], b"RPLXHIST\x02\x00\x00\x00" )
+			timestamp, length = struct.unpack( "<qI", data[16:28] )
+			self_.assertEqual( ( timestamp, length ), ( 1, 0x80000003 ) )
+			self_.assertSequenceEqual( data[28:56], b"one\x07\x02\x00\x00\x00\x05\x00\x00\x00\x00\x00\x00\x00\x08\x00\x00\x00/tmp/a b" )
+	def test_history_metadata_stream( self_ ):
+		history = (
+			"### 0000-00-00 00:00:00.001\n"
+			"\r#@# status=2 duration=5 directory=/tmp/a b\n"
+			"one\n"
+			"### 0000-00-00 00:00:00.002\n"
+			"two\n"
+		)
+		self_.check_scenario(
+			rapid( ".history<cr>.save<cr><c-d>" ),
+			"<c9><brightmagenta>.<rst><ceos><c10><c9><brightmagenta>.history<rst><ceos><c17>\r\n"
+			"   0: one\r\n"
+			"   1: two\r\n"
+			"<brightgreen>replxx<rst>> "
+			"<c9><brightmagenta>.<rst>save<rst><ceos><c14>\r\n",
+			history
+		)
+		with open( "replxx_history_alt.txt", "r", newline = "" ) as f:
+			data = f.read().split( "\n" )
+			self_.assertSequenceEqual( data[:5], history.split( "\n" )[:5] )
+			self_.assertEqual( data[6], ".history" )
+	def test_history_scan_view( self_ ):
+		history = (
+			"### 2020-01-01 00:00:00.000\nplain\n"
+			"### 2020-01-01 00:00:01.000\nżółw\n"
+			"### 2020-01-01 00:00:02.000\n😀x\n"
+			"### 2020-01-01 00:00:03.000\na\x17b\n"
+		)
+		self_.check_scenario(
+			rapid( "/lengths<cr><c-d>" ),
+			"<c9>/<rst><ceos><c10><c9>/lengths<rst><ceos><c17>\r\n"
+			"23 5: plain\r\n"
+			"23 7: żółw\r\n"
+			"23 5: 😀x\r\n"
+			"23 3: a\r\n"
+			"b\r\n"
+			"/lengths\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1"
+		)
+		self_.check_scenario(
+			rapid( ".history<cr><c-d>" ),
+			"<c9><brightmagenta>.<rst><ceos><c10><c9><brightmagenta>.history<rst><ceos><c17>\r\n"
+			"   0: plain\r\n"
+			"   1: żółw\r\n"
+			"   2: 😀x\r\n"
+			"   3: a\r\n"
+			"b\r\n",
+			history
+		)
+	def test_history_snapshot_thread( self_ ):
+		self_.check_scenario(
+			[ ".snapshot<cr>", "one<cr>", "two<cr>", "<up><up>x<down>three<cr>", ".snapshot<cr><c-d>" ],
+			"<c9><brightmagenta>.<rst><ceos><c10><c9><brightmagenta>.<rst>s<rst><ceos><c11><c9><brightmagenta>.<rst>sn<rst><ceos><c12><c9><brightmagenta>.<rst>sna<rst><ceos><c13><c9><brightmagenta>.<rst>snap<rst><ceos><c14><c9><brightmagenta>.<rst>snaps<rst><ceos><c15><c9><brightmagenta>.<rst>snapsh<rst><ceos><c16><c9><brightmagenta>.<rst>snapsho<rst><ceos><c17><c9><brightmagenta>.<rst>snapshot<rst><ceos><c18><c9><brightmagenta>.<rst>snapshot<rst><ceos><c18>\r\n"
+			"<brightgreen>replxx<rst>> <c9>o<rst><ceos><c10><c9>on<rst><ceos><c11><c9>one<rst><ceos><c12><c9>one<rst><ceos><c12>\r\n"
+			"one\r\n"
+			"<brightgreen>replxx<rst>> <c9>t<rst><ceos><c10><c9>tw<rst><ceos><c11><c9>two<rst><ceos><c12><c9>two<rst><ceos><c12>\r\n"
+			"two\r\n"
+			"<brightgreen>replxx<rst>> <c9>two<rst><ceos><c12><c9>one<rst><ceos><c12><c9>onex<rst><ceos><c13><c9>two<rst><ceos><c12><c9>twot<rst><ceos><c13><c9>twoth<rst><ceos><c14><c9>twothr<rst><ceos><c15><c9>twothre<rst><ceos><c16><c9>twothree<rst><ceos><c17><c9>twothree<rst><ceos><c17>\r\n"
+			"twothree\r\n"
+			"<brightgreen>replxx<rst>> <c9><brightmagenta>.<rst><ceos><c10><c9><brightmagenta>.<rst>s<rst><ceos><c11><c9><brightmagenta>.<rst>sn<rst><ceos><c12><c9><brightmagenta>.<rst>sna<rst><ceos><c13><c9><brightmagenta>.<rst>snap<rst><ceos><c14><c9><brightmagenta>.<rst>snaps<rst><ceos><c15><c9><brightmagenta>.<rst>snapsh<rst><ceos><c16><c9><brightmagenta>.<rst>snapsho<rst><ceos><c17><c9><brightmagenta>.<rst>snapshot<rst><ceos><c18><c9><brightmagenta>.<rst>snapshot<rst><ceos><c18>\r\n"
+			"snapshots consistent\r\n"
+			"   0: first\r\n"
+			"   1: second\r\n"
+			"   2: .snapshot\r\n"
+			"   3: one\r\n"
+			"   4: two\r\n"
+			"   5: twothree\r\n",
+			"### 2020-01-01 00:00:00.000\nfirst\n### 2020-01-01 00:00:01.000\nsecond\n"
+		)
+	def test_history_range( self_ ):
+		history = (
+			"### 2020-01-01 10:00:00.000\n"
+			"one\n"
+			"### 2020-01-02 10:00:00.000\n"
+			"two\n"
+			"### 2020-01-02 23:59:59.999\n"
+			"three\n"
+			"### 2020-01-03 00:00:00.000\n"
+			"four\n"
+		)
+		self_.check_scenario(
+			"/range 2020-01-02 2020-01-03<cr><c-d>",
+			"<c9>/<rst><ceos><c10><c9>/r<rst><ceos><c11><c9>/ra<rst><ceos><c12><c9>/ran<rst><ceos><c13><c9>/rang<rst><ceos><c14><c9>/range<rst><ceos><c15><c9>/range <rst><ceos><c16><c9>/range <brightmagenta>2<rst><ceos><c17><c9>/range <brightmagenta>20<rst><ceos><c18><c9>/range <brightmagenta>202<rst><ceos><c19><c9>/range <brightmagenta>2020<rst><ceos><c20><c9>/range <brightmagenta>2020<rst>-<rst><ceos><c21><c9>/range <brightmagenta>2020<rst>-<brightmagenta>0<rst><ceos><c22><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst><ceos><c23><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<rst><ceos><c24><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>0<rst><ceos><c25><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst><ceos><c26><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <rst><ceos><c27><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2<rst><ceos><c28><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>20<rst><ceos><c29><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>202<rst><ceos><c30><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst><ceos><c31><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<rst><ceos><c32><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>0<rst><ceos><c33><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>01<rst><ceos><c34><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<rst><ceos><c35><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>0<rst><ceos><c36><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>03<rst><ceos><c37><c9>/range <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>02<rst> <brightmagenta>2020<rst>-<brightmagenta>01<rst>-<brightmagenta>03<rst><ceos><c37>\r\n"
+			"2020-01-02 10:00:00.000 two\r\n"
+			"2020-01-02 23:59:59.999 three\r\n"
+			"/range 2020-01-02 2020-01-03\r\n",
+			history,
+			command = ReplxxTests._cSample_ + " q1"
+		)
+	def test_differential_rendering( self_ ):
+		self_.check_scenario(
+			"abc<left><left>x<backspace><c-e><s-cr>de<c-u><backspace><cr><c-d>",
+			"<c9>a<rst><ceos><c10>b<c11>c<c12><c11><c10>xbc<c11><c10>bc<ceol><c10><c12>\r\n"
+			"<c1>d<gray>b<rst><c2>e<c3>\r<ceol><c1><u1><c12><c12>\r\n"
+			"abc\r\n",
+			command = ReplxxTests._cSample_ + " q1 D1"
+		)
 	def test_bracketed_paste( self_ ):
 		self_.check_scenario(
 			"a0<paste-pfx>b1c2d3e<paste-sfx>4f<cr><c-d>",
@@ -3236,6 +3939,38 @@ class ReplxxTests( unittest.TestCase ):
 			"three\r\n",
 			"one\ntwo\nthree\n"
 		)
+	def test_history_scratch_browse( self_ ):
+		history = "alfa one\nbravo two\ncharlie three\ndelta four\necho five\n"
+		self_.check_scenario(
+			"<up>x<up><up>y<pgup>z<pgdown><up><up><up><up><up><cr><c-d>",
+			"<c9>echo five<rst><ceos><c18><c9>echo fivex<rst><ceos><c19>"
+			"<c9>delta four<rst><ceos><c19><c9>charlie three<rst><ceos><c22><c9>charlie threey<rst><ceos><c23>"
+			"<c9>alfa one<rst><ceos><c17><c9>alfa onez<rst><ceos><c18><c9><rst><ceos><c9>"
+			"<c9>echo fivex<rst><ceos><c19><c9>delta four<rst><ceos><c19><c9>charlie threey<rst><ceos><c23>"
+			"<c9>bravo two<rst><ceos><c18><c9>alfa onez<rst><ceos><c18><c9>alfa onez<rst><ceos><c18>\r\n"
+			"alfa onez\r\n",
+			history
+		)
+		with open( "replxx_history.txt", "r" ) as f:
+			lines = [ l for l in f.read().split( "\n" ) if l and not l.startswith( "### " ) ]
+		self_.assertEqual( lines, [ "alfa one", "bravo two", "charlie three", "delta four", "echo five", "alfa onez" ] )
+		self_.check_scenario(
+			"<up><up><c-e> foo<down><down>d<m-p><m-p><m-p><cr><c-d>",
+			"<c9>echo five<rst><ceos><c18><c9>delta four<rst><ceos><c19>"
+			"<c9>delta four <rst><ceos><c20><c9>delta four f<rst><ceos><c21><c9>delta four fo<rst><ceos><c22><c9>delta four foo<rst><ceos><c23>"
+			"<c9>echo five<rst><ceos><c18><c9><rst><ceos><c9><c9>d<rst><ceos><c10>"
+			"<c9>delta four foo<rst><ceos><c23><c9>delta four foo<rst><ceos><c23>\r\n"
+			"delta four foo\r\n",
+			history
+		)
+		self_.check_scenario(
+			"<up><c-e> foo<down><m-.><m-.><m-.><cr><c-d>",
+			"<c9>echo five<rst><ceos><c18>"
+			"<c9>echo five <rst><ceos><c19><c9>echo five f<rst><ceos><c20><c9>echo five fo<rst><ceos><c21><c9>echo five foo<rst><ceos><c22>"
+			"<c9><rst><ceos><c9><c9>foo<rst><ceos><c12><c9>four<rst><ceos><c13><c9>three<rst><ceos><c14><c9>three<rst><ceos><c14>\r\n"
+			"three\r\n",
+			history
+		)
 	def test_move_up_over_multiline( self_ ):
 		self_.check_scenario(
 			"<m-up><m-up><m-up><cr><c-d>",
@@ -3276,6 +4011,57 @@ class ReplxxTests( unittest.TestCase ):
 			"fortran\r\n",
 			"\n".join( _words_[::-1] ) + "\n"
 		)
+	def test_fuzzy_history_search( self_ ):
+		self_.check_scenario(
+			"<m-s>rcd<up><cr><c-d>",
+			"<c1><ceos><c1><ceos>(fuzzy-search)`': recorded\r\n"
+			"> recorded\r\n"
+			"  repl_charlie delta\r\n"
+			"  repl_alfa bravo<u3><c27><c1><ceos>(fuzzy-search)`r': recorded\r\n"
+			"> <brightmagenta>r<rst>ecorded\r\n"
+			"  <brightmagenta>r<rst>epl_charlie delta\r\n"
+			"  <brightmagenta>r<rst>epl_alfa bravo<u3><c28><c1><ceos>(fuzzy-search)`rc': repl_charlie delta\r\n"
+			"> <brightmagenta>r<rst>epl_<brightmagenta>c<rst>harlie delta\r\n"
+			"  <brightmagenta>r<rst>e<brightmagenta>c<rst>orded<u2><c39><c1><ceos>(fuzzy-search)`rcd': repl_charlie delta\r\n"
+			"> <brightmagenta>r<rst>epl_<brightmagenta>c<rst>harlie <brightmagenta>d<rst>elta\r\n"
+			"  <brightmagenta>r<rst>e<brightmagenta>c<rst>or<brightmagenta>d<rst>ed<u2><c40><c1><ceos>(fuzzy-search)`rcd': recorded\r\n"
+			"  <brightmagenta>r<rst>epl_<brightmagenta>c<rst>harlie <brightmagenta>d<rst>elta\r\n"
+			"> <brightmagenta>r<rst>e<brightmagenta>c<rst>or<brightmagenta>d<rst>ed<u2><c30><c1><ceos><brightgreen>replxx<rst>> "
+			"recorded<c17><c9>recorded<rst><ceos><c17><c9>recorded<rst><ceos><c17>\r\n"
+			"recorded\r\n",
+			"repl_alfa bravo\n"
+			"repl_charlie delta\n"
+			"recorded\n"
+		)
+	def test_regex_history_search( self_ ):
+		self_.check_scenario(
+			"<m-x>d\\w*o$<up><cr><c-d>",
+			"<c1><ceos><c1><ceos>(regex-search)`': redo\r\n"
+			"> redo\r\n"
+			"  recorded\r\n"
+			"  repl_charlie delta\r\n"
+			"  repl_alfa bravo<u4><c23><c1><ceos>(regex-search)`d': redo\r\n"
+			"> re<brightmagenta>d<rst>o\r\n"
+			"  recor<brightmagenta>d<rst>ed\r\n"
+			"  repl_charlie <brightmagenta>d<rst>elta<u3><c24><c1><ceos>(regex-search)`d\\': "
+			"<c21><c1><ceos>(regex-search)`d\\w': redo\r\n"
+			"> re<brightmagenta>d<rst><brightmagenta>o<rst>\r\n"
+			"  recor<brightmagenta>d<rst><brightmagenta>e<rst>d\r\n"
+			"  repl_charlie <brightmagenta>d<rst><brightmagenta>e<rst>lta<u3><c26><c1><ceos>(regex-search)`d\\w*': redo\r\n"
+			"> re<brightmagenta>d<rst><brightmagenta>o<rst>\r\n"
+			"  recor<brightmagenta>d<rst><brightmagenta>e<rst><brightmagenta>d<rst>\r\n"
+			"  repl_charlie <brightmagenta>d<rst><brightmagenta>e<rst><brightmagenta>l<rst><brightmagenta>t<rst><brightmagenta>a<rst>"
+			"<u3><c27><c1><ceos>(regex-search)`d\\w*o': redo\r\n"
+			"> re<brightmagenta>d<rst><brightmagenta>o<rst><u1><c28><c1><ceos>(regex-search)`d\\w*o$': redo\r\n"
+			"> re<brightmagenta>d<rst><brightmagenta>o<rst><u1><c29><bell><c1><ceos>(regex-search)`d\\w*o$': redo\r\n"
+			"> re<brightmagenta>d<rst><brightmagenta>o<rst><u1><c29><c1><ceos><brightgreen>replxx<rst>> "
+			"redo<c13><c9>redo<rst><ceos><c13><c9>redo<rst><ceos><c13>\r\n"
+			"redo\r\n",
+			"repl_alfa bravo\n"
+			"repl_charlie delta\n"
+			"recorded\n"
+			"redo\n"
+		)
 
 def parseArgs( self, func, argv ):
 	global verbosity